@@ -0,0 +1,304 @@
+#include <cstring>
+#include <fstream>
+#include <boost/bind/bind.hpp>
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+#define STREAM_MAGIC 0x31464342		/* "BCF1" */
+
+struct StreamHeader {
+	boost::uint32_t magic;
+	boost::uint32_t blockElements;
+	boost::uint64_t elementCount;
+	boost::uint64_t blockCount;
+};
+
+static void encodeBlockRange(const float* data, size_t count, std::vector<CLHelper::BlockWords>* blocks, size_t firstBlock, size_t lastBlock);
+static void decodeBlockRange(const CLHelper::CompressedStream* stream, size_t outputBlock, float* output, size_t firstBlock, size_t lastBlock);
+
+static boost::uint32_t floatBits(float value)
+{
+	boost::uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+void CLHelper::encodeBlock(const float* data, size_t count, BlockWords* words)
+{
+	words->clear();
+	if(count == 0)
+		return;
+
+	std::vector<boost::uint32_t> zigzag(count - 1);
+	boost::uint32_t previous = floatBits(data[0]);
+	boost::uint32_t combined = 0;
+	for(size_t i = 1; i < count; i++)
+	{
+		boost::uint32_t bits = floatBits(data[i]);
+		boost::int32_t delta = (boost::int32_t) (bits - previous);
+		zigzag[i - 1] = ((boost::uint32_t) delta << 1) ^ (boost::uint32_t) (delta >> 31);
+		combined |= zigzag[i - 1];
+		previous = bits;
+	}
+
+	boost::uint32_t width = 0;
+	while(width < 32 && (combined >> width) != 0)
+		width++;
+
+	words->push_back(floatBits(data[0]));
+	words->push_back(width);
+
+	size_t packedWords = ((count - 1) * width + 31) / 32;
+	size_t firstPacked = words->size();
+	words->resize(firstPacked + packedWords, 0);
+
+	boost::uint64_t bitPosition = 0;
+	for(size_t i = 0; i < zigzag.size() && width > 0; i++)
+	{
+		size_t word = firstPacked + (size_t) (bitPosition >> 5);
+		boost::uint32_t shift = (boost::uint32_t) (bitPosition & 31);
+		(*words)[word] |= zigzag[i] << shift;
+		if(shift + width > 32)
+			(*words)[word + 1] |= zigzag[i] >> (32 - shift);
+		bitPosition += width;
+	}
+}
+
+void CLHelper::decodeBlock(const boost::uint32_t* words, size_t count, float* output)
+{
+	if(count == 0)
+		return;
+
+	boost::uint32_t value = words[0];
+	boost::uint32_t width = words[1];
+	const boost::uint32_t* packed = words + 2;
+	boost::uint32_t mask = (width == 32) ? 0xFFFFFFFF : ((1u << width) - 1);
+
+	memcpy(&output[0], &value, sizeof(value));
+
+	boost::uint64_t bitPosition = 0;
+	for(size_t i = 1; i < count; i++)
+	{
+		boost::uint32_t zigzag = 0;
+		if(width > 0) {
+			size_t word = (size_t) (bitPosition >> 5);
+			boost::uint32_t shift = (boost::uint32_t) (bitPosition & 31);
+			zigzag = packed[word] >> shift;
+			if(shift + width > 32)
+				zigzag |= packed[word + 1] << (32 - shift);
+			zigzag &= mask;
+			bitPosition += width;
+		}
+
+		value += (zigzag >> 1) ^ (0u - (zigzag & 1));
+		memcpy(&output[i], &value, sizeof(value));
+	}
+}
+
+void CLHelper::assembleStream(const std::vector<BlockWords>& blocks, boost::uint64_t elementCount, std::vector<char>* stream)
+{
+	StreamHeader header;
+	header.magic = STREAM_MAGIC;
+	header.blockElements = COMPRESSION_BLOCK_ELEMENTS;
+	header.elementCount = elementCount;
+	header.blockCount = blocks.size();
+
+	std::vector<boost::uint64_t> offsets(blocks.size() + 1, 0);
+	for(size_t block = 0; block < blocks.size(); block++)
+		offsets[block + 1] = offsets[block] + blocks[block].size();
+
+	size_t offsetBytes = offsets.size() * sizeof(boost::uint64_t);
+	stream->resize(sizeof(header) + offsetBytes + offsets.back() * sizeof(boost::uint32_t));
+
+	char* position = &(*stream)[0];
+	memcpy(position, &header, sizeof(header));
+	position += sizeof(header);
+	memcpy(position, &offsets[0], offsetBytes);
+	position += offsetBytes;
+	for(size_t block = 0; block < blocks.size(); block++)
+	{
+		if(blocks[block].empty())
+			continue;
+		memcpy(position, &blocks[block][0], blocks[block].size() * sizeof(boost::uint32_t));
+		position += blocks[block].size() * sizeof(boost::uint32_t);
+	}
+}
+
+void CLHelper::encodeBlocks(const float* data, size_t count, size_t firstBlock, size_t blockCount, std::vector<BlockWords>* blocks)
+{
+	ThreadPool::shared().parallelFor(firstBlock, firstBlock + blockCount, boost::bind(&encodeBlockRange, data, count, blocks, boost::placeholders::_1, boost::placeholders::_2));
+}
+
+void CLHelper::compressStream(const float* data, size_t count, std::vector<char>* stream)
+{
+	size_t blockCount = (count + COMPRESSION_BLOCK_ELEMENTS - 1) / COMPRESSION_BLOCK_ELEMENTS;
+	std::vector<BlockWords> blocks(blockCount);
+
+	encodeBlocks(data, count, 0, blockCount, &blocks);
+	assembleStream(blocks, count, stream);
+}
+
+CLHelper::CompressedStream::CompressedStream()
+	: stream(NULL), streamBytes(0), elementCount(0), blockCount(0), blockElements(0), offsets(NULL), data(NULL)
+{
+}
+
+// Checks everything the decoders rely on, so a malformed file is rejected here
+// instead of making them read or write out of bounds
+bool CLHelper::CompressedStream::open(const std::vector<char>& streamData)
+{
+	if(streamData.size() < sizeof(StreamHeader))
+		return false;
+
+	StreamHeader header;
+	memcpy(&header, &streamData[0], sizeof(header));
+	if(header.magic != STREAM_MAGIC || header.blockElements == 0)
+		return false;
+
+	// Every block holds at least one element and only the last one may be partial
+	boost::uint64_t expectedBlocks = header.elementCount / header.blockElements + (header.elementCount % header.blockElements != 0 ? 1 : 0);
+	if(header.blockCount != expectedBlocks)
+		return false;
+
+	size_t bytesLeft = streamData.size() - sizeof(header);
+	if(header.blockCount >= bytesLeft / sizeof(boost::uint64_t))
+		return false;
+
+	size_t offsetBytes = (size_t) (header.blockCount + 1) * sizeof(boost::uint64_t);
+	bytesLeft -= offsetBytes;
+
+	stream = &streamData[0];
+	streamBytes = streamData.size();
+	elementCount = header.elementCount;
+	blockCount = (size_t) header.blockCount;
+	blockElements = header.blockElements;
+	offsets = (const boost::uint64_t*) (stream + sizeof(header));
+	data = (const boost::uint32_t*) (stream + sizeof(header) + offsetBytes);
+
+	if(offsets[0] != 0 || offsets[blockCount] > bytesLeft / sizeof(boost::uint32_t))
+		return false;
+
+	for(size_t block = 0; block < blockCount; block++)
+	{
+		if(offsets[block + 1] < offsets[block])
+			return false;
+
+		// First value and bit width, then the packed differences of the rest
+		boost::uint64_t words = offsets[block + 1] - offsets[block];
+		if(words < 2)
+			return false;
+
+		boost::uint32_t width = data[offsets[block] + 1];
+		if(width > 32 || words < 2 + ((boost::uint64_t) (blockSize(block) - 1) * width + 31) / 32)
+			return false;
+	}
+
+	return true;
+}
+
+bool CLHelper::CompressedStream::load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	file.seekg(0, std::ios::end);
+	loaded.resize((size_t) file.tellg());
+	file.seekg(0, std::ios::beg);
+	if(!loaded.empty())
+		file.read(&loaded[0], loaded.size());
+
+	return file.good() && open(loaded);
+}
+
+boost::uint64_t CLHelper::CompressedStream::getElementCount() const
+{
+	return elementCount;
+}
+
+size_t CLHelper::CompressedStream::getBlockCount() const
+{
+	return blockCount;
+}
+
+size_t CLHelper::CompressedStream::getBlockElements() const
+{
+	return blockElements;
+}
+
+size_t CLHelper::CompressedStream::blockSize(size_t block) const
+{
+	boost::uint64_t first = (boost::uint64_t) block * blockElements;
+	return (size_t) std::min((boost::uint64_t) blockElements, elementCount - first);
+}
+
+const boost::uint32_t* CLHelper::CompressedStream::blockWords(size_t block) const
+{
+	return data + offsets[block];
+}
+
+size_t CLHelper::CompressedStream::blockWordOffset(size_t block) const
+{
+	return (size_t) offsets[block];
+}
+
+const boost::uint32_t* CLHelper::CompressedStream::getData() const
+{
+	return data;
+}
+
+size_t CLHelper::CompressedStream::getCompressedBytes() const
+{
+	return streamBytes;
+}
+
+// Decodes blocks [firstBlock, firstBlock + count) to output, which receives the
+// first block's first element at index 0
+void CLHelper::CompressedStream::decode(size_t firstBlock, size_t count, float* output) const
+{
+	ThreadPool::shared().parallelFor(firstBlock, firstBlock + count, boost::bind(&decodeBlockRange, this, firstBlock, output, boost::placeholders::_1, boost::placeholders::_2));
+}
+
+bool CLHelper::saveStream(const std::string& path, const std::vector<char>& stream)
+{
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+		return false;
+
+	file.write(&stream[0], stream.size());
+	return file.good();
+}
+
+bool CLHelper::compressFloatFile(const std::string& rawPath, const std::string& streamPath)
+{
+	std::ifstream file(rawPath.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	file.seekg(0, std::ios::end);
+	std::vector<float> data((size_t) file.tellg() / sizeof(float));
+	file.seekg(0, std::ios::beg);
+	if(!data.empty())
+		file.read((char*) &data[0], data.size() * sizeof(float));
+	if(!file.good())
+		return false;
+
+	std::vector<char> stream;
+	compressStream(data.empty() ? NULL : &data[0], data.size(), &stream);
+	return saveStream(streamPath, stream);
+}
+
+static void encodeBlockRange(const float* data, size_t count, std::vector<CLHelper::BlockWords>* blocks, size_t firstBlock, size_t lastBlock)
+{
+	for(size_t block = firstBlock; block < lastBlock; block++)
+	{
+		size_t first = block * COMPRESSION_BLOCK_ELEMENTS;
+		CLHelper::encodeBlock(data + first, std::min((size_t) COMPRESSION_BLOCK_ELEMENTS, count - first), &(*blocks)[block]);
+	}
+}
+
+static void decodeBlockRange(const CLHelper::CompressedStream* stream, size_t outputBlock, float* output, size_t firstBlock, size_t lastBlock)
+{
+	for(size_t block = firstBlock; block < lastBlock; block++)
+		CLHelper::decodeBlock(stream->blockWords(block), stream->blockSize(block), output + (block - outputBlock) * stream->getBlockElements());
+}
@@ -0,0 +1,77 @@
+#ifndef _BLOCKCOMPRESSION_H
+#define _BLOCKCOMPRESSION_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#define COMPRESSION_BLOCK_ELEMENTS 4096
+
+namespace CLHelper
+{
+	/*
+	 * Lightweight block compression for float arrays. Every block of up to
+	 * COMPRESSION_BLOCK_ELEMENTS values stores its first value's bits followed by
+	 * the zigzag encoded differences of consecutive bit patterns, packed at the
+	 * smallest width that holds them all. Smooth data packs tightly, noise costs
+	 * at most one extra word per block. Blocks decode independently, so a stream
+	 * can be decoded by several threads or by one work-item per block.
+	 *
+	 * Stream layout, all fields native endian:
+	 *   header     magic, blockElements, elementCount (64 bit), blockCount (64 bit)
+	 *   offsets    blockCount + 1 word offsets (64 bit) of the blocks into the data
+	 *   data       per block: first value, bit width, packed differences (32-bit words)
+	 */
+	typedef std::vector<boost::uint32_t> BlockWords;
+
+	void encodeBlock(const float* data, size_t count, BlockWords* words);
+	void decodeBlock(const boost::uint32_t* words, size_t count, float* output);
+
+	/* Assembles encoded blocks into a stream */
+	void assembleStream(const std::vector<BlockWords>& blocks, boost::uint64_t elementCount, std::vector<char>* stream);
+
+	/* Encodes blocks [firstBlock, firstBlock + blockCount) of an array of count elements into blocks, on the shared thread pool */
+	void encodeBlocks(const float* data, size_t count, size_t firstBlock, size_t blockCount, std::vector<BlockWords>* blocks);
+
+	/* Encodes a whole array */
+	void compressStream(const float* data, size_t count, std::vector<char>* stream);
+
+	class CompressedStream {
+
+	public:
+		CompressedStream();
+
+		bool open(const std::vector<char>& stream);		/* the stream must outlive this object */
+		bool load(const std::string& path);				/* reads a stream file into memory */
+
+		boost::uint64_t getElementCount() const;
+		size_t getBlockCount() const;
+		size_t getBlockElements() const;
+		size_t blockSize(size_t block) const;			/* elements in the block */
+
+		const boost::uint32_t* blockWords(size_t block) const;
+		size_t blockWordOffset(size_t block) const;		/* offset into getData(), block == getBlockCount() gives the end */
+		const boost::uint32_t* getData() const;
+		size_t getCompressedBytes() const;
+
+		void decode(size_t firstBlock, size_t blockCount, float* output) const;
+
+	private:
+		std::vector<char> loaded;
+		const char* stream;
+		size_t streamBytes;
+
+		boost::uint64_t elementCount;
+		size_t blockCount;
+		size_t blockElements;
+		const boost::uint64_t* offsets;
+		const boost::uint32_t* data;
+	};
+
+	bool saveStream(const std::string& path, const std::vector<char>& stream);
+
+	/* Compresses a file of raw native endian floats into a stream file */
+	bool compressFloatFile(const std::string& rawPath, const std::string& streamPath);
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "BufferPool.h"
+
+#define MIN_SIZE_CLASS 4096
+
+CLHelper::BufferPool::BufferPool(cl::Context& context, cl_ulong maxPooledBytes)
+	: context(context), maxPooledBytes(maxPooledBytes), pooledBytes(0)
+{
+}
+
+cl::Buffer CLHelper::BufferPool::acquire(size_t size, cl_mem_flags flags, size_t* capacity)
+{
+	size_t bufferSize = sizeClass(size);
+	if(capacity != NULL)
+		*capacity = bufferSize;
+
+	{
+		boost::mutex::scoped_lock lock(poolMutex);
+
+		std::multimap<BufferKey, cl::Buffer>::iterator buffer = freeBuffers.find(BufferKey(flags, bufferSize));
+		if(buffer != freeBuffers.end()) {
+			cl::Buffer pooledBuffer = buffer->second;
+			freeBuffers.erase(buffer);
+			pooledBytes -= bufferSize;
+			return pooledBuffer;
+		}
+	}
+
+	cl_int err;
+	cl::Buffer newBuffer(context, flags, bufferSize, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	return newBuffer;
+}
+
+void CLHelper::BufferPool::release(const cl::Buffer& buffer, size_t capacity, cl_mem_flags flags)
+{
+	boost::mutex::scoped_lock lock(poolMutex);
+
+	// Let the buffer go if keeping it would exceed the budget
+	if(pooledBytes + capacity > maxPooledBytes)
+		return;
+
+	freeBuffers.insert(std::make_pair(BufferKey(flags, capacity), buffer));
+	pooledBytes += capacity;
+}
+
+cl_ulong CLHelper::BufferPool::getPooledBytes()
+{
+	boost::mutex::scoped_lock lock(poolMutex);
+	return pooledBytes;
+}
+
+size_t CLHelper::BufferPool::sizeClass(size_t size)
+{
+	// Powers of two, so that jobs of similar sizes share buffers
+	size_t bufferSize = MIN_SIZE_CLASS;
+	while(bufferSize < size)
+		bufferSize *= 2;
+
+	return bufferSize;
+}
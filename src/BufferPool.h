@@ -0,0 +1,33 @@
+#ifndef _BUFFERPOOL_H
+#define _BUFFERPOOL_H
+
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	/* Reuses cl::Buffer objects of the same flags and size class across jobs */
+	class BufferPool {
+
+	public:
+		BufferPool(cl::Context& context, cl_ulong maxPooledBytes);
+
+		cl::Buffer acquire(size_t size, cl_mem_flags flags, size_t* capacity = NULL);
+		void release(const cl::Buffer& buffer, size_t capacity, cl_mem_flags flags);
+
+		cl_ulong getPooledBytes();
+		static size_t sizeClass(size_t size);
+
+	private:
+		typedef std::pair<cl_mem_flags, size_t> BufferKey;
+
+		cl::Context context;
+		cl_ulong maxPooledBytes;				/* buffers released beyond this are freed instead */
+		cl_ulong pooledBytes;
+		std::multimap<BufferKey, cl::Buffer> freeBuffers;
+		boost::mutex poolMutex;
+	};
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <sstream>
+#include <boost/bind/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "BuildService.h"
+#include "KernelPreprocessor.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+/* Most programs built at the same time; drivers compile on the calling thread */
+#define BUILD_THREADS 4
+
+/* Finished builds kept for formatLogs() */
+#define BUILD_HISTORY 64
+
+namespace pt = boost::posix_time;
+
+CLHelper::ProgramBuild::ProgramBuild(const std::string& relativeFilePath, const std::string& options)
+	: relativeFilePath(relativeFilePath),
+	  options(options),
+	  done(false),
+	  status(CL_SUCCESS),
+	  seconds(0.0)
+{
+}
+
+bool CLHelper::ProgramBuild::isDone() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return done;
+}
+
+cl::Program& CLHelper::ProgramBuild::wait()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	while(!done)
+		finished.wait(lock);
+
+	if(status != CL_SUCCESS) {
+		std::cerr << "Build error in \"" << relativeFilePath << "\"! Showing build log:" << std::endl << std::endl << log << std::endl;
+		CHECK_OPENCL_ERROR(status, "cl::Program::build() failed.");
+	}
+	return program;
+}
+
+const std::string& CLHelper::ProgramBuild::getRelativeFilePath() const
+{
+	return relativeFilePath;
+}
+
+const std::string& CLHelper::ProgramBuild::getOptions() const
+{
+	return options;
+}
+
+std::string CLHelper::ProgramBuild::getLog() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return log;
+}
+
+double CLHelper::ProgramBuild::getSeconds() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return seconds;
+}
+
+void CLHelper::ProgramBuild::finish(cl_int status, const std::string& log, double seconds)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	this->status = status;
+	this->log = log;
+	this->seconds = seconds;
+	done = true;
+	finished.notify_all();
+}
+
+CLHelper::BuildService& CLHelper::BuildService::shared()
+{
+	// Never destroyed, like the shared thread pool
+	static BuildService* service = new BuildService();
+	return *service;
+}
+
+CLHelper::BuildService::BuildService()
+	: workers(std::min(std::max(boost::thread::hardware_concurrency(), 1u), (unsigned int) BUILD_THREADS), false),
+	  pending(0)
+{
+}
+
+boost::shared_ptr<CLHelper::ProgramBuild> CLHelper::BuildService::submit(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	const std::string& options)
+{
+	// The same source and options for the same devices is the same program, whichever cache asks
+	std::ostringstream key;
+	key << context();
+	for(size_t i = 0; i < devices.size(); i++)
+		key << " " << devices[i]();
+	key << " " << KernelLibrary::shared().hash(relativeFilePath, options);
+
+	boost::shared_ptr<ProgramBuild> programBuild;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		std::map<std::string, boost::weak_ptr<ProgramBuild> >::iterator live = liveBuilds.find(key.str());
+		if(live != liveBuilds.end() && (programBuild = live->second.lock())) {
+			Metrics::shared().add("build_reused", 1);
+			return programBuild;
+		}
+
+		// Forget the programs nobody holds anymore
+		for(live = liveBuilds.begin(); live != liveBuilds.end(); )
+		{
+			if(live->second.expired())
+				liveBuilds.erase(live++);
+			else
+				live++;
+		}
+
+		programBuild.reset(new ProgramBuild(relativeFilePath, options));
+		liveBuilds[key.str()] = programBuild;
+
+		pending++;
+		Metrics::shared().set("build_pending", (double) pending);
+	}
+	workers.submit(boost::bind(&BuildService::build, this, programBuild, context, devices));
+
+	return programBuild;
+}
+
+void CLHelper::BuildService::waitAll()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	while(pending > 0)
+		idle.wait(lock);
+}
+
+std::string CLHelper::BuildService::formatLogs() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::ostringstream logs;
+	for(size_t i = 0; i < builds.size(); i++)
+	{
+		std::string log = builds[i]->getLog();
+		if(log.empty())
+			continue;
+
+		logs << builds[i]->getRelativeFilePath() << " " << builds[i]->getOptions() << std::endl << log;
+	}
+	return logs.str();
+}
+
+void CLHelper::BuildService::build(boost::shared_ptr<ProgramBuild> programBuild, cl::Context context, std::vector<cl::Device> devices)
+{
+	pt::ptime start = pt::microsec_clock::universal_time();
+
+	createProgram(context, devices, programBuild->relativeFilePath, programBuild->options.c_str(), &programBuild->program);
+
+	std::string log;
+	cl_int err = buildProgram(programBuild->program, devices, programBuild->options.c_str(), &log);
+
+	double seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+	programBuild->finish(err, log, seconds);
+
+	boost::mutex::scoped_lock lock(mutex);
+	builds.push_back(programBuild);
+	if(builds.size() > BUILD_HISTORY)
+		builds.erase(builds.begin());
+
+	pending--;
+	Metrics::shared().set("build_pending", (double) pending);
+	idle.notify_all();
+}
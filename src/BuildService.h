@@ -0,0 +1,96 @@
+#ifndef _BUILDSERVICE_H
+#define _BUILDSERVICE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "CLHelper.h"
+#include "ThreadPool.h"
+
+namespace CLHelper
+{
+	/* One program being built in the background, shared by everyone who needs it */
+	class ProgramBuild {
+
+	public:
+		ProgramBuild(const std::string& relativeFilePath, const std::string& options);
+
+		bool isDone() const;
+
+		/* Blocks until the program is built; a failed build prints its log and exits */
+		cl::Program& wait();
+
+		const std::string& getRelativeFilePath() const;
+		const std::string& getOptions() const;
+		std::string getLog() const;			/* every device's build log, empty while building */
+		double getSeconds() const;			/* load and build time */
+
+	private:
+		friend class BuildService;
+
+		ProgramBuild(const ProgramBuild&);
+		ProgramBuild& operator=(const ProgramBuild&);
+
+		void finish(cl_int status, const std::string& log, double seconds);
+
+		std::string relativeFilePath;
+		std::string options;
+		cl::Program program;
+
+		mutable boost::mutex mutex;
+		boost::condition_variable finished;
+		bool done;
+		cl_int status;
+		std::string log;
+		double seconds;
+	};
+
+	/*
+	 * Compiles programs on its own worker threads, so several programs, or the
+	 * variants of one program for several devices, build at the same time and
+	 * off the threads that prepare the inputs. Submitting returns at once;
+	 * only the launches that need a program wait for it. Programs are keyed
+	 * by their devices and the hash of their expanded source and options, so
+	 * caches asking for the same program while it is alive share one build.
+	 * Build logs are kept with the builds instead of being printed, and build
+	 * times go to the build_* metrics.
+	 */
+	class BuildService {
+
+	public:
+		static BuildService& shared();
+
+		boost::shared_ptr<ProgramBuild> submit(
+			cl::Context& context,
+			std::vector<cl::Device>& devices,
+			const std::string& relativeFilePath,
+			const std::string& options = "");
+
+		/* Waits for everything submitted so far */
+		void waitAll();
+
+		/* "<file> <options>" and the log of every finished build that logged something */
+		std::string formatLogs() const;
+
+	private:
+		BuildService();
+		BuildService(const BuildService&);
+		BuildService& operator=(const BuildService&);
+
+		void build(boost::shared_ptr<ProgramBuild> programBuild, cl::Context context, std::vector<cl::Device> devices);
+
+		ThreadPool workers;
+
+		mutable boost::mutex mutex;
+		std::map<std::string, boost::weak_ptr<ProgramBuild> > liveBuilds;		/* by context, devices and source hash */
+		std::vector<boost::shared_ptr<ProgramBuild> > builds;		/* the last finished ones, oldest first */
+		size_t pending;
+		boost::condition_variable idle;
+	};
+};
+
+#endif
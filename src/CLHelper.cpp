@@ -1,10 +1,49 @@
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <boost/bind/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include "CLHelper.h"
+#include "KernelPreprocessor.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#define PREBUILT_DIRECTORY "prebuilt"
 
 namespace fs = boost::filesystem;
 
+/* One program of precompileKernels(), built on the thread pool */
+struct PrecompiledProgram {
+	std::vector<cl::Device> devices;
+	std::string relativeFilePath;
+	std::string source;
+	cl::Program program;
+};
+
+static fs::path prebuiltPath(const std::string& relativeFilePath, const std::string& suffix);
+static bool readBinaryFile(const fs::path& path, std::string* contents);
+static void createProgramFromSource(cl::Context& context, const std::string& source, cl::Program* program);
+static void buildPrecompiledProgram(PrecompiledProgram* precompiled, const char* options);
+static bool createProgramFromBinaries(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	const std::string& source,
+	const char* options,
+	cl::Program* program);
+#ifdef CL_VERSION_2_1
+static bool createProgramFromIL(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	const char* options,
+	cl::Program* program);
+#endif
+
 void CLHelper::findSpecifiedDevices(
 	const std::string& defaultVendor,
 	const cl_device_type defaultDeviceType,
@@ -68,46 +107,423 @@ void CLHelper::findSpecifiedDevices(
 	}
 }
 
+void CLHelper::partitionDevices(
+	const std::string& partitionScheme,
+	std::vector<cl::Device>* deviceList,
+	std::vector<CLHelper::DeviceInfo>* deviceInfoList)
+{
+#ifdef CL_VERSION_1_2
+	cl_int err;
+
+	// Build the partition property list from the scheme:
+	// 'NUMA', 'L4', 'L3', 'L2', 'L1' partition by affinity domain,
+	// 'EQUALLY:<n>' into sub-devices of n compute units, and '<n>,<m>,...' by counts
+	std::vector<cl_device_partition_property> properties;
+	if(partitionScheme == "NUMA" || partitionScheme == "L4" || partitionScheme == "L3" || partitionScheme == "L2" || partitionScheme == "L1") {
+		cl_device_affinity_domain domain = CL_DEVICE_AFFINITY_DOMAIN_NUMA;
+		if(partitionScheme == "L4") domain = CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE;
+		else if(partitionScheme == "L3") domain = CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE;
+		else if(partitionScheme == "L2") domain = CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE;
+		else if(partitionScheme == "L1") domain = CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE;
+
+		properties.push_back(CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN);
+		properties.push_back((cl_device_partition_property) domain);
+	}
+	else if(partitionScheme.find("EQUALLY:") == 0) {
+		if(atoi(partitionScheme.c_str() + 8) <= 0) {
+			std::cerr << "Invalid partition scheme provided: " << partitionScheme << std::endl;
+			exit(1);
+		}
+
+		properties.push_back(CL_DEVICE_PARTITION_EQUALLY);
+		properties.push_back((cl_device_partition_property) atoi(partitionScheme.c_str() + 8));
+	}
+	else {
+		std::vector<std::string> counts;
+		boost::algorithm::split(counts, partitionScheme, boost::algorithm::is_any_of(","));
+
+		properties.push_back(CL_DEVICE_PARTITION_BY_COUNTS);
+		std::vector<std::string>::iterator count;
+		for(count = counts.begin(); count != counts.end(); count++) {
+			if(atoi(count->c_str()) <= 0) {
+				std::cerr << "Invalid partition scheme provided: " << partitionScheme << std::endl;
+				exit(1);
+			}
+			properties.push_back((cl_device_partition_property) atoi(count->c_str()));
+		}
+		properties.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+	}
+	properties.push_back(0);
+
+	std::vector<cl::Device> subDeviceList;
+	std::vector<CLHelper::DeviceInfo> subDeviceInfoList;
+
+	std::vector<cl::Device>::iterator device;
+	for(device = deviceList->begin(); device != deviceList->end(); device++)
+	{
+		std::vector<cl::Device> subDevices;
+		err = device->createSubDevices(&properties[0], &subDevices);
+		CHECK_OPENCL_ERROR(err, "cl::Device::createSubDevices() failed.");
+
+		std::vector<cl::Device>::iterator subDevice;
+		for(subDevice = subDevices.begin(); subDevice != subDevices.end(); subDevice++)
+		{
+			CLHelper::DeviceInfo deviceInfo;
+			deviceInfo.setDeviceInfo(*subDevice);
+
+			subDeviceList.push_back(*subDevice);
+			subDeviceInfoList.push_back(deviceInfo);
+		}
+	}
+
+	*deviceList = subDeviceList;
+	*deviceInfoList = subDeviceInfoList;
+#else
+	std::cerr << "Device partitioning requires OpenCL 1.2. Exiting..." << std::endl;
+	exit(1);
+#endif
+}
+
 void CLHelper::loadKernelFileToString(std::string relativeFilePath, std::string* source)
 {
-	std::string filePathString = (fs::current_path() / relativeFilePath).string();
-	boost::algorithm::replace_all(filePathString, "\"", "");
+	// With its #includes inlined, read from disk only the first time
+	*source = KernelLibrary::shared().expand(relativeFilePath).source;
+}
 
-	std::ifstream sourceFile(filePathString.c_str(), std::ifstream::in);
-	if(!sourceFile.good()) {
-		std::cerr << std::endl;
-		std::cerr << "Unable to open file \"" << filePathString << "\"." << std::endl;
-		exit(1);
+void CLHelper::createProgram(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	std::string relativeFilePath,
+	const char* options,
+	cl::Program* program)
+{
+	TRACE_SCOPE("createProgram");
+
+	std::string source;
+	loadKernelFileToString(relativeFilePath, &source);
+
+	// Prefer native binaries built for exactly these devices and drivers, then
+	// portable SPIR-V, and only compile the source when neither is available.
+	// The program still has to be passed to compileProgram() afterwards.
+	if(createProgramFromBinaries(context, devices, relativeFilePath, source, options, program)) {
+		std::cout << "Using prebuilt binaries for \"" << relativeFilePath << "\"." << std::endl;
+		return;
 	}
+#ifdef CL_VERSION_2_1
+	if(createProgramFromIL(context, devices, relativeFilePath, options, program)) {
+		std::cout << "Using prebuilt SPIR-V for \"" << relativeFilePath << "\"." << std::endl;
+		return;
+	}
+#endif
 
-	*source = std::string((std::istreambuf_iterator<char>(sourceFile)),
-	                       std::istreambuf_iterator<char>());
+	createProgramFromSource(context, source, program);
 }
 
-void CLHelper::compileProgram(
+void CLHelper::savePrebuiltProgram(
+	cl::Program& program,
+	std::string relativeFilePath,
+	const std::string& source,
+	const char* options)
+{
+	cl_int err;
+
+	// Binaries are returned in the order of CL_PROGRAM_DEVICES, which need not
+	// match the order of the device list the program was built for
+	std::vector<cl::Device> devices;
+	err = program.getInfo(CL_PROGRAM_DEVICES, &devices);
+	CHECK_OPENCL_ERROR(err, "cl::Program::getInfo(CL_PROGRAM_DEVICES) failed.");
+
+	std::vector<size_t> binarySizes;
+	err = program.getInfo(CL_PROGRAM_BINARY_SIZES, &binarySizes);
+	CHECK_OPENCL_ERROR(err, "cl::Program::getInfo(CL_PROGRAM_BINARY_SIZES) failed.");
+
+	std::vector<std::string> binaries(devices.size());
+	std::vector<unsigned char*> binaryPointers(devices.size(), (unsigned char*) NULL);
+	for(size_t i = 0; i < devices.size(); i++)
+	{
+		binaries[i].resize(binarySizes[i]);
+		if(binarySizes[i] > 0)
+			binaryPointers[i] = (unsigned char*) &binaries[i][0];
+	}
+
+	err = clGetProgramInfo(program(), CL_PROGRAM_BINARIES,
+			sizeof(unsigned char*) * binaryPointers.size(), &binaryPointers[0], NULL);
+	CHECK_OPENCL_ERROR(err, "clGetProgramInfo(CL_PROGRAM_BINARIES) failed.");
+
+	fs::create_directories(fs::current_path() / PREBUILT_DIRECTORY);
+
+	for(size_t i = 0; i < devices.size(); i++)
+	{
+		if(binaries[i].empty())
+			continue;
+
+		std::string deviceName;
+		devices[i].getInfo(CL_DEVICE_NAME, &deviceName);
+
+		fs::path binaryPath = prebuiltPath(relativeFilePath, "." + deviceFingerprint(devices[i], source, options) + ".bin");
+		std::ofstream binaryFile(binaryPath.string().c_str(), std::ofstream::out | std::ofstream::binary);
+		if(!binaryFile.good()) {
+			std::cerr << "Unable to write file \"" << binaryPath.string() << "\"." << std::endl;
+			exit(1);
+		}
+		binaryFile.write(binaries[i].data(), binaries[i].length());
+
+		std::cout << "Wrote " << binaryPath.filename().string() << " (" << deviceName << ", "
+		          << binaries[i].length() << " bytes)" << std::endl;
+	}
+}
+
+void CLHelper::precompileKernels(
+	const std::string& defaultVendor,
+	const cl_device_type defaultDeviceType,
+	std::vector<std::string>& relativeFilePaths,
+	const char* options)
+{
+	cl_int err;
+
+	std::vector<cl::Platform> platforms;
+	err = cl::Platform::get(&platforms);
+	CHECK_OPENCL_ERROR(err, "cl::Platform::get() failed.");
+
+	std::vector<cl::Platform>::iterator platform;
+	for(platform = platforms.begin(); platform != platforms.end(); platform++)
+	{
+		std::string platformVendorString;
+		platform->getInfo(CL_PLATFORM_VENDOR, &platformVendorString);
+
+		if(defaultVendor.length() > 0 && platformVendorString.find(defaultVendor) == std::string::npos) {
+			continue;
+		}
+
+		std::vector<cl::Device> devices;
+		if(platform->getDevices(defaultDeviceType, &devices) != CL_SUCCESS) continue;
+
+		// Build every device separately, since each one gets its own binary anyway,
+		// and all of the programs at the same time
+		std::vector<PrecompiledProgram> programs;
+		std::vector<cl::Device>::iterator device;
+		for(device = devices.begin(); device != devices.end(); device++)
+		{
+			std::vector<cl::Device> singleDevice(1, *device);
+
+			cl::Context context(singleDevice, NULL, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+
+			std::vector<std::string>::iterator filePath;
+			for(filePath = relativeFilePaths.begin(); filePath != relativeFilePaths.end(); filePath++)
+			{
+				PrecompiledProgram precompiled;
+				precompiled.devices = singleDevice;
+				precompiled.relativeFilePath = *filePath;
+				loadKernelFileToString(*filePath, &precompiled.source);
+				createProgramFromSource(context, precompiled.source, &precompiled.program);
+				programs.push_back(precompiled);
+			}
+		}
+
+		TaskGroup builds;
+		for(size_t i = 0; i < programs.size(); i++)
+			builds.run(boost::bind(&buildPrecompiledProgram, &programs[i], options));
+		builds.wait();
+
+		for(size_t i = 0; i < programs.size(); i++)
+			savePrebuiltProgram(programs[i].program, programs[i].relativeFilePath, programs[i].source, options);
+	}
+}
+
+std::string CLHelper::hashString(const std::string& data)
+{
+	// 64-bit FNV-1a, which is stable across runs, compilers and platforms
+	cl_ulong hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < data.length(); i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	std::ostringstream hashStream;
+	hashStream << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return hashStream.str();
+}
+
+std::string CLHelper::deviceFingerprint(const cl::Device& device, const std::string& source, const char* options)
+{
+	std::string deviceName, deviceVendor, driverVersion, deviceVersion;
+	device.getInfo(CL_DEVICE_NAME, &deviceName);
+	device.getInfo(CL_DEVICE_VENDOR, &deviceVendor);
+	device.getInfo(CL_DRIVER_VERSION, &driverVersion);
+	device.getInfo(CL_DEVICE_VERSION, &deviceVersion);
+
+	// Any change to the device, the driver, the build options or the source gives a new fingerprint
+	std::string key = deviceName + "\n" + deviceVendor + "\n" + driverVersion + "\n" + deviceVersion + "\n"
+	                + (options != NULL ? options : "") + "\n" + source;
+	return hashString(key);
+}
+
+cl_int CLHelper::buildProgram(
 	cl::Program& program,
 	std::vector<cl::Device>& devices,
 	const char* options,
+	std::string* log,
 	void (CL_CALLBACK * notifyFptr)(cl_program, void *),
 	void* data)
 {
-	cl_int err;
+	TRACE_SCOPE("buildProgram");
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
 
-	err = program.build(devices, options, NULL, NULL);
-	if(err != CL_SUCCESS) {
-		std::cout << "Build error! Showing build log:" << std::endl << std::endl;
+	cl_int err = program.build(devices, options, notifyFptr, data);
 
-		std::string errorLog;
+	// With a callback the build may still be running, and its log is not complete yet
+	log->clear();
+	if(notifyFptr == NULL || err != CL_SUCCESS) {
 		std::vector<cl::Device>::iterator device;
 		for(device = devices.begin(); device != devices.end(); device++)
 		{
-			errorLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device);
-			std::cout << errorLog << std::endl;
+			std::string deviceLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device);
+			if(deviceLog.find_first_not_of(" \t\r\n") == std::string::npos)
+				continue;
+			*log += "[" + device->getInfo<CL_DEVICE_NAME>() + "]\n" + deviceLog;
+			if(deviceLog[deviceLog.length() - 1] != '\n')
+				*log += "\n";
 		}
+	}
+
+	double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+	Metrics& metrics = Metrics::shared();
+	metrics.add("build_programs", 1);
+	metrics.add("build_seconds", seconds);
+	metrics.add("build_log_bytes", (double) log->length());
+	if(err != CL_SUCCESS)
+		metrics.add("build_failures", 1);
+	else if(!log->empty())
+		metrics.add("build_warnings", 1);
+
+	return err;
+}
+
+void CLHelper::compileProgram(
+	cl::Program& program,
+	std::vector<cl::Device>& devices,
+	const char* options,
+	void (CL_CALLBACK * notifyFptr)(cl_program, void *),
+	void* data)
+{
+	std::string log;
+	cl_int err = buildProgram(program, devices, options, &log, notifyFptr, data);
+	if(err != CL_SUCCESS) {
+		std::cerr << "Build error! Showing build log:" << std::endl << std::endl << log << std::endl;
 		CHECK_OPENCL_ERROR(err, "cl::Program::build() failed.");
 	}
 }
 
+static fs::path prebuiltPath(const std::string& relativeFilePath, const std::string& suffix)
+{
+	std::string stem = fs::path(relativeFilePath).stem().string();
+	return fs::current_path() / PREBUILT_DIRECTORY / (stem + suffix);
+}
+
+static bool readBinaryFile(const fs::path& path, std::string* contents)
+{
+	std::ifstream file(path.string().c_str(), std::ifstream::in | std::ifstream::binary);
+	if(!file.good())
+		return false;
+
+	*contents = std::string((std::istreambuf_iterator<char>(file)),
+	                         std::istreambuf_iterator<char>());
+	return !contents->empty();
+}
+
+static void createProgramFromSource(cl::Context& context, const std::string& source, cl::Program* program)
+{
+	cl_int err;
+
+	cl::Program::Sources sources;
+	sources.push_back(std::make_pair(source.c_str(), source.length()));
+
+	*program = cl::Program(context, sources, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Program::Program() failed.");
+}
+
+static void buildPrecompiledProgram(PrecompiledProgram* precompiled, const char* options)
+{
+	CLHelper::compileProgram(precompiled->program, precompiled->devices, options);
+}
+
+static bool createProgramFromBinaries(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	const std::string& source,
+	const char* options,
+	cl::Program* program)
+{
+	std::vector<std::string> blobs(devices.size());
+	cl::Program::Binaries binaries;
+	for(size_t i = 0; i < devices.size(); i++)
+	{
+		fs::path binaryPath = prebuiltPath(relativeFilePath, "." + CLHelper::deviceFingerprint(devices[i], source, options) + ".bin");
+		if(!readBinaryFile(binaryPath, &blobs[i]))
+			return false;
+
+		binaries.push_back(std::make_pair((const void*) blobs[i].data(), blobs[i].length()));
+	}
+
+	cl_int err;
+	std::vector<cl_int> binaryStatus;
+	*program = cl::Program(context, devices, binaries, &binaryStatus, &err);
+	if(err != CL_SUCCESS) {
+		std::cerr << "Ignoring prebuilt binaries for \"" << relativeFilePath << "\": "
+		          << CLHelper::openCLErrorCodeToString(err) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+#ifdef CL_VERSION_2_1
+static bool createProgramFromIL(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	const char* options,
+	cl::Program* program)
+{
+	// SPIR-V is generated offline without any -D definitions, so it cannot serve specialized builds
+	if(options != NULL && std::string(options).find("-D") != std::string::npos)
+		return false;
+
+	// Ignore SPIR-V that is older than the kernel source it was generated from
+	boost::system::error_code ec;
+	fs::path ilPath = prebuiltPath(relativeFilePath, ".spv");
+	fs::path sourcePath = fs::current_path() / relativeFilePath;
+	if(!fs::exists(ilPath, ec) || fs::last_write_time(ilPath, ec) < fs::last_write_time(sourcePath, ec))
+		return false;
+
+	std::vector<cl::Device>::iterator device;
+	for(device = devices.begin(); device != devices.end(); device++)
+	{
+		std::string ilVersion;
+		if(device->getInfo(CL_DEVICE_IL_VERSION, &ilVersion) != CL_SUCCESS || ilVersion.find("SPIR-V") == std::string::npos)
+			return false;
+	}
+
+	std::string il;
+	if(!readBinaryFile(ilPath, &il))
+		return false;
+
+	cl_int err;
+	cl_program ilProgram = clCreateProgramWithIL(context(), il.data(), il.length(), &err);
+	if(err != CL_SUCCESS) {
+		std::cerr << "Ignoring prebuilt SPIR-V for \"" << relativeFilePath << "\": "
+		          << CLHelper::openCLErrorCodeToString(err) << std::endl;
+		return false;
+	}
+
+	*program = cl::Program(ilProgram);
+	return true;
+}
+#endif
+
 void CLHelper::printAllPlatformsAndDevices()
 {
 	cl_int err;
@@ -169,6 +585,23 @@ void CLHelper::printDeviceInfoList(std::vector<CLHelper::DeviceInfo>& deviceInfo
 	}
 }
 
+// Turns "OpenCL 1.2 <vendor specific>" (or "OpenCL C 1.2 ...") into 120, and anything unparsable into 0
+int CLHelper::parseOpenCLVersion(const std::string& versionString)
+{
+	size_t position = versionString.find_first_of("0123456789");
+	if(position == std::string::npos)
+		return 0;
+
+	int major = 0, minor = 0;
+	char separator = 0;
+	std::istringstream versionStream(versionString.substr(position));
+	versionStream >> major >> separator >> minor;
+	if(separator != '.')
+		return 0;
+
+	return major * 100 + minor * 10;
+}
+
 std::string CLHelper::deviceTypeToString(cl_device_type type) {
 	switch(type) {
 	case CL_DEVICE_TYPE_DEFAULT:
@@ -188,21 +621,32 @@ std::string CLHelper::deviceTypeToString(cl_device_type type) {
 	}
 }
 
+// Accepts one type or several separated by commas, such as "GPU,ACCELERATOR"
 cl_device_type CLHelper::deviceStringToType(std::string deviceString) {
-	if(deviceString.find("DEFAULT") != std::string::npos)
-		return CL_DEVICE_TYPE_DEFAULT;
-	else if(deviceString.find("GPU") != std::string::npos)
-		return CL_DEVICE_TYPE_GPU;
-	else if(deviceString.find("CPU") != std::string::npos)
-		return CL_DEVICE_TYPE_CPU;
-	else if(deviceString.find("ACCELERATOR") != std::string::npos)
-		return CL_DEVICE_TYPE_ACCELERATOR;
-	else if(deviceString.find("ALL") != std::string::npos)
-		return CL_DEVICE_TYPE_ALL;
-	else {
-		std::cerr << "Invalid device string provided: " << deviceString;
-		exit(1);
+	std::vector<std::string> typeStrings;
+	boost::algorithm::split(typeStrings, deviceString, boost::algorithm::is_any_of(","));
+
+	cl_device_type type = 0;
+	std::vector<std::string>::iterator typeString;
+	for(typeString = typeStrings.begin(); typeString != typeStrings.end(); typeString++) {
+		std::string name = boost::algorithm::to_upper_copy(boost::algorithm::trim_copy(*typeString));
+		if(name == "DEFAULT")
+			type |= CL_DEVICE_TYPE_DEFAULT;
+		else if(name == "GPU")
+			type |= CL_DEVICE_TYPE_GPU;
+		else if(name == "CPU")
+			type |= CL_DEVICE_TYPE_CPU;
+		else if(name == "ACCELERATOR")
+			type |= CL_DEVICE_TYPE_ACCELERATOR;
+		else if(name == "ALL")
+			type |= CL_DEVICE_TYPE_ALL;
+		else {
+			std::cerr << "Invalid device string provided: " << deviceString;
+			exit(1);
+		}
 	}
+
+	return type;
 }
 
 // Constructor
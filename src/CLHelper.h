@@ -101,8 +101,44 @@ namespace CLHelper
 		std::vector<cl::Device>* deviceList,
 		std::vector<DeviceInfo>* deviceInfoList);
 
+	void partitionDevices(
+		const std::string& partitionScheme,
+		std::vector<cl::Device>* deviceList,
+		std::vector<DeviceInfo>* deviceInfoList);
+
 	void loadKernelFileToString(std::string relativeFilePath, std::string* source);
 
+	void createProgram(
+		cl::Context& context,
+		std::vector<cl::Device>& devices,
+		std::string relativeFilePath,
+		const char* options,
+		cl::Program* program);
+
+	void savePrebuiltProgram(
+		cl::Program& program,
+		std::string relativeFilePath,
+		const std::string& source,
+		const char* options);
+
+	void precompileKernels(
+		const std::string& defaultVendor,
+		const cl_device_type defaultDeviceType,
+		std::vector<std::string>& relativeFilePaths,
+		const char* options = "");
+
+	std::string hashString(const std::string& data);
+	std::string deviceFingerprint(const cl::Device& device, const std::string& source, const char* options);
+
+	/* Builds without exiting on failure, the devices' build logs go to log and the time to the build_* metrics */
+	cl_int buildProgram(
+		cl::Program& program,
+		std::vector<cl::Device>& devices,
+		const char* options,
+		std::string* log,
+		void (CL_CALLBACK * notifyFptr)(cl_program, void *) = NULL,
+		void* data = NULL);
+
 	void compileProgram(
 		cl::Program& program,
 		std::vector<cl::Device>& devices,
@@ -116,6 +152,8 @@ namespace CLHelper
 
 	void printDeviceInfoList(std::vector<DeviceInfo>& deviceInfoList);
 
+	int parseOpenCLVersion(const std::string& versionString);
+
 	std::string deviceTypeToString(cl_device_type type);
 	cl_device_type deviceStringToType(std::string deviceString);
 
@@ -0,0 +1,408 @@
+#include <cstring>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "CompressedStreaming.h"
+#include "KernelBinder.h"
+#include "KernelSpecializer.h"
+#include "ThreadPool.h"
+
+namespace pt = boost::posix_time;
+
+/* Buffers for one chunk in flight */
+struct StreamSlot {
+	cl::Buffer pinnedA, pinnedB;		/* host decode: staging memory the driver can transfer from directly */
+	float* stagingA;
+	float* stagingB;
+	cl::Buffer d_wordsA, d_wordsB;		/* device decode: compressed blocks and their offsets */
+	cl::Buffer d_offsetsA, d_offsetsB;
+	std::vector<cl_uint> offsetsA, offsetsB;
+	cl::Buffer d_dataA, d_dataB, d_dataC;
+
+	boost::shared_ptr<CLHelper::KernelBinder> decodeKernelA, decodeKernelB, addKernel;
+	cl::Event done;
+	boost::shared_ptr<CLHelper::TaskGroup> completion;	/* output compression, started when done completes */
+	bool busy;
+
+	size_t firstBlock, blockCount, firstElement, elementCount;
+
+	StreamSlot() : stagingA(NULL), stagingB(NULL), busy(false), firstBlock(0), blockCount(0), firstElement(0), elementCount(0) {}
+};
+
+static void uploadBlocks(
+	cl::CommandQueue& commQueue,
+	const CLHelper::CompressedStream& stream,
+	size_t firstBlock,
+	size_t blockCount,
+	cl::Buffer& d_words,
+	cl::Buffer& d_offsets,
+	std::vector<cl_uint>& offsets,
+	double* uploadedBytes);
+static void finishSlot(StreamSlot& slot);
+static void generateNoisyRamp(std::vector<float>* data, int noiseBits, boost::uint32_t seed);
+
+void CLHelper::streamAdd(
+	cl::Context& context,
+	cl::CommandQueue& commQueue,
+	std::vector<cl::Device>& devices,
+	StreamDecode decode,
+	const float* rawA,
+	const float* rawB,
+	const CompressedStream* compressedA,
+	const CompressedStream* compressedB,
+	size_t elementCount,
+	const StreamingOptions& options,
+	std::vector<float>* result,
+	std::vector<char>* compressedResult,
+	StreamingReport* report)
+{
+	cl_int err;
+
+	size_t blockElements = COMPRESSION_BLOCK_ELEMENTS;
+	if(decode != STREAM_RAW) {
+		if(compressedA == NULL || compressedB == NULL
+				|| compressedA->getElementCount() != elementCount || compressedB->getElementCount() != elementCount
+				|| compressedA->getBlockElements() != compressedB->getBlockElements()) {
+			std::cerr << "streamAdd(): the compressed inputs differ in size or layout." << std::endl;
+			exit(1);
+		}
+		blockElements = compressedA->getBlockElements();
+	}
+
+	size_t chunkBlocks = std::max(options.chunkBlocks, (size_t) 1);
+	size_t chunkElements = chunkBlocks * blockElements;
+	size_t blockCount = (elementCount + blockElements - 1) / blockElements;
+	size_t chunkCount = (blockCount + chunkBlocks - 1) / chunkBlocks;
+
+	result->resize(elementCount);
+	*report = StreamingReport();
+
+	SpecializationCache addPrograms(context, devices, "SimpleAddKernel.cl");
+	SpecializationCache decodePrograms(context, devices, "CompressionKernels.cl");
+
+// Start both builds at once, the buffers below are created while they compile
+	addPrograms.prepareGeneric();
+	if(decode == STREAM_DEVICE_DECODE)
+		decodePrograms.prepareGeneric();
+
+// Two slots, so the host prepares one chunk while the device works on the other
+	std::vector<StreamSlot> slots(2);
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		StreamSlot& slot = slots[i];
+		size_t chunkBytes = chunkElements * sizeof(cl_float);
+
+		slot.d_dataA = cl::Buffer(context, CL_MEM_READ_WRITE, chunkBytes, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		slot.d_dataB = cl::Buffer(context, CL_MEM_READ_WRITE, chunkBytes, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		slot.d_dataC = cl::Buffer(context, CL_MEM_WRITE_ONLY, chunkBytes, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		slot.addKernel.reset(new KernelBinder(addPrograms.getGeneric(), "simpleAddKernel"));
+		slot.completion.reset(new TaskGroup());
+
+		if(decode == STREAM_HOST_DECODE) {
+			slot.pinnedA = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, chunkBytes, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+			slot.pinnedB = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, chunkBytes, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+			slot.stagingA = (float*) commQueue.enqueueMapBuffer(slot.pinnedA, CL_TRUE, CL_MAP_WRITE, 0, chunkBytes, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+			slot.stagingB = (float*) commQueue.enqueueMapBuffer(slot.pinnedB, CL_TRUE, CL_MAP_WRITE, 0, chunkBytes, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		}
+		else if(decode == STREAM_DEVICE_DECODE) {
+			// Worst case per block: first value, width and one full word per difference
+			size_t maxWordBytes = chunkBlocks * (blockElements + 2) * sizeof(cl_uint);
+
+			slot.d_wordsA = cl::Buffer(context, CL_MEM_READ_ONLY, maxWordBytes, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+			slot.d_wordsB = cl::Buffer(context, CL_MEM_READ_ONLY, maxWordBytes, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+			slot.d_offsetsA = cl::Buffer(context, CL_MEM_READ_ONLY, chunkBlocks * sizeof(cl_uint), NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+			slot.d_offsetsB = cl::Buffer(context, CL_MEM_READ_ONLY, chunkBlocks * sizeof(cl_uint), NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+			slot.offsetsA.resize(chunkBlocks);
+			slot.offsetsB.resize(chunkBlocks);
+
+			slot.decodeKernelA.reset(new KernelBinder(decodePrograms.getGeneric(), "decodeBlocksKernel"));
+			slot.decodeKernelB.reset(new KernelBinder(decodePrograms.getGeneric(), "decodeBlocksKernel"));
+		}
+	}
+
+	std::vector<BlockWords> outputBlocks(options.compressOutput ? blockCount : 0);
+	std::vector<BlockWords>* outputBlocksPointer = options.compressOutput ? &outputBlocks : NULL;
+
+	pt::ptime start = pt::microsec_clock::universal_time();
+
+	for(size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		StreamSlot& slot = slots[chunk % slots.size()];
+		if(slot.busy)
+			finishSlot(slot);
+
+		slot.firstBlock = chunk * chunkBlocks;
+		slot.blockCount = std::min(chunkBlocks, blockCount - slot.firstBlock);
+		slot.firstElement = slot.firstBlock * blockElements;
+		slot.elementCount = std::min(chunkElements, elementCount - slot.firstElement);
+		size_t chunkBytes = slot.elementCount * sizeof(cl_float);
+
+		switch(decode) {
+		case STREAM_RAW:
+			err  = commQueue.enqueueWriteBuffer(slot.d_dataA, CL_FALSE, 0, chunkBytes, rawA + slot.firstElement);
+			err |= commQueue.enqueueWriteBuffer(slot.d_dataB, CL_FALSE, 0, chunkBytes, rawB + slot.firstElement);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+			report->uploadedBytes += 2.0 * chunkBytes;
+			break;
+
+		case STREAM_HOST_DECODE:
+			compressedA->decode(slot.firstBlock, slot.blockCount, slot.stagingA);
+			compressedB->decode(slot.firstBlock, slot.blockCount, slot.stagingB);
+
+			err  = commQueue.enqueueWriteBuffer(slot.d_dataA, CL_FALSE, 0, chunkBytes, slot.stagingA);
+			err |= commQueue.enqueueWriteBuffer(slot.d_dataB, CL_FALSE, 0, chunkBytes, slot.stagingB);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+			report->uploadedBytes += 2.0 * chunkBytes;
+			break;
+
+		case STREAM_DEVICE_DECODE:
+		{
+			uploadBlocks(commQueue, *compressedA, slot.firstBlock, slot.blockCount, slot.d_wordsA, slot.d_offsetsA, slot.offsetsA, &report->uploadedBytes);
+			uploadBlocks(commQueue, *compressedB, slot.firstBlock, slot.blockCount, slot.d_wordsB, slot.d_offsetsB, slot.offsetsB, &report->uploadedBytes);
+
+			KernelBinder* decodeKernels[2] = { slot.decodeKernelA.get(), slot.decodeKernelB.get() };
+			cl::Buffer* words[2] = { &slot.d_wordsA, &slot.d_wordsB };
+			cl::Buffer* offsets[2] = { &slot.d_offsetsA, &slot.d_offsetsB };
+			cl::Buffer* outputs[2] = { &slot.d_dataA, &slot.d_dataB };
+			for(int input = 0; input < 2; input++)
+			{
+				KernelBinder& decodeKernel = *decodeKernels[input];
+				err  = decodeKernel.set(0, *words[input]);
+				err |= decodeKernel.set(1, *offsets[input]);
+				err |= decodeKernel.set(2, (cl_uint) slot.blockCount);
+				err |= decodeKernel.set(3, (cl_uint) blockElements);
+				err |= decodeKernel.set(4, (cl_uint) slot.elementCount);
+				err |= decodeKernel.set(5, *outputs[input]);
+				CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+				err = commQueue.enqueueNDRangeKernel(decodeKernel.getKernel(), cl::NullRange, cl::NDRange(slot.blockCount), cl::NullRange);
+				CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+			}
+			break;
+		}
+		}
+
+		KernelBinder& addKernel = *slot.addKernel;
+		err  = addKernel.set(0, slot.d_dataA);
+		err |= addKernel.set(1, slot.d_dataB);
+		err |= addKernel.set(2, slot.d_dataC);
+		err |= addKernel.set(3, (cl_uint) slot.elementCount);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		err = commQueue.enqueueNDRangeKernel(addKernel.getKernel(), cl::NullRange, cl::NDRange(slot.elementCount), cl::NullRange);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+		err = commQueue.enqueueReadBuffer(slot.d_dataC, CL_FALSE, 0, chunkBytes, &(*result)[slot.firstElement], NULL, &slot.done);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+		// The pool compresses the chunk as soon as it arrives, not when the slot is reused
+		if(outputBlocksPointer != NULL)
+			slot.completion->runOnCompletion(slot.done, boost::bind(&encodeBlocks, &(*result)[0], elementCount, slot.firstBlock, slot.blockCount, outputBlocksPointer));
+
+		err = commQueue.flush();
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::flush() failed.");
+		slot.busy = true;
+	}
+
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		if(slots[i].busy)
+			finishSlot(slots[i]);
+	}
+
+	if(options.compressOutput && compressedResult != NULL) {
+		assembleStream(outputBlocks, elementCount, compressedResult);
+		report->compressedOutputBytes = compressedResult->size();
+	}
+
+	report->seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		if(slots[i].stagingA != NULL) {
+			commQueue.enqueueUnmapMemObject(slots[i].pinnedA, slots[i].stagingA);
+			commQueue.enqueueUnmapMemObject(slots[i].pinnedB, slots[i].stagingB);
+		}
+	}
+	commQueue.finish();
+}
+
+void CLHelper::runCompressionBenchmark(std::vector<cl::Device>& deviceList, size_t elementCount)
+{
+	cl_int err;
+
+	std::vector<cl::Device> devices(1, deviceList.front());
+	cl::Context context(devices, NULL, NULL, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+	cl::CommandQueue commQueue(context, devices.front(), 0, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	// Ramps with increasingly many random low bits, from perfectly smooth to nearly incompressible
+	const int noiseBits[] = { 0, 8, 12, 16, 20, 24, 31 };
+	const char* pathNames[] = { "raw", "host decode", "device decode" };
+
+	std::vector<float> dataA(elementCount), dataB(elementCount);
+	std::vector<float> rawResult, result;
+	StreamingOptions options;
+
+	std::cout << "Compressed streaming benchmark, " << elementCount << " elements per input, GB/s of uncompressed data:" << std::endl;
+	std::cout << "  noise bits, compression ratio, raw, host decode, device decode" << std::endl;
+
+	int lastWinningNoise[3] = { -1, -1, -1 };
+	for(size_t level = 0; level < sizeof(noiseBits) / sizeof(noiseBits[0]); level++)
+	{
+		generateNoisyRamp(&dataA, noiseBits[level], 1);
+		generateNoisyRamp(&dataB, noiseBits[level], 2);
+
+		std::vector<char> streamA, streamB;
+		compressStream(&dataA[0], elementCount, &streamA);
+		compressStream(&dataB[0], elementCount, &streamB);
+		CompressedStream compressedA, compressedB;
+		compressedA.open(streamA);
+		compressedB.open(streamB);
+
+		double ratio = 2.0 * elementCount * sizeof(cl_float) / (streamA.size() + streamB.size());
+		std::cout << "  " << noiseBits[level] << ", " << ratio;
+
+		double rawSeconds = 0;
+		for(int path = STREAM_RAW; path <= STREAM_DEVICE_DECODE; path++)
+		{
+			StreamingReport report;
+			streamAdd(context, commQueue, devices, (StreamDecode) path, &dataA[0], &dataB[0], &compressedA, &compressedB,
+					  elementCount, options, path == STREAM_RAW ? &rawResult : &result, NULL, &report);
+
+			// Decoding is lossless, so every path has to produce the raw path's result exactly
+			if(path != STREAM_RAW && memcmp(&result[0], &rawResult[0], elementCount * sizeof(cl_float)) != 0) {
+				std::cerr << std::endl << "The " << pathNames[path] << " result differs from the raw result." << std::endl;
+				exit(1);
+			}
+
+			if(path == STREAM_RAW)
+				rawSeconds = report.seconds;
+			else if(report.seconds < rawSeconds)
+				lastWinningNoise[path] = noiseBits[level];
+
+			std::cout << ", " << 3.0 * elementCount * sizeof(cl_float) / report.seconds / 1e9;
+		}
+		std::cout << std::endl;
+	}
+
+	for(int path = STREAM_HOST_DECODE; path <= STREAM_DEVICE_DECODE; path++)
+	{
+		if(lastWinningNoise[path] < 0)
+			std::cout << "With " << pathNames[path] << ", compression never beats the raw path on this device." << std::endl;
+		else
+			std::cout << "With " << pathNames[path] << ", compression beats the raw path up to " << lastWinningNoise[path] << " bits of noise." << std::endl;
+	}
+}
+
+void CLHelper::runCompressedFileAdd(
+	std::vector<cl::Device>& deviceList,
+	const std::string& pathA,
+	const std::string& pathB,
+	const std::string& outputPath,
+	bool deviceDecode)
+{
+	cl_int err;
+
+	CompressedStream compressedA, compressedB;
+	if(!compressedA.load(pathA) || !compressedB.load(pathB)) {
+		std::cerr << "Unable to read compressed inputs \"" << pathA << "\" and \"" << pathB << "\"." << std::endl;
+		exit(1);
+	}
+
+	std::vector<cl::Device> devices(1, deviceList.front());
+	cl::Context context(devices, NULL, NULL, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+	cl::CommandQueue commQueue(context, devices.front(), 0, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	StreamingOptions options;
+	options.compressOutput = !outputPath.empty();
+
+	size_t elementCount = (size_t) compressedA.getElementCount();
+	std::vector<float> result;
+	std::vector<char> compressedResult;
+	StreamingReport report;
+	streamAdd(context, commQueue, devices, deviceDecode ? STREAM_DEVICE_DECODE : STREAM_HOST_DECODE, NULL, NULL,
+			  &compressedA, &compressedB, elementCount, options, &result, &compressedResult, &report);
+
+	std::cout << "Streamed " << elementCount << " elements in " << report.seconds << " s, "
+			  << 3.0 * elementCount * sizeof(cl_float) / report.seconds / 1e9 << " GB/s of uncompressed data, "
+			  << report.uploadedBytes / 1e6 << " MB uploaded" << std::endl;
+	if(elementCount > 0)
+		std::cout << "Result: " << result[elementCount - 1] << std::endl;
+
+	if(options.compressOutput) {
+		if(!saveStream(outputPath, compressedResult)) {
+			std::cerr << "Unable to write \"" << outputPath << "\"." << std::endl;
+			exit(1);
+		}
+		std::cout << "Compressed result: " << report.compressedOutputBytes << " bytes, ratio "
+				  << (double) elementCount * sizeof(cl_float) / report.compressedOutputBytes << std::endl;
+	}
+}
+
+static void uploadBlocks(
+	cl::CommandQueue& commQueue,
+	const CLHelper::CompressedStream& stream,
+	size_t firstBlock,
+	size_t blockCount,
+	cl::Buffer& d_words,
+	cl::Buffer& d_offsets,
+	std::vector<cl_uint>& offsets,
+	double* uploadedBytes)
+{
+	cl_int err;
+
+	size_t firstWord = stream.blockWordOffset(firstBlock);
+	size_t wordCount = stream.blockWordOffset(firstBlock + blockCount) - firstWord;
+	for(size_t block = 0; block < blockCount; block++)
+		offsets[block] = (cl_uint) (stream.blockWordOffset(firstBlock + block) - firstWord);
+
+	err  = commQueue.enqueueWriteBuffer(d_words, CL_FALSE, 0, wordCount * sizeof(cl_uint), stream.getData() + firstWord);
+	err |= commQueue.enqueueWriteBuffer(d_offsets, CL_FALSE, 0, blockCount * sizeof(cl_uint), &offsets[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+
+	*uploadedBytes += (double) (wordCount + blockCount) * sizeof(cl_uint);
+}
+
+// Waits for the slot's chunk and for the compression of its result
+static void finishSlot(StreamSlot& slot)
+{
+	cl_int err = slot.done.wait();
+	CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+
+	slot.completion->wait();
+
+	slot.busy = false;
+}
+
+static void generateNoisyRamp(std::vector<float>* data, int noiseBits, boost::uint32_t seed)
+{
+	boost::uint32_t noiseMask = (noiseBits >= 32) ? 0xFFFFFFFF : ((1u << noiseBits) - 1);
+	boost::uint32_t state = seed;
+
+	for(size_t i = 0; i < data->size(); i++)
+	{
+		state = state * 1664525u + 1013904223u;
+
+		float value = (float) i;
+		boost::uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		bits ^= state & noiseMask;
+		memcpy(&(*data)[i], &bits, sizeof(bits));
+	}
+}
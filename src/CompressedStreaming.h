@@ -0,0 +1,62 @@
+#ifndef _COMPRESSEDSTREAMING_H
+#define _COMPRESSEDSTREAMING_H
+
+#include "CLHelper.h"
+#include "BlockCompression.h"
+
+namespace CLHelper
+{
+	enum StreamDecode {
+		STREAM_RAW,				/* inputs are plain floats, no decoding */
+		STREAM_HOST_DECODE,		/* blocks decoded on the host thread pool into pinned staging memory */
+		STREAM_DEVICE_DECODE	/* compressed blocks uploaded and decoded by decodeBlocksKernel */
+	};
+
+	struct StreamingOptions {
+		size_t chunkBlocks;		/* blocks per chunk, two chunks are in flight */
+		bool compressOutput;
+
+		StreamingOptions() : chunkBlocks(256), compressOutput(false) {}
+	};
+
+	struct StreamingReport {
+		double seconds;
+		double uploadedBytes;	/* bytes written to the device */
+		size_t compressedOutputBytes;
+
+		StreamingReport() : seconds(0), uploadedBytes(0), compressedOutputBytes(0) {}
+	};
+
+	/*
+	 * Adds two arrays chunk by chunk: while the device adds chunk k the host
+	 * prepares chunk k+1. With STREAM_RAW the inputs are read from rawA/rawB,
+	 * otherwise from the compressed streams, which must have the same layout.
+	 */
+	void streamAdd(
+		cl::Context& context,
+		cl::CommandQueue& commQueue,
+		std::vector<cl::Device>& devices,
+		StreamDecode decode,
+		const float* rawA,
+		const float* rawB,
+		const CompressedStream* compressedA,
+		const CompressedStream* compressedB,
+		size_t elementCount,
+		const StreamingOptions& options,
+		std::vector<float>* result,
+		std::vector<char>* compressedResult,
+		StreamingReport* report);
+
+	/* Compares the three paths over inputs of increasing entropy to find where compression stops paying off */
+	void runCompressionBenchmark(std::vector<cl::Device>& deviceList, size_t elementCount);
+
+	/* Adds two stream files, optionally writing the result as a stream file */
+	void runCompressedFileAdd(
+		std::vector<cl::Device>& deviceList,
+		const std::string& pathA,
+		const std::string& pathB,
+		const std::string& outputPath,
+		bool deviceDecode);
+};
+
+#endif
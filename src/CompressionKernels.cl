@@ -0,0 +1,45 @@
+// Decodes the block compressed format described in BlockCompression.h, one
+// work-item per block. 'words' holds the data of blockCount consecutive blocks,
+// 'blockOffsets' their word offsets into it, and block 0 decodes to output[0].
+__kernel
+void decodeBlocksKernel(
+	__global const uint* words,
+	__global const uint* blockOffsets,
+	unsigned int blockCount,
+	unsigned int blockElements,
+	unsigned int elementCount,
+	__global float* output)
+{
+	unsigned int block = get_global_id(0);
+	if(block >= blockCount)
+		return;
+
+	__global const uint* blockWords = words + blockOffsets[block];
+	__global float* blockOutput = output + block * blockElements;
+	unsigned int count = min(blockElements, elementCount - block * blockElements);
+
+	uint value = blockWords[0];
+	uint width = blockWords[1];
+	__global const uint* packed = blockWords + 2;
+	uint mask = (width == 32) ? 0xFFFFFFFF : ((1u << width) - 1);
+
+	blockOutput[0] = as_float(value);
+
+	unsigned int bitPosition = 0;
+	for(unsigned int i = 1; i < count; i++)
+	{
+		uint zigzag = 0;
+		if(width > 0) {
+			unsigned int word = bitPosition >> 5;
+			unsigned int shift = bitPosition & 31;
+			zigzag = packed[word] >> shift;
+			if(shift + width > 32)
+				zigzag |= packed[word + 1] << (32 - shift);
+			zigzag &= mask;
+			bitPosition += width;
+		}
+
+		value += (zigzag >> 1) ^ (0u - (zigzag & 1));
+		blockOutput[i] = as_float(value);
+	}
+}
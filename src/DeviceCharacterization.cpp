@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "DeviceCharacterization.h"
+#include "KernelSpecializer.h"
+
+#define PROFILE_DIRECTORY "profiles"
+#define CHARACTERIZATION_REPETITIONS 5
+#define MAX_BANDWIDTH_BYTES (64 * 1024 * 1024)
+#define LOCAL_ITERATIONS 64				/* must match MicroBenchmarkKernels.cl */
+#define FLOPS_PER_LANE (128 * 64)		/* FLOPS_ITERATIONS * flops per iteration in MicroBenchmarkKernels.cl */
+#define HOST_ALIGNMENT 4096
+
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+static double timeKernel(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions, bool fastest);
+static double secondsSince(const pt::ptime& start);
+static double gigabytesPerSecond(double bytes, double seconds);
+
+double CLHelper::eventSeconds(const cl::Event& event)
+{
+	cl_int err;
+	cl_ulong start, end;
+
+	err  = event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+	err |= event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+	CHECK_OPENCL_ERROR(err, "cl::Event::getProfilingInfo() failed.");
+
+	return (end - start) * 1e-9;
+}
+
+double CLHelper::averageKernelSeconds(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions)
+{
+	return timeKernel(commQueue, kernel, global, local, repetitions, false);
+}
+
+double CLHelper::bestKernelSeconds(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions)
+{
+	return timeKernel(commQueue, kernel, global, local, repetitions, true);
+}
+
+CLHelper::RooflineProfile::RooflineProfile()
+	: globalReadBandwidth(0), globalWriteBandwidth(0), globalCopyBandwidth(0), globalTriadBandwidth(0),
+	  localBandwidth(0),
+	  readWriteHostToDevice(0), readWriteDeviceToHost(0),
+	  mapHostToDevice(0), mapDeviceToHost(0),
+	  hostPtrHostToDevice(0), hostPtrDeviceToHost(0)
+{
+	for(int i = 0; i < FLOPS_VECTOR_WIDTHS; i++)
+		peakGflops[i] = 0;
+}
+
+double CLHelper::RooflineProfile::peakGflopsMax() const
+{
+	double peak = 0;
+	for(int i = 0; i < FLOPS_VECTOR_WIDTHS; i++)
+		peak = std::max(peak, peakGflops[i]);
+
+	return peak;
+}
+
+double CLHelper::RooflineProfile::ridgePoint() const
+{
+	return globalTriadBandwidth > 0 ? peakGflopsMax() / globalTriadBandwidth : 0;
+}
+
+void CLHelper::characterizeDevice(cl::Device& device, DeviceInfo& deviceInfo, RooflineProfile* profile)
+{
+	cl_int err;
+
+	device.getInfo(CL_DEVICE_NAME, &profile->deviceName);
+	device.getInfo(CL_DRIVER_VERSION, &profile->driverVersion);
+
+	std::vector<cl::Device> devices(1, device);
+	cl::Context context(devices, NULL, NULL, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+
+	cl::CommandQueue commQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	SpecializationCache programCache(context, devices, "MicroBenchmarkKernels.cl", FLOPS_VECTOR_WIDTHS);
+	cl::Program& program = programCache.getGeneric();
+
+	size_t bytes = (size_t) std::min((cl_ulong) MAX_BANDWIDTH_BYTES, deviceInfo.maxMemAllocSize);
+	bytes -= bytes % (16 * 1024);
+	size_t count = bytes / (4 * sizeof(cl_float));
+
+	cl::Buffer d_dataA(context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_dataB(context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_dataC(context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+// Global memory: read, write, copy and triad
+	cl::Kernel writeKernel(program, "writeBandwidthKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+	err  = writeKernel.setArg(0, d_dataA);
+	err |= writeKernel.setArg(1, 1.0f);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	profile->globalWriteBandwidth = gigabytesPerSecond(bytes, bestKernelSeconds(commQueue, writeKernel, cl::NDRange(count), cl::NullRange, CHARACTERIZATION_REPETITIONS));
+
+	cl::Kernel readKernel(program, "readBandwidthKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+	err  = readKernel.setArg(0, d_dataA);
+	err |= readKernel.setArg(1, d_dataB);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	profile->globalReadBandwidth = gigabytesPerSecond(bytes, bestKernelSeconds(commQueue, readKernel, cl::NDRange(count), cl::NullRange, CHARACTERIZATION_REPETITIONS));
+
+	cl::Kernel copyKernel(program, "copyBandwidthKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+	err  = copyKernel.setArg(0, d_dataA);
+	err |= copyKernel.setArg(1, d_dataB);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	profile->globalCopyBandwidth = gigabytesPerSecond(2.0 * bytes, bestKernelSeconds(commQueue, copyKernel, cl::NDRange(count), cl::NullRange, CHARACTERIZATION_REPETITIONS));
+
+	cl::Kernel triadKernel(program, "triadBandwidthKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+	err  = triadKernel.setArg(0, d_dataA);
+	err |= triadKernel.setArg(1, d_dataB);
+	err |= triadKernel.setArg(2, d_dataC);
+	err |= triadKernel.setArg(3, 3.0f);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	profile->globalTriadBandwidth = gigabytesPerSecond(3.0 * bytes, bestKernelSeconds(commQueue, triadKernel, cl::NDRange(count), cl::NullRange, CHARACTERIZATION_REPETITIONS));
+
+// Local memory, with the largest power-of-two work-group that both the device and the built kernel allow and that fits
+	cl::Kernel localKernel(program, "localBandwidthKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+	size_t kernelWorkGroupSize;
+	err = localKernel.getWorkGroupInfo(device, CL_KERNEL_WORK_GROUP_SIZE, &kernelWorkGroupSize);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::getWorkGroupInfo() failed.");
+
+	size_t maxLocalSize = std::min((size_t) deviceInfo.maxWorkGroupSize, kernelWorkGroupSize);
+	size_t localSize = 1;
+	while(localSize * 2 <= maxLocalSize && localSize * 2 * sizeof(cl_float) <= deviceInfo.localMemSize)
+		localSize *= 2;
+	size_t localGlobalSize = std::min(count, (size_t) deviceInfo.maxComputeUnits * localSize * 64);
+	localGlobalSize -= localGlobalSize % localSize;
+
+	err  = localKernel.setArg(0, d_dataA);
+#ifdef CL_VERSION_1_2
+	err |= localKernel.setArg(1, cl::Local(localSize * sizeof(cl_float)));
+#else
+	err |= localKernel.setArg(1, cl::__local(localSize * sizeof(cl_float)));
+#endif
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	profile->localBandwidth = gigabytesPerSecond(
+		(double) localGlobalSize * LOCAL_ITERATIONS * sizeof(cl_float),
+		bestKernelSeconds(commQueue, localKernel, cl::NDRange(localGlobalSize), cl::NDRange(localSize), CHARACTERIZATION_REPETITIONS));
+
+// Peak single precision flops for every vector width
+	const char* floatTypes[FLOPS_VECTOR_WIDTHS] = { "float", "float2", "float4", "float8", "float16" };
+	for(int width = 0; width < FLOPS_VECTOR_WIDTHS; width++)
+	{
+		size_t lanes = (size_t) 1 << width;
+		size_t flopsGlobalSize = std::min(bytes / (lanes * sizeof(cl_float)), (size_t) deviceInfo.maxComputeUnits * deviceInfo.maxWorkGroupSize * 8);
+
+		Specialization specialization;
+		specialization.define("FLOAT_TYPE", floatTypes[width]);
+
+		cl::Kernel flopsKernel(programCache.get(specialization), "peakFlopsKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+		err  = flopsKernel.setArg(0, d_dataA);
+		err |= flopsKernel.setArg(1, 0.5f);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		double seconds = bestKernelSeconds(commQueue, flopsKernel, cl::NDRange(flopsGlobalSize), cl::NullRange, CHARACTERIZATION_REPETITIONS);
+		profile->peakGflops[width] = (double) flopsGlobalSize * lanes * FLOPS_PER_LANE / seconds / 1e9;
+	}
+
+// Host <-> device transfers, with page aligned host memory so that USE_HOST_PTR can be zero-copy
+	std::vector<char> hostStorage(2 * bytes + HOST_ALIGNMENT);
+	char* hostData = &hostStorage[0] + (HOST_ALIGNMENT - ((size_t) &hostStorage[0]) % HOST_ALIGNMENT) % HOST_ALIGNMENT;
+	char* hostScratch = hostData + bytes;
+	memset(hostData, 1, bytes);
+
+#ifdef CL_VERSION_1_2
+	cl_map_flags writeMapFlags = CL_MAP_WRITE_INVALIDATE_REGION;
+#else
+	cl_map_flags writeMapFlags = CL_MAP_WRITE;
+#endif
+
+	cl::Buffer d_mapped(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_hostPtr(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, bytes, hostData, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	for(int rep = 0; rep < CHARACTERIZATION_REPETITIONS; rep++)
+	{
+		pt::ptime start = pt::microsec_clock::universal_time();
+		err = commQueue.enqueueWriteBuffer(d_dataA, CL_TRUE, 0, bytes, hostData);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+		profile->readWriteHostToDevice = std::max(profile->readWriteHostToDevice, gigabytesPerSecond(bytes, secondsSince(start)));
+
+		start = pt::microsec_clock::universal_time();
+		err = commQueue.enqueueReadBuffer(d_dataA, CL_TRUE, 0, bytes, hostScratch);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+		profile->readWriteDeviceToHost = std::max(profile->readWriteDeviceToHost, gigabytesPerSecond(bytes, secondsSince(start)));
+
+		start = pt::microsec_clock::universal_time();
+		void* mapped = commQueue.enqueueMapBuffer(d_mapped, CL_TRUE, writeMapFlags, 0, bytes, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		memcpy(mapped, hostData, bytes);
+		commQueue.enqueueUnmapMemObject(d_mapped, mapped);
+		commQueue.finish();
+		profile->mapHostToDevice = std::max(profile->mapHostToDevice, gigabytesPerSecond(bytes, secondsSince(start)));
+
+		start = pt::microsec_clock::universal_time();
+		mapped = commQueue.enqueueMapBuffer(d_mapped, CL_TRUE, CL_MAP_READ, 0, bytes, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		memcpy(hostScratch, mapped, bytes);
+		commQueue.enqueueUnmapMemObject(d_mapped, mapped);
+		commQueue.finish();
+		profile->mapDeviceToHost = std::max(profile->mapDeviceToHost, gigabytesPerSecond(bytes, secondsSince(start)));
+
+		// With USE_HOST_PTR the data is already in place, so this times the map/unmap synchronization
+		// plus a copy kernel pulling the data through the device: zero-copy plus kernel, not a plain transfer
+		start = pt::microsec_clock::universal_time();
+		mapped = commQueue.enqueueMapBuffer(d_hostPtr, CL_TRUE, CL_MAP_WRITE, 0, bytes, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		commQueue.enqueueUnmapMemObject(d_hostPtr, mapped);
+		err = copyKernel.setArg(0, d_hostPtr);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+		err = commQueue.enqueueNDRangeKernel(copyKernel, cl::NullRange, cl::NDRange(count), cl::NullRange);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+		commQueue.finish();
+		double hostPtrSeconds = secondsSince(start);
+		profile->hostPtrHostToDevice = std::max(profile->hostPtrHostToDevice, gigabytesPerSecond(bytes, hostPtrSeconds));
+
+		start = pt::microsec_clock::universal_time();
+		mapped = commQueue.enqueueMapBuffer(d_hostPtr, CL_TRUE, CL_MAP_READ, 0, bytes, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		commQueue.enqueueUnmapMemObject(d_hostPtr, mapped);
+		commQueue.finish();
+		profile->hostPtrDeviceToHost = std::max(profile->hostPtrDeviceToHost, gigabytesPerSecond(bytes, secondsSince(start)));
+	}
+}
+
+void CLHelper::printRooflineProfile(const RooflineProfile& profile)
+{
+	std::cout << "Roofline profile of " << profile.deviceName << " (driver " << profile.driverVersion << ")" << std::endl;
+	std::cout << "  Global memory read  : " << profile.globalReadBandwidth << " GB/s" << std::endl;
+	std::cout << "  Global memory write : " << profile.globalWriteBandwidth << " GB/s" << std::endl;
+	std::cout << "  Global memory copy  : " << profile.globalCopyBandwidth << " GB/s" << std::endl;
+	std::cout << "  Global memory triad : " << profile.globalTriadBandwidth << " GB/s" << std::endl;
+	std::cout << "  Local memory        : " << profile.localBandwidth << " GB/s" << std::endl;
+	for(int width = 0; width < FLOPS_VECTOR_WIDTHS; width++)
+		std::cout << "  Peak GFLOPS (width " << (1 << width) << ") : " << profile.peakGflops[width] << std::endl;
+	std::cout << "  Ridge point         : " << profile.ridgePoint() << " flops/byte" << std::endl;
+	std::cout << "  Read/write  H2D/D2H : " << profile.readWriteHostToDevice << " / " << profile.readWriteDeviceToHost << " GB/s" << std::endl;
+	std::cout << "  Map/unmap   H2D/D2H : " << profile.mapHostToDevice << " / " << profile.mapDeviceToHost << " GB/s" << std::endl;
+	std::cout << "  USE_HOST_PTR H2D/D2H: " << profile.hostPtrHostToDevice << " (zero-copy + kernel) / " << profile.hostPtrDeviceToHost << " GB/s" << std::endl;
+}
+
+std::string CLHelper::rooflineProfilePath(const cl::Device& device)
+{
+	// One profile per device and driver, independent of any kernel source
+	std::string deviceName, driverVersion;
+	device.getInfo(CL_DEVICE_NAME, &deviceName);
+	device.getInfo(CL_DRIVER_VERSION, &driverVersion);
+
+	return (fs::current_path() / PROFILE_DIRECTORY / (hashString(deviceName + "\n" + driverVersion) + ".json")).string();
+}
+
+void CLHelper::saveRooflineProfile(const cl::Device& device, const RooflineProfile& profile)
+{
+	boost::property_tree::ptree tree;
+	tree.put("device", profile.deviceName);
+	tree.put("driver", profile.driverVersion);
+	tree.put("global.read", profile.globalReadBandwidth);
+	tree.put("global.write", profile.globalWriteBandwidth);
+	tree.put("global.copy", profile.globalCopyBandwidth);
+	tree.put("global.triad", profile.globalTriadBandwidth);
+	tree.put("local", profile.localBandwidth);
+	for(int width = 0; width < FLOPS_VECTOR_WIDTHS; width++)
+	{
+		std::ostringstream key;
+		key << "gflops.width" << (1 << width);
+		tree.put(key.str(), profile.peakGflops[width]);
+	}
+	tree.put("transfer.readwrite.h2d", profile.readWriteHostToDevice);
+	tree.put("transfer.readwrite.d2h", profile.readWriteDeviceToHost);
+	tree.put("transfer.map.h2d", profile.mapHostToDevice);
+	tree.put("transfer.map.d2h", profile.mapDeviceToHost);
+	tree.put("transfer.hostptr.h2d", profile.hostPtrHostToDevice);
+	tree.put("transfer.hostptr.d2h", profile.hostPtrDeviceToHost);
+
+	std::string path = rooflineProfilePath(device);
+	fs::create_directories(fs::path(path).parent_path());
+	boost::property_tree::write_json(path, tree);
+
+	std::cout << "Wrote " << path << std::endl;
+}
+
+bool CLHelper::loadRooflineProfile(const cl::Device& device, RooflineProfile* profile)
+{
+	std::string path = rooflineProfilePath(device);
+	if(!fs::exists(path))
+		return false;
+
+	boost::property_tree::ptree tree;
+	try {
+		boost::property_tree::read_json(path, tree);
+	}
+	catch(boost::property_tree::json_parser_error& e) {
+		std::cerr << "Ignoring unreadable profile \"" << path << "\": " << e.what() << std::endl;
+		return false;
+	}
+
+	profile->deviceName = tree.get("device", "");
+	profile->driverVersion = tree.get("driver", "");
+	profile->globalReadBandwidth = tree.get("global.read", 0.0);
+	profile->globalWriteBandwidth = tree.get("global.write", 0.0);
+	profile->globalCopyBandwidth = tree.get("global.copy", 0.0);
+	profile->globalTriadBandwidth = tree.get("global.triad", 0.0);
+	profile->localBandwidth = tree.get("local", 0.0);
+	for(int width = 0; width < FLOPS_VECTOR_WIDTHS; width++)
+	{
+		std::ostringstream key;
+		key << "gflops.width" << (1 << width);
+		profile->peakGflops[width] = tree.get(key.str(), 0.0);
+	}
+	profile->readWriteHostToDevice = tree.get("transfer.readwrite.h2d", 0.0);
+	profile->readWriteDeviceToHost = tree.get("transfer.readwrite.d2h", 0.0);
+	profile->mapHostToDevice = tree.get("transfer.map.h2d", 0.0);
+	profile->mapDeviceToHost = tree.get("transfer.map.d2h", 0.0);
+	profile->hostPtrHostToDevice = tree.get("transfer.hostptr.h2d", 0.0);
+	profile->hostPtrDeviceToHost = tree.get("transfer.hostptr.d2h", 0.0);
+
+	return true;
+}
+
+static double secondsSince(const pt::ptime& start)
+{
+	return (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static double gigabytesPerSecond(double bytes, double seconds)
+{
+	return seconds > 0 ? bytes / seconds / 1e9 : 0;
+}
+
+// Launches the kernel once to warm up, then returns the average or the fastest device time of the timed launches
+static double timeKernel(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions, bool fastest)
+{
+	cl_int err;
+	double seconds = 0;
+
+	repetitions = std::max(repetitions, (size_t) 1);
+	for(size_t rep = 0; rep <= repetitions; rep++)
+	{
+		cl::Event clEvent;
+		err = commQueue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, NULL, &clEvent);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+		err = clEvent.wait();
+		CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+
+		if(rep == 0)
+			continue;
+
+		double launchSeconds = CLHelper::eventSeconds(clEvent);
+		if(!fastest)
+			seconds += launchSeconds / repetitions;
+		else if(rep == 1 || launchSeconds < seconds)
+			seconds = launchSeconds;
+	}
+
+	return seconds;
+}
@@ -0,0 +1,50 @@
+#ifndef _DEVICECHARACTERIZATION_H
+#define _DEVICECHARACTERIZATION_H
+
+#include "CLHelper.h"
+
+#define FLOPS_VECTOR_WIDTHS 5		/* float, float2, float4, float8, float16 */
+
+namespace CLHelper
+{
+	/* Measured limits of one device, all bandwidths in GB/s */
+	struct RooflineProfile {
+		std::string deviceName;
+		std::string driverVersion;
+
+		double globalReadBandwidth;
+		double globalWriteBandwidth;
+		double globalCopyBandwidth;		/* counts bytes read plus bytes written */
+		double globalTriadBandwidth;	/* a = b + s*c, counts all three streams */
+		double localBandwidth;
+		double peakGflops[FLOPS_VECTOR_WIDTHS];	/* single precision, by vector width 1, 2, 4, 8, 16 */
+
+		double readWriteHostToDevice;	/* enqueueWriteBuffer */
+		double readWriteDeviceToHost;	/* enqueueReadBuffer */
+		double mapHostToDevice;			/* CL_MEM_ALLOC_HOST_PTR + map/memcpy/unmap */
+		double mapDeviceToHost;
+		double hostPtrHostToDevice;		/* CL_MEM_USE_HOST_PTR + map/unmap + a copy kernel reading it: zero-copy plus kernel */
+		double hostPtrDeviceToHost;		/* CL_MEM_USE_HOST_PTR + map/unmap */
+
+		RooflineProfile();
+
+		double peakGflopsMax() const;
+		double ridgePoint() const;		/* flops per byte where the roofline turns from memory to compute bound */
+	};
+
+	void characterizeDevice(cl::Device& device, DeviceInfo& deviceInfo, RooflineProfile* profile);
+	void printRooflineProfile(const RooflineProfile& profile);
+
+	std::string rooflineProfilePath(const cl::Device& device);
+	void saveRooflineProfile(const cl::Device& device, const RooflineProfile& profile);
+	bool loadRooflineProfile(const cl::Device& device, RooflineProfile* profile);
+
+	/* Device time of a finished command, from a queue created with CL_QUEUE_PROFILING_ENABLE */
+	double eventSeconds(const cl::Event& event);
+
+	/* Launch the kernel once to warm up, then time repetitions launches on the device: their average, or the fastest */
+	double averageKernelSeconds(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions);
+	double bestKernelSeconds(cl::CommandQueue& commQueue, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, size_t repetitions);
+};
+
+#endif
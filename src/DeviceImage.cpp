@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "DeviceCharacterization.h"
+#include "DeviceImage.h"
+#include "Validation.h"
+
+bool CLHelper::imagesUsable(
+	const cl::Context& context,
+	const DeviceInfo& deviceInfo,
+	size_t width,
+	size_t height,
+	size_t depth,
+	cl_uint readArgs)
+{
+	if(!deviceInfo.imageSupport || deviceInfo.maxReadImageArgs < readArgs || deviceInfo.maxSamplers == 0)
+		return false;
+
+	if(depth <= 1) {
+		if(width > deviceInfo.image2dMaxWidth || height > deviceInfo.image2dMaxHeight)
+			return false;
+	}
+	else if(width > deviceInfo.image3dMaxWidth || height > deviceInfo.image3dMaxHeight || depth > deviceInfo.image3dMaxDepth)
+		return false;
+
+	// CL_R is not among the formats every device must support before OpenCL 2.0
+	std::vector<cl::ImageFormat> formats;
+	if(context.getSupportedImageFormats(CL_MEM_READ_ONLY, depth <= 1 ? CL_MEM_OBJECT_IMAGE2D : CL_MEM_OBJECT_IMAGE3D, &formats) != CL_SUCCESS)
+		return false;
+
+	std::vector<cl::ImageFormat>::iterator format;
+	for(format = formats.begin(); format != formats.end(); format++)
+	{
+		if(format->image_channel_order == CL_R && format->image_channel_data_type == CL_FLOAT)
+			return true;
+	}
+
+	return false;
+}
+
+CLHelper::DeviceImage::DeviceImage(
+	cl::Context& context,
+	const DeviceInfo& deviceInfo,
+	size_t width,
+	size_t height,
+	size_t depth,
+	bool allowImage)
+	: width(width), height(height), depth(std::max(depth, (size_t) 1))
+{
+	cl_int err;
+
+	backing = (allowImage && imagesUsable(context, deviceInfo, width, height, this->depth)) ? BACKING_IMAGE : BACKING_BUFFER;
+
+	// Embedded profile devices need not filter float images linearly
+	manualFilter = (deviceInfo.profileType != NULL && strstr(deviceInfo.profileType, "EMBEDDED") != NULL);
+
+	if(backing == BACKING_BUFFER) {
+		buffer = cl::Buffer(context, CL_MEM_READ_ONLY, width * height * this->depth * sizeof(cl_float), NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	}
+	else if(this->depth == 1) {
+		image2D = cl::Image2D(context, CL_MEM_READ_ONLY, cl::ImageFormat(CL_R, CL_FLOAT), width, height, 0, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Image2D::Image2D() failed.");
+	}
+	else {
+		image3D = cl::Image3D(context, CL_MEM_READ_ONLY, cl::ImageFormat(CL_R, CL_FLOAT), width, height, this->depth, 0, 0, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Image3D::Image3D() failed.");
+	}
+}
+
+CLHelper::ImageBacking CLHelper::DeviceImage::getBacking() const
+{
+	return backing;
+}
+
+size_t CLHelper::DeviceImage::getWidth() const
+{
+	return width;
+}
+
+size_t CLHelper::DeviceImage::getHeight() const
+{
+	return height;
+}
+
+size_t CLHelper::DeviceImage::getDepth() const
+{
+	return depth;
+}
+
+void CLHelper::DeviceImage::upload(cl::CommandQueue& commQueue, const float* data, size_t rowPitch, size_t slicePitch)
+{
+	cl_int err;
+
+	rowPitch = (rowPitch > 0) ? rowPitch : width;
+	slicePitch = (slicePitch > 0) ? slicePitch : rowPitch * height;
+
+	if(backing == BACKING_IMAGE) {
+		cl::size_t<3> origin, region;
+		origin[0] = 0; origin[1] = 0; origin[2] = 0;
+		region[0] = width; region[1] = height; region[2] = depth;
+
+		// The image takes the host layout as it is, only 3D images have a slice pitch
+		cl::Image& image = (depth == 1) ? (cl::Image&) image2D : (cl::Image&) image3D;
+		err = commQueue.enqueueWriteImage(image, CL_TRUE, origin, region, rowPitch * sizeof(cl_float),
+			(depth == 1) ? 0 : slicePitch * sizeof(cl_float), (void*) data);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteImage() failed.");
+		return;
+	}
+
+	// Buffers are packed, so padded host rows are repacked first
+	std::vector<float> packed;
+	if(rowPitch != width || slicePitch != width * height) {
+		packed.resize(width * height * depth);
+		for(size_t z = 0; z < depth; z++)
+		{
+			for(size_t y = 0; y < height; y++)
+				memcpy(&packed[(z * height + y) * width], data + z * slicePitch + y * rowPitch, width * sizeof(float));
+		}
+		data = &packed[0];
+	}
+
+	err = commQueue.enqueueWriteBuffer(buffer, CL_TRUE, 0, width * height * depth * sizeof(cl_float), data);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+}
+
+void CLHelper::DeviceImage::download(cl::CommandQueue& commQueue, float* data, size_t rowPitch, size_t slicePitch)
+{
+	cl_int err;
+
+	rowPitch = (rowPitch > 0) ? rowPitch : width;
+	slicePitch = (slicePitch > 0) ? slicePitch : rowPitch * height;
+
+	if(backing == BACKING_IMAGE) {
+		cl::size_t<3> origin, region;
+		origin[0] = 0; origin[1] = 0; origin[2] = 0;
+		region[0] = width; region[1] = height; region[2] = depth;
+
+		cl::Image& image = (depth == 1) ? (cl::Image&) image2D : (cl::Image&) image3D;
+		err = commQueue.enqueueReadImage(image, CL_TRUE, origin, region, rowPitch * sizeof(cl_float),
+			(depth == 1) ? 0 : slicePitch * sizeof(cl_float), data);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadImage() failed.");
+		return;
+	}
+
+	bool isPacked = (rowPitch == width && slicePitch == width * height);
+	std::vector<float> packed(isPacked ? 0 : width * height * depth);
+
+	err = commQueue.enqueueReadBuffer(buffer, CL_TRUE, 0, width * height * depth * sizeof(cl_float), isPacked ? data : &packed[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+	if(!isPacked) {
+		for(size_t z = 0; z < depth; z++)
+		{
+			for(size_t y = 0; y < height; y++)
+				memcpy(data + z * slicePitch + y * rowPitch, &packed[(z * height + y) * width], width * sizeof(float));
+		}
+	}
+}
+
+cl_int CLHelper::DeviceImage::setArg(cl::Kernel& kernel, cl_uint index)
+{
+	if(backing == BACKING_BUFFER)
+		return kernel.setArg(index, buffer);
+	if(depth == 1)
+		return kernel.setArg(index, image2D);
+	return kernel.setArg(index, image3D);
+}
+
+void CLHelper::DeviceImage::defineBacking(Specialization* specialization) const
+{
+	if(backing == BACKING_IMAGE) {
+		specialization->define("IMAGE_BACKING");
+		if(manualFilter)
+			specialization->define("MANUAL_FILTER");
+	}
+}
+
+void CLHelper::runImageBenchmark(Runtime& runtime, size_t edge, size_t repetitions)
+{
+	cl_int err;
+
+	cl::Context& context = runtime.getContext();
+	DeviceInfo& deviceInfo = runtime.getDeviceInfo(0);
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
+	repetitions = std::max(repetitions, (size_t) 1);
+
+	// Smooth waves with a fine checkerboard on top, so the filtering shows
+	std::vector<float> source(edge * edge);
+	for(size_t y = 0; y < edge; y++)
+	{
+		for(size_t x = 0; x < edge; x++)
+			source[y * edge + x] = 0.5f + 0.25f * (float) (std::sin(0.05 * x) * std::cos(0.03 * y)) + (((x ^ y) & 1) ? 0.1f : -0.1f);
+	}
+
+	size_t outEdge = 2 * edge;
+	cl::Buffer d_resampled(context, CL_MEM_WRITE_ONLY, outEdge * outEdge * sizeof(cl_float), NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_swirled(context, CL_MEM_WRITE_ONLY, edge * edge * sizeof(cl_float), NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	std::cout << "Image benchmark, " << edge << " x " << edge << " source, average of " << repetitions << " runs:" << std::endl;
+
+	// The buffer is the reference the image results are compared to
+	const char* backingNames[] = { "image", "buffer" };
+	std::vector<float> resampled[2], swirled[2];
+	double resampleSeconds[2], swirlSeconds[2];
+	for(int variant = BACKING_BUFFER; variant >= BACKING_IMAGE; variant--)
+	{
+		DeviceImage image(context, deviceInfo, edge, edge, 1, variant == BACKING_IMAGE);
+		if(image.getBacking() != variant) {
+			std::cout << "  " << backingNames[variant] << ": not usable on this device, kernels fall back to buffers" << std::endl;
+			break;
+		}
+		image.upload(commQueue, &source[0]);
+
+		Specialization specialization;
+		image.defineBacking(&specialization);
+		cl::Program program = runtime.getProgram("ImageKernels.cl", specialization);
+
+		cl::Kernel resampleKernel(program, "resampleKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+		err  = image.setArg(resampleKernel, 0);
+		err |= resampleKernel.setArg(1, (cl_uint) edge);
+		err |= resampleKernel.setArg(2, (cl_uint) edge);
+		err |= resampleKernel.setArg(3, d_resampled);
+		err |= resampleKernel.setArg(4, (cl_uint) outEdge);
+		err |= resampleKernel.setArg(5, (cl_uint) outEdge);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		cl::Kernel swirlKernel(program, "swirlKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+		err  = image.setArg(swirlKernel, 0);
+		err |= swirlKernel.setArg(1, (cl_uint) edge);
+		err |= swirlKernel.setArg(2, (cl_uint) edge);
+		err |= swirlKernel.setArg(3, d_swirled);
+		err |= swirlKernel.setArg(4, 0.5f);
+		err |= swirlKernel.setArg(5, 4.0f / edge);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		resampleSeconds[variant] = averageKernelSeconds(commQueue, resampleKernel, cl::NDRange(outEdge, outEdge), cl::NullRange, repetitions);
+		swirlSeconds[variant] = averageKernelSeconds(commQueue, swirlKernel, cl::NDRange(edge, edge), cl::NullRange, repetitions);
+
+		resampled[variant].resize(outEdge * outEdge);
+		swirled[variant].resize(edge * edge);
+		err  = commQueue.enqueueReadBuffer(d_resampled, CL_TRUE, 0, outEdge * outEdge * sizeof(cl_float), &resampled[variant][0]);
+		err |= commQueue.enqueueReadBuffer(d_swirled, CL_TRUE, 0, edge * edge * sizeof(cl_float), &swirled[variant][0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+		std::cout << "  " << backingNames[variant] << ": resample " << 1e3 * resampleSeconds[variant] << " ms, "
+		          << outEdge * outEdge / resampleSeconds[variant] / 1e9 << " Gsamples/s; swirl " << 1e3 * swirlSeconds[variant] << " ms, "
+		          << edge * edge / swirlSeconds[variant] / 1e9 << " Gsamples/s";
+		if(variant == BACKING_IMAGE) {
+			std::cout << "; speedup " << resampleSeconds[BACKING_BUFFER] / resampleSeconds[BACKING_IMAGE]
+			          << " and " << swirlSeconds[BACKING_BUFFER] / swirlSeconds[BACKING_IMAGE]
+			          << ", max difference " << std::max(maxDifference(&resampled[BACKING_BUFFER][0], &resampled[BACKING_IMAGE][0], outEdge * outEdge),
+			                                             maxDifference(&swirled[BACKING_BUFFER][0], &swirled[BACKING_IMAGE][0], edge * edge));
+		}
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef _DEVICEIMAGE_H
+#define _DEVICEIMAGE_H
+
+#include "CLHelper.h"
+#include "KernelSpecializer.h"
+#include "Runtime.h"
+
+namespace CLHelper
+{
+	enum ImageBacking {
+		BACKING_IMAGE,		/* cl::Image2D or cl::Image3D, read through a sampler */
+		BACKING_BUFFER		/* row major cl::Buffer, the fallback */
+	};
+
+	/*
+	 * Whether a single channel float array of the given size can live in an
+	 * image on the device: images must be supported, the format available in
+	 * the context, the size within the device's limits and readArgs image
+	 * arguments allowed per kernel. A depth of 1 means a 2D image.
+	 */
+	bool imagesUsable(
+		const cl::Context& context,
+		const DeviceInfo& deviceInfo,
+		size_t width,
+		size_t height,
+		size_t depth = 1,
+		cl_uint readArgs = 1);
+
+	/*
+	 * A 2D or 3D array of floats for kernels to gather from, in an image where
+	 * imagesUsable() allows it and in a buffer otherwise. Kernels reading it
+	 * are built with defineBacking(), see ImageKernels.cl.
+	 */
+	class DeviceImage {
+
+	public:
+		DeviceImage(
+			cl::Context& context,
+			const DeviceInfo& deviceInfo,
+			size_t width,
+			size_t height,
+			size_t depth = 1,
+			bool allowImage = true);
+
+		ImageBacking getBacking() const;
+		size_t getWidth() const;
+		size_t getHeight() const;
+		size_t getDepth() const;
+
+		/* Copies a host array in, rows rowPitch and slices slicePitch elements apart (0 for packed) */
+		void upload(cl::CommandQueue& commQueue, const float* data, size_t rowPitch = 0, size_t slicePitch = 0);
+		void download(cl::CommandQueue& commQueue, float* data, size_t rowPitch = 0, size_t slicePitch = 0);
+
+		cl_int setArg(cl::Kernel& kernel, cl_uint index);
+		void defineBacking(Specialization* specialization) const;
+
+	private:
+		ImageBacking backing;
+		size_t width;
+		size_t height;
+		size_t depth;
+		bool manualFilter;			/* the device cannot filter float images linearly */
+
+		cl::Image2D image2D;
+		cl::Image3D image3D;
+		cl::Buffer buffer;
+	};
+
+	/* Compares image and buffer backed gathers of ImageKernels.cl on the runtime's first device */
+	void runImageBenchmark(Runtime& runtime, size_t edge, size_t repetitions);
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include "DeviceMonitor.h"
+#include "Metrics.h"
+
+namespace pt = boost::posix_time;
+
+static std::string deviceMetric(size_t deviceIndex, const char* name)
+{
+	std::ostringstream metric;
+	metric << "device" << deviceIndex << "_" << name;
+	return metric.str();
+}
+
+std::string CLHelper::deviceHealthToString(DeviceHealth health)
+{
+	switch(health) {
+	case DEVICE_HEALTHY:
+		return "healthy";
+	case DEVICE_DRAINING:
+		return "draining";
+	case DEVICE_QUARANTINED:
+		return "quarantined";
+	}
+
+	return "unknown";
+}
+
+CLHelper::DeviceMonitor::DeviceStats::DeviceStats()
+	: throughput(0), errorRate(0), samples(0), running(0), health(DEVICE_HEALTHY), quarantines(0)
+{
+}
+
+CLHelper::DeviceMonitor::DeviceMonitor(size_t deviceCount, const DeviceMonitorOptions& options)
+	: options(options), devices(deviceCount)
+{
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+		publish(deviceIndex);
+}
+
+void CLHelper::DeviceMonitor::recordCommand(size_t deviceIndex, const cl::Event& event, double bytes)
+{
+	cl_int status;
+	cl_int err = event.getInfo(CL_EVENT_COMMAND_EXECUTION_STATUS, &status);
+	if(err != CL_SUCCESS || status < 0) {
+		recordError(deviceIndex);
+		return;
+	}
+
+	// Without profiling on the queue there is no timing, and no sample
+	cl_ulong start, end;
+	err  = event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+	err |= event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+	if(err == CL_SUCCESS && end > start)
+		recordSample(deviceIndex, (end - start) * 1e-9, bytes);
+}
+
+void CLHelper::DeviceMonitor::recordSample(size_t deviceIndex, double seconds, double bytes)
+{
+	if(seconds <= 0)
+		return;
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	DeviceStats& device = devices[deviceIndex];
+	double throughput = bytes / seconds;
+	if(device.samples == 0)
+		device.throughput = throughput;
+	else
+		device.throughput += options.smoothing * (throughput - device.throughput);
+	device.errorRate -= options.smoothing * device.errorRate;
+	device.samples++;
+
+	evaluate();
+	publish(deviceIndex);
+}
+
+void CLHelper::DeviceMonitor::recordError(size_t deviceIndex)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	DeviceStats& device = devices[deviceIndex];
+	device.errorRate += options.smoothing * (1.0 - device.errorRate);
+	device.samples++;
+	Metrics::shared().add(deviceMetric(deviceIndex, "errors"), 1);
+
+	evaluate();
+	publish(deviceIndex);
+}
+
+void CLHelper::DeviceMonitor::beginWork(size_t deviceIndex)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	devices[deviceIndex].running++;
+	publish(deviceIndex);
+}
+
+void CLHelper::DeviceMonitor::endWork(size_t deviceIndex)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if(devices[deviceIndex].running > 0)
+		devices[deviceIndex].running--;
+
+	evaluate();
+	publish(deviceIndex);
+}
+
+bool CLHelper::DeviceMonitor::isAccepting(size_t deviceIndex)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	evaluate();
+
+	return devices[deviceIndex].health == DEVICE_HEALTHY || acceptingDevices() == 0;
+}
+
+// Healthy devices that are slower than the best one run fewer jobs at a time,
+// so their queues do not hold work the faster devices would finish sooner
+size_t CLHelper::DeviceMonitor::allowedConcurrency(size_t deviceIndex, size_t queueCount)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	const DeviceStats& device = devices[deviceIndex];
+	double best = bestThroughput();
+	if(device.samples < options.minSamples || best <= 0)
+		return queueCount;
+
+	size_t allowed = (size_t) ceil(queueCount * device.throughput / best);
+	return std::max(std::min(allowed, queueCount), (size_t) 1);
+}
+
+size_t CLHelper::DeviceMonitor::getRunning(size_t deviceIndex) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return devices[deviceIndex].running;
+}
+
+std::vector<size_t> CLHelper::DeviceMonitor::splitWork(size_t total, size_t granularity)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	evaluate();
+
+	granularity = std::max(granularity, (size_t) 1);
+	bool anyAccepting = (acceptingDevices() > 0);
+
+	// Devices without enough samples yet are weighted like the average judged device
+	size_t judgedDevices = 0;
+	double judgedSum = 0;
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		if(devices[deviceIndex].health == DEVICE_HEALTHY && devices[deviceIndex].samples >= options.minSamples) {
+			judgedSum += devices[deviceIndex].throughput;
+			judgedDevices++;
+		}
+	}
+	double defaultWeight = (judgedDevices > 0 && judgedSum > 0) ? judgedSum / judgedDevices : 1.0;
+
+	std::vector<double> weights(devices.size(), 0);
+	double weightSum = 0;
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		const DeviceStats& device = devices[deviceIndex];
+		if(device.health != DEVICE_HEALTHY && anyAccepting)
+			continue;
+
+		weights[deviceIndex] = (device.samples >= options.minSamples && device.throughput > 0) ? device.throughput : defaultWeight;
+		weightSum += weights[deviceIndex];
+	}
+
+	// Whole units of granularity in proportion to the weights, the remainder to the heaviest device
+	std::vector<size_t> parts(devices.size(), 0);
+	size_t units = total / granularity;
+	size_t assigned = 0;
+	size_t heaviest = 0;
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		parts[deviceIndex] = (size_t) floor(units * weights[deviceIndex] / weightSum) * granularity;
+		assigned += parts[deviceIndex];
+		if(weights[deviceIndex] > weights[heaviest])
+			heaviest = deviceIndex;
+	}
+	if(!parts.empty())
+		parts[heaviest] += total - assigned;
+
+	return parts;
+}
+
+CLHelper::DeviceHealth CLHelper::DeviceMonitor::getHealth(size_t deviceIndex) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return devices[deviceIndex].health;
+}
+
+double CLHelper::DeviceMonitor::getThroughput(size_t deviceIndex) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return devices[deviceIndex].throughput;
+}
+
+double CLHelper::DeviceMonitor::getErrorRate(size_t deviceIndex) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return devices[deviceIndex].errorRate;
+}
+
+// Called with the mutex held. Moves devices between the health states.
+void CLHelper::DeviceMonitor::evaluate()
+{
+	pt::ptime now = pt::microsec_clock::universal_time();
+
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		DeviceStats& device = devices[deviceIndex];
+
+		// Readmit after the quarantine, with fresh statistics: a throttled device may have recovered
+		if(device.health == DEVICE_QUARANTINED && (now - device.quarantinedAt).total_milliseconds() >= options.quarantineSeconds * 1000) {
+			device.throughput = 0;
+			device.errorRate = 0;
+			device.samples = 0;
+			setHealth(deviceIndex, DEVICE_HEALTHY, "quarantine over, judged anew");
+		}
+
+		if(device.health == DEVICE_DRAINING && device.running == 0)
+			setHealth(deviceIndex, DEVICE_QUARANTINED, "drained");
+	}
+
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		DeviceStats& device = devices[deviceIndex];
+		if(device.health != DEVICE_HEALTHY || device.samples < options.minSamples || acceptingDevices() <= 1)
+			continue;
+
+		std::ostringstream reason;
+		double best = bestThroughput();
+		if(device.errorRate > options.maxErrorRate)
+			reason << "error rate " << device.errorRate << " above " << options.maxErrorRate;
+		else if(best > 0 && device.throughput < options.minRelativeThroughput * best)
+			reason << "throughput " << device.throughput / 1e9 << " GB/s below " << 100 * options.minRelativeThroughput
+				   << "% of the best device's " << best / 1e9 << " GB/s";
+		else
+			continue;
+
+		setHealth(deviceIndex, DEVICE_DRAINING, reason.str());
+		if(device.running == 0)
+			setHealth(deviceIndex, DEVICE_QUARANTINED, "drained");
+	}
+}
+
+void CLHelper::DeviceMonitor::setHealth(size_t deviceIndex, DeviceHealth health, const std::string& reason)
+{
+	DeviceStats& device = devices[deviceIndex];
+	device.health = health;
+	if(health == DEVICE_QUARANTINED) {
+		device.quarantinedAt = pt::microsec_clock::universal_time();
+		device.quarantines++;
+	}
+
+	std::cerr << "Device " << deviceIndex << " " << deviceHealthToString(health) << ": " << reason << std::endl;
+	publish(deviceIndex);
+}
+
+// Best rolling throughput among the healthy devices that have enough samples
+double CLHelper::DeviceMonitor::bestThroughput() const
+{
+	double best = 0;
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		const DeviceStats& device = devices[deviceIndex];
+		if(device.health == DEVICE_HEALTHY && device.samples >= options.minSamples)
+			best = std::max(best, device.throughput);
+	}
+
+	return best;
+}
+
+size_t CLHelper::DeviceMonitor::acceptingDevices() const
+{
+	size_t accepting = 0;
+	for(size_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+	{
+		if(devices[deviceIndex].health == DEVICE_HEALTHY)
+			accepting++;
+	}
+	return accepting;
+}
+
+void CLHelper::DeviceMonitor::publish(size_t deviceIndex) const
+{
+	const DeviceStats& device = devices[deviceIndex];
+	Metrics& metrics = Metrics::shared();
+
+	metrics.set(deviceMetric(deviceIndex, "throughput_gbs"), device.throughput / 1e9);
+	metrics.set(deviceMetric(deviceIndex, "error_rate"), device.errorRate);
+	metrics.set(deviceMetric(deviceIndex, "state"), (double) device.health);
+	metrics.set(deviceMetric(deviceIndex, "running"), (double) device.running);
+	metrics.set(deviceMetric(deviceIndex, "quarantines"), (double) device.quarantines);
+}
@@ -0,0 +1,92 @@
+#ifndef _DEVICEMONITOR_H
+#define _DEVICEMONITOR_H
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	/* Published as device<i>_state: 0 healthy, 1 draining, 2 quarantined */
+	enum DeviceHealth {
+		DEVICE_HEALTHY,
+		DEVICE_DRAINING,		/* takes no new work, becomes quarantined once its running work is done */
+		DEVICE_QUARANTINED		/* takes no work until readmitted on probation */
+	};
+
+	std::string deviceHealthToString(DeviceHealth health);
+
+	struct DeviceMonitorOptions {
+		double smoothing;				/* weight of a new sample in the rolling averages */
+		size_t minSamples;				/* samples before a device is judged */
+		double minRelativeThroughput;	/* a device below this share of the best device's throughput is drained */
+		double maxErrorRate;			/* a device failing a larger share of its commands is drained */
+		double quarantineSeconds;		/* after this a quarantined device is readmitted, judged anew */
+
+		DeviceMonitorOptions()
+			: smoothing(0.1), minSamples(20), minRelativeThroughput(0.5), maxErrorRate(0.05), quarantineSeconds(30) {}
+	};
+
+	/*
+	 * Rolling per-device throughput and error rates, taken from kernel event
+	 * timings. Devices that fall behind the others or keep failing are drained
+	 * and quarantined, and devices that stay healthy but are slower get a smaller
+	 * share of the work. At least one device always keeps taking work.
+	 * Every change is published to Metrics::shared().
+	 */
+	class DeviceMonitor {
+
+	public:
+		explicit DeviceMonitor(size_t deviceCount, const DeviceMonitorOptions& options = DeviceMonitorOptions());
+
+		/* Records a completed command moving the given bytes; needs a queue with CL_QUEUE_PROFILING_ENABLE */
+		void recordCommand(size_t deviceIndex, const cl::Event& event, double bytes);
+		void recordSample(size_t deviceIndex, double seconds, double bytes);
+		void recordError(size_t deviceIndex);
+
+		void beginWork(size_t deviceIndex);
+		void endWork(size_t deviceIndex);
+
+		/* Whether the device may take new work, and how many of its queueCount queues may run at once */
+		bool isAccepting(size_t deviceIndex);
+		size_t allowedConcurrency(size_t deviceIndex, size_t queueCount);
+		size_t getRunning(size_t deviceIndex) const;
+
+		/* Splits total into per-device parts proportional to throughput, in multiples of granularity */
+		std::vector<size_t> splitWork(size_t total, size_t granularity = 1);
+
+		DeviceHealth getHealth(size_t deviceIndex) const;
+		double getThroughput(size_t deviceIndex) const;		/* bytes per second */
+		double getErrorRate(size_t deviceIndex) const;
+
+	private:
+		struct DeviceStats {
+			double throughput;
+			double errorRate;
+			size_t samples;
+			size_t running;
+			DeviceHealth health;
+			boost::posix_time::ptime quarantinedAt;
+			unsigned long quarantines;
+
+			DeviceStats();
+		};
+
+		DeviceMonitor(const DeviceMonitor&);
+		DeviceMonitor& operator=(const DeviceMonitor&);
+
+		void evaluate();
+		void setHealth(size_t deviceIndex, DeviceHealth health, const std::string& reason);
+		double bestThroughput() const;
+		size_t acceptingDevices() const;
+		void publish(size_t deviceIndex) const;
+
+		DeviceMonitorOptions options;
+		mutable boost::mutex mutex;
+		std::vector<DeviceStats> devices;
+	};
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#include "DeviceSelector.h"
+#include "DeviceCharacterization.h"
+
+struct Candidate {
+	cl::Device device;
+	CLHelper::DeviceInfo deviceInfo;
+	double profileScore;
+	double fallbackScore;
+	bool profiled;
+};
+
+static bool betterProfileScore(const Candidate& a, const Candidate& b);
+static bool betterFallbackScore(const Candidate& a, const Candidate& b);
+
+bool CLHelper::parseDeviceRequirements(const std::string& predicates, DeviceRequirements* requirements)
+{
+	std::vector<std::string> entries;
+	boost::algorithm::split(entries, predicates, boost::algorithm::is_any_of(","));
+
+	std::vector<std::string>::iterator entry;
+	for(entry = entries.begin(); entry != entries.end(); entry++)
+	{
+		if(entry->empty())
+			continue;
+
+		std::string name = entry->substr(0, entry->find('='));
+		std::string value = (entry->find('=') != std::string::npos) ? entry->substr(entry->find('=') + 1) : "";
+
+		if(name == "fp64" && value.empty())
+			requirements->requireDouble = true;
+		else if(name == "all-platforms" && value.empty())
+			requirements->samePlatform = false;
+		else if(name == "min-memory" && atof(value.c_str()) > 0)
+			requirements->minGlobalMemSize = (cl_ulong) (atof(value.c_str()) * 1024 * 1024);
+		else if(name == "min-alloc" && atof(value.c_str()) > 0)
+			requirements->minMaxMemAllocSize = (cl_ulong) (atof(value.c_str()) * 1024 * 1024);
+		else if(name == "min-version" && parseOpenCLVersion(value) > 0)
+			requirements->minOpenCLVersion = parseOpenCLVersion(value);
+		else if(name == "count" && atoi(value.c_str()) > 0)
+			requirements->maxDevices = (size_t) atoi(value.c_str());
+		else if(name == "rank" && value == "bandwidth")
+			requirements->ranking = RANK_BANDWIDTH;
+		else if(name == "rank" && value == "compute")
+			requirements->ranking = RANK_COMPUTE;
+		else
+			return false;
+	}
+
+	return true;
+}
+
+bool CLHelper::meetsRequirements(const DeviceInfo& deviceInfo, const DeviceRequirements& requirements)
+{
+	if(!deviceInfo.available || !deviceInfo.compilerAvailable)
+		return false;
+	if(deviceInfo.globalMemSize < requirements.minGlobalMemSize)
+		return false;
+	if(deviceInfo.maxMemAllocSize < requirements.minMaxMemAllocSize)
+		return false;
+	if(requirements.requireDouble && deviceInfo.doubleFpConfig == 0)
+		return false;
+	if(requirements.minOpenCLVersion > 0 && parseOpenCLVersion(deviceInfo.deviceVersion) < requirements.minOpenCLVersion)
+		return false;
+
+	return true;
+}
+
+bool CLHelper::deviceThroughputScore(const cl::Device& device, const DeviceInfo& deviceInfo, DeviceRanking ranking, double* score)
+{
+	RooflineProfile profile;
+	if(loadRooflineProfile(device, &profile)) {
+		*score = (ranking == RANK_COMPUTE) ? profile.peakGflopsMax() : profile.globalTriadBandwidth;
+		if(*score > 0)
+			return true;
+	}
+
+	*score = (double) deviceInfo.maxComputeUnits * deviceInfo.maxClockFrequency;
+	return false;
+}
+
+void CLHelper::selectDevices(
+	const DeviceRequirements& requirements,
+	std::vector<cl::Device>* deviceList,
+	std::vector<DeviceInfo>* deviceInfoList)
+{
+	cl_int err;
+
+	std::vector<cl::Platform> platforms;
+	err = cl::Platform::get(&platforms);
+	CHECK_OPENCL_ERROR(err, "cl::Platform::get failed");
+
+	// Gather the suitable devices of every platform, unlike findSpecifiedDevices() which stops at the first match
+	std::vector<Candidate> candidates;
+	bool allProfiled = true;
+	std::vector<cl::Platform>::iterator platform;
+	for(platform = platforms.begin(); platform != platforms.end(); platform++)
+	{
+		std::string platformVendorString;
+		platform->getInfo(CL_PLATFORM_VENDOR, &platformVendorString);
+
+		if(requirements.vendor.length() > 0 && platformVendorString.find(requirements.vendor) == std::string::npos)
+			continue;
+
+		std::vector<cl::Device> devices;
+		if(platform->getDevices(requirements.type, &devices) != CL_SUCCESS)
+			continue;
+
+		std::vector<cl::Device>::iterator device;
+		for(device = devices.begin(); device != devices.end(); device++)
+		{
+			Candidate candidate;
+			candidate.device = *device;
+			candidate.deviceInfo.setDeviceInfo(*device);
+			if(!meetsRequirements(candidate.deviceInfo, requirements))
+				continue;
+
+			candidate.profiled = deviceThroughputScore(*device, candidate.deviceInfo, requirements.ranking, &candidate.profileScore);
+			candidate.fallbackScore = (double) candidate.deviceInfo.maxComputeUnits * candidate.deviceInfo.maxClockFrequency;
+			allProfiled = allProfiled && candidate.profiled;
+			candidates.push_back(candidate);
+		}
+	}
+
+	if(candidates.empty()) {
+		std::cerr << "No devices found which match the criteria. Exiting..." << std::endl;
+		exit(1);
+	}
+
+	// Measured and estimated throughputs are not comparable, so measurements only rank if every device has one
+	std::stable_sort(candidates.begin(), candidates.end(), allProfiled ? &betterProfileScore : &betterFallbackScore);
+
+	cl_platform_id bestPlatform = candidates.front().deviceInfo.platform;
+	size_t selected = 0;
+	std::vector<Candidate>::iterator candidate;
+	for(candidate = candidates.begin(); candidate != candidates.end(); candidate++)
+	{
+		if(requirements.maxDevices > 0 && selected == requirements.maxDevices)
+			break;
+		if(requirements.samePlatform && candidate->deviceInfo.platform != bestPlatform)
+			continue;
+
+		deviceList->push_back(candidate->device);
+		deviceInfoList->push_back(candidate->deviceInfo);
+		selected++;
+	}
+}
+
+static bool betterProfileScore(const Candidate& a, const Candidate& b)
+{
+	return a.profileScore > b.profileScore;
+}
+
+static bool betterFallbackScore(const Candidate& a, const Candidate& b)
+{
+	return a.fallbackScore > b.fallbackScore;
+}
@@ -0,0 +1,55 @@
+#ifndef _DEVICESELECTOR_H
+#define _DEVICESELECTOR_H
+
+#include <vector>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	enum DeviceRanking {
+		RANK_BANDWIDTH,		/* measured triad bandwidth, for memory bound programs like the add */
+		RANK_COMPUTE		/* measured peak GFLOPS */
+	};
+
+	/* What a device must offer to be selected, and how the suitable ones are ordered */
+	struct DeviceRequirements {
+		std::string vendor;				/* substring of the platform vendor, empty for any */
+		cl_device_type type;			/* a bitfield, e.g. CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU */
+		cl_ulong minGlobalMemSize;		/* bytes */
+		cl_ulong minMaxMemAllocSize;	/* bytes */
+		int minOpenCLVersion;			/* as parseOpenCLVersion() returns, e.g. 120 */
+		bool requireDouble;
+		size_t maxDevices;				/* best ones kept, 0 for all */
+		bool samePlatform;				/* keep only the best device's platform, so all fit in one context */
+		DeviceRanking ranking;
+
+		DeviceRequirements()
+			: type(CL_DEVICE_TYPE_ALL), minGlobalMemSize(0), minMaxMemAllocSize(0), minOpenCLVersion(0),
+			  requireDouble(false), maxDevices(0), samePlatform(true), ranking(RANK_BANDWIDTH) {}
+	};
+
+	/*
+	 * Parses comma separated predicates into requirements, leaving vendor and
+	 * type alone: 'fp64', 'min-memory=<MiB>', 'min-alloc=<MiB>',
+	 * 'min-version=<major.minor>', 'count=<n>', 'all-platforms' and
+	 * 'rank=bandwidth' or 'rank=compute'.
+	 */
+	bool parseDeviceRequirements(const std::string& predicates, DeviceRequirements* requirements);
+
+	bool meetsRequirements(const DeviceInfo& deviceInfo, const DeviceRequirements& requirements);
+
+	/*
+	 * Scores the device's throughput from its roofline profile, if it has been
+	 * characterized, and by maxComputeUnits * maxClockFrequency otherwise.
+	 * Returns false for the latter, as those scores are not comparable to the former.
+	 */
+	bool deviceThroughputScore(const cl::Device& device, const DeviceInfo& deviceInfo, DeviceRanking ranking, double* score);
+
+	/* Appends every device of every platform meeting the requirements, best first. Exits if there is none. */
+	void selectDevices(
+		const DeviceRequirements& requirements,
+		std::vector<cl::Device>* deviceList,
+		std::vector<DeviceInfo>* deviceInfoList);
+};
+
+#endif
@@ -0,0 +1,763 @@
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "DeviceSort.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+/* Keys each work-item counts and scatters per pass */
+#define SORT_ITEMS_PER_WORK_ITEM 8
+
+/* Bounds of the work-group size of the sort kernels */
+#define MIN_SORT_WORK_GROUP 64
+#define MAX_SORT_WORK_GROUP 256
+
+/* Smallest size of the benchmark's size sweep */
+#define MIN_BENCHMARK_KEYS 1024
+
+#ifdef CL_VERSION_1_2
+#define LOCAL_ARRAY(bytes) cl::Local(bytes)
+#else
+#define LOCAL_ARRAY(bytes) cl::__local(bytes)
+#endif
+
+namespace pt = boost::posix_time;
+
+struct SortTimes {
+	double hostSort;
+	double poolSort;
+	double deviceWithTransfers;
+	double deviceResident;
+};
+
+template <typename Key> static void mergeSortedRuns(Key* keys, cl_uint* values, size_t count, size_t runLength);
+template <typename Key> static void sortRuns(Key* keys, size_t count, size_t runLength, size_t firstRun, size_t endRun);
+template <typename Key> static void poolSort(std::vector<Key>& keys);
+template <typename Key> static SortTimes timeSorts(CLHelper::DeviceSorter& sorter, cl::Context& context, cl::CommandQueue& commQueue, size_t count, size_t repetitions);
+static void benchmarkSortByKey(CLHelper::DeviceSorter& sorter, cl::Context& context, cl::CommandQueue& commQueue, size_t count, size_t repetitions);
+static cl_ulong nextRandom(cl_ulong* state);
+static double secondsSince(const pt::ptime& start);
+
+CLHelper::RadixShape CLHelper::chooseRadixShape(const DeviceInfo& deviceInfo, size_t maxRadixBits, size_t kernelWorkGroupSize)
+{
+	RadixShape shape;
+	shape.itemsPerWorkItem = SORT_ITEMS_PER_WORK_ITEM;
+
+	size_t workGroupLimit = std::min((size_t) deviceInfo.maxWorkGroupSize, (size_t) MAX_SORT_WORK_GROUP);
+	if(kernelWorkGroupSize > 0)
+		workGroupLimit = std::min(workGroupLimit, kernelWorkGroupSize);
+
+	size_t maxWorkGroupSize = 1;
+	while(maxWorkGroupSize * 2 <= workGroupLimit)
+		maxWorkGroupSize *= 2;
+	size_t minWorkGroupSize = std::min((size_t) MIN_SORT_WORK_GROUP, maxWorkGroupSize);
+
+	// The scatter rebases one digit per work-item, so a pass never has more digits than work-items
+	for(size_t bits = maxRadixBits; bits >= 1; bits--)
+	{
+		for(size_t workGroupSize = maxWorkGroupSize; workGroupSize >= minWorkGroupSize; workGroupSize /= 2)
+		{
+			shape.radixBits = bits;
+			shape.workGroupSize = workGroupSize;
+			if(((size_t) 1 << bits) <= workGroupSize
+					&& shape.histogramBytes() + workGroupSize * sizeof(cl_uint) <= deviceInfo.localMemSize)
+				return shape;
+		}
+	}
+
+	shape.radixBits = 1;
+	shape.workGroupSize = minWorkGroupSize;
+	return shape;
+}
+
+void CLHelper::defineRadixShape(const RadixShape& shape, size_t keyBits, Specialization* specialization)
+{
+	specialization->define("KEY_TYPE", (keyBits == 64) ? "ulong" : "uint");
+	specialization->define("RADIX_BITS", shape.radixBits);
+	specialization->define("SORT_ITEMS", shape.itemsPerWorkItem);
+}
+
+CLHelper::DeviceSorter::DeviceSorter(Runtime& runtime, size_t deviceIndex, size_t keyBits)
+	: runtime(runtime), commQueue(runtime.getQueues(deviceIndex).front()), keyBits(keyBits), keyBytes(keyBits / 8),
+	  tempKeysCapacity(0), tempValuesCapacity(0), groupCountsCapacity(0), chunkKeysCapacity(0), chunkValuesCapacity(0),
+	  headsCapacity(0), segmentStartsCapacity(0)
+{
+	cl_int err;
+
+	if(keyBits != 32 && keyBits != 64) {
+		std::cerr << "Keys of " << keyBits << " bits cannot be sorted, only 32 or 64-bit keys." << std::endl;
+		exit(1);
+	}
+
+	DeviceInfo& deviceInfo = runtime.getDeviceInfo(deviceIndex);
+	shape = chooseRadixShape(deviceInfo);
+
+	// A chunk needs its keys and values twice, and positions are cl_uints
+	size_t elementBytes = 2 * (keyBytes + sizeof(cl_uint));
+	maxChunkElements = (size_t) std::min(deviceInfo.maxMemAllocSize / keyBytes, deviceInfo.globalMemSize / 2 / elementBytes);
+	maxChunkElements = std::max(std::min(maxChunkElements, (size_t) UINT_MAX - 1), (size_t) 1);
+
+	cl::Kernel* kernels[] = { &countKernel, &scatterKernel, &scanKernel, &addKernel, &headsKernel, &startsKernel };
+	const char* kernelNames[] = { "radixCountKernel", "radixScatterKernel", "scanBlocksKernel",
+	                              "addBlockOffsetsKernel", "segmentHeadsKernel", "segmentStartsKernel" };
+	const size_t blockKernelCount = 4;		/* the kernels launched by runBlocks() with shape.workGroupSize */
+
+	// The built kernels may allow fewer work-items than the device, so shrink the shape until they all fit.
+	// Every retry has a smaller work-group, so this ends at a work-group of one work-item at worst.
+	for(;;)
+	{
+		specialization = Specialization();
+		defineRadixShape(shape, keyBits, &specialization);
+		program = runtime.getProgram("SortKernels.cl", specialization);
+
+		size_t kernelWorkGroupSize = shape.workGroupSize;
+		for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+		{
+			*kernels[i] = cl::Kernel(program, kernelNames[i], &err);
+			CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+			if(i < blockKernelCount) {
+				size_t workGroupSize;
+				err = kernels[i]->getWorkGroupInfo(runtime.getDevice(deviceIndex), CL_KERNEL_WORK_GROUP_SIZE, &workGroupSize);
+				CHECK_OPENCL_ERROR(err, "cl::Kernel::getWorkGroupInfo() failed.");
+				kernelWorkGroupSize = std::min(kernelWorkGroupSize, workGroupSize);
+			}
+		}
+
+		if(kernelWorkGroupSize >= shape.workGroupSize || shape.workGroupSize == 1)
+			break;
+		shape = chooseRadixShape(deviceInfo, 8, std::max(kernelWorkGroupSize, (size_t) 1));
+	}
+
+	runtime.prepareProgram("SortKernels.cl", reduceSpecialization(REDUCE_MIN));
+	runtime.prepareProgram("SortKernels.cl", reduceSpecialization(REDUCE_MAX));
+}
+
+void CLHelper::DeviceSorter::sort(cl::Buffer& keys, cl::Buffer* values, size_t count)
+{
+	cl_int err;
+
+	if(count <= 1)
+		return;
+
+	TRACE_SCOPE("deviceSort");
+
+	size_t radix = (size_t) 1 << shape.radixBits;
+	size_t groups = (count + shape.blockElements() - 1) / shape.blockElements();
+
+	reserve(&tempKeys, &tempKeysCapacity, count * keyBytes);
+	if(values != NULL)
+		reserve(&tempValues, &tempValuesCapacity, count * sizeof(cl_uint));
+	reserve(&groupCounts, &groupCountsCapacity, radix * groups * sizeof(cl_uint));
+
+	// Without values the key buffers stand in for them; withValues keeps the kernel off them
+	cl::Buffer* keysIn = &keys;
+	cl::Buffer* keysOut = &tempKeys;
+	cl::Buffer* valuesIn = (values != NULL) ? values : &keys;
+	cl::Buffer* valuesOut = (values != NULL) ? &tempValues : &tempKeys;
+
+	size_t passes = (keyBits + shape.radixBits - 1) / shape.radixBits;
+	for(size_t pass = 0; pass < passes; pass++)
+	{
+		cl_uint shift = (cl_uint) (pass * shape.radixBits);
+
+		err  = countKernel.setArg(0, *keysIn);
+		err |= countKernel.setArg(1, (cl_uint) count);
+		err |= countKernel.setArg(2, shift);
+		err |= countKernel.setArg(3, groupCounts);
+		err |= countKernel.setArg(4, LOCAL_ARRAY(shape.histogramBytes()));
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+		runBlocks(countKernel, count);
+
+		exclusiveScan(groupCounts, radix * groups);
+
+		err  = scatterKernel.setArg(0, *keysIn);
+		err |= scatterKernel.setArg(1, *valuesIn);
+		err |= scatterKernel.setArg(2, *keysOut);
+		err |= scatterKernel.setArg(3, *valuesOut);
+		err |= scatterKernel.setArg(4, (cl_uint) count);
+		err |= scatterKernel.setArg(5, shift);
+		err |= scatterKernel.setArg(6, (cl_uint) (values != NULL ? 1 : 0));
+		err |= scatterKernel.setArg(7, groupCounts);
+		err |= scatterKernel.setArg(8, LOCAL_ARRAY(shape.histogramBytes()));
+		err |= scatterKernel.setArg(9, LOCAL_ARRAY(shape.workGroupSize * sizeof(cl_uint)));
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+		runBlocks(scatterKernel, count);
+
+		std::swap(keysIn, keysOut);
+		std::swap(valuesIn, valuesOut);
+	}
+
+	// After an odd number of passes the sorted keys are in the temporary buffers
+	if(passes % 2 == 1) {
+		err = commQueue.enqueueCopyBuffer(tempKeys, keys, 0, 0, count * keyBytes);
+		if(values != NULL)
+			err |= commQueue.enqueueCopyBuffer(tempValues, *values, 0, 0, count * sizeof(cl_uint));
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueCopyBuffer() failed.");
+	}
+}
+
+void CLHelper::DeviceSorter::exclusiveScan(cl::Buffer& data, size_t count)
+{
+	if(count == 0)
+		return;
+
+	scanLevel(data, count, 0);
+}
+
+size_t CLHelper::DeviceSorter::reduceByKey(
+	const cl::Buffer& keys,
+	const cl::Buffer& values,
+	size_t count,
+	cl::Buffer* uniqueKeys,
+	cl::Buffer* results,
+	ReduceOperation operation)
+{
+	cl_int err;
+
+	if(count == 0)
+		return 0;
+
+	TRACE_SCOPE("reduceByKey");
+
+	// heads[count] stays 0, so the scan's last entry is the number of segments
+	reserve(&heads, &headsCapacity, (count + 1) * sizeof(cl_uint));
+	err  = headsKernel.setArg(0, keys);
+	err |= headsKernel.setArg(1, (cl_uint) count);
+	err |= headsKernel.setArg(2, heads);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	err = commQueue.enqueueNDRangeKernel(headsKernel, cl::NullRange, cl::NDRange(count + 1), cl::NullRange);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+	exclusiveScan(heads, count + 1);
+
+	cl_uint segmentCount;
+	err = commQueue.enqueueReadBuffer(heads, CL_TRUE, count * sizeof(cl_uint), sizeof(cl_uint), &segmentCount);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+	reserve(&segmentStarts, &segmentStartsCapacity, (segmentCount + 1) * sizeof(cl_uint));
+	*uniqueKeys = cl::Buffer(runtime.getContext(), CL_MEM_READ_WRITE, segmentCount * keyBytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	*results = cl::Buffer(runtime.getContext(), CL_MEM_READ_WRITE, segmentCount * sizeof(cl_float), NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	err  = startsKernel.setArg(0, keys);
+	err |= startsKernel.setArg(1, heads);
+	err |= startsKernel.setArg(2, (cl_uint) count);
+	err |= startsKernel.setArg(3, segmentStarts);
+	err |= startsKernel.setArg(4, *uniqueKeys);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	err = commQueue.enqueueNDRangeKernel(startsKernel, cl::NullRange, cl::NDRange(count), cl::NullRange);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+	reduceSegments(values, segmentStarts, segmentCount, *results, operation);
+	return segmentCount;
+}
+
+void CLHelper::DeviceSorter::reduceSegments(
+	const cl::Buffer& values,
+	const cl::Buffer& segmentStarts,
+	size_t segmentCount,
+	cl::Buffer& results,
+	ReduceOperation operation)
+{
+	cl_int err;
+
+	if(segmentCount == 0)
+		return;
+
+	cl::Program reduceProgram = runtime.getProgram("SortKernels.cl", reduceSpecialization(operation));
+	cl::Kernel reduceKernel(reduceProgram, "reduceSegmentsKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+	err  = reduceKernel.setArg(0, values);
+	err |= reduceKernel.setArg(1, segmentStarts);
+	err |= reduceKernel.setArg(2, (cl_uint) segmentCount);
+	err |= reduceKernel.setArg(3, results);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+	err = commQueue.enqueueNDRangeKernel(reduceKernel, cl::NullRange, cl::NDRange(segmentCount), cl::NullRange);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+}
+
+void CLHelper::DeviceSorter::sort(std::vector<cl_uint>& keys, std::vector<cl_uint>* values)
+{
+	if(keyBits != 32) {
+		std::cerr << "A sorter for " << keyBits << "-bit keys cannot sort 32-bit keys." << std::endl;
+		exit(1);
+	}
+
+	if(!keys.empty())
+		sortHost(&keys[0], keys.size(), values);
+}
+
+void CLHelper::DeviceSorter::sort(std::vector<cl_ulong>& keys, std::vector<cl_uint>* values)
+{
+	if(keyBits != 64) {
+		std::cerr << "A sorter for " << keyBits << "-bit keys cannot sort 64-bit keys." << std::endl;
+		exit(1);
+	}
+
+	if(!keys.empty())
+		sortHost(&keys[0], keys.size(), values);
+}
+
+size_t CLHelper::DeviceSorter::getMaxChunkElements() const
+{
+	return maxChunkElements;
+}
+
+void CLHelper::DeviceSorter::setMaxChunkElements(size_t elements)
+{
+	maxChunkElements = std::max(std::min(elements, (size_t) UINT_MAX - 1), (size_t) 1);
+}
+
+const CLHelper::RadixShape& CLHelper::DeviceSorter::getShape() const
+{
+	return shape;
+}
+
+size_t CLHelper::DeviceSorter::getKeyBits() const
+{
+	return keyBits;
+}
+
+void CLHelper::DeviceSorter::sortHost(void* keys, size_t count, std::vector<cl_uint>* values)
+{
+	if(values != NULL && values->size() != count) {
+		std::cerr << "Sorting " << count << " keys with " << values->size() << " values." << std::endl;
+		exit(1);
+	}
+
+	for(size_t first = 0; first < count; first += maxChunkElements)
+	{
+		sortChunk((char*) keys + first * keyBytes, (values != NULL) ? &(*values)[first] : NULL,
+		          std::min(maxChunkElements, count - first));
+	}
+
+	if(count <= maxChunkElements)
+		return;
+
+	cl_uint* valueData = (values != NULL) ? &(*values)[0] : NULL;
+	if(keyBits == 64)
+		mergeSortedRuns((cl_ulong*) keys, valueData, count, maxChunkElements);
+	else
+		mergeSortedRuns((cl_uint*) keys, valueData, count, maxChunkElements);
+}
+
+void CLHelper::DeviceSorter::sortChunk(char* keys, cl_uint* values, size_t count)
+{
+	cl_int err;
+
+	reserve(&chunkKeys, &chunkKeysCapacity, count * keyBytes);
+	err = commQueue.enqueueWriteBuffer(chunkKeys, CL_FALSE, 0, count * keyBytes, keys);
+	if(values != NULL) {
+		reserve(&chunkValues, &chunkValuesCapacity, count * sizeof(cl_uint));
+		err |= commQueue.enqueueWriteBuffer(chunkValues, CL_FALSE, 0, count * sizeof(cl_uint), values);
+	}
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+
+	sort(chunkKeys, (values != NULL) ? &chunkValues : NULL, count);
+
+	if(values != NULL) {
+		err = commQueue.enqueueReadBuffer(chunkValues, CL_FALSE, 0, count * sizeof(cl_uint), values);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+	}
+	err = commQueue.enqueueReadBuffer(chunkKeys, CL_TRUE, 0, count * keyBytes, keys);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+}
+
+/* Scans blocks, then the block totals one level down, then adds them back */
+void CLHelper::DeviceSorter::scanLevel(cl::Buffer& data, size_t count, size_t level)
+{
+	cl_int err;
+
+	size_t groups = (count + shape.blockElements() - 1) / shape.blockElements();
+	if(blockSums.size() <= level) {
+		blockSums.resize(level + 1);
+		blockSumsCapacity.resize(level + 1, 0);
+	}
+	reserve(&blockSums[level], &blockSumsCapacity[level], groups * sizeof(cl_uint));
+
+	// A handle of its own: the next level may grow blockSums
+	cl::Buffer levelSums = blockSums[level];
+
+	err  = scanKernel.setArg(0, data);
+	err |= scanKernel.setArg(1, (cl_uint) count);
+	err |= scanKernel.setArg(2, levelSums);
+	err |= scanKernel.setArg(3, LOCAL_ARRAY(shape.workGroupSize * sizeof(cl_uint)));
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	runBlocks(scanKernel, count);
+
+	if(groups == 1)
+		return;
+
+	scanLevel(levelSums, groups, level + 1);
+
+	err  = addKernel.setArg(0, data);
+	err |= addKernel.setArg(1, (cl_uint) count);
+	err |= addKernel.setArg(2, levelSums);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	runBlocks(addKernel, count);
+}
+
+/* One work-group per block of count elements */
+void CLHelper::DeviceSorter::runBlocks(cl::Kernel& kernel, size_t count)
+{
+	size_t groups = std::max((count + shape.blockElements() - 1) / shape.blockElements(), (size_t) 1);
+
+	cl_int err = commQueue.enqueueNDRangeKernel(kernel, cl::NullRange,
+		cl::NDRange(groups * shape.workGroupSize), cl::NDRange(shape.workGroupSize));
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+}
+
+void CLHelper::DeviceSorter::reserve(cl::Buffer* buffer, size_t* capacity, size_t bytes)
+{
+	cl_int err;
+
+	if(bytes <= *capacity)
+		return;
+
+	*buffer = cl::Buffer(runtime.getContext(), CL_MEM_READ_WRITE, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	*capacity = bytes;
+}
+
+CLHelper::Specialization CLHelper::DeviceSorter::reduceSpecialization(ReduceOperation operation) const
+{
+	Specialization reduce = specialization;
+	if(operation == REDUCE_MIN)
+		reduce.define("REDUCE_MIN");
+	else if(operation == REDUCE_MAX)
+		reduce.define("REDUCE_MAX");
+
+	return reduce;
+}
+
+void CLHelper::runSortBenchmark(Runtime& runtime, size_t count, size_t repetitions)
+{
+	cl::Context& context = runtime.getContext();
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
+	repetitions = std::max(repetitions, (size_t) 1);
+	count = std::max(count, (size_t) MIN_BENCHMARK_KEYS);
+
+	std::cout << "Sort benchmark, up to " << count << " keys, best of " << repetitions << " runs, Mkeys/s:" << std::endl;
+
+	const size_t keyBits[] = { 32, 64 };
+	for(size_t width = 0; width < sizeof(keyBits) / sizeof(keyBits[0]); width++)
+	{
+		DeviceSorter sorter(runtime, 0, keyBits[width]);
+		const RadixShape& shape = sorter.getShape();
+
+		std::cout << "  " << keyBits[width] << "-bit keys, " << shape.radixBits << " bits per pass, work-groups of "
+		          << shape.workGroupSize << " x " << shape.itemsPerWorkItem << " keys" << std::endl;
+		std::cout << "    keys, std::sort, thread pool sort, device with transfers, device resident" << std::endl;
+
+		// The size from which the device keeps beating both host sorts, transfers included
+		size_t crossover = 0;
+		for(size_t size = MIN_BENCHMARK_KEYS; ; size = std::min(size * 4, count))
+		{
+			SortTimes times = (keyBits[width] == 64)
+				? timeSorts<cl_ulong>(sorter, context, commQueue, size, repetitions)
+				: timeSorts<cl_uint>(sorter, context, commQueue, size, repetitions);
+
+			std::cout << "    " << size << ", " << size / times.hostSort / 1e6 << ", " << size / times.poolSort / 1e6
+			          << ", " << size / times.deviceWithTransfers / 1e6 << ", " << size / times.deviceResident / 1e6 << std::endl;
+
+			if(times.deviceWithTransfers < std::min(times.hostSort, times.poolSort)) {
+				if(crossover == 0)
+					crossover = size;
+			}
+			else
+				crossover = 0;
+
+			if(size == count)
+				break;
+		}
+
+		if(crossover == 0)
+			std::cout << "  The host sorts " << keyBits[width] << "-bit keys faster at every size on this device." << std::endl;
+		else
+			std::cout << "  The device sorts " << keyBits[width] << "-bit keys faster from " << crossover << " keys on." << std::endl;
+
+		if(keyBits[width] == 32)
+			benchmarkSortByKey(sorter, context, commQueue, count, repetitions);
+	}
+}
+
+/* Stable k-way merge of the sorted runs of runLength keys, and their values */
+template <typename Key>
+static void mergeSortedRuns(Key* keys, cl_uint* values, size_t count, size_t runLength)
+{
+	// Equal keys come out in the order of their runs, which keeps the merge stable
+	typedef std::pair<Key, size_t> Head;
+	std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+
+	size_t runCount = (count + runLength - 1) / runLength;
+	std::vector<size_t> positions(runCount);
+	for(size_t run = 0; run < runCount; run++)
+	{
+		positions[run] = run * runLength;
+		heads.push(Head(keys[positions[run]], run));
+	}
+
+	std::vector<Key> mergedKeys;
+	std::vector<cl_uint> mergedValues;
+	mergedKeys.reserve(count);
+	if(values != NULL)
+		mergedValues.reserve(count);
+
+	while(!heads.empty())
+	{
+		size_t run = heads.top().second;
+		mergedKeys.push_back(heads.top().first);
+		heads.pop();
+
+		size_t position = positions[run]++;
+		if(values != NULL)
+			mergedValues.push_back(values[position]);
+		if(positions[run] < std::min((run + 1) * runLength, count))
+			heads.push(Head(keys[positions[run]], run));
+	}
+
+	std::copy(mergedKeys.begin(), mergedKeys.end(), keys);
+	if(values != NULL)
+		std::copy(mergedValues.begin(), mergedValues.end(), values);
+}
+
+template <typename Key>
+static void sortRuns(Key* keys, size_t count, size_t runLength, size_t firstRun, size_t endRun)
+{
+	for(size_t run = firstRun; run < endRun; run++)
+		std::sort(keys + run * runLength, keys + std::min((run + 1) * runLength, count));
+}
+
+/* One std::sort per pool thread, then a merge of the runs */
+template <typename Key>
+static void poolSort(std::vector<Key>& keys)
+{
+	CLHelper::ThreadPool& pool = CLHelper::ThreadPool::shared();
+	size_t count = keys.size();
+	size_t runs = std::min(std::max(pool.getThreadCount(), (size_t) 1), count);
+	size_t runLength = (count + runs - 1) / runs;
+	runs = (count + runLength - 1) / runLength;		/* rounding runLength up can leave the last runs empty */
+
+	pool.parallelFor(0, runs, boost::bind(&sortRuns<Key>, &keys[0], count, runLength, _1, _2), 1);
+	if(runs > 1)
+		mergeSortedRuns(&keys[0], (cl_uint*) NULL, count, runLength);
+}
+
+/* Every sort of the same keys, with one untimed run first to build and warm up */
+template <typename Key>
+static SortTimes timeSorts(CLHelper::DeviceSorter& sorter, cl::Context& context, cl::CommandQueue& commQueue, size_t count, size_t repetitions)
+{
+	cl_int err;
+
+	std::vector<Key> unsorted(count), expected, keys;
+	cl_ulong state = 0x9E3779B97F4A7C15ULL ^ count;
+	for(size_t i = 0; i < count; i++)
+		unsorted[i] = (Key) nextRandom(&state);
+
+	size_t bytes = count * sizeof(Key);
+	cl::Buffer d_unsorted(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &unsorted[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_keys(context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	SortTimes times = { 1e30, 1e30, 1e30, 1e30 };
+	for(size_t rep = 0; rep <= repetitions; rep++)
+	{
+		expected = unsorted;
+		pt::ptime start = pt::microsec_clock::universal_time();
+		std::sort(expected.begin(), expected.end());
+		double hostSeconds = secondsSince(start);
+
+		keys = unsorted;
+		start = pt::microsec_clock::universal_time();
+		poolSort(keys);
+		double poolSeconds = secondsSince(start);
+		if(keys != expected) {
+			std::cerr << std::endl << "The thread pool sort of " << count << " keys differs from std::sort." << std::endl;
+			exit(1);
+		}
+
+		keys = unsorted;
+		start = pt::microsec_clock::universal_time();
+		sorter.sort(keys);
+		double transferSeconds = secondsSince(start);
+		if(keys != expected) {
+			std::cerr << std::endl << "The device sort of " << count << " keys differs from std::sort." << std::endl;
+			exit(1);
+		}
+
+		err = commQueue.enqueueCopyBuffer(d_unsorted, d_keys, 0, 0, bytes);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueCopyBuffer() failed.");
+		err = commQueue.finish();
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::finish() failed.");
+
+		start = pt::microsec_clock::universal_time();
+		sorter.sort(d_keys, NULL, count);
+		err = commQueue.finish();
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::finish() failed.");
+		double residentSeconds = secondsSince(start);
+
+		if(rep == 0)
+			continue;
+
+		times.hostSort = std::min(times.hostSort, hostSeconds);
+		times.poolSort = std::min(times.poolSort, poolSeconds);
+		times.deviceWithTransfers = std::min(times.deviceWithTransfers, transferSeconds);
+		times.deviceResident = std::min(times.deviceResident, residentSeconds);
+	}
+
+	err = commQueue.enqueueReadBuffer(d_keys, CL_TRUE, 0, bytes, &keys[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+	if(keys != expected) {
+		std::cerr << std::endl << "The resident device sort of " << count << " keys differs from std::sort." << std::endl;
+		exit(1);
+	}
+
+	return times;
+}
+
+/* Sort by key, reduce by key and the chunked path on 32-bit keys with many duplicates */
+static void benchmarkSortByKey(CLHelper::DeviceSorter& sorter, cl::Context& context, cl::CommandQueue& commQueue, size_t count, size_t repetitions)
+{
+	cl_int err;
+
+	std::vector<cl_uint> unsortedKeys(count), indices(count);
+	cl_ulong state = 0x2545F4914F6CDD1DULL;
+	for(size_t i = 0; i < count; i++)
+	{
+		unsortedKeys[i] = (cl_uint) (nextRandom(&state) % std::max(count / 8, (size_t) 1));
+		indices[i] = (cl_uint) i;
+	}
+
+	// Pairs with their index sort stably with std::sort, which the device sort has to match
+	double hostSeconds = 1e30, deviceSeconds = 1e30;
+	std::vector<std::pair<cl_uint, cl_uint> > pairs(count);
+	std::vector<cl_uint> keys, values;
+	for(size_t rep = 0; rep <= repetitions; rep++)
+	{
+		for(size_t i = 0; i < count; i++)
+			pairs[i] = std::make_pair(unsortedKeys[i], indices[i]);
+
+		pt::ptime start = pt::microsec_clock::universal_time();
+		std::sort(pairs.begin(), pairs.end());
+		double seconds = secondsSince(start);
+		if(rep > 0)
+			hostSeconds = std::min(hostSeconds, seconds);
+
+		keys = unsortedKeys;
+		values = indices;
+		start = pt::microsec_clock::universal_time();
+		sorter.sort(keys, &values);
+		seconds = secondsSince(start);
+		if(rep > 0)
+			deviceSeconds = std::min(deviceSeconds, seconds);
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(keys[i] != pairs[i].first || values[i] != pairs[i].second) {
+			std::cerr << std::endl << "The device sort by key differs from the stable host sort at " << i << "." << std::endl;
+			exit(1);
+		}
+	}
+
+	std::cout << "  sort by key, " << count << " pairs: host " << count / hostSeconds / 1e6
+	          << " Mpairs/s, device with transfers " << count / deviceSeconds / 1e6 << " Mpairs/s" << std::endl;
+
+	// Reduce by key over the sorted keys, with small integers so every sum is exact
+	std::vector<float> reduceValues(count);
+	for(size_t i = 0; i < count; i++)
+		reduceValues[i] = (float) (values[i] % 8);
+
+	std::vector<cl_uint> expectedKeys;
+	std::vector<float> expectedSums;
+	pt::ptime start = pt::microsec_clock::universal_time();
+	for(size_t i = 0; i < count; i++)
+	{
+		if(i == 0 || keys[i] != keys[i - 1]) {
+			expectedKeys.push_back(keys[i]);
+			expectedSums.push_back(0.0f);
+		}
+		expectedSums.back() += reduceValues[i];
+	}
+	hostSeconds = secondsSince(start);
+
+	cl::Buffer d_keys(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, count * sizeof(cl_uint), &keys[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_values(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, count * sizeof(cl_float), &reduceValues[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	cl::Buffer d_uniqueKeys, d_sums;
+	size_t segmentCount = 0;
+	deviceSeconds = 1e30;
+	for(size_t rep = 0; rep <= repetitions; rep++)
+	{
+		start = pt::microsec_clock::universal_time();
+		segmentCount = sorter.reduceByKey(d_keys, d_values, count, &d_uniqueKeys, &d_sums);
+		err = commQueue.finish();
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::finish() failed.");
+		double seconds = secondsSince(start);
+		if(rep > 0)
+			deviceSeconds = std::min(deviceSeconds, seconds);
+	}
+
+	std::vector<cl_uint> uniqueKeys(segmentCount);
+	std::vector<float> sums(segmentCount);
+	if(segmentCount == expectedKeys.size()) {
+		err  = commQueue.enqueueReadBuffer(d_uniqueKeys, CL_TRUE, 0, segmentCount * sizeof(cl_uint), &uniqueKeys[0]);
+		err |= commQueue.enqueueReadBuffer(d_sums, CL_TRUE, 0, segmentCount * sizeof(cl_float), &sums[0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+	}
+	if(uniqueKeys != expectedKeys || sums != expectedSums) {
+		std::cerr << std::endl << "The device reduce by key differs from the host reduction." << std::endl;
+		exit(1);
+	}
+
+	std::cout << "  reduce by key, " << segmentCount << " keys: host " << count / hostSeconds / 1e6
+	          << " Mvalues/s, device resident " << count / deviceSeconds / 1e6 << " Mvalues/s" << std::endl;
+
+	// The chunked path for arrays bigger than the device, here four chunks
+	size_t maxChunkElements = sorter.getMaxChunkElements();
+	sorter.setMaxChunkElements((count + 3) / 4);
+
+	std::vector<cl_uint> expected = unsortedKeys;
+	start = pt::microsec_clock::universal_time();
+	std::sort(expected.begin(), expected.end());
+	hostSeconds = secondsSince(start);
+
+	keys = unsortedKeys;
+	start = pt::microsec_clock::universal_time();
+	sorter.sort(keys);
+	deviceSeconds = secondsSince(start);
+	sorter.setMaxChunkElements(maxChunkElements);
+
+	if(keys != expected) {
+		std::cerr << std::endl << "The chunked device sort differs from std::sort." << std::endl;
+		exit(1);
+	}
+
+	std::cout << "  chunked sort, 4 chunks of " << (count + 3) / 4 << " keys: host " << count / hostSeconds / 1e6
+	          << " Mkeys/s, device " << count / deviceSeconds / 1e6 << " Mkeys/s" << std::endl;
+}
+
+/* xorshift64* */
+static cl_ulong nextRandom(cl_ulong* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static double secondsSince(const pt::ptime& start)
+{
+	return (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
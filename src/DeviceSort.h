@@ -0,0 +1,128 @@
+#ifndef _DEVICESORT_H
+#define _DEVICESORT_H
+
+#include <vector>
+#include "CLHelper.h"
+#include "KernelSpecializer.h"
+#include "Runtime.h"
+
+namespace CLHelper
+{
+	enum ReduceOperation {
+		REDUCE_SUM,
+		REDUCE_MIN,
+		REDUCE_MAX
+	};
+
+	/* How one device runs the radix passes of SortKernels.cl */
+	struct RadixShape {
+		size_t radixBits;			/* bits sorted per pass */
+		size_t workGroupSize;
+		size_t itemsPerWorkItem;
+
+		size_t blockElements() const { return workGroupSize * itemsPerWorkItem; }
+		size_t histogramBytes() const { return ((size_t) 1 << radixBits) * workGroupSize * sizeof(cl_uint); }
+	};
+
+	/*
+	 * Picks the most bits per pass whose histogram, one column of 2^bits
+	 * counters per work-item, fits localMemSize next to the scan scratch,
+	 * with a work-group of at least 64 work-items where the device allows.
+	 * Fewer passes mean fewer trips through global memory. A non-zero
+	 * kernelWorkGroupSize, the built kernels' CL_KERNEL_WORK_GROUP_SIZE,
+	 * further caps the work-group.
+	 */
+	RadixShape chooseRadixShape(const DeviceInfo& deviceInfo, size_t maxRadixBits = 8, size_t kernelWorkGroupSize = 0);
+
+	/* Defines KEY_TYPE, RADIX_BITS and SORT_ITEMS for SortKernels.cl */
+	void defineRadixShape(const RadixShape& shape, size_t keyBits, Specialization* specialization);
+
+	/*
+	 * Stable LSD radix sort, sort-by-key, exclusive scan and segmented
+	 * reductions on one device of a runtime, for 32 or 64-bit keys and
+	 * cl_uint values. Commands on device buffers are enqueued on the device's
+	 * first queue and only reduceByKey() waits for them; host arrays too big
+	 * for the device are sorted chunk by chunk and the sorted chunks merged on
+	 * the host.
+	 */
+	class DeviceSorter {
+
+	public:
+		DeviceSorter(Runtime& runtime, size_t deviceIndex = 0, size_t keyBits = 32);
+
+		void sort(cl::Buffer& keys, cl::Buffer* values, size_t count);
+
+		/* In place, count cl_uints */
+		void exclusiveScan(cl::Buffer& data, size_t count);
+
+		/*
+		 * Reduces the cl_float values of every run of equal keys, which sorted
+		 * keys have one of per distinct key. uniqueKeys and results receive
+		 * one entry per run; returns the number of runs.
+		 */
+		size_t reduceByKey(
+			const cl::Buffer& keys,
+			const cl::Buffer& values,
+			size_t count,
+			cl::Buffer* uniqueKeys,
+			cl::Buffer* results,
+			ReduceOperation operation = REDUCE_SUM);
+
+		/* Segment s is [segmentStarts[s], segmentStarts[s + 1]) */
+		void reduceSegments(
+			const cl::Buffer& values,
+			const cl::Buffer& segmentStarts,
+			size_t segmentCount,
+			cl::Buffer& results,
+			ReduceOperation operation = REDUCE_SUM);
+
+		/* Host arrays of any size, with keys of the sorter's width */
+		void sort(std::vector<cl_uint>& keys, std::vector<cl_uint>* values = NULL);
+		void sort(std::vector<cl_ulong>& keys, std::vector<cl_uint>* values = NULL);
+
+		/* Largest chunk sorted on the device at once, from its memory unless set */
+		size_t getMaxChunkElements() const;
+		void setMaxChunkElements(size_t elements);
+
+		const RadixShape& getShape() const;
+		size_t getKeyBits() const;
+
+	private:
+		DeviceSorter(const DeviceSorter&);
+		DeviceSorter& operator=(const DeviceSorter&);
+
+		void sortHost(void* keys, size_t count, std::vector<cl_uint>* values);
+		void sortChunk(char* keys, cl_uint* values, size_t count);
+		void scanLevel(cl::Buffer& data, size_t count, size_t level);
+		void runBlocks(cl::Kernel& kernel, size_t count);
+		void reserve(cl::Buffer* buffer, size_t* capacity, size_t bytes);
+		Specialization reduceSpecialization(ReduceOperation operation) const;
+
+		Runtime& runtime;
+		cl::CommandQueue commQueue;
+		size_t keyBits;
+		size_t keyBytes;
+		RadixShape shape;
+		size_t maxChunkElements;
+
+		Specialization specialization;
+		cl::Program program;
+		cl::Kernel countKernel, scatterKernel, scanKernel, addKernel, headsKernel, startsKernel;
+
+		// Scratch buffers, grown on demand and reused by later calls
+		cl::Buffer tempKeys, tempValues, groupCounts, chunkKeys, chunkValues, heads, segmentStarts;
+		size_t tempKeysCapacity, tempValuesCapacity, groupCountsCapacity, chunkKeysCapacity, chunkValuesCapacity, headsCapacity, segmentStartsCapacity;
+		std::vector<cl::Buffer> blockSums;		/* one per level of exclusiveScan() */
+		std::vector<size_t> blockSumsCapacity;
+	};
+
+	/*
+	 * Times 32 and 64-bit key sorts on the runtime's first device against
+	 * std::sort and a thread pool sort on the host for growing sizes up to
+	 * count, and reports where the device starts to win. Also times sort by
+	 * key, reduce by key and the chunked path.
+	 */
+	void runSortBenchmark(Runtime& runtime, size_t count, size_t repetitions);
+};
+
+#endif
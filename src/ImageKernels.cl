@@ -0,0 +1,86 @@
+// Bilinear gathers from a single channel float source, kept either in an image
+// (-D IMAGE_BACKING), where the texture cache and sampler do the work, or in a
+// row major buffer, interpolated by hand. Both clamp to the edge, so they agree
+// up to the sampler's reduced precision interpolation weights.
+// -D MANUAL_FILTER makes images interpolate by hand as well, for devices that
+// cannot filter float images linearly.
+
+#ifdef IMAGE_BACKING
+// A macro rather than a typedef, image types take no typedef with an access qualifier
+#define Source __read_only image2d_t
+
+__constant sampler_t nearestSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+__constant sampler_t linearSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+float loadTexel(Source source, unsigned int width, int x, int y)
+{
+	return read_imagef(source, nearestSampler, (int2) (x, y)).x;
+}
+#else
+#define Source __global const float*
+
+float loadTexel(Source source, unsigned int width, int x, int y)
+{
+	return source[y * width + x];
+}
+#endif
+
+// Samples at (x, y) in texel units, texel centers at whole numbers
+float sampleBilinear(Source source, unsigned int width, unsigned int height, float x, float y)
+{
+#if defined(IMAGE_BACKING) && !defined(MANUAL_FILTER)
+	return read_imagef(source, linearSampler, (float2) (x + 0.5f, y + 0.5f)).x;
+#else
+	x = clamp(x, 0.0f, (float) (width - 1));
+	y = clamp(y, 0.0f, (float) (height - 1));
+
+	int x0 = (int) x;
+	int y0 = (int) y;
+	int x1 = min(x0 + 1, (int) width - 1);
+	int y1 = min(y0 + 1, (int) height - 1);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	float top = mix(loadTexel(source, width, x0, y0), loadTexel(source, width, x1, y0), fx);
+	float bottom = mix(loadTexel(source, width, x0, y1), loadTexel(source, width, x1, y1), fx);
+	return mix(top, bottom, fy);
+#endif
+}
+
+// Scales the source to outWidth x outHeight
+__kernel
+void resampleKernel(Source source, unsigned int width, unsigned int height, __global float* output, unsigned int outWidth, unsigned int outHeight)
+{
+	unsigned int x = get_global_id(0);
+	unsigned int y = get_global_id(1);
+
+	if(x >= outWidth || y >= outHeight)
+		return;
+
+	float sourceX = (x + 0.5f) * width / outWidth - 0.5f;
+	float sourceY = (y + 0.5f) * height / outHeight - 0.5f;
+	output[y * outWidth + x] = sampleBilinear(source, width, height, sourceX, sourceY);
+}
+
+// Rotates the source by angle radians around its center, increasing the
+// rotation with the distance from the center by twist radians per texel, so
+// neighbouring work-items gather from increasingly distant rows
+__kernel
+void swirlKernel(Source source, unsigned int width, unsigned int height, __global float* output, float angle, float twist)
+{
+	unsigned int x = get_global_id(0);
+	unsigned int y = get_global_id(1);
+
+	if(x >= width || y >= height)
+		return;
+
+	float centerX = 0.5f * (width - 1);
+	float centerY = 0.5f * (height - 1);
+	float dx = x - centerX;
+	float dy = y - centerY;
+	float rotation = angle + twist * sqrt(dx * dx + dy * dy);
+
+	float cosine;
+	float sine = sincos(rotation, &cosine);
+	output[y * width + x] = sampleBilinear(source, width, height, centerX + cosine * dx - sine * dy, centerY + sine * dx + cosine * dy);
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <sstream>
+#include "JobClient.h"
+
+CLHelper::JobClient::JobClient()
+	: socket(ioService)
+{
+}
+
+bool CLHelper::JobClient::connect(const std::string& socketPath)
+{
+	boost::system::error_code ec;
+	socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath), ec);
+	if(ec) {
+		std::cerr << "Unable to connect to \"" << socketPath << "\": " << ec.message() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool CLHelper::JobClient::submitAdd(const std::string& tenant, size_t dataSize, JobResult* result, StorageFormat format)
+{
+	std::ostringstream line;
+	line << "ADD " << tenant << " " << dataSize;
+	if(format != STORAGE_FLOAT)
+		line << " " << storageFormatToString(format);
+	line << "\n";
+
+	std::string reply;
+	if(!request(line.str(), &reply))
+		return false;
+
+	return parseJobResult(reply, result);
+}
+
+bool CLHelper::JobClient::attachArena(const std::string& arenaName, const std::string& tenant)
+{
+	std::string reply;
+	return request("ATTACH " + arenaName + " " + tenant + "\n", &reply) && reply == "ATTACHED";
+}
+
+bool CLHelper::JobClient::detachArena(const std::string& arenaName)
+{
+	std::string reply;
+	return request("DETACH " + arenaName + "\n", &reply) && reply == "DETACHED";
+}
+
+bool CLHelper::JobClient::getStats(std::string* stats)
+{
+	return request("STATS\n", stats);
+}
+
+bool CLHelper::JobClient::shutdownServer()
+{
+	std::string reply;
+	return request("SHUTDOWN\n", &reply) && reply == "BYE";
+}
+
+bool CLHelper::JobClient::request(const std::string& line, std::string* reply)
+{
+	boost::system::error_code ec;
+	boost::asio::write(socket, boost::asio::buffer(line), ec);
+	if(ec)
+		return false;
+
+	boost::asio::read_until(socket, replyBuffer, '\n', ec);
+	if(ec)
+		return false;
+
+	std::istream replyStream(&replyBuffer);
+	std::getline(replyStream, *reply);
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#ifndef _JOBCLIENT_H
+#define _JOBCLIENT_H
+
+#include <boost/asio.hpp>
+#include "JobProtocol.h"
+#include "StorageFormat.h"
+
+namespace CLHelper
+{
+	/* Blocking client for the job server, one outstanding request per client */
+	class JobClient {
+
+	public:
+		JobClient();
+
+		bool connect(const std::string& socketPath);
+		bool submitAdd(const std::string& tenant, size_t dataSize, JobResult* result, StorageFormat format = STORAGE_FLOAT);
+		bool attachArena(const std::string& arenaName, const std::string& tenant);
+		bool detachArena(const std::string& arenaName);
+		bool getStats(std::string* stats);
+		bool shutdownServer();
+
+	private:
+		bool request(const std::string& line, std::string* reply);
+
+		boost::asio::io_service ioService;
+		boost::asio::local::stream_protocol::socket socket;
+		boost::asio::streambuf replyBuffer;
+	};
+};
+
+#endif
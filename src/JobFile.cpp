@@ -0,0 +1,233 @@
+#include <climits>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <boost/shared_ptr.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include "DeviceSelector.h"
+#include "JobFile.h"
+
+typedef cl_int (*JobProgram)(CLHelper::Runtime& runtime, const JobSpec& job);
+
+static bool applyJobTree(const boost::property_tree::ptree& tree, JobSpec* job);
+static JobProgram findJobProgram(const std::string& program);
+static cl_int runSimpleAddJob(CLHelper::Runtime& runtime, const JobSpec& job);
+static cl_int runTransferBenchmarkJob(CLHelper::Runtime& runtime, const JobSpec& job);
+static cl_int runPersistentBenchmarkJob(CLHelper::Runtime& runtime, const JobSpec& job);
+
+bool DeviceSelection::operator<(const DeviceSelection& other) const
+{
+	if(vendor != other.vendor)
+		return vendor < other.vendor;
+	if(type != other.type)
+		return type < other.type;
+	if(id != other.id)
+		return id < other.id;
+	if(select != other.select)
+		return select < other.select;
+	return partition < other.partition;
+}
+
+bool loadJobFile(const std::string& path, const JobSpec& defaults, std::vector<JobSpec>* jobs)
+{
+	boost::property_tree::ptree tree;
+	try {
+		boost::property_tree::read_json(path, tree);
+	}
+	catch(boost::property_tree::ptree_error& e) {
+		std::cerr << "Unreadable job file \"" << path << "\": " << e.what() << std::endl;
+		return false;
+	}
+
+	JobSpec fileDefaults = defaults;
+	boost::optional<boost::property_tree::ptree&> defaultsTree = tree.get_child_optional("defaults");
+	if(defaultsTree && !applyJobTree(*defaultsTree, &fileDefaults))
+		return false;
+
+	boost::optional<boost::property_tree::ptree&> jobsTree = tree.get_child_optional("jobs");
+	if(!jobsTree || jobsTree->empty()) {
+		std::cerr << "Job file \"" << path << "\" has no jobs" << std::endl;
+		return false;
+	}
+
+	boost::property_tree::ptree::const_iterator entry;
+	for(entry = jobsTree->begin(); entry != jobsTree->end(); entry++)
+	{
+		JobSpec job = fileDefaults;
+		std::ostringstream defaultName;
+		defaultName << "job" << jobs->size();
+		job.name = defaultName.str();
+
+		if(!applyJobTree(entry->second, &job))
+			return false;
+		jobs->push_back(job);
+	}
+
+	return true;
+}
+
+size_t runJobs(const std::vector<JobSpec>& jobs)
+{
+	std::map<DeviceSelection, boost::shared_ptr<CLHelper::Runtime> > runtimes;
+	size_t failedJobs = 0;
+
+	for(size_t jobIndex = 0; jobIndex < jobs.size(); jobIndex++)
+	{
+		const JobSpec& job = jobs[jobIndex];
+
+		std::cout << std::endl;
+		std::cout << "Job " << job.name << " (" << job.program << ", " << jobIndex + 1 << " of " << jobs.size() << ")" << std::endl;
+
+		// Jobs on the same devices share the context, queues and compiled programs
+		boost::shared_ptr<CLHelper::Runtime>& runtime = runtimes[job.device];
+		if(!runtime) {
+			std::vector<cl::Device> deviceList;
+			std::vector<CLHelper::DeviceInfo> deviceInfoList;
+			cl_device_type type = CLHelper::deviceStringToType(job.device.type);
+			if(job.device.select.length() > 0) {
+				CLHelper::DeviceRequirements requirements;
+				requirements.vendor = job.device.vendor;
+				requirements.type = (type == CL_DEVICE_TYPE_DEFAULT) ? CL_DEVICE_TYPE_ALL : type;
+				CLHelper::parseDeviceRequirements(job.device.select, &requirements);
+				CLHelper::selectDevices(requirements, &deviceList, &deviceInfoList);
+			}
+			else
+				CLHelper::findSpecifiedDevices(job.device.vendor, type, job.device.id, &deviceList, &deviceInfoList);
+			if(job.device.partition.length() > 0)
+				CLHelper::partitionDevices(job.device.partition, &deviceList, &deviceInfoList);
+
+			std::cout << "Selected devices:" << std::endl;
+			CLHelper::printDeviceInfoList(deviceInfoList);
+
+			// Profiling gives the per-repetition kernel times
+			runtime.reset(new CLHelper::Runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE));
+		}
+
+		if(findJobProgram(job.program)(*runtime, job) != CL_SUCCESS)
+			failedJobs++;
+	}
+
+	return failedJobs;
+}
+
+// Overrides the fields of job given in tree, leaving the others alone
+static bool applyJobTree(const boost::property_tree::ptree& tree, JobSpec* job)
+{
+	try {
+		job->name = tree.get("name", job->name);
+
+		job->program = tree.get("program", job->program);
+		if(!findJobProgram(job->program)) {
+			std::cerr << "Job " << job->name << ": unknown program \"" << job->program << "\"" << std::endl;
+			return false;
+		}
+
+		// Read as a double so that a negative size is not wrapped around by the conversion
+		SimpleAddOptions& add = job->add;
+		boost::optional<const boost::property_tree::ptree&> sizeTree = tree.get_child_optional("size");
+		if(sizeTree) {
+			double size = sizeTree->get_value<double>();
+			if(size < 1 || size > UINT_MAX || size != std::floor(size)) {
+				std::cerr << "Job " << job->name << ": size must be an integer between 1 and " << UINT_MAX << std::endl;
+				return false;
+			}
+			add.dataSize = (size_t) size;
+		}
+		add.repetitions = tree.get("repetitions", add.repetitions);
+
+		// The add always computes in float, so the element type is the storage format
+		boost::optional<std::string> elementType = tree.get_optional<std::string>("elementType");
+		if(elementType && !CLHelper::storageFormatFromString(*elementType, &add.storageFormat)) {
+			std::cerr << "Job " << job->name << ": invalid element type \"" << *elementType << "\"" << std::endl;
+			return false;
+		}
+
+		const char* inputNames[] = { "inputs.a", "inputs.b" };
+		InputSource* inputs[] = { &add.inputA, &add.inputB };
+		for(int i = 0; i < 2; i++)
+		{
+			boost::optional<std::string> input = tree.get_optional<std::string>(inputNames[i]);
+			if(input && !parseInputSource(*input, inputs[i])) {
+				std::cerr << "Job " << job->name << ": invalid input \"" << *input << "\"" << std::endl;
+				return false;
+			}
+		}
+
+		DeviceSelection& device = job->device;
+		device.vendor = tree.get("device.vendor", device.vendor);
+		if(device.vendor.compare("AMD") == 0)
+			device.vendor = "Advanced Micro Devices, Inc.";
+		device.type = tree.get("device.type", device.type);
+		device.id = tree.get("device.id", device.id);
+		device.select = tree.get("device.select", device.select);
+		device.partition = tree.get("device.partition", device.partition);
+
+		CLHelper::DeviceRequirements requirements;
+		if(!CLHelper::parseDeviceRequirements(device.select, &requirements)) {
+			std::cerr << "Job " << job->name << ": invalid device predicates \"" << device.select << "\"" << std::endl;
+			return false;
+		}
+
+		add.workGroupSize = tree.get("tuning.workGroupSize", add.workGroupSize);
+		add.specialize = tree.get("tuning.specialize", add.specialize);
+		add.fastMath = tree.get("tuning.fastMath", add.fastMath);
+		boost::optional<std::string> transfer = tree.get_optional<std::string>("tuning.transfer");
+		if(transfer && !CLHelper::parseTransferStrategy(*transfer, &add.transferStrategy)) {
+			std::cerr << "Job " << job->name << ": invalid transfer strategy \"" << *transfer << "\"" << std::endl;
+			return false;
+		}
+
+		boost::optional<std::string> validationMode = tree.get_optional<std::string>("validation.mode");
+		if(validationMode && !CLHelper::validationModeFromString(*validationMode, &add.validation.mode)) {
+			std::cerr << "Job " << job->name << ": invalid validation mode \"" << *validationMode << "\"" << std::endl;
+			return false;
+		}
+		add.validation.sampleFraction = tree.get("validation.sampleFraction", add.validation.sampleFraction);
+		boost::optional<std::string> tolerances = tree.get_optional<std::string>("validation.tolerance");
+		if(tolerances && !CLHelper::parseTolerances(*tolerances, &add.validation)) {
+			std::cerr << "Job " << job->name << ": invalid tolerances \"" << *tolerances << "\"" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+	catch(boost::property_tree::ptree_error& e) {
+		std::cerr << "Job " << job->name << ": " << e.what() << std::endl;
+		return false;
+	}
+}
+
+static JobProgram findJobProgram(const std::string& program)
+{
+	if(program == "simple-add")
+		return &runSimpleAddJob;
+	if(program == "benchmark-transfers")
+		return &runTransferBenchmarkJob;
+	if(program == "benchmark-persistent")
+		return &runPersistentBenchmarkJob;
+
+	return NULL;
+}
+
+static cl_int runSimpleAddJob(CLHelper::Runtime& runtime, const JobSpec& job)
+{
+	return runSimpleAdd(runtime, job.add);
+}
+
+// The benchmarks compare ways of setting up a context, so they still create their own
+static cl_int runTransferBenchmarkJob(CLHelper::Runtime& runtime, const JobSpec& job)
+{
+	std::vector<cl::Device> deviceList(1, runtime.getDevice(0));
+	std::vector<CLHelper::DeviceInfo> deviceInfoList(1, runtime.getDeviceInfo(0));
+
+	return runTransferBenchmark(deviceList, deviceInfoList, job.add.repetitions);
+}
+
+static cl_int runPersistentBenchmarkJob(CLHelper::Runtime& runtime, const JobSpec& job)
+{
+	std::vector<cl::Device> deviceList(1, runtime.getDevice(0));
+	std::vector<CLHelper::DeviceInfo> deviceInfoList(1, runtime.getDeviceInfo(0));
+
+	return runPersistentBenchmark(deviceList, deviceInfoList, job.add.repetitions);
+}
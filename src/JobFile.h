@@ -0,0 +1,49 @@
+#ifndef _JOBFILE_H
+#define _JOBFILE_H
+
+#include <string>
+#include <vector>
+#include "SimpleAddProgram.h"
+
+/* Which devices a job runs on, as given on the command line */
+struct DeviceSelection {
+	std::string vendor;
+	std::string type;			/* 'GPU', 'CPU', 'ALL' or 'DEFAULT' */
+	cl_int id;					/* ignored if select is given */
+	std::string select;			/* predicates as for --select, empty for the device with the id */
+	std::string partition;		/* see --partition, empty for the whole device */
+
+	DeviceSelection() : type("DEFAULT"), id(0) {}
+
+	bool operator<(const DeviceSelection& other) const;
+};
+
+struct JobSpec {
+	std::string name;
+	std::string program;		/* 'simple-add', 'benchmark-transfers' or 'benchmark-persistent' */
+	DeviceSelection device;
+	SimpleAddOptions add;		/* the benchmarks use add.repetitions as their iteration count */
+
+	JobSpec() : program("simple-add") {}
+};
+
+/*
+ * Reads a JSON job file of the form
+ *
+ * {
+ *   "defaults": { <job fields> },
+ *   "jobs": [ { "name": "half-random", <job fields> }, ... ]
+ * }
+ *
+ * where the job fields are "program", "elementType", "size", "repetitions",
+ * "inputs": { "a", "b" }, "device": { "vendor", "type", "id", "select", "partition" },
+ * "tuning": { "workGroupSize", "transfer", "specialize", "fastMath" } and
+ * "validation": { "mode", "sampleFraction", "tolerance" }. Fields missing from a
+ * job are taken from "defaults", then from the given defaults.
+ */
+bool loadJobFile(const std::string& path, const JobSpec& defaults, std::vector<JobSpec>* jobs);
+
+/* Runs the jobs in order, keeping one warm runtime per device selection. Returns the number of failed jobs. */
+size_t runJobs(const std::vector<JobSpec>& jobs);
+
+#endif
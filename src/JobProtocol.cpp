@@ -0,0 +1,45 @@
+#include <sstream>
+#include "JobProtocol.h"
+
+CLHelper::JobResult::JobResult()
+	: accepted(false), jobId(0), deviceIndex(0), queueMs(0), executeMs(0), totalMs(0), lastValue(0)
+{
+}
+
+std::string CLHelper::formatJobResult(const JobResult& result)
+{
+	std::ostringstream line;
+	if(result.accepted) {
+		line << "OK " << result.jobId << " " << result.deviceIndex << " "
+		     << result.queueMs << " " << result.executeMs << " " << result.totalMs << " "
+		     << result.lastValue;
+	}
+	else {
+		line << "REJECTED " << result.message;
+	}
+	line << "\n";
+
+	return line.str();
+}
+
+bool CLHelper::parseJobResult(const std::string& line, JobResult* result)
+{
+	std::istringstream lineStream(line);
+	std::string status;
+	lineStream >> status;
+
+	if(status == "OK") {
+		result->accepted = true;
+		lineStream >> result->jobId >> result->deviceIndex
+		           >> result->queueMs >> result->executeMs >> result->totalMs
+		           >> result->lastValue;
+		return !lineStream.fail();
+	}
+	else if(status == "REJECTED") {
+		result->accepted = false;
+		std::getline(lineStream >> std::ws, result->message);
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,39 @@
+#ifndef _JOBPROTOCOL_H
+#define _JOBPROTOCOL_H
+
+#include <string>
+
+// Line based protocol spoken over the job server's Unix socket:
+//
+//   ADD <tenant> <dataSize> [<storage>]
+//                              -> OK <jobId> <device> <queueMs> <executeMs> <totalMs> <lastValue>
+//                              -> REJECTED <reason>
+//                                 <storage> is float (default), half, bf16 or int8
+//   ATTACH <arena> <tenant>    -> ATTACHED, after which jobs go through the arena's rings
+//                              -> ERROR when the arena cannot be opened or is attached already
+//   DETACH <arena>             -> DETACHED, the server stops polling the arena; closing the
+//                                 connection that attached it does the same
+//                              -> ERROR when this connection did not attach the arena
+//   STATS                      -> STATS <key>=<value> ...
+//   SHUTDOWN                   -> BYE
+
+namespace CLHelper
+{
+	struct JobResult {
+		bool accepted;
+		std::string message;		/* reason for a rejection */
+		unsigned long jobId;
+		size_t deviceIndex;
+		double queueMs;				/* time from submission until a device picked the job up */
+		double executeMs;			/* time spent on the device, including transfers */
+		double totalMs;
+		float lastValue;			/* last element of the result, as a cheap check */
+
+		JobResult();
+	};
+
+	std::string formatJobResult(const JobResult& result);
+	bool parseJobResult(const std::string& line, JobResult* result);
+};
+
+#endif
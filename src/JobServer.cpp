@@ -0,0 +1,661 @@
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <sstream>
+#include <boost/bind/bind.hpp>
+#include "JobServer.h"
+#include "Metrics.h"
+
+namespace pt = boost::posix_time;
+
+#define ARENA_SPIN_POLLS 10000		/* empty polls of a request ring before the poller starts sleeping */
+#define ARENA_IDLE_SLEEP_US 50
+#define ARENA_COMPLETION_TIMEOUT_MS 1000	/* longest a full completion ring is waited on before its arena is detached */
+#define WORKER_WAKEUP_MS 250		/* longest a worker sleeps before asking the monitor again, so a readmitted device gets work */
+
+/* Fails the job instead of the server, inside executeAdd's do/while(false) block */
+#define CHECK_JOB_ERROR(actual, call) \
+	if(actual != CL_SUCCESS) \
+	{ \
+		failedCall = call; \
+		break; \
+	}
+
+static double millisecondsSince(const pt::ptime& start)
+{
+	return (pt::microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+CLHelper::JobServer::JobServer(Runtime& runtime, const std::string& socketPath, const JobServerOptions& options)
+	: runtime(runtime),
+	  socketPath(socketPath),
+	  options(options),
+	  acceptor(ioService),
+	  queuedJobs(0),
+	  nextJobId(1),
+	  stopping(false),
+	  completedJobs(0),
+	  rejectedJobs(0),
+	  failedJobs(0),
+	  monitor(runtime.getDeviceCount(), options.monitor)
+{
+	for(size_t deviceIndex = 0; deviceIndex < runtime.getDeviceCount(); deviceIndex++)
+	{
+		memoryBudget.push_back((cl_ulong) (runtime.getDeviceInfo(deviceIndex).globalMemSize * options.memoryFraction));
+		reservedMemory.push_back(0);
+		completedPerDevice.push_back(0);
+	}
+}
+
+CLHelper::JobServer::~JobServer()
+{
+	stop();
+	workers.join_all();
+}
+
+void CLHelper::JobServer::run()
+{
+	// One worker per command queue, so every queue of every device is kept busy
+	for(size_t deviceIndex = 0; deviceIndex < runtime.getDeviceCount(); deviceIndex++)
+	{
+		for(size_t queueIndex = 0; queueIndex < runtime.getQueues(deviceIndex).size(); queueIndex++)
+			workers.create_thread(boost::bind(&JobServer::workerLoop, this, deviceIndex, queueIndex));
+	}
+
+	::unlink(socketPath.c_str());
+	boost::asio::local::stream_protocol::endpoint endpoint(socketPath);
+	acceptor.open(endpoint.protocol());
+	acceptor.bind(endpoint);
+	acceptor.listen();
+
+	std::cout << "Serving jobs on " << socketPath << " with " << workers.size() << " workers" << std::endl;
+
+	startAccept();
+	ioService.run();
+
+	boost::system::error_code ec;
+	acceptor.close(ec);
+
+	workers.join_all();
+	::unlink(socketPath.c_str());
+}
+
+void CLHelper::JobServer::stop()
+{
+	std::vector<JobPtr> abandonedJobs;
+	{
+		boost::mutex::scoped_lock lock(schedulerMutex);
+		if(stopping)
+			return;
+		stopping = true;
+
+		std::map<std::string, std::deque<JobPtr> >::iterator tenant;
+		for(tenant = tenantQueues.begin(); tenant != tenantQueues.end(); tenant++)
+			abandonedJobs.insert(abandonedJobs.end(), tenant->second.begin(), tenant->second.end());
+		tenantQueues.clear();
+		queuedJobs = 0;
+	}
+	jobAvailable.notify_all();
+
+	// Jobs that never reached a device are answered instead of left waiting
+	std::vector<JobPtr>::iterator job;
+	for(job = abandonedJobs.begin(); job != abandonedJobs.end(); job++)
+	{
+		JobResult result;
+		result.message = "server is shutting down";
+		if((*job)->onComplete)
+			(*job)->onComplete(result);
+		else
+			(*job)->promise.set_value(result);
+	}
+
+	ioService.stop();
+}
+
+CLHelper::JobResult CLHelper::JobServer::submitAdd(const std::string& tenant, size_t dataSize, StorageFormat storageFormat)
+{
+	JobPtr job(new Job());
+	job->tenant = tenant;
+	job->dataSize = dataSize;
+	job->storageFormat = storageFormat;
+
+	JobResult rejection;
+	if(!enqueueJob(job, &rejection))
+		return rejection;
+
+	boost::unique_future<JobResult> future = job->promise.get_future();
+	return future.get();
+}
+
+bool CLHelper::JobServer::attachArena(const std::string& arenaName, const std::string& tenant)
+{
+	// The request ring has a single consumer, so an arena gets one poller however often it is attached
+	boost::mutex::scoped_lock lock(schedulerMutex);
+	if(attachedArenas.count(arenaName) > 0)
+		return false;
+
+	AttachmentPtr attachment(new ArenaAttachment());
+	attachment->arena.reset(new SharedArena());
+	if(!attachment->arena->open(arenaName))
+		return false;
+
+	attachedArenas[arenaName] = attachment;
+	workers.create_thread(boost::bind(&JobServer::pollArena, this, attachment, tenant));
+	return true;
+}
+
+// The poller notices on its next poll, forgets the arena and ends. The arena stays mapped
+// until the jobs already taken from it are done.
+bool CLHelper::JobServer::detachArena(const std::string& arenaName)
+{
+	boost::mutex::scoped_lock lock(schedulerMutex);
+	std::map<std::string, AttachmentPtr>::iterator attached = attachedArenas.find(arenaName);
+	if(attached == attachedArenas.end() || attached->second->detached)
+		return false;
+
+	attached->second->detached = true;
+	return true;
+}
+
+// Checks a job against the admission limits and queues it for its tenant
+bool CLHelper::JobServer::enqueueJob(JobPtr job, JobResult* rejection)
+{
+	// Kernels take the size as a cl_uint. Below that limit the byte counts cannot overflow.
+	size_t elementSize = storageFormatSize(job->storageFormat);
+	bool validSize = (job->dataSize > 0 && job->dataSize <= UINT_MAX);
+	job->reservedBytes = validSize ? 3 * job->dataSize * elementSize : 0;
+	job->submitTime = pt::microsec_clock::universal_time();
+
+	{
+		boost::mutex::scoped_lock lock(schedulerMutex);
+
+		// Admission control: refuse what no device could ever hold, and refuse when the backlog is full.
+		// The sizes are compared in elements, so that huge requests cannot wrap around.
+		bool fitsAnyDevice = false;
+		for(size_t deviceIndex = 0; validSize && deviceIndex < memoryBudget.size(); deviceIndex++)
+		{
+			if(job->dataSize <= memoryBudget[deviceIndex] / (3 * elementSize) &&
+			   job->dataSize <= runtime.getDeviceInfo(deviceIndex).maxMemAllocSize / elementSize)
+				fitsAnyDevice = true;
+		}
+
+		if(!validSize)
+			rejection->message = "job size must be positive and fit in a cl_uint";
+		else if(!fitsAnyDevice)
+			rejection->message = "job does not fit in device memory";
+		else if(stopping)
+			rejection->message = "server is shutting down";
+		else if(queuedJobs >= options.maxQueuedJobs)
+			rejection->message = "too many queued jobs";
+
+		if(!rejection->message.empty()) {
+			rejectedJobs++;
+			return false;
+		}
+
+		job->id = nextJobId++;
+		tenantQueues[job->tenant].push_back(job);
+		queuedJobs++;
+	}
+	jobAvailable.notify_all();
+
+	return true;
+}
+
+std::string CLHelper::JobServer::getStats()
+{
+	boost::mutex::scoped_lock lock(schedulerMutex);
+
+	std::vector<double> latencies(recentLatencies.begin(), recentLatencies.end());
+	std::sort(latencies.begin(), latencies.end());
+
+	std::ostringstream stats;
+	stats << "STATS completed=" << completedJobs
+	      << " rejected=" << rejectedJobs
+	      << " failed=" << failedJobs
+	      << " queued=" << queuedJobs
+	      << " pooled_bytes=" << runtime.getBufferPool().getPooledBytes();
+	if(!latencies.empty()) {
+		stats << " p50_ms=" << latencies[latencies.size() / 2]
+		      << " p99_ms=" << latencies[(latencies.size() * 99) / 100]
+		      << " max_ms=" << latencies.back();
+	}
+	for(size_t deviceIndex = 0; deviceIndex < completedPerDevice.size(); deviceIndex++)
+		stats << " device" << deviceIndex << "=" << completedPerDevice[deviceIndex];
+	stats << Metrics::shared().format();
+	stats << "\n";
+
+	return stats.str();
+}
+
+// Accepts asynchronously, so stop() can end ioService.run() from any thread; a blocking
+// accept() would not return when the acceptor is closed from another thread
+void CLHelper::JobServer::startAccept()
+{
+	boost::shared_ptr<Socket> socket(new Socket(ioService));
+	acceptor.async_accept(*socket, boost::bind(&JobServer::handleAccept, this, socket, boost::asio::placeholders::error));
+}
+
+void CLHelper::JobServer::handleAccept(boost::shared_ptr<Socket> socket, const boost::system::error_code& ec)
+{
+	if(stopping)
+		return;
+
+	if(ec) {
+		std::cerr << "accept() failed: " << ec.message() << std::endl;
+	}
+	else {
+		boost::thread connectionThread(boost::bind(&JobServer::serveConnection, this, socket));
+		connectionThread.detach();
+	}
+
+	startAccept();
+}
+
+// Arenas attached over a connection are detached when it closes, so a client
+// that exits or crashes without DETACH does not leave its poller behind
+void CLHelper::JobServer::serveConnection(boost::shared_ptr<Socket> socket)
+{
+	boost::asio::streambuf requestBuffer;
+	std::istream requestStream(&requestBuffer);
+	std::vector<std::string> connectionArenas;
+
+	while(true)
+	{
+		boost::system::error_code ec;
+		boost::asio::read_until(*socket, requestBuffer, '\n', ec);
+		if(ec)
+			break;
+
+		std::string line, command;
+		std::getline(requestStream, line);
+		std::istringstream lineStream(line);
+		lineStream >> command;
+
+		std::string reply;
+		if(command == "ADD") {
+			std::string tenant, storage;
+			size_t dataSize = 0;
+			StorageFormat storageFormat = STORAGE_FLOAT;
+			lineStream >> tenant >> dataSize;
+
+			// Reduced precision storage is opt-in per job
+			if(lineStream >> storage && !storageFormatFromString(storage, &storageFormat)) {
+				JobResult rejection;
+				rejection.message = "unknown storage format " + storage;
+				reply = formatJobResult(rejection);
+			}
+			else {
+				reply = formatJobResult(submitAdd(tenant, dataSize, storageFormat));
+			}
+		}
+		else if(command == "ATTACH") {
+			std::string arenaName, tenant;
+			lineStream >> arenaName >> tenant;
+			if(attachArena(arenaName, tenant)) {
+				connectionArenas.push_back(arenaName);
+				reply = "ATTACHED\n";
+			}
+			else
+				reply = "ERROR unable to open arena or already attached\n";
+		}
+		else if(command == "DETACH") {
+			std::string arenaName;
+			lineStream >> arenaName;
+			std::vector<std::string>::iterator attached = std::find(connectionArenas.begin(), connectionArenas.end(), arenaName);
+			if(attached != connectionArenas.end() && detachArena(arenaName)) {
+				connectionArenas.erase(attached);
+				reply = "DETACHED\n";
+			}
+			else
+				reply = "ERROR arena not attached by this connection\n";
+		}
+		else if(command == "STATS") {
+			reply = getStats();
+		}
+		else if(command == "SHUTDOWN") {
+			reply = "BYE\n";
+		}
+		else {
+			reply = "ERROR unknown command\n";
+		}
+
+		boost::asio::write(*socket, boost::asio::buffer(reply), ec);
+		if(ec)
+			break;
+
+		if(command == "SHUTDOWN") {
+			stop();
+			break;
+		}
+	}
+
+	for(size_t arena = 0; arena < connectionArenas.size(); arena++)
+		detachArena(connectionArenas[arena]);
+}
+
+void CLHelper::JobServer::workerLoop(size_t deviceIndex, size_t queueIndex)
+{
+	cl::CommandQueue& commQueue = runtime.getQueues(deviceIndex)[queueIndex];
+
+	// Kernel objects are not thread-safe to set arguments on, so every worker keeps its own
+	std::map<cl_program, WorkerKernels> kernelCache;
+
+	while(true)
+	{
+		JobPtr job;
+		{
+			boost::mutex::scoped_lock lock(schedulerMutex);
+			// The monitor readmits a quarantined device on time alone, with no one to notify
+			while(!stopping && !(job = takeJob(deviceIndex)))
+				jobAvailable.timed_wait(lock, pt::milliseconds(WORKER_WAKEUP_MS));
+
+			if(!job)
+				return;
+		}
+
+		JobResult result = executeAdd(*job, deviceIndex, commQueue, kernelCache);
+		monitor.endWork(deviceIndex);
+
+		{
+			boost::mutex::scoped_lock lock(schedulerMutex);
+			reservedMemory[deviceIndex] -= job->reservedBytes;
+			if(result.accepted) {
+				completedJobs++;
+				completedPerDevice[deviceIndex]++;
+
+				recentLatencies.push_back(result.totalMs);
+				if(recentLatencies.size() > options.latencySamples)
+					recentLatencies.pop_front();
+			}
+			else
+				failedJobs++;
+		}
+		// Memory was released, so a job that did not fit before may fit now
+		jobAvailable.notify_all();
+
+		if(job->onComplete)
+			job->onComplete(result);
+		else
+			job->promise.set_value(result);
+	}
+}
+
+void CLHelper::JobServer::completeSharedJob(AttachmentPtr attachment, boost::uint64_t jobId, const JobResult& result)
+{
+	SharedJobCompletion completion;
+	completion.jobId = jobId;
+	completion.accepted = result.accepted ? 1 : 0;
+	completion.lastValue = result.lastValue;
+	completion.executeMs = result.executeMs;
+	completion.totalMs = result.totalMs;
+
+	// A well-behaved client never has more than SHARED_RING_CAPACITY jobs outstanding, so the ring drains.
+	// One that stops popping completions loses them and its arena, instead of blocking the workers.
+	boost::mutex::scoped_lock lock(attachment->completionMutex);
+	pt::ptime start = pt::microsec_clock::universal_time();
+	while(!attachment->detached && !attachment->arena->getCompletions().push(completion))
+	{
+		if((pt::microsec_clock::universal_time() - start).total_milliseconds() >= ARENA_COMPLETION_TIMEOUT_MS) {
+			std::cerr << "Arena " << attachment->arena->getName() << ": completion ring full for "
+					  << ARENA_COMPLETION_TIMEOUT_MS << " ms, detaching" << std::endl;
+			attachment->detached = true;
+			break;
+		}
+		boost::this_thread::yield();
+	}
+}
+
+// Moves job descriptors from an arena's request ring into the scheduler until the arena is detached
+void CLHelper::JobServer::pollArena(AttachmentPtr attachment, std::string tenant)
+{
+	boost::shared_ptr<SharedArena> arena = attachment->arena;
+	size_t idlePolls = 0;
+
+	while(!stopping && !attachment->detached)
+	{
+		SharedJobDescriptor descriptor;
+		if(!arena->getRequests().pop(&descriptor)) {
+			// Spin for a while to keep latency low, then back off
+			if(++idlePolls > ARENA_SPIN_POLLS)
+				boost::this_thread::sleep(pt::microseconds(ARENA_IDLE_SLEEP_US));
+			continue;
+		}
+		idlePolls = 0;
+
+		JobPtr job(new Job());
+		job->tenant = tenant;
+		job->dataSize = descriptor.dataSize;
+		job->arena = arena;
+		job->onComplete = boost::bind(&JobServer::completeSharedJob, attachment, descriptor.jobId, boost::placeholders::_1);
+
+		// Never trust offsets coming from another process, and check them without overflowing
+		JobResult rejection;
+		boost::uint64_t dataBytes = descriptor.dataSize * sizeof(cl_float);
+		if(descriptor.dataSize > arena->getDataSize() / sizeof(cl_float) ||
+		   !arena->contains(descriptor.offsetA, dataBytes) ||
+		   !arena->contains(descriptor.offsetB, dataBytes) ||
+		   !arena->contains(descriptor.offsetC, dataBytes)) {
+			rejection.message = "job data outside the arena";
+			job->onComplete(rejection);
+			continue;
+		}
+
+		job->hostA = (float*) arena->getData(descriptor.offsetA);
+		job->hostB = (float*) arena->getData(descriptor.offsetB);
+		job->hostC = (float*) arena->getData(descriptor.offsetC);
+
+		if(!enqueueJob(job, &rejection))
+			job->onComplete(rejection);
+	}
+
+	// The name can be attached again once this poller is gone
+	boost::mutex::scoped_lock lock(schedulerMutex);
+	std::map<std::string, AttachmentPtr>::iterator attached = attachedArenas.find(arena->getName());
+	if(attached != attachedArenas.end() && attached->second == attachment)
+		attachedArenas.erase(attached);
+}
+
+// Called with schedulerMutex held. Visits the tenants round-robin and takes the
+// first queued job that fits into what is left of the device's memory budget.
+CLHelper::JobServer::JobPtr CLHelper::JobServer::takeJob(size_t deviceIndex)
+{
+	if(tenantQueues.empty())
+		return JobPtr();
+
+	// Drained and quarantined devices take no new jobs, slower healthy ones fewer at a time
+	if(!monitor.isAccepting(deviceIndex) ||
+	   monitor.getRunning(deviceIndex) >= monitor.allowedConcurrency(deviceIndex, runtime.getQueues(deviceIndex).size()))
+		return JobPtr();
+
+	std::map<std::string, std::deque<JobPtr> >::iterator start = tenantQueues.upper_bound(lastTenant);
+	if(start == tenantQueues.end())
+		start = tenantQueues.begin();
+
+	std::map<std::string, std::deque<JobPtr> >::iterator tenant = start;
+	do
+	{
+		JobPtr job = tenant->second.front();
+		if(reservedMemory[deviceIndex] + job->reservedBytes <= memoryBudget[deviceIndex] &&
+		   job->dataSize * storageFormatSize(job->storageFormat) <= runtime.getDeviceInfo(deviceIndex).maxMemAllocSize)
+		{
+			reservedMemory[deviceIndex] += job->reservedBytes;
+			queuedJobs--;
+			lastTenant = tenant->first;
+			monitor.beginWork(deviceIndex);
+
+			tenant->second.pop_front();
+			if(tenant->second.empty())
+				tenantQueues.erase(tenant);
+
+			return job;
+		}
+
+		tenant++;
+		if(tenant == tenantQueues.end())
+			tenant = tenantQueues.begin();
+	}
+	while(tenant != start);
+
+	return JobPtr();
+}
+
+CLHelper::JobResult CLHelper::JobServer::executeAdd(
+	Job& job,
+	size_t deviceIndex,
+	cl::CommandQueue& commQueue,
+	std::map<cl_program, WorkerKernels>& kernelCache)
+{
+	cl_int err;
+	pt::ptime startTime = pt::microsec_clock::universal_time();
+
+	JobResult result;
+	result.accepted = true;
+	result.jobId = job.id;
+	result.deviceIndex = deviceIndex;
+	result.queueMs = (startTime - job.submitTime).total_microseconds() / 1000.0;
+
+// Specialize for the job size while the cache has room, otherwise the generic program is used
+	Specialization specialization;
+	specialization.define("FIXED_DATA_SIZE", job.dataSize);
+	specialization.define("NO_BOUNDS_CHECK");
+
+	bool storedJob = (job.storageFormat != STORAGE_FLOAT);
+	if(storedJob)
+		specialization.define(storageFormatDefine(job.storageFormat));
+	cl::Program program = runtime.getProgram("SimpleAddKernel.cl", specialization);
+
+	std::map<cl_program, WorkerKernels>::iterator kernels = kernelCache.find(program());
+	if(kernels == kernelCache.end()) {
+		WorkerKernels workerKernels;
+		workerKernels.initKernel.reset(new KernelBinder(program, storedJob ? "initStoredKernel" : "initKernel"));
+		workerKernels.simpleAddKernel.reset(new KernelBinder(program, storedJob ? "simpleAddStoredKernel" : "simpleAddKernel"));
+
+		kernels = kernelCache.insert(std::make_pair(program(), workerKernels)).first;
+	}
+
+	size_t elementSize = storageFormatSize(job.storageFormat);
+	size_t dataBytes = job.dataSize * elementSize;
+
+	// int8 scales for the generated ramp inputs and their sums
+	float scaleA = std::max((float) std::min(job.dataSize, (size_t) RAMP_PERIOD) - 1, 1.0f) / 127.0f;
+	float scaleC = 2 * scaleA;
+	DeviceInfo& deviceInfo = runtime.getDeviceInfo(deviceIndex);
+	BufferPool& bufferPool = runtime.getBufferPool();
+
+// Jobs from a shared arena are wrapped in place on devices that share host memory.
+// Everything else uses pooled buffers, which discrete devices fill with one copy per input.
+	bool sharedJob = (job.hostA != NULL);
+	bool zeroCopy = sharedJob && ((deviceInfo.dType & CL_DEVICE_TYPE_CPU) || deviceInfo.hostUnifiedMem);
+
+	size_t capacity = 0;
+	cl::Buffer d_dataA, d_dataB, d_dataC;
+	const char* failedCall = NULL;
+	do
+	{
+		if(zeroCopy) {
+			d_dataA = cl::Buffer(runtime.getContext(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, dataBytes, job.hostA, &err);
+			CHECK_JOB_ERROR(err, "cl::Buffer::Buffer()");
+			d_dataB = cl::Buffer(runtime.getContext(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, dataBytes, job.hostB, &err);
+			CHECK_JOB_ERROR(err, "cl::Buffer::Buffer()");
+			d_dataC = cl::Buffer(runtime.getContext(), CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, dataBytes, job.hostC, &err);
+			CHECK_JOB_ERROR(err, "cl::Buffer::Buffer()");
+		}
+		else {
+			d_dataA = bufferPool.acquire(dataBytes, CL_MEM_READ_WRITE, &capacity);
+			d_dataB = bufferPool.acquire(dataBytes, CL_MEM_READ_WRITE);
+			d_dataC = bufferPool.acquire(dataBytes, CL_MEM_READ_WRITE);
+		}
+
+		KernelBinder& simpleAddKernel = *kernels->second.simpleAddKernel;
+		err  = simpleAddKernel.set(0, d_dataA);
+		err |= simpleAddKernel.set(1, d_dataB);
+		err |= simpleAddKernel.set(2, d_dataC);
+		err |= simpleAddKernel.set(3, (cl_uint) job.dataSize);
+		if(storedJob) {
+			err |= simpleAddKernel.set(4, scaleA);
+			err |= simpleAddKernel.set(5, scaleA);
+			err |= simpleAddKernel.set(6, scaleC);
+		}
+		CHECK_JOB_ERROR(err, "cl::Kernel::setArg()");
+
+		if(sharedJob && !zeroCopy) {
+			err  = commQueue.enqueueWriteBuffer(d_dataA, CL_FALSE, 0, dataBytes, job.hostA);
+			err |= commQueue.enqueueWriteBuffer(d_dataB, CL_FALSE, 0, dataBytes, job.hostB);
+			CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer()");
+		}
+		else if(!sharedJob) {
+			KernelBinder& initKernel = *kernels->second.initKernel;
+			if(storedJob) {
+				err  = initKernel.set(0, d_dataA);
+				err |= initKernel.set(1, d_dataB);
+				err |= initKernel.set(2, (cl_uint) 0);
+				err |= initKernel.set(3, (cl_uint) job.dataSize);
+				err |= initKernel.set(4, scaleA);
+				err |= initKernel.set(5, scaleA);
+			}
+			else {
+				err  = initKernel.set(0, d_dataA);
+				err |= initKernel.set(1, d_dataB);
+				err |= initKernel.set(2, d_dataC);
+				err |= initKernel.set(3, (cl_uint) 0);
+				err |= initKernel.set(4, (cl_uint) job.dataSize);
+			}
+			CHECK_JOB_ERROR(err, "cl::Kernel::setArg()");
+
+			err = commQueue.enqueueNDRangeKernel(initKernel.getKernel(), cl::NullRange, cl::NDRange(job.dataSize), cl::NullRange);
+			CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel()");
+		}
+
+		cl::Event addEvent;
+		err = commQueue.enqueueNDRangeKernel(simpleAddKernel.getKernel(), cl::NullRange, cl::NDRange(job.dataSize), cl::NullRange, NULL, &addEvent);
+		CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel()");
+
+		if(zeroCopy) {
+			// Mapping a CL_MEM_USE_HOST_PTR buffer makes the result visible at the client's address
+			void* mappedResult = commQueue.enqueueMapBuffer(d_dataC, CL_TRUE, CL_MAP_READ, 0, dataBytes, NULL, NULL, &err);
+			CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueMapBuffer()");
+			commQueue.enqueueUnmapMemObject(d_dataC, mappedResult);
+
+			result.lastValue = job.hostC[job.dataSize - 1];
+		}
+		else if(sharedJob) {
+			err = commQueue.enqueueReadBuffer(d_dataC, CL_TRUE, 0, dataBytes, job.hostC);
+			CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueReadBuffer()");
+
+			result.lastValue = job.hostC[job.dataSize - 1];
+		}
+		else {
+			cl_float lastStored = 0;
+			err = commQueue.enqueueReadBuffer(d_dataC, CL_TRUE, (job.dataSize - 1) * elementSize, elementSize, &lastStored);
+			CHECK_JOB_ERROR(err, "cl::CommandQueue::enqueueReadBuffer()");
+			decodeStorage(job.storageFormat, &lastStored, 1, &result.lastValue, scaleC);
+		}
+
+		// The blocking read above has waited for the add, so its timing is available
+		monitor.recordCommand(deviceIndex, addEvent, 3.0 * dataBytes);
+	}
+	while(false);
+
+	// A failed job is reported to its client and the worker goes on. Whatever was enqueued
+	// before the failure must be done before the buffers go back to the pool. The monitor
+	// drains and then quarantines a device that keeps failing.
+	if(failedCall != NULL) {
+		commQueue.finish();
+		monitor.recordError(deviceIndex);
+
+		result.accepted = false;
+		result.message = std::string("job failed, ") + failedCall + " returned " + openCLErrorCodeToString(err);
+	}
+
+	if(!zeroCopy) {
+		bufferPool.release(d_dataA, capacity, CL_MEM_READ_WRITE);
+		bufferPool.release(d_dataB, capacity, CL_MEM_READ_WRITE);
+		bufferPool.release(d_dataC, capacity, CL_MEM_READ_WRITE);
+	}
+
+	result.executeMs = millisecondsSince(startTime);
+	result.totalMs = millisecondsSince(job.submitTime);
+
+	return result;
+}
@@ -0,0 +1,121 @@
+#ifndef _JOBSERVER_H
+#define _JOBSERVER_H
+
+#include <deque>
+#include <list>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "Runtime.h"
+#include "DeviceMonitor.h"
+#include "JobProtocol.h"
+#include "KernelBinder.h"
+#include "SharedArena.h"
+#include "StorageFormat.h"
+
+namespace CLHelper
+{
+	struct JobServerOptions {
+		double memoryFraction;		/* share of a device's globalMemSize that running jobs may reserve */
+		size_t maxQueuedJobs;		/* submissions beyond this are rejected */
+		size_t latencySamples;		/* number of recent job latencies kept for STATS */
+		DeviceMonitorOptions monitor;	/* when a device is drained and quarantined */
+
+		JobServerOptions() : memoryFraction(0.8), maxQueuedJobs(1024), latencySamples(4096) {}
+	};
+
+	/* Long-running server executing jobs from local clients on a warm Runtime */
+	class JobServer {
+
+	public:
+		JobServer(Runtime& runtime, const std::string& socketPath, const JobServerOptions& options = JobServerOptions());
+		~JobServer();
+
+		void run();
+		void stop();
+
+		JobResult submitAdd(const std::string& tenant, size_t dataSize, StorageFormat storageFormat = STORAGE_FLOAT);
+		bool attachArena(const std::string& arenaName, const std::string& tenant);	/* false if it cannot be opened or is attached already */
+		bool detachArena(const std::string& arenaName);	/* false if it is not attached */
+		std::string getStats();
+
+	private:
+		struct Job {
+			unsigned long id;
+			std::string tenant;
+			size_t dataSize;
+			StorageFormat storageFormat;				/* generated jobs may use reduced precision, shared ones are float */
+			cl_ulong reservedBytes;
+			boost::posix_time::ptime submitTime;
+			boost::promise<JobResult> promise;
+
+			float* hostA;								/* inputs and output in a shared arena, or NULL */
+			float* hostB;								/* to generate the inputs on the device */
+			float* hostC;
+			boost::shared_ptr<SharedArena> arena;		/* keeps the arena mapped while the job runs */
+			boost::function<void (const JobResult&)> onComplete;	/* used instead of the promise if set */
+
+			Job() : storageFormat(STORAGE_FLOAT), hostA(NULL), hostB(NULL), hostC(NULL) {}
+		};
+		typedef boost::shared_ptr<Job> JobPtr;
+
+		/* An attached arena is polled until it is detached, after which its completions are dropped */
+		struct ArenaAttachment {
+			boost::shared_ptr<SharedArena> arena;
+			boost::mutex completionMutex;				/* workers of all devices complete jobs, this makes them one producer */
+			boost::atomic<bool> detached;
+
+			ArenaAttachment() : detached(false) {}
+		};
+		typedef boost::shared_ptr<ArenaAttachment> AttachmentPtr;
+		typedef boost::asio::local::stream_protocol::socket Socket;
+
+		/* Binders remember the bound arguments, so jobs reusing pooled buffers skip most setArg calls */
+		struct WorkerKernels {
+			boost::shared_ptr<KernelBinder> initKernel;
+			boost::shared_ptr<KernelBinder> simpleAddKernel;
+		};
+
+		void startAccept();
+		void handleAccept(boost::shared_ptr<Socket> socket, const boost::system::error_code& ec);
+		void serveConnection(boost::shared_ptr<Socket> socket);
+		void workerLoop(size_t deviceIndex, size_t queueIndex);
+		void pollArena(AttachmentPtr attachment, std::string tenant);
+		static void completeSharedJob(AttachmentPtr attachment, boost::uint64_t jobId, const JobResult& result);
+
+		bool enqueueJob(JobPtr job, JobResult* rejection);
+		JobPtr takeJob(size_t deviceIndex);
+		JobResult executeAdd(Job& job, size_t deviceIndex, cl::CommandQueue& commQueue, std::map<cl_program, WorkerKernels>& kernelCache);
+
+		Runtime& runtime;
+		std::string socketPath;
+		JobServerOptions options;
+
+		boost::asio::io_service ioService;
+		boost::asio::local::stream_protocol::acceptor acceptor;
+		boost::thread_group workers;
+
+		boost::mutex schedulerMutex;
+		boost::condition_variable jobAvailable;
+		std::map<std::string, std::deque<JobPtr> > tenantQueues;
+		std::string lastTenant;						/* tenants are served round-robin, starting after this one */
+		size_t queuedJobs;
+		std::vector<cl_ulong> memoryBudget;			/* per device */
+		std::vector<cl_ulong> reservedMemory;		/* per device, held by running jobs */
+		unsigned long nextJobId;
+		boost::atomic<bool> stopping;
+		std::map<std::string, AttachmentPtr> attachedArenas;	/* by name, each polled by one thread */
+
+		unsigned long completedJobs;
+		unsigned long rejectedJobs;
+		unsigned long failedJobs;			/* accepted, but an OpenCL call failed while running them */
+		std::vector<unsigned long> completedPerDevice;
+		std::list<double> recentLatencies;
+		DeviceMonitor monitor;
+	};
+};
+
+#endif
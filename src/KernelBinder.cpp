@@ -0,0 +1,239 @@
+#include <cstdlib>
+#include <cstring>
+#include "KernelBinder.h"
+
+static size_t scalarTypeSize(const std::string& typeName);
+
+CLHelper::KernelBinder::KernelBinder(const cl::Program& program, const std::string& kernelName)
+	: kernelName(kernelName),
+	  argumentInfo(false),
+	  skipped(0)
+{
+	cl_int err;
+
+	kernel = cl::Kernel(program, kernelName.c_str(), &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+	cl_uint argumentCount;
+	err = kernel.getInfo(CL_KERNEL_NUM_ARGS, &argumentCount);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::getInfo() failed.");
+
+	arguments.resize(argumentCount);
+	bound.resize(argumentCount, false);
+	boundValues.resize(argumentCount);
+	boundBuffers.resize(argumentCount);
+
+#ifdef CL_VERSION_1_2
+	// Argument metadata is only kept when the program was built with -cl-kernel-arg-info
+	argumentInfo = true;
+	for(cl_uint index = 0; index < argumentCount && argumentInfo; index++)
+	{
+		ArgumentInfo& argument = arguments[index];
+
+		err = kernel.getArgInfo(index, CL_KERNEL_ARG_NAME, &argument.name);
+		if(err == CL_KERNEL_ARG_INFO_NOT_AVAILABLE) {
+			argumentInfo = false;
+			break;
+		}
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::getArgInfo() failed.");
+
+		err  = kernel.getArgInfo(index, CL_KERNEL_ARG_TYPE_NAME, &argument.typeName);
+		err |= kernel.getArgInfo(index, CL_KERNEL_ARG_ADDRESS_QUALIFIER, &argument.addressQualifier);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::getArgInfo() failed.");
+
+		// Some implementations include the terminating zero in the returned strings
+		argument.name = argument.name.c_str();
+		argument.typeName = argument.typeName.c_str();
+		argument.scalarSize = scalarTypeSize(argument.typeName);
+	}
+#endif
+}
+
+cl::Kernel& CLHelper::KernelBinder::getKernel()
+{
+	return kernel;
+}
+
+cl_uint CLHelper::KernelBinder::getArgumentCount() const
+{
+	return (cl_uint) arguments.size();
+}
+
+bool CLHelper::KernelBinder::hasArgumentInfo() const
+{
+	return argumentInfo;
+}
+
+cl_uint CLHelper::KernelBinder::argumentIndex(const std::string& name) const
+{
+	if(!argumentInfo) {
+		std::cerr << "Cannot bind \"" << name << "\" of " << kernelName << " by name, the program was built without -cl-kernel-arg-info." << std::endl;
+		exit(1);
+	}
+
+	for(cl_uint index = 0; index < arguments.size(); index++)
+	{
+		if(arguments[index].name == name)
+			return index;
+	}
+
+	std::cerr << kernelName << " has no argument named \"" << name << "\"." << std::endl;
+	exit(1);
+}
+
+cl_int CLHelper::KernelBinder::set(cl_uint index, const cl::Buffer& buffer)
+{
+	checkPointer(index, CL_KERNEL_ARG_ADDRESS_GLOBAL);
+
+	cl_mem memory = buffer();
+	cl_int err = bind(index, sizeof(cl_mem), &memory);
+	if(err == CL_SUCCESS)
+		boundBuffers[index] = buffer;
+
+	return err;
+}
+
+cl_int CLHelper::KernelBinder::setLocal(cl_uint index, size_t size)
+{
+	checkPointer(index, CL_KERNEL_ARG_ADDRESS_LOCAL);
+
+	// The value of a local argument is its size, there is nothing else to compare
+	bound[index] = false;
+	return clSetKernelArg(kernel(), index, size, NULL);
+}
+
+cl_int CLHelper::KernelBinder::setSVMPointer(cl_uint index, void* pointer)
+{
+	checkPointer(index, CL_KERNEL_ARG_ADDRESS_GLOBAL);
+
+	if(isBound(index, sizeof(void*), &pointer)) {
+		skipped++;
+		return CL_SUCCESS;
+	}
+
+#ifdef CL_VERSION_2_0
+	cl_int err = clSetKernelArgSVMPointer(kernel(), index, pointer);
+#else
+	cl_int err = CL_INVALID_OPERATION;
+#endif
+	remember(index, sizeof(void*), &pointer, err);
+	boundBuffers[index] = cl::Buffer();
+
+	return err;
+}
+
+void CLHelper::KernelBinder::invalidate()
+{
+	bound.assign(bound.size(), false);
+	boundBuffers.assign(boundBuffers.size(), cl::Buffer());
+}
+
+size_t CLHelper::KernelBinder::getSkippedCount() const
+{
+	return skipped;
+}
+
+void CLHelper::KernelBinder::checkIndex(cl_uint index) const
+{
+	if(index >= arguments.size()) {
+		std::cerr << kernelName << " has " << arguments.size() << " arguments, cannot set argument " << index << "." << std::endl;
+		exit(1);
+	}
+}
+
+void CLHelper::KernelBinder::checkScalar(cl_uint index, size_t size) const
+{
+	checkIndex(index);
+	if(!argumentInfo)
+		return;
+
+	const ArgumentInfo& argument = arguments[index];
+	if(argument.addressQualifier != CL_KERNEL_ARG_ADDRESS_PRIVATE) {
+		std::cerr << kernelName << " argument \"" << argument.name << "\" is a " << argument.typeName
+				  << " pointer and needs a buffer, not a value of " << size << " bytes." << std::endl;
+		exit(1);
+	}
+
+	if(argument.scalarSize != 0 && argument.scalarSize != size) {
+		std::cerr << kernelName << " argument \"" << argument.name << "\" is a " << argument.typeName
+				  << " (" << argument.scalarSize << " bytes), but was given a value of " << size << " bytes." << std::endl;
+		exit(1);
+	}
+}
+
+void CLHelper::KernelBinder::checkPointer(cl_uint index, cl_kernel_arg_address_qualifier addressQualifier) const
+{
+	checkIndex(index);
+	if(!argumentInfo)
+		return;
+
+	// Buffers may also be passed as __constant pointers
+	const ArgumentInfo& argument = arguments[index];
+	bool matches = (argument.addressQualifier == addressQualifier)
+		|| (addressQualifier == CL_KERNEL_ARG_ADDRESS_GLOBAL && argument.addressQualifier == CL_KERNEL_ARG_ADDRESS_CONSTANT);
+	if(!matches) {
+		std::cerr << kernelName << " argument \"" << argument.name << "\" is declared as " << argument.typeName
+				  << " and cannot take a " << (addressQualifier == CL_KERNEL_ARG_ADDRESS_LOCAL ? "local allocation" : "buffer") << "." << std::endl;
+		exit(1);
+	}
+}
+
+cl_int CLHelper::KernelBinder::bind(cl_uint index, size_t size, const void* value)
+{
+	if(isBound(index, size, value)) {
+		skipped++;
+		return CL_SUCCESS;
+	}
+
+	cl_int err = clSetKernelArg(kernel(), index, size, value);
+	remember(index, size, value, err);
+
+	return err;
+}
+
+bool CLHelper::KernelBinder::isBound(cl_uint index, size_t size, const void* value) const
+{
+	const std::vector<unsigned char>& boundValue = boundValues[index];
+	return bound[index] && boundValue.size() == size && memcmp(&boundValue[0], value, size) == 0;
+}
+
+void CLHelper::KernelBinder::remember(cl_uint index, size_t size, const void* value, cl_int err)
+{
+	if(err != CL_SUCCESS) {
+		bound[index] = false;
+		return;
+	}
+
+	const unsigned char* bytes = (const unsigned char*) value;
+	boundValues[index].assign(bytes, bytes + size);
+	bound[index] = true;
+}
+
+// Size of an OpenCL C scalar or vector type name such as "uint" or "float4"
+static size_t scalarTypeSize(const std::string& typeName)
+{
+	if(typeName.empty() || typeName[typeName.length() - 1] == '*')
+		return 0;
+
+	size_t digits = typeName.find_first_of("0123456789");
+	std::string baseType = typeName.substr(0, digits);
+	size_t width = (digits == std::string::npos) ? 1 : atoi(typeName.c_str() + digits);
+
+	// Three-component vectors are padded to four
+	if(width == 3)
+		width = 4;
+
+	size_t baseSize;
+	if(baseType == "char" || baseType == "uchar" || baseType == "bool")
+		baseSize = 1;
+	else if(baseType == "short" || baseType == "ushort" || baseType == "half")
+		baseSize = 2;
+	else if(baseType == "int" || baseType == "uint" || baseType == "float")
+		baseSize = 4;
+	else if(baseType == "long" || baseType == "ulong" || baseType == "double")
+		baseSize = 8;
+	else
+		return 0;
+
+	return baseSize * width;
+}
@@ -0,0 +1,74 @@
+#ifndef _KERNELBINDER_H
+#define _KERNELBINDER_H
+
+#include <vector>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	/*
+	 * Wraps one cl::Kernel and remembers the value bound to every argument, so
+	 * setting an argument to the value it already has costs no driver call.
+	 * If the program was built with -cl-kernel-arg-info (see
+	 * Specialization::keepArgumentInfo()), arguments can also be bound by name
+	 * and every value is checked against the argument's declared type when it
+	 * is set instead of failing later with CL_INVALID_ARG_SIZE.
+	 * The binder assumes it is the only one setting arguments on its kernel.
+	 */
+	class KernelBinder {
+
+	public:
+		KernelBinder(const cl::Program& program, const std::string& kernelName);
+
+		cl::Kernel& getKernel();
+		cl_uint getArgumentCount() const;
+		bool hasArgumentInfo() const;
+		cl_uint argumentIndex(const std::string& name) const;
+
+		template <typename T>
+		cl_int set(cl_uint index, const T& value)
+		{
+			checkScalar(index, sizeof(T));
+			return bind(index, sizeof(T), &value);
+		}
+		cl_int set(cl_uint index, const cl::Buffer& buffer);
+		cl_int setLocal(cl_uint index, size_t size);
+		cl_int setSVMPointer(cl_uint index, void* pointer);
+
+		template <typename T>
+		cl_int set(const std::string& name, const T& value)
+		{
+			return set(argumentIndex(name), value);
+		}
+
+		void invalidate();					/* forget the bound values, e.g. after another owner set arguments */
+		size_t getSkippedCount() const;		/* setArg calls saved so far */
+
+	private:
+		struct ArgumentInfo {
+			std::string name;
+			std::string typeName;
+			cl_kernel_arg_address_qualifier addressQualifier;
+			size_t scalarSize;				/* 0 if unknown, e.g. for structs */
+		};
+
+		void checkIndex(cl_uint index) const;
+		void checkScalar(cl_uint index, size_t size) const;
+		void checkPointer(cl_uint index, cl_kernel_arg_address_qualifier addressQualifier) const;
+		cl_int bind(cl_uint index, size_t size, const void* value);
+		bool isBound(cl_uint index, size_t size, const void* value) const;
+		void remember(cl_uint index, size_t size, const void* value, cl_int err);
+
+		cl::Kernel kernel;
+		std::string kernelName;
+		bool argumentInfo;
+		std::vector<ArgumentInfo> arguments;
+
+		std::vector<bool> bound;
+		std::vector<std::vector<unsigned char> > boundValues;
+		std::vector<cl::Buffer> boundBuffers;	/* keeps bound buffers alive so their handles cannot be reused */
+		size_t skipped;
+	};
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include "KernelPreprocessor.h"
+
+/* Prefix of the paths of embedded headers, which never name a file */
+#define EMBEDDED_PREFIX "embedded:"
+
+namespace fs = boost::filesystem;
+
+static bool parseDirective(const std::string& line, std::string* directive, std::string* arguments);
+static bool parseInclude(const std::string& arguments, std::string* name, bool* quoted);
+static bool updateCommentState(const std::string& line, bool inComment);
+
+CLHelper::KernelLibrary& CLHelper::KernelLibrary::shared()
+{
+	static KernelLibrary library;
+	return library;
+}
+
+void CLHelper::KernelLibrary::addEmbedded(const std::string& name, const std::string& source)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	embedded[name] = source;
+	expansions.clear();
+}
+
+void CLHelper::KernelLibrary::addSearchPath(const std::string& directory)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	searchPaths.push_back(directory);
+	expansions.clear();
+}
+
+CLHelper::ExpandedSource CLHelper::KernelLibrary::expand(const std::string& relativeFilePath)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::map<std::string, ExpandedSource>::iterator cached = expansions.find(relativeFilePath);
+	if(cached != expansions.end())
+		return cached->second;
+
+	std::string filePathString = (fs::current_path() / relativeFilePath).string();
+	boost::algorithm::replace_all(filePathString, "\"", "");
+
+	if(readFile(filePathString) == NULL) {
+		std::cerr << std::endl;
+		std::cerr << "Unable to open file \"" << filePathString << "\"." << std::endl;
+		exit(1);
+	}
+
+	// #line directives name files as they were written, so the expansion does
+	// not depend on where the kernels are installed
+	ExpandedSource expanded;
+	std::vector<std::string> includeStack;
+	std::set<std::string> includedOnce;
+	expandFile(filePathString, relativeFilePath, &includeStack, &includedOnce, &expanded);
+	expanded.hash = hashString(expanded.source);
+
+	expansions[relativeFilePath] = expanded;
+	return expanded;
+}
+
+std::string CLHelper::KernelLibrary::hash(const std::string& relativeFilePath, const std::string& options)
+{
+	return hashString(expand(relativeFilePath).source + "\n" + options);
+}
+
+void CLHelper::KernelLibrary::clear()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	files.clear();
+	expansions.clear();
+}
+
+bool CLHelper::KernelLibrary::findInclude(const std::string& name, bool quoted, const std::string& includingPath, std::string* path)
+{
+	if(embedded.count(name) > 0) {
+		*path = EMBEDDED_PREFIX + name;
+		return true;
+	}
+
+	std::vector<std::string> directories;
+	if(quoted && includingPath.compare(0, strlen(EMBEDDED_PREFIX), EMBEDDED_PREFIX) != 0)
+		directories.push_back(fs::path(includingPath).parent_path().string());
+	if(searchPaths.empty())
+		directories.push_back(fs::current_path().string());
+	else
+		directories.insert(directories.end(), searchPaths.begin(), searchPaths.end());
+
+	for(size_t i = 0; i < directories.size(); i++)
+	{
+		std::string candidate = (fs::path(directories[i]) / name).string();
+		if(readFile(candidate) != NULL) {
+			*path = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+const std::string* CLHelper::KernelLibrary::readFile(const std::string& path)
+{
+	if(path.compare(0, strlen(EMBEDDED_PREFIX), EMBEDDED_PREFIX) == 0) {
+		std::map<std::string, std::string>::iterator header = embedded.find(path.substr(strlen(EMBEDDED_PREFIX)));
+		return (header != embedded.end()) ? &header->second : NULL;
+	}
+
+	std::map<std::string, std::string>::iterator file = files.find(path);
+	if(file != files.end())
+		return &file->second;
+
+	std::ifstream sourceFile(path.c_str(), std::ifstream::in);
+	if(!sourceFile.good())
+		return NULL;
+
+	std::string& contents = files[path];
+	contents = std::string((std::istreambuf_iterator<char>(sourceFile)),
+	                       std::istreambuf_iterator<char>());
+	return &contents;
+}
+
+void CLHelper::KernelLibrary::expandFile(
+	const std::string& path,
+	const std::string& displayName,
+	std::vector<std::string>* includeStack,
+	std::set<std::string>* includedOnce,
+	ExpandedSource* expanded)
+{
+	if(includedOnce->count(path) > 0)
+		return;
+
+	if(std::find(includeStack->begin(), includeStack->end(), path) != includeStack->end()) {
+		std::cerr << "Recursive #include of \"" << displayName << "\"." << std::endl;
+		exit(1);
+	}
+
+	if(std::find(expanded->files.begin(), expanded->files.end(), path) == expanded->files.end())
+		expanded->files.push_back(path);
+	includeStack->push_back(path);
+
+	const std::string& contents = *readFile(path);
+	std::string& source = expanded->source;
+
+	size_t lineNumber = 0;
+	bool inComment = false;
+	for(size_t position = 0; position < contents.length(); )
+	{
+		size_t lineEnd = contents.find('\n', position);
+		bool newline = (lineEnd != std::string::npos);
+		if(!newline)
+			lineEnd = contents.length();
+
+		std::string line = contents.substr(position, lineEnd - position);
+		position = newline ? lineEnd + 1 : lineEnd;
+		lineNumber++;
+
+		std::string directive, arguments, name, includePath;
+		bool quoted = false;
+		if(!inComment && parseDirective(line, &directive, &arguments)) {
+			if(directive == "include" && parseInclude(arguments, &name, &quoted)
+					&& findInclude(name, quoted, path, &includePath)) {
+				std::ostringstream resume;
+				resume << "#line " << (lineNumber + 1) << " \"" << displayName << "\"\n";
+
+				source += "#line 1 \"" + name + "\"\n";
+				expandFile(includePath, name, includeStack, includedOnce, expanded);
+				if(!source.empty() && source[source.length() - 1] != '\n')
+					source += "\n";
+				source += resume.str();
+				continue;
+			}
+			if(directive == "include" && quoted) {
+				std::cerr << "Unable to find \"" << name << "\", included from \"" << displayName << "\"." << std::endl;
+				exit(1);
+			}
+
+			// Kept as an empty line, so the line numbers stay right
+			if(directive == "pragma" && arguments == "once") {
+				includedOnce->insert(path);
+				source += "\n";
+				continue;
+			}
+		}
+
+		inComment = updateCommentState(line, inComment);
+		source += line;
+		if(newline)
+			source += "\n";
+	}
+
+	includeStack->pop_back();
+}
+
+/* Splits "#  directive  arguments" into its parts, with surrounding space removed */
+static bool parseDirective(const std::string& line, std::string* directive, std::string* arguments)
+{
+	std::string trimmed = boost::algorithm::trim_copy(line);
+	if(trimmed.empty() || trimmed[0] != '#')
+		return false;
+
+	trimmed = boost::algorithm::trim_left_copy(trimmed.substr(1));
+	size_t nameEnd = 0;
+	while(nameEnd < trimmed.length() && isalpha((unsigned char) trimmed[nameEnd]))
+		nameEnd++;
+
+	*directive = trimmed.substr(0, nameEnd);
+	*arguments = boost::algorithm::trim_copy(trimmed.substr(nameEnd));
+	return !directive->empty();
+}
+
+static bool parseInclude(const std::string& arguments, std::string* name, bool* quoted)
+{
+	if(arguments.empty() || (arguments[0] != '"' && arguments[0] != '<'))
+		return false;
+
+	*quoted = (arguments[0] == '"');
+	size_t end = arguments.find(*quoted ? '"' : '>', 1);
+	if(end == std::string::npos)
+		return false;
+
+	*name = arguments.substr(1, end - 1);
+	return !name->empty();
+}
+
+/* Whether a block comment is still open after the line, for skipping directives inside comments */
+static bool updateCommentState(const std::string& line, bool inComment)
+{
+	bool inString = false;
+	for(size_t i = 0; i < line.length(); i++)
+	{
+		if(inComment) {
+			if(line.compare(i, 2, "*/") == 0) {
+				inComment = false;
+				i++;
+			}
+		}
+		else if(inString) {
+			if(line[i] == '\\')
+				i++;
+			else if(line[i] == '"')
+				inString = false;
+		}
+		else if(line[i] == '"')
+			inString = true;
+		else if(line.compare(i, 2, "//") == 0)
+			break;
+		else if(line.compare(i, 2, "/*") == 0) {
+			inComment = true;
+			i++;
+		}
+	}
+	return inComment;
+}
@@ -0,0 +1,74 @@
+#ifndef _KERNELPREPROCESSOR_H
+#define _KERNELPREPROCESSOR_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	/* A kernel file with every #include inlined */
+	struct ExpandedSource {
+		std::string source;
+		std::string hash;					/* hashString() of source */
+		std::vector<std::string> files;		/* every file read for it, the kernel file first */
+	};
+
+	/*
+	 * Host side #include resolution for kernel files, so programs never rely on
+	 * the driver's include handling and the source handed to it is the whole
+	 * source. Quoted includes are looked up among the embedded headers, then
+	 * next to the including file, then in the search directories (the current
+	 * directory when none were added); angle bracket includes skip the second
+	 * step and are left to the driver when not found. #pragma once and include
+	 * guards both work. Inlined text is wrapped in #line directives, so build
+	 * logs still point into the right file, and a file without includes expands
+	 * to itself.
+	 *
+	 * Files are read once per process and expansions are kept, so building many
+	 * variants of a program never goes back to the filesystem; clear() forgets
+	 * them after kernel files were edited.
+	 */
+	class KernelLibrary {
+
+	public:
+		static KernelLibrary& shared();
+
+		/* A header compiled into the host program, found by #include "<name>" */
+		void addEmbedded(const std::string& name, const std::string& source);
+		void addSearchPath(const std::string& directory);
+
+		/* Exits when the file or one of its quoted includes cannot be found */
+		ExpandedSource expand(const std::string& relativeFilePath);
+
+		/* Stable across runs: changes with the expanded source or the options only */
+		std::string hash(const std::string& relativeFilePath, const std::string& options);
+
+		void clear();
+
+	private:
+		KernelLibrary() {}
+		KernelLibrary(const KernelLibrary&);
+		KernelLibrary& operator=(const KernelLibrary&);
+
+		bool findInclude(const std::string& name, bool quoted, const std::string& includingPath, std::string* path);
+		const std::string* readFile(const std::string& path);
+		void expandFile(
+			const std::string& path,
+			const std::string& displayName,		/* as written in the #include, or the kernel file's relative path */
+			std::vector<std::string>* includeStack,
+			std::set<std::string>* includedOnce,
+			ExpandedSource* expanded);
+
+		boost::mutex mutex;
+		std::map<std::string, std::string> embedded;	/* by include name */
+		std::vector<std::string> searchPaths;
+		std::map<std::string, std::string> files;		/* contents by path */
+		std::map<std::string, ExpandedSource> expansions;	/* by the relative path of the kernel file */
+	};
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "KernelSpecializer.h"
+
+CLHelper::Specialization::Specialization()
+	: fastMath(false), mad(false), argumentInfo(false)
+{
+}
+
+void CLHelper::Specialization::define(const std::string& name)
+{
+	defines[name] = "";
+}
+
+void CLHelper::Specialization::allowFastMath(bool allow)
+{
+	fastMath = allow;
+}
+
+void CLHelper::Specialization::allowMad(bool allow)
+{
+	mad = allow;
+}
+
+void CLHelper::Specialization::keepArgumentInfo(bool keep)
+{
+	argumentInfo = keep;
+}
+
+bool CLHelper::Specialization::isGeneric() const
+{
+	return defines.empty() && !fastMath && !mad && !argumentInfo;
+}
+
+std::string CLHelper::Specialization::buildOptions() const
+{
+	std::string options;
+
+	std::map<std::string, std::string>::const_iterator define;
+	for(define = defines.begin(); define != defines.end(); define++)
+	{
+		options += " -D " + define->first;
+		if(!define->second.empty())
+			options += "=" + define->second;
+	}
+
+	// -cl-fast-relaxed-math implies -cl-mad-enable
+	if(fastMath)
+		options += " -cl-fast-relaxed-math";
+	else if(mad)
+		options += " -cl-mad-enable";
+
+	if(argumentInfo)
+		options += " -cl-kernel-arg-info";
+
+	return options;
+}
+
+CLHelper::SpecializationCache::SpecializationCache(
+	cl::Context& context,
+	std::vector<cl::Device>& devices,
+	const std::string& relativeFilePath,
+	size_t maxSpecializations,
+	SpecializationPolicy policy)
+	: context(context),
+	  devices(devices),
+	  relativeFilePath(relativeFilePath),
+	  maxSpecializations(maxSpecializations),
+	  policy(policy)
+{
+}
+
+cl::Program& CLHelper::SpecializationCache::getGeneric()
+{
+	return prepareGeneric()->wait();
+}
+
+cl::Program& CLHelper::SpecializationCache::get(const Specialization& specialization, bool* specialized)
+{
+	return prepare(specialization, specialized)->wait();
+}
+
+boost::shared_ptr<CLHelper::ProgramBuild> CLHelper::SpecializationCache::prepareGeneric()
+{
+	if(!genericProgram)
+		genericProgram = build("");
+
+	return genericProgram;
+}
+
+boost::shared_ptr<CLHelper::ProgramBuild> CLHelper::SpecializationCache::prepare(const Specialization& specialization, bool* specialized)
+{
+	if(specialized != NULL)
+		*specialized = false;
+
+	if(specialization.isGeneric() || maxSpecializations == 0)
+		return prepareGeneric();
+
+	std::string options = specialization.buildOptions();
+
+	std::map<std::string, boost::shared_ptr<ProgramBuild> >::iterator program = programs.find(options);
+	if(program != programs.end()) {
+		recentlyUsed.remove(options);
+		recentlyUsed.push_front(options);
+
+		if(specialized != NULL)
+			*specialized = true;
+		return program->second;
+	}
+
+	// Make room for a new variant, or fall back to the generic program
+	if(programs.size() >= maxSpecializations) {
+		if(policy == SPECIALIZATION_KEEP_FIRST)
+			return prepareGeneric();
+
+		programs.erase(recentlyUsed.back());
+		recentlyUsed.pop_back();
+	}
+
+	recentlyUsed.push_front(options);
+	program = programs.insert(std::make_pair(options, build(options))).first;
+
+	if(specialized != NULL)
+		*specialized = true;
+	return program->second;
+}
+
+size_t CLHelper::SpecializationCache::size() const
+{
+	return programs.size();
+}
+
+boost::shared_ptr<CLHelper::ProgramBuild> CLHelper::SpecializationCache::build(const std::string& options)
+{
+	return BuildService::shared().submit(context, devices, relativeFilePath, options);
+}
@@ -0,0 +1,86 @@
+#ifndef _KERNELSPECIALIZER_H
+#define _KERNELSPECIALIZER_H
+
+#include <list>
+#include <map>
+#include <sstream>
+#include <boost/shared_ptr.hpp>
+#include "CLHelper.h"
+#include "BuildService.h"
+
+namespace CLHelper
+{
+	/* A set of problem constants and compiler flags to bake into a program */
+	class Specialization {
+
+	public:
+		Specialization();
+
+		template <typename T>
+		void define(const std::string& name, const T& value)
+		{
+			std::ostringstream valueStream;
+			valueStream << value;
+			defines[name] = valueStream.str();
+		}
+		void define(const std::string& name);
+
+		void allowFastMath(bool allow = true);		/* -cl-fast-relaxed-math, only where the caller tolerates it */
+		void allowMad(bool allow = true);			/* -cl-mad-enable */
+		void keepArgumentInfo(bool keep = true);	/* -cl-kernel-arg-info, for binding and checking arguments by name */
+
+		bool isGeneric() const;					/* no options at all, the build that prebuilt binaries are made with */
+		std::string buildOptions() const;
+
+	private:
+		std::map<std::string, std::string> defines;	/* sorted, so equal sets give equal options */
+		bool fastMath;
+		bool mad;
+		bool argumentInfo;
+	};
+
+	enum SpecializationPolicy {
+		SPECIALIZATION_KEEP_FIRST,		/* Keep the first N variants, use the generic program after that */
+		SPECIALIZATION_EVICT_LRU		/* Replace the least recently used variant */
+	};
+
+	/*
+	 * Compiles and caches specialized variants of one kernel file. Variants
+	 * build on the build service: prepare() starts a build without waiting,
+	 * get() waits for the one variant it returns.
+	 */
+	class SpecializationCache {
+
+	public:
+		SpecializationCache(
+			cl::Context& context,
+			std::vector<cl::Device>& devices,
+			const std::string& relativeFilePath,
+			size_t maxSpecializations = 8,
+			SpecializationPolicy policy = SPECIALIZATION_KEEP_FIRST);
+
+		cl::Program& getGeneric();
+		cl::Program& get(const Specialization& specialization, bool* specialized = NULL);
+
+		boost::shared_ptr<ProgramBuild> prepareGeneric();
+		boost::shared_ptr<ProgramBuild> prepare(const Specialization& specialization, bool* specialized = NULL);
+
+		size_t size() const;
+
+	private:
+		boost::shared_ptr<ProgramBuild> build(const std::string& options);
+
+		cl::Context context;
+		std::vector<cl::Device> devices;
+		std::string relativeFilePath;
+		size_t maxSpecializations;
+		SpecializationPolicy policy;
+
+		boost::shared_ptr<ProgramBuild> genericProgram;
+
+		std::map<std::string, boost::shared_ptr<ProgramBuild> > programs;
+		std::list<std::string> recentlyUsed;		/* front is the most recently used build options */
+	};
+};
+
+#endif
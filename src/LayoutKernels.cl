@@ -0,0 +1,74 @@
+// Records of 4 byte fields stored as uints in one of three layouts, matching
+// CLHelper::LayoutKind and CLHelper::layoutIndex() on the host.
+#define LAYOUT_AOS 0
+#define LAYOUT_SOA 1
+#define LAYOUT_AOSOA 2
+
+size_t layoutIndex(unsigned int kind, unsigned int tileWidth, unsigned int record, unsigned int field, unsigned int fieldCount, unsigned int count)
+{
+	if(kind == LAYOUT_SOA)
+		return (size_t) field * count + record;
+	if(kind == LAYOUT_AOSOA)
+		return ((size_t) (record / tileWidth) * fieldCount + field) * tileWidth + record % tileWidth;
+	return (size_t) record * fieldCount + field;
+}
+
+// CLHelper::defineRecordAccessors() defines LAYOUT_KIND, LAYOUT_TILE and
+// RECORD_FIELDS along with LOAD_<field> and STORE_<field> built on this
+#ifdef LAYOUT_KIND
+#define RECORD_INDEX(record, field, count) layoutIndex(LAYOUT_KIND, LAYOUT_TILE, record, field, RECORD_FIELDS, count)
+#endif
+
+// One work-item per record and field, the layouts are kernel arguments so a
+// single build converts between any two of them
+__kernel
+void convertLayoutKernel(
+	__global const uint* source,
+	__global uint* destination,
+	unsigned int count,
+	unsigned int fieldCount,
+	unsigned int sourceKind,
+	unsigned int sourceTile,
+	unsigned int destinationKind,
+	unsigned int destinationTile)
+{
+	unsigned int record = get_global_id(0);
+	unsigned int field = get_global_id(1);
+
+	if(record >= count)
+		return;
+
+	destination[layoutIndex(destinationKind, destinationTile, record, field, fieldCount, count)] =
+		source[layoutIndex(sourceKind, sourceTile, record, field, fieldCount, count)];
+}
+
+// Benchmark kernels for the particle record of CLHelper::runLayoutBenchmark()
+#if defined(LOAD_x) && defined(LOAD_vx) && defined(LOAD_mass)
+
+// Reads six fields and writes three of every record
+__kernel
+void advanceKernel(__global uint* data, unsigned int count, float dt)
+{
+	unsigned int record = get_global_id(0);
+
+	if(record >= count)
+		return;
+
+	STORE_x(data, record, count, LOAD_x(data, record, count) + dt * LOAD_vx(data, record, count));
+	STORE_y(data, record, count, LOAD_y(data, record, count) + dt * LOAD_vy(data, record, count));
+	STORE_z(data, record, count, LOAD_z(data, record, count) + dt * LOAD_vz(data, record, count));
+}
+
+// Touches a single field, where AoS wastes most of every memory transaction
+__kernel
+void scaleMassKernel(__global uint* data, unsigned int count, float factor)
+{
+	unsigned int record = get_global_id(0);
+
+	if(record >= count)
+		return;
+
+	STORE_mass(data, record, count, LOAD_mass(data, record, count) * factor);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#include <sstream>
+#include "Metrics.h"
+
+CLHelper::Metrics& CLHelper::Metrics::shared()
+{
+	static Metrics metrics;
+	return metrics;
+}
+
+void CLHelper::Metrics::set(const std::string& name, double value)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	values[name] = value;
+}
+
+void CLHelper::Metrics::add(const std::string& name, double delta)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	values[name] += delta;
+}
+
+double CLHelper::Metrics::get(const std::string& name) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::map<std::string, double>::const_iterator value = values.find(name);
+	return (value != values.end()) ? value->second : 0;
+}
+
+std::map<std::string, double> CLHelper::Metrics::snapshot() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return values;
+}
+
+std::string CLHelper::Metrics::format() const
+{
+	std::map<std::string, double> metrics = snapshot();
+
+	std::ostringstream formatted;
+	std::map<std::string, double>::const_iterator metric;
+	for(metric = metrics.begin(); metric != metrics.end(); metric++)
+		formatted << " " << metric->first << "=" << metric->second;
+
+	return formatted.str();
+}
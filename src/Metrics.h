@@ -0,0 +1,37 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <map>
+#include <string>
+#include <boost/thread/mutex.hpp>
+
+namespace CLHelper
+{
+	/*
+	 * Named numeric metrics shared by the whole process. Components publish
+	 * gauges and counters under "<component>_<name>" keys, the job server
+	 * reports all of them in its STATS reply.
+	 */
+	class Metrics {
+
+	public:
+		static Metrics& shared();
+
+		void set(const std::string& name, double value);		/* gauge */
+		void add(const std::string& name, double delta);		/* counter */
+		double get(const std::string& name) const;				/* 0 for unknown names */
+
+		std::map<std::string, double> snapshot() const;
+		std::string format() const;		/* " <name>=<value>" for every metric, sorted by name */
+
+	private:
+		Metrics() {}
+		Metrics(const Metrics&);
+		Metrics& operator=(const Metrics&);
+
+		mutable boost::mutex mutex;
+		std::map<std::string, double> values;
+	};
+};
+
+#endif
@@ -0,0 +1,82 @@
+// Micro-kernels used by DeviceCharacterization to measure what a device can do.
+// Every bandwidth kernel moves one float4 per work-item.
+
+#ifndef FLOAT_TYPE
+#define FLOAT_TYPE float
+#endif
+
+#define LOCAL_ITERATIONS 64
+#define FLOPS_ITERATIONS 128
+
+__kernel
+void readBandwidthKernel(__global const float4* input, __global float* output)
+{
+	unsigned int threadId = get_global_id(0);
+	float4 value = input[threadId];
+
+	// Practically never true, but keeps the load from being optimized away
+	if(value.x + value.y + value.z + value.w == -1.0f)
+		output[0] = value.x;
+}
+
+__kernel
+void writeBandwidthKernel(__global float4* output, float value)
+{
+	output[get_global_id(0)] = (float4) (value);
+}
+
+__kernel
+void copyBandwidthKernel(__global const float4* input, __global float4* output)
+{
+	unsigned int threadId = get_global_id(0);
+	output[threadId] = input[threadId];
+}
+
+__kernel
+void triadBandwidthKernel(__global float4* dataA, __global const float4* dataB, __global const float4* dataC, float scalar)
+{
+	unsigned int threadId = get_global_id(0);
+	dataA[threadId] = dataB[threadId] + scalar * dataC[threadId];
+}
+
+// Requires a power-of-two work-group size
+__kernel
+void localBandwidthKernel(__global float* output, __local float* scratch)
+{
+	unsigned int localId = get_local_id(0);
+	unsigned int localMask = get_local_size(0) - 1;
+
+	scratch[localId] = (float) localId;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	float sum = 0.0f;
+	for(unsigned int i = 0; i < LOCAL_ITERATIONS; i++)
+		sum += scratch[(localId + i) & localMask];
+
+	output[get_global_id(0)] = sum;
+}
+
+// Four independent chains of 8 mads per iteration: 64 flops per lane per iteration
+#define MAD8(x) \
+	x = mad(x, factor, offset); x = mad(x, factor, offset); x = mad(x, factor, offset); x = mad(x, factor, offset); \
+	x = mad(x, factor, offset); x = mad(x, factor, offset); x = mad(x, factor, offset); x = mad(x, factor, offset);
+
+__kernel
+void peakFlopsKernel(__global FLOAT_TYPE* output, float seed)
+{
+	FLOAT_TYPE factor = (FLOAT_TYPE) (0.999f);
+	FLOAT_TYPE offset = (FLOAT_TYPE) (seed);
+	FLOAT_TYPE x0 = (FLOAT_TYPE) (get_global_id(0));
+	FLOAT_TYPE x1 = x0 + (FLOAT_TYPE) (1.0f);
+	FLOAT_TYPE x2 = x0 + (FLOAT_TYPE) (2.0f);
+	FLOAT_TYPE x3 = x0 + (FLOAT_TYPE) (3.0f);
+
+	for(int i = 0; i < FLOPS_ITERATIONS; i++) {
+		MAD8(x0)
+		MAD8(x1)
+		MAD8(x2)
+		MAD8(x3)
+	}
+
+	output[get_global_id(0)] = x0 + x1 + x2 + x3;
+}
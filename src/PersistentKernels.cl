@@ -0,0 +1,49 @@
+// Built with -cl-std=CL2.0 and -D QUEUE_CAPACITY=<n>, and launched as a single
+// work-group that stays resident until the host raises the stop flag. Work is
+// handed over through fine-grained SVM with atomics, so submitting an add costs
+// the host a few memory writes instead of a kernel launch.
+
+#define CONTROL_SUBMITTED 0		/* tickets published by the host */
+#define CONTROL_COMPLETED 1		/* tickets finished by the kernel */
+#define CONTROL_STOP 2			/* set by the host to end the kernel once the queue is drained */
+
+typedef struct {
+	uint offsetA;
+	uint offsetB;
+	uint offsetC;
+	uint dataSize;
+} WorkDescriptor;
+
+__kernel
+void persistentAddKernel(__global atomic_int* control, __global const WorkDescriptor* descriptors, __global float* arena)
+{
+	__local int nextTicket;
+	int processed = 0;
+
+	for(;;) {
+		// One work-item polls, the others wait at the barrier
+		if(get_local_id(0) == 0) {
+			int submitted;
+			while((submitted = atomic_load_explicit(&control[CONTROL_SUBMITTED], memory_order_acquire, memory_scope_all_svm_devices)) == processed
+				&& !atomic_load_explicit(&control[CONTROL_STOP], memory_order_acquire, memory_scope_all_svm_devices))
+				;
+			nextTicket = (submitted == processed) ? -1 : processed;
+		}
+		work_group_barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE, memory_scope_all_svm_devices);
+
+		int ticket = nextTicket;
+		work_group_barrier(CLK_LOCAL_MEM_FENCE);
+		if(ticket < 0)
+			return;
+
+		WorkDescriptor descriptor = descriptors[ticket % QUEUE_CAPACITY];
+		for(uint i = get_local_id(0); i < descriptor.dataSize; i += get_local_size(0))
+			arena[descriptor.offsetC + i] = arena[descriptor.offsetA + i] + arena[descriptor.offsetB + i];
+
+		work_group_barrier(CLK_GLOBAL_MEM_FENCE, memory_scope_all_svm_devices);
+		if(get_local_id(0) == 0)
+			atomic_store_explicit(&control[CONTROL_COMPLETED], ticket + 1, memory_order_release, memory_scope_all_svm_devices);
+
+		processed++;
+	}
+}
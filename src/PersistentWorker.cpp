@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include "PersistentWorker.h"
+
+#define CONTROL_SUBMITTED 0
+#define CONTROL_COMPLETED 1
+#define CONTROL_STOP 2
+#define CONTROL_COUNT 3
+
+#define DESCRIPTOR_WORDS 4
+
+bool CLHelper::PersistentWorker::isSupported(cl::Device& device, DeviceInfo& deviceInfo)
+{
+#ifdef CL_VERSION_2_0
+	if(parseOpenCLVersion(deviceInfo.deviceVersion) < 200)
+		return false;
+
+	cl_device_svm_capabilities svmCapabilities = 0;
+	if(device.getInfo(CL_DEVICE_SVM_CAPABILITIES, &svmCapabilities) != CL_SUCCESS)
+		return false;
+
+	// The host's atomics have to be usable on the memory the kernel polls
+	return (svmCapabilities & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0
+		&& (svmCapabilities & CL_DEVICE_SVM_ATOMICS) != 0
+		&& sizeof(boost::atomic<boost::int32_t>) == sizeof(cl_int);
+#else
+	return false;
+#endif
+}
+
+CLHelper::PersistentWorker::PersistentWorker(cl::Context& context, cl::Device& device, DeviceInfo& deviceInfo, size_t maxDataSize)
+	: context(context),
+	  maxDataSize(maxDataSize),
+	  control(NULL),
+	  descriptors(NULL),
+	  arena(NULL),
+	  nextTicket(0),
+	  running(false)
+{
+	if(!isSupported(device, deviceInfo)) {
+		std::cerr << "PersistentWorker needs fine-grained SVM with atomics, which the device does not support." << std::endl;
+		exit(1);
+	}
+
+#ifdef CL_VERSION_2_0
+	cl_int err;
+
+	commQueue = cl::CommandQueue(context, device, 0, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	std::ostringstream options;
+	options << "-cl-std=CL2.0 -D QUEUE_CAPACITY=" << PERSISTENT_QUEUE_CAPACITY;
+
+	std::vector<cl::Device> devices(1, device);
+	createProgram(context, devices, "PersistentKernels.cl", options.str().c_str(), &program);
+	compileProgram(program, devices, options.str().c_str());
+
+	kernel = cl::Kernel(program, "persistentAddKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+	cl_svm_mem_flags sharedFlags = CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER;
+	void* controlMemory = clSVMAlloc(context(), sharedFlags | CL_MEM_SVM_ATOMICS, CONTROL_COUNT * sizeof(cl_int), 0);
+	descriptors = (cl_uint*) clSVMAlloc(context(), sharedFlags, PERSISTENT_QUEUE_CAPACITY * DESCRIPTOR_WORDS * sizeof(cl_uint), 0);
+	arena = (cl_float*) clSVMAlloc(context(), sharedFlags, PERSISTENT_QUEUE_CAPACITY * 3 * maxDataSize * sizeof(cl_float), 0);
+	if(controlMemory == NULL || descriptors == NULL || arena == NULL) {
+		std::cerr << "clSVMAlloc() failed for the persistent worker queue." << std::endl;
+		exit(1);
+	}
+
+	control = (boost::atomic<boost::int32_t>*) controlMemory;
+	for(int i = 0; i < CONTROL_COUNT; i++)
+		new (&control[i]) boost::atomic<boost::int32_t>(0);
+
+	err  = clSetKernelArgSVMPointer(kernel(), 0, control);
+	err |= clSetKernelArgSVMPointer(kernel(), 1, descriptors);
+	err |= clSetKernelArgSVMPointer(kernel(), 2, arena);
+	CHECK_OPENCL_ERROR(err, "clSetKernelArgSVMPointer() failed.");
+
+	// A single work-group, since only one group is guaranteed to make progress while others spin
+	size_t workGroupSize = std::min(deviceInfo.maxWorkGroupSize, (size_t) 256);
+	err = commQueue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(workGroupSize), cl::NDRange(workGroupSize), NULL, &kernelEvent);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+	err = commQueue.flush();
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::flush() failed.");
+
+	running = true;
+#endif
+}
+
+CLHelper::PersistentWorker::~PersistentWorker()
+{
+	stop();
+
+#ifdef CL_VERSION_2_0
+	if(control != NULL)
+		clSVMFree(context(), control);
+	if(descriptors != NULL)
+		clSVMFree(context(), descriptors);
+	if(arena != NULL)
+		clSVMFree(context(), arena);
+#endif
+}
+
+boost::int32_t CLHelper::PersistentWorker::submitAdd(const cl_float* dataA, const cl_float* dataB, size_t dataSize)
+{
+	if(dataSize > maxDataSize) {
+		std::cerr << "PersistentWorker::submitAdd(): " << dataSize << " elements exceed the maximum of " << maxDataSize << std::endl;
+		exit(1);
+	}
+
+	boost::int32_t ticket = nextTicket++;
+
+	// The slot is free once the ticket that used it one lap ago has completed
+	while(control[CONTROL_COMPLETED].load(boost::memory_order_acquire) <= ticket - PERSISTENT_QUEUE_CAPACITY)
+		;
+
+	size_t slot = ticket % PERSISTENT_QUEUE_CAPACITY;
+	cl_uint offsetA = (cl_uint) (slot * 3 * maxDataSize);
+	cl_uint offsetB = offsetA + (cl_uint) maxDataSize;
+	cl_uint offsetC = offsetB + (cl_uint) maxDataSize;
+
+	memcpy(arena + offsetA, dataA, dataSize * sizeof(cl_float));
+	memcpy(arena + offsetB, dataB, dataSize * sizeof(cl_float));
+
+	cl_uint* descriptor = descriptors + slot * DESCRIPTOR_WORDS;
+	descriptor[0] = offsetA;
+	descriptor[1] = offsetB;
+	descriptor[2] = offsetC;
+	descriptor[3] = (cl_uint) dataSize;
+
+	// Publishing the ticket makes the inputs and the descriptor visible to the kernel
+	control[CONTROL_SUBMITTED].store(ticket + 1, boost::memory_order_release);
+
+	return ticket;
+}
+
+const cl_float* CLHelper::PersistentWorker::wait(boost::int32_t ticket)
+{
+	while(control[CONTROL_COMPLETED].load(boost::memory_order_acquire) <= ticket)
+		;
+
+	size_t slot = ticket % PERSISTENT_QUEUE_CAPACITY;
+	return arena + slot * 3 * maxDataSize + 2 * maxDataSize;
+}
+
+// Lets the kernel drain the queue and return
+void CLHelper::PersistentWorker::stop()
+{
+	if(!running)
+		return;
+
+	control[CONTROL_STOP].store(1, boost::memory_order_release);
+
+	cl_int err = kernelEvent.wait();
+	CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+
+	running = false;
+}
+
+size_t CLHelper::PersistentWorker::getMaxDataSize() const
+{
+	return maxDataSize;
+}
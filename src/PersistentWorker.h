@@ -0,0 +1,56 @@
+#ifndef _PERSISTENTWORKER_H
+#define _PERSISTENTWORKER_H
+
+#include "CLHelper.h"
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#define PERSISTENT_QUEUE_CAPACITY 256
+
+namespace CLHelper
+{
+	/*
+	 * Runs adds through one long-running kernel instead of one launch per add.
+	 * The kernel polls a queue of work descriptors in fine-grained SVM, so it
+	 * needs an OpenCL 2.0 device with CL_DEVICE_SVM_FINE_GRAIN_BUFFER and
+	 * CL_DEVICE_SVM_ATOMICS; check isSupported() first. A worker has a single
+	 * producer: submitAdd() and wait() must be called from one thread.
+	 */
+	class PersistentWorker {
+
+	public:
+		static bool isSupported(cl::Device& device, DeviceInfo& deviceInfo);
+
+		PersistentWorker(cl::Context& context, cl::Device& device, DeviceInfo& deviceInfo, size_t maxDataSize);
+		~PersistentWorker();
+
+		/* Copies the inputs into the queue and returns a ticket for wait() */
+		boost::int32_t submitAdd(const cl_float* dataA, const cl_float* dataB, size_t dataSize);
+
+		/* Spins until the ticket is done, the result stays valid for the next PERSISTENT_QUEUE_CAPACITY - 1 submissions */
+		const cl_float* wait(boost::int32_t ticket);
+
+		void stop();
+		size_t getMaxDataSize() const;
+
+	private:
+		PersistentWorker(const PersistentWorker&);
+		PersistentWorker& operator=(const PersistentWorker&);
+
+		cl::Context context;
+		cl::CommandQueue commQueue;
+		cl::Program program;
+		cl::Kernel kernel;
+		cl::Event kernelEvent;
+
+		size_t maxDataSize;
+		boost::atomic<boost::int32_t>* control;		/* submitted, completed, stop; shared with the kernel */
+		cl_uint* descriptors;						/* PERSISTENT_QUEUE_CAPACITY x (offsetA, offsetB, offsetC, dataSize) */
+		cl_float* arena;							/* three arrays of maxDataSize per queue slot */
+
+		boost::int32_t nextTicket;
+		bool running;
+	};
+};
+
+#endif
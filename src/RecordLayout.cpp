@@ -0,0 +1,277 @@
+#include <cstring>
+#include <sstream>
+#include <boost/bind/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "DeviceCharacterization.h"
+#include "RecordLayout.h"
+#include "ThreadPool.h"
+
+static void convertRecordRange(
+	size_t fieldCount,
+	size_t count,
+	const boost::uint32_t* source,
+	const CLHelper::RecordLayout* sourceLayout,
+	boost::uint32_t* destination,
+	const CLHelper::RecordLayout* destinationLayout,
+	size_t firstRecord,
+	size_t lastRecord);
+
+std::string CLHelper::RecordLayout::toString() const
+{
+	if(kind == LAYOUT_SOA)
+		return "SoA";
+	if(kind == LAYOUT_AOS)
+		return "AoS";
+
+	std::ostringstream name;
+	name << "AoSoA" << tileWidth;
+	return name.str();
+}
+
+CLHelper::RecordType::RecordType(const std::string& name)
+	: name(name)
+{
+}
+
+CLHelper::RecordType& CLHelper::RecordType::addField(const std::string& fieldName, const std::string& clType)
+{
+	if(clType != "float" && clType != "int" && clType != "uint") {
+		std::cerr << "Invalid type \"" << clType << "\" for field " << name << "." << fieldName << ", fields must be 'float', 'int' or 'uint'" << std::endl;
+		exit(1);
+	}
+
+	fieldNames.push_back(fieldName);
+	fieldTypes.push_back(clType);
+	return *this;
+}
+
+const std::string& CLHelper::RecordType::getName() const
+{
+	return name;
+}
+
+size_t CLHelper::RecordType::getFieldCount() const
+{
+	return fieldNames.size();
+}
+
+size_t CLHelper::RecordType::getRecordBytes() const
+{
+	return fieldNames.size() * sizeof(boost::uint32_t);
+}
+
+const std::string& CLHelper::RecordType::getFieldName(size_t field) const
+{
+	return fieldNames[field];
+}
+
+const std::string& CLHelper::RecordType::getFieldType(size_t field) const
+{
+	return fieldTypes[field];
+}
+
+size_t CLHelper::layoutElements(const RecordLayout& layout, size_t fieldCount, size_t count)
+{
+	if(layout.kind == LAYOUT_AOSOA)
+		count = (count + layout.tileWidth - 1) / layout.tileWidth * layout.tileWidth;
+
+	return count * fieldCount;
+}
+
+size_t CLHelper::preferredTileWidth(const DeviceInfo& deviceInfo, size_t workGroupMultiple)
+{
+	size_t vectorWidth = std::max(deviceInfo.preferredFloatVecWidth, (cl_uint) 1);
+	if(deviceInfo.dType & CL_DEVICE_TYPE_CPU)
+		return vectorWidth;
+
+	return vectorWidth * std::max(workGroupMultiple, (size_t) 1);
+}
+
+void CLHelper::convertLayout(
+	const RecordType& type,
+	const boost::uint32_t* source,
+	const RecordLayout& sourceLayout,
+	boost::uint32_t* destination,
+	const RecordLayout& destinationLayout,
+	size_t count)
+{
+	ThreadPool::shared().parallelFor(0, count, boost::bind(&convertRecordRange, type.getFieldCount(), count,
+		source, &sourceLayout, destination, &destinationLayout, boost::placeholders::_1, boost::placeholders::_2));
+}
+
+cl::Event CLHelper::convertLayoutOnDevice(
+	Runtime& runtime,
+	cl::CommandQueue& commQueue,
+	const RecordType& type,
+	const cl::Buffer& source,
+	const RecordLayout& sourceLayout,
+	cl::Buffer& destination,
+	const RecordLayout& destinationLayout,
+	size_t count)
+{
+	cl_int err;
+
+	cl::Kernel kernel(runtime.getProgram("LayoutKernels.cl"), "convertLayoutKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+	err  = kernel.setArg(0, source);
+	err |= kernel.setArg(1, destination);
+	err |= kernel.setArg(2, (cl_uint) count);
+	err |= kernel.setArg(3, (cl_uint) type.getFieldCount());
+	err |= kernel.setArg(4, (cl_uint) sourceLayout.kind);
+	err |= kernel.setArg(5, (cl_uint) sourceLayout.tileWidth);
+	err |= kernel.setArg(6, (cl_uint) destinationLayout.kind);
+	err |= kernel.setArg(7, (cl_uint) destinationLayout.tileWidth);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+	cl::Event clEvent;
+	err = commQueue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(count, type.getFieldCount()), cl::NullRange, NULL, &clEvent);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+	return clEvent;
+}
+
+void CLHelper::defineRecordAccessors(const RecordType& type, const RecordLayout& layout, Specialization* specialization)
+{
+	specialization->define("LAYOUT_KIND", (int) layout.kind);
+	specialization->define("LAYOUT_TILE", layout.tileWidth);
+	specialization->define("RECORD_FIELDS", type.getFieldCount());
+
+	// Build options are split at spaces, so the macro bodies have none
+	for(size_t field = 0; field < type.getFieldCount(); field++)
+	{
+		std::ostringstream load, store, index;
+		index << "RECORD_INDEX(r," << field << ",n)";
+		load << "as_" << type.getFieldType(field) << "(d[" << index.str() << "])";
+		store << "(d[" << index.str() << "]=as_uint((" << type.getFieldType(field) << ")(v)))";
+
+		specialization->define("LOAD_" + type.getFieldName(field) + "(d,r,n)", load.str());
+		specialization->define("STORE_" + type.getFieldName(field) + "(d,r,n,v)", store.str());
+	}
+}
+
+void CLHelper::runLayoutBenchmark(Runtime& runtime, size_t count, size_t repetitions)
+{
+	cl_int err;
+
+	DeviceInfo& deviceInfo = runtime.getDeviceInfo(0);
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
+	repetitions = std::max(repetitions, (size_t) 1);
+
+	RecordType particle("Particle");
+	particle.addField("x").addField("y").addField("z")
+	        .addField("vx").addField("vy").addField("vz")
+	        .addField("mass").addField("id", "uint");
+	size_t fieldCount = particle.getFieldCount();
+
+	// GPUs get tiles spanning the work-items the device runs in lockstep
+	size_t workGroupMultiple = 1;
+	cl::Kernel convertKernel(runtime.getProgram("LayoutKernels.cl"), "convertLayoutKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+#ifdef CL_VERSION_1_1
+	err = convertKernel.getWorkGroupInfo(runtime.getDevice(0), CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, &workGroupMultiple);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::getWorkGroupInfo() failed.");
+#endif
+
+	RecordLayout aos(LAYOUT_AOS);
+	RecordLayout layouts[] = { aos, RecordLayout(LAYOUT_SOA), RecordLayout(LAYOUT_AOSOA, preferredTileWidth(deviceInfo, workGroupMultiple)) };
+
+	std::vector<boost::uint32_t> records(count * fieldCount);
+	for(size_t record = 0; record < count; record++)
+	{
+		float values[] = { (float) record, 0.5f * record, 0.25f * record, 1.0f, -1.0f, 0.5f, 1.0f + record % 7 };
+		memcpy(&records[record * fieldCount], values, sizeof(values));
+		records[record * fieldCount + 7] = (boost::uint32_t) record;
+	}
+
+	cl::Buffer d_records(runtime.getContext(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, records.size() * sizeof(boost::uint32_t), &records[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	std::cout << "Layout benchmark, " << count << " particles of " << particle.getRecordBytes() << " bytes, average of " << repetitions << " runs, GB/s of fields used:" << std::endl;
+	std::cout << "  layout, host conversion, device conversion, advance (6 fields read, 3 written), scale mass (1 read, 1 written)" << std::endl;
+
+	std::vector<boost::uint32_t> reference;
+	for(size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+	{
+		const RecordLayout& layout = layouts[i];
+		size_t elements = layoutElements(layout, fieldCount, count);
+		double layoutBytes = (double) count * particle.getRecordBytes();
+
+		// Convert on the host and on the device, the two must agree
+		std::vector<boost::uint32_t> converted(elements, 0);
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		convertLayout(particle, &records[0], aos, &converted[0], layout, count);
+		double hostSeconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+
+		// Written first so that the padding of the last AoSoA tile is zero as on the host
+		cl::Buffer d_converted(runtime.getContext(), CL_MEM_READ_WRITE, elements * sizeof(boost::uint32_t), NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		err = commQueue.enqueueWriteBuffer(d_converted, CL_TRUE, 0, elements * sizeof(boost::uint32_t), &converted[0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+
+		cl::Event convertEvent = convertLayoutOnDevice(runtime, commQueue, particle, d_records, aos, d_converted, layout, count);
+		err = convertEvent.wait();
+		CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+		double deviceSeconds = eventSeconds(convertEvent);
+
+		std::vector<boost::uint32_t> deviceConverted(elements);
+		err = commQueue.enqueueReadBuffer(d_converted, CL_TRUE, 0, elements * sizeof(boost::uint32_t), &deviceConverted[0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+		bool conversionsAgree = (deviceConverted == converted);
+
+		// Run the field kernels through the generated accessors
+		Specialization specialization;
+		defineRecordAccessors(particle, layout, &specialization);
+		cl::Program program = runtime.getProgram("LayoutKernels.cl", specialization);
+
+		cl::Kernel advanceKernel(program, "advanceKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+		err  = advanceKernel.setArg(0, d_converted);
+		err |= advanceKernel.setArg(1, (cl_uint) count);
+		err |= advanceKernel.setArg(2, 0.01f);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		cl::Kernel scaleKernel(program, "scaleMassKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+		err  = scaleKernel.setArg(0, d_converted);
+		err |= scaleKernel.setArg(1, (cl_uint) count);
+		err |= scaleKernel.setArg(2, 1.0f);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		double advanceSeconds = averageKernelSeconds(commQueue, advanceKernel, cl::NDRange(count), cl::NullRange, repetitions);
+		double scaleSeconds = averageKernelSeconds(commQueue, scaleKernel, cl::NDRange(count), cl::NullRange, repetitions);
+
+		// Every layout ran the same steps, so back in AoS their results must be identical
+		err = commQueue.enqueueReadBuffer(d_converted, CL_TRUE, 0, elements * sizeof(boost::uint32_t), &deviceConverted[0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+		std::vector<boost::uint32_t> result(count * fieldCount);
+		convertLayout(particle, &deviceConverted[0], layout, &result[0], aos, count);
+		if(reference.empty())
+			reference = result;
+
+		std::cout << "  " << layout.toString() << ", "
+		          << 2 * layoutBytes / hostSeconds / 1e9 << ", "
+		          << 2 * layoutBytes / deviceSeconds / 1e9 << (conversionsAgree ? "" : " (differs from host)") << ", "
+		          << 9.0 * sizeof(cl_float) * count / advanceSeconds / 1e9 << ", "
+		          << 2.0 * sizeof(cl_float) * count / scaleSeconds / 1e9
+		          << (result == reference ? "" : ", result differs from AoS") << std::endl;
+	}
+}
+
+static void convertRecordRange(
+	size_t fieldCount,
+	size_t count,
+	const boost::uint32_t* source,
+	const CLHelper::RecordLayout* sourceLayout,
+	boost::uint32_t* destination,
+	const CLHelper::RecordLayout* destinationLayout,
+	size_t firstRecord,
+	size_t lastRecord)
+{
+	for(size_t record = firstRecord; record < lastRecord; record++)
+	{
+		for(size_t field = 0; field < fieldCount; field++)
+			destination[CLHelper::layoutIndex(*destinationLayout, fieldCount, count, record, field)] =
+				source[CLHelper::layoutIndex(*sourceLayout, fieldCount, count, record, field)];
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef _RECORDLAYOUT_H
+#define _RECORDLAYOUT_H
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include "CLHelper.h"
+#include "KernelSpecializer.h"
+#include "Runtime.h"
+
+namespace CLHelper
+{
+	/* Must match the LAYOUT_* values in LayoutKernels.cl */
+	enum LayoutKind {
+		LAYOUT_AOS = 0,			/* record after record */
+		LAYOUT_SOA = 1,			/* one array per field */
+		LAYOUT_AOSOA = 2		/* records in tiles of tileWidth, each tile one array per field */
+	};
+
+	struct RecordLayout {
+		LayoutKind kind;
+		size_t tileWidth;		/* records per tile, only for LAYOUT_AOSOA */
+
+		RecordLayout(LayoutKind kind = LAYOUT_AOS, size_t tileWidth = 1) : kind(kind), tileWidth(std::max(tileWidth, (size_t) 1)) {}
+
+		std::string toString() const;
+	};
+
+	/* A record of 4 byte fields ('float', 'int' or 'uint'), described once and stored in any layout */
+	class RecordType {
+
+	public:
+		explicit RecordType(const std::string& name);
+
+		RecordType& addField(const std::string& fieldName, const std::string& clType = "float");
+
+		const std::string& getName() const;
+		size_t getFieldCount() const;
+		size_t getRecordBytes() const;
+		const std::string& getFieldName(size_t field) const;
+		const std::string& getFieldType(size_t field) const;
+
+	private:
+		std::string name;
+		std::vector<std::string> fieldNames;
+		std::vector<std::string> fieldTypes;
+	};
+
+	/* Position of a field of a record, in 4 byte elements from the start of the data */
+	inline size_t layoutIndex(const RecordLayout& layout, size_t fieldCount, size_t count, size_t record, size_t field)
+	{
+		if(layout.kind == LAYOUT_SOA)
+			return field * count + record;
+		if(layout.kind == LAYOUT_AOSOA)
+			return ((record / layout.tileWidth) * fieldCount + field) * layout.tileWidth + record % layout.tileWidth;
+		return record * fieldCount + field;
+	}
+
+	/* Elements taken by count records, AoSoA pads the last tile */
+	size_t layoutElements(const RecordLayout& layout, size_t fieldCount, size_t count);
+
+	/*
+	 * AoSoA tile width for a device: the preferred float vector width, so a
+	 * tile fills a vector register on CPUs. GPUs, which vectorize across
+	 * work-items, should pass the kernel's preferred work-group size multiple.
+	 */
+	size_t preferredTileWidth(const DeviceInfo& deviceInfo, size_t workGroupMultiple = 1);
+
+	/* Converts count records between layouts on the host thread pool */
+	void convertLayout(
+		const RecordType& type,
+		const boost::uint32_t* source,
+		const RecordLayout& sourceLayout,
+		boost::uint32_t* destination,
+		const RecordLayout& destinationLayout,
+		size_t count);
+
+	/* Converts count records between layouts with convertLayoutKernel, returning the kernel's event */
+	cl::Event convertLayoutOnDevice(
+		Runtime& runtime,
+		cl::CommandQueue& commQueue,
+		const RecordType& type,
+		const cl::Buffer& source,
+		const RecordLayout& sourceLayout,
+		cl::Buffer& destination,
+		const RecordLayout& destinationLayout,
+		size_t count);
+
+	/*
+	 * Defines the accessors LOAD_<field>(data, record, count) and
+	 * STORE_<field>(data, record, count, value) over __global uint* data in the
+	 * given layout, for kernels including the prologue of LayoutKernels.cl
+	 */
+	void defineRecordAccessors(const RecordType& type, const RecordLayout& layout, Specialization* specialization);
+
+	/* Times field access kernels and conversions over AoS, SoA and AoSoA particles on the runtime's first device */
+	void runLayoutBenchmark(Runtime& runtime, size_t count, size_t repetitions);
+};
+
+#endif
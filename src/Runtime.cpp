@@ -0,0 +1,111 @@
+#include "Runtime.h"
+#include "Trace.h"
+
+/* Fraction of the smallest device's global memory that idle pooled buffers may hold */
+#define POOLED_MEMORY_FRACTION 0.25
+
+void CL_CALLBACK runtimeContextCallback(const char* errorinfo, const void* private_info_size, size_t cb, void* user_data);
+
+CLHelper::Runtime::Runtime(
+	std::vector<cl::Device>& deviceList,
+	std::vector<DeviceInfo>& deviceInfoList,
+	size_t queuesPerDevice,
+	cl_command_queue_properties queueProperties)
+	: deviceList(deviceList), deviceInfoList(deviceInfoList)
+{
+	TRACE_SCOPE("createContext");
+	cl_int err;
+
+	context = cl::Context(deviceList, NULL, &runtimeContextCallback, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+
+	cl_ulong minGlobalMemSize = 0;
+	for(size_t deviceIndex = 0; deviceIndex < deviceList.size(); deviceIndex++)
+	{
+		std::vector<cl::CommandQueue> commQueueList;
+		for(size_t queueIndex = 0; queueIndex < queuesPerDevice; queueIndex++)
+		{
+			commQueueList.push_back(cl::CommandQueue(context, deviceList[deviceIndex], queueProperties, &err));
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+		}
+		commQueueLists.push_back(commQueueList);
+
+		cl_ulong globalMemSize = deviceInfoList[deviceIndex].globalMemSize;
+		if(deviceIndex == 0 || globalMemSize < minGlobalMemSize)
+			minGlobalMemSize = globalMemSize;
+	}
+
+	bufferPool.reset(new BufferPool(context, (cl_ulong) (minGlobalMemSize * POOLED_MEMORY_FRACTION)));
+	monitor.reset(new DeviceMonitor(deviceList.size()));
+}
+
+cl::Context& CLHelper::Runtime::getContext()
+{
+	return context;
+}
+
+size_t CLHelper::Runtime::getDeviceCount() const
+{
+	return deviceList.size();
+}
+
+cl::Device& CLHelper::Runtime::getDevice(size_t deviceIndex)
+{
+	return deviceList[deviceIndex];
+}
+
+CLHelper::DeviceInfo& CLHelper::Runtime::getDeviceInfo(size_t deviceIndex)
+{
+	return deviceInfoList[deviceIndex];
+}
+
+std::vector<cl::CommandQueue>& CLHelper::Runtime::getQueues(size_t deviceIndex)
+{
+	return commQueueLists[deviceIndex];
+}
+
+cl::Program CLHelper::Runtime::getProgram(const std::string& relativeFilePath, const Specialization& specialization)
+{
+	TRACE_SCOPE("getProgram");
+
+	// Wait without the lock, so another job can still find or start its own build
+	boost::shared_ptr<ProgramBuild> programBuild = findProgram(relativeFilePath, specialization);
+	return programBuild->wait();
+}
+
+void CLHelper::Runtime::prepareProgram(const std::string& relativeFilePath, const Specialization& specialization)
+{
+	findProgram(relativeFilePath, specialization);
+}
+
+CLHelper::BufferPool& CLHelper::Runtime::getBufferPool()
+{
+	return *bufferPool;
+}
+
+CLHelper::DeviceMonitor& CLHelper::Runtime::getMonitor()
+{
+	return *monitor;
+}
+
+CLHelper::ThreadPool& CLHelper::Runtime::getThreadPool()
+{
+	return ThreadPool::shared();
+}
+
+boost::shared_ptr<CLHelper::ProgramBuild> CLHelper::Runtime::findProgram(const std::string& relativeFilePath, const Specialization& specialization)
+{
+	boost::mutex::scoped_lock lock(programMutex);
+
+	boost::shared_ptr<SpecializationCache>& programCache = programCaches[relativeFilePath];
+	if(!programCache)
+		programCache.reset(new SpecializationCache(context, deviceList, relativeFilePath));
+
+	return programCache->prepare(specialization);
+}
+
+void CL_CALLBACK runtimeContextCallback(const char* errorinfo, const void* private_info_size, size_t cb, void* user_data)
+{
+	std::cerr << "runtimeContextCallback called!" << std::endl;
+	std::cerr << errorinfo << std::endl;
+}
@@ -0,0 +1,55 @@
+#ifndef _RUNTIME_H
+#define _RUNTIME_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "CLHelper.h"
+#include "BufferPool.h"
+#include "DeviceMonitor.h"
+#include "KernelSpecializer.h"
+#include "ThreadPool.h"
+
+namespace CLHelper
+{
+	/* A context with its queues, compiled programs and buffers, kept warm across many jobs */
+	class Runtime {
+
+	public:
+		Runtime(
+			std::vector<cl::Device>& deviceList,
+			std::vector<DeviceInfo>& deviceInfoList,
+			size_t queuesPerDevice = 1,
+			cl_command_queue_properties queueProperties = 0);
+
+		cl::Context& getContext();
+		size_t getDeviceCount() const;
+		cl::Device& getDevice(size_t deviceIndex);
+		DeviceInfo& getDeviceInfo(size_t deviceIndex);
+		std::vector<cl::CommandQueue>& getQueues(size_t deviceIndex);
+
+		/* Waits only for the variant asked for, other jobs' builds go on meanwhile */
+		cl::Program getProgram(const std::string& relativeFilePath, const Specialization& specialization = Specialization());
+
+		/* Starts building a variant that getProgram() will be asked for later */
+		void prepareProgram(const std::string& relativeFilePath, const Specialization& specialization = Specialization());
+		BufferPool& getBufferPool();
+		DeviceMonitor& getMonitor();		/* throughput of the devices over the jobs run so far */
+		ThreadPool& getThreadPool();		/* host threads for preparing and consuming buffers */
+
+	private:
+		std::vector<cl::Device> deviceList;
+		std::vector<DeviceInfo> deviceInfoList;
+		cl::Context context;
+		std::vector<std::vector<cl::CommandQueue> > commQueueLists;	/* queues of every device */
+
+		std::map<std::string, boost::shared_ptr<SpecializationCache> > programCaches;
+		boost::mutex programMutex;
+
+		boost::shared_ptr<ProgramBuild> findProgram(const std::string& relativeFilePath, const Specialization& specialization);
+
+		boost::shared_ptr<BufferPool> bufferPool;
+		boost::shared_ptr<DeviceMonitor> monitor;
+	};
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+#include <iostream>
+#include "SharedArena.h"
+
+#define SHARED_ARENA_MAGIC 0x434c4152
+#define SHARED_ARENA_VERSION 1
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+CLHelper::SharedArena::SharedArena()
+	: owner(false), mappedSize(0), mapping(NULL), header(NULL), dataOffset(0), dataSize(0), allocated(0)
+{
+}
+
+CLHelper::SharedArena::~SharedArena()
+{
+	close();
+}
+
+bool CLHelper::SharedArena::create(const std::string& name, size_t dataSize)
+{
+	BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT32_LOCK_FREE == 2);
+
+	close();
+
+	size_t headerSize = alignUp(sizeof(Header), SHARED_ARENA_ALIGNMENT);
+	size_t totalSize = headerSize + alignUp(dataSize, SHARED_ARENA_ALIGNMENT);
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0) {
+		std::cerr << "shm_open(\"" << name << "\") failed." << std::endl;
+		return false;
+	}
+
+	if(ftruncate(fd, totalSize) != 0) {
+		std::cerr << "ftruncate() of shared arena failed." << std::endl;
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* address = mmap(NULL, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(address == MAP_FAILED) {
+		std::cerr << "mmap() of shared arena failed." << std::endl;
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	this->name = name;
+	owner = true;
+	mappedSize = totalSize;
+	mapping = (char*) address;
+	this->dataOffset = headerSize;
+	this->dataSize = totalSize - headerSize;
+
+	header = new (mapping) Header();
+	header->requests.head = 0;
+	header->requests.tail = 0;
+	header->completions.head = 0;
+	header->completions.tail = 0;
+	header->dataOffset = this->dataOffset;
+	header->dataSize = this->dataSize;
+	header->version = SHARED_ARENA_VERSION;
+	header->magic = SHARED_ARENA_MAGIC;
+
+	return true;
+}
+
+bool CLHelper::SharedArena::open(const std::string& name)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDWR, 0600);
+	if(fd < 0) {
+		std::cerr << "shm_open(\"" << name << "\") failed." << std::endl;
+		return false;
+	}
+
+	struct stat fileStatus;
+	if(fstat(fd, &fileStatus) != 0 || (size_t) fileStatus.st_size < sizeof(Header)) {
+		::close(fd);
+		return false;
+	}
+
+	void* address = mmap(NULL, fileStatus.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(address == MAP_FAILED)
+		return false;
+
+	this->name = name;
+	owner = false;
+	mappedSize = fileStatus.st_size;
+	mapping = (char*) address;
+	header = (Header*) mapping;
+
+	// Read the layout once: later checks must not depend on memory the client can still change
+	dataOffset = header->dataOffset;
+	dataSize = header->dataSize;
+
+	if(header->magic != SHARED_ARENA_MAGIC || header->version != SHARED_ARENA_VERSION ||
+	   dataOffset < sizeof(Header) || dataOffset > mappedSize || dataSize > mappedSize - dataOffset) {
+		std::cerr << "\"" << name << "\" is not a compatible shared arena." << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+const std::string& CLHelper::SharedArena::getName() const
+{
+	return name;
+}
+
+size_t CLHelper::SharedArena::getDataSize() const
+{
+	return dataSize;
+}
+
+void* CLHelper::SharedArena::getData(boost::uint64_t offset)
+{
+	return mapping + dataOffset + offset;
+}
+
+bool CLHelper::SharedArena::contains(boost::uint64_t offset, boost::uint64_t bytes) const
+{
+	return offset <= dataSize && bytes <= dataSize - offset;
+}
+
+bool CLHelper::SharedArena::allocate(size_t size, boost::uint64_t* offset)
+{
+	boost::uint64_t alignedSize = alignUp(size, SHARED_ARENA_ALIGNMENT);
+	if(alignedSize > dataSize - allocated)
+		return false;
+
+	*offset = allocated;
+	allocated += alignedSize;
+	return true;
+}
+
+void CLHelper::SharedArena::resetAllocations()
+{
+	allocated = 0;
+}
+
+CLHelper::SharedRing<CLHelper::SharedJobDescriptor>& CLHelper::SharedArena::getRequests()
+{
+	return header->requests;
+}
+
+CLHelper::SharedRing<CLHelper::SharedJobCompletion>& CLHelper::SharedArena::getCompletions()
+{
+	return header->completions;
+}
+
+void CLHelper::SharedArena::close()
+{
+	if(mapping != NULL)
+		munmap(mapping, mappedSize);
+	if(owner)
+		shm_unlink(name.c_str());
+
+	owner = false;
+	mappedSize = 0;
+	mapping = NULL;
+	header = NULL;
+	dataOffset = 0;
+	dataSize = 0;
+	allocated = 0;
+}
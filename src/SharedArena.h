@@ -0,0 +1,114 @@
+#ifndef _SHAREDARENA_H
+#define _SHAREDARENA_H
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#define SHARED_RING_CAPACITY 256		/* must be a power of two */
+#define SHARED_ARENA_ALIGNMENT 4096		/* allocations are page aligned, which also satisfies CL_DEVICE_MEM_BASE_ADDR_ALIGN */
+
+namespace CLHelper
+{
+	/* Describes a job whose inputs and output live in the arena, by offset into the data region */
+	struct SharedJobDescriptor {
+		boost::uint64_t jobId;
+		boost::uint64_t offsetA;
+		boost::uint64_t offsetB;
+		boost::uint64_t offsetC;
+		boost::uint64_t dataSize;
+	};
+
+	struct SharedJobCompletion {
+		boost::uint64_t jobId;
+		boost::int32_t accepted;
+		float lastValue;
+		double executeMs;
+		double totalMs;
+	};
+
+	/* Single-producer single-consumer ring that lives in shared memory */
+	template <typename T>
+	struct SharedRing {
+		boost::atomic<boost::uint32_t> head;	/* next slot to read, written by the consumer only */
+		boost::atomic<boost::uint32_t> tail;	/* next slot to write, written by the producer only */
+		T slots[SHARED_RING_CAPACITY];
+
+		bool push(const T& value)
+		{
+			boost::uint32_t currentTail = tail.load(boost::memory_order_relaxed);
+			if(currentTail - head.load(boost::memory_order_acquire) == SHARED_RING_CAPACITY)
+				return false;
+
+			slots[currentTail & (SHARED_RING_CAPACITY - 1)] = value;
+			tail.store(currentTail + 1, boost::memory_order_release);
+			return true;
+		}
+
+		bool pop(T* value)
+		{
+			boost::uint32_t currentHead = head.load(boost::memory_order_relaxed);
+			if(currentHead == tail.load(boost::memory_order_acquire))
+				return false;
+
+			*value = slots[currentHead & (SHARED_RING_CAPACITY - 1)];
+			head.store(currentHead + 1, boost::memory_order_release);
+			return true;
+		}
+	};
+
+	/*
+	 * A POSIX shared memory region shared by one client process and the job server.
+	 * The client creates it, writes job inputs in place and pushes descriptors onto
+	 * the request ring; the server wraps the same pages as OpenCL buffers and answers
+	 * on the completion ring. Nothing is copied through the socket.
+	 */
+	class SharedArena {
+
+	public:
+		SharedArena();
+		~SharedArena();
+
+		bool create(const std::string& name, size_t dataSize);
+		bool open(const std::string& name);
+
+		const std::string& getName() const;
+		size_t getDataSize() const;
+		void* getData(boost::uint64_t offset);
+
+		/* Whether bytes at offset lie in the data region, without overflowing on offsets from the client */
+		bool contains(boost::uint64_t offset, boost::uint64_t bytes) const;
+
+		bool allocate(size_t size, boost::uint64_t* offset);	/* client side bump allocator */
+		void resetAllocations();
+
+		SharedRing<SharedJobDescriptor>& getRequests();
+		SharedRing<SharedJobCompletion>& getCompletions();
+
+	private:
+		struct Header {
+			boost::uint32_t magic;
+			boost::uint32_t version;
+			boost::uint64_t dataOffset;
+			boost::uint64_t dataSize;
+			SharedRing<SharedJobDescriptor> requests;
+			SharedRing<SharedJobCompletion> completions;
+		};
+
+		SharedArena(const SharedArena&);
+		SharedArena& operator=(const SharedArena&);
+
+		void close();
+
+		std::string name;
+		bool owner;					/* the creator unlinks the region */
+		size_t mappedSize;
+		char* mapping;
+		Header* header;
+		boost::uint64_t dataOffset;		/* copied from the header when mapped, the client can still write it */
+		boost::uint64_t dataSize;
+		boost::uint64_t allocated;
+	};
+};
+
+#endif
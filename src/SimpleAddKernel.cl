@@ -1,8 +1,159 @@
+#include "KernelHelpers.clh"
+
+// When built with -D FIXED_DATA_SIZE=<n> the problem size is a compile time
+// constant and the dataSize argument is ignored. If the host also defines
+// NO_BOUNDS_CHECK (global size is exactly the data size) the check is dropped.
 __kernel
 void simpleAddKernel(__global float* dataA, __global float* dataB, __global float* dataC, unsigned int dataSize)
 {
 	unsigned int threadId = get_global_id(0);
 
+#if defined(FIXED_DATA_SIZE) && defined(NO_BOUNDS_CHECK)
+	dataC[threadId] = dataA[threadId] + dataB[threadId];
+#elif defined(FIXED_DATA_SIZE)
+	if(threadId < FIXED_DATA_SIZE)
+		dataC[threadId] = dataA[threadId] + dataB[threadId];
+#else
 	if(threadId < dataSize)
 		dataC[threadId] = dataA[threadId] + dataB[threadId];
-}
\ No newline at end of file
+#endif
+}
+
+// simpleAddKernel that also adds every result's checksumMix() to *checksum, so
+// the output can be validated without reading it back. The work-group sums its
+// share in local memory first, leaving one atomic per work-group.
+__kernel
+void simpleAddChecksumKernel(
+	__global float* dataA,
+	__global float* dataB,
+	__global float* dataC,
+	unsigned int dataSize,
+	volatile __global uint* checksum,
+	__local uint* partialSums)
+{
+	unsigned int threadId = get_global_id(0);
+	unsigned int localId = get_local_id(0);
+
+#if defined(FIXED_DATA_SIZE) && defined(NO_BOUNDS_CHECK)
+	bool inRange = true;
+#elif defined(FIXED_DATA_SIZE)
+	bool inRange = threadId < FIXED_DATA_SIZE;
+#else
+	bool inRange = threadId < dataSize;
+#endif
+
+	uint mixed = 0;
+	if(inRange) {
+		float sum = dataA[threadId] + dataB[threadId];
+		dataC[threadId] = sum;
+		mixed = checksumMix(threadId, sum);
+	}
+
+	uint groupSum = workGroupSum(mixed, partialSums);
+
+	if(localId == 0)
+		atomic_add(checksum, groupSum);
+}
+
+// Fills one slice of the inputs on the device that will consume it, so that
+// with CL_MEM_ALLOC_HOST_PTR buffers the pages are first touched by that
+// device's (NUMA-local) threads rather than by the host thread.
+__kernel
+void initKernel(__global float* dataA, __global float* dataB, __global float* dataC, unsigned int offset, unsigned int dataSize)
+{
+	unsigned int threadId = get_global_id(0);
+
+	if(threadId < dataSize) {
+		dataA[threadId] = (float) (offset + threadId);
+		dataB[threadId] = (float) (offset + threadId);
+		dataC[threadId] = 0.0f;
+	}
+}
+
+// Reduced precision storage, selected with -D STORAGE_HALF, STORAGE_BF16 or
+// STORAGE_INT8. Values are converted to float when loaded and back when stored,
+// so only the bytes moved shrink. vload_half/vstore_half need no cl_khr_fp16.
+// INT8 values are multiplied by a per-array scale, the others ignore it.
+#if defined(STORAGE_HALF) || defined(STORAGE_BF16) || defined(STORAGE_INT8)
+
+#if defined(STORAGE_HALF)
+typedef half StorageType;
+
+float loadStored(__global const StorageType* data, unsigned int index, float scale)
+{
+	return vload_half(index, data);
+}
+
+void storeStored(float value, __global StorageType* data, unsigned int index, float scale)
+{
+	vstore_half_rte(value, index, data);
+}
+#elif defined(STORAGE_BF16)
+typedef ushort StorageType;
+
+float loadStored(__global const StorageType* data, unsigned int index, float scale)
+{
+	return as_float(((uint) data[index]) << 16);
+}
+
+// Round to nearest even, matching the host's conversion
+void storeStored(float value, __global StorageType* data, unsigned int index, float scale)
+{
+	uint bits = as_uint(value);
+	if(isnan(value))
+		data[index] = (ushort) ((bits >> 16) | 0x40);
+	else
+		data[index] = (ushort) ((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+#else
+typedef char StorageType;
+
+float loadStored(__global const StorageType* data, unsigned int index, float scale)
+{
+	return (float) data[index] * scale;
+}
+
+void storeStored(float value, __global StorageType* data, unsigned int index, float scale)
+{
+	data[index] = convert_char_sat_rte(value / scale);
+}
+#endif
+
+__kernel
+void simpleAddStoredKernel(
+	__global const StorageType* dataA,
+	__global const StorageType* dataB,
+	__global StorageType* dataC,
+	unsigned int dataSize,
+	float scaleA,
+	float scaleB,
+	float scaleC)
+{
+	unsigned int threadId = get_global_id(0);
+
+#if defined(FIXED_DATA_SIZE) && defined(NO_BOUNDS_CHECK)
+#elif defined(FIXED_DATA_SIZE)
+	if(threadId >= FIXED_DATA_SIZE)
+		return;
+#else
+	if(threadId >= dataSize)
+		return;
+#endif
+
+	float sum = loadStored(dataA, threadId, scaleA) + loadStored(dataB, threadId, scaleB);
+	storeStored(sum, dataC, threadId, scaleC);
+}
+
+// Same as initKernel, for inputs kept in reduced precision
+__kernel
+void initStoredKernel(__global StorageType* dataA, __global StorageType* dataB, unsigned int offset, unsigned int dataSize, float scaleA, float scaleB)
+{
+	unsigned int threadId = get_global_id(0);
+
+	if(threadId < dataSize) {
+		storeStored((float) ((offset + threadId) % RAMP_PERIOD), dataA, threadId, scaleA);
+		storeStored((float) ((offset + threadId) % RAMP_PERIOD), dataB, threadId, scaleB);
+	}
+}
+
+#endif
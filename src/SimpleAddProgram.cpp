@@ -1,5 +1,20 @@
 #include "SimpleAddProgram.h"
+#include "DeviceCharacterization.h"
+#include "KernelBinder.h"
+#include "KernelSpecializer.h"
+#include "PersistentWorker.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "TransferStrategy.h"
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/timer.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+namespace pt = boost::posix_time;
 
 void CL_CALLBACK contextCallbackFunction(const char* errorinfo, const void* private_info_size, size_t cb, void* user_data);
 
@@ -7,116 +22,771 @@ void CL_CALLBACK contextCallbackFunction(const char* errorinfo, const void* priv
 
 typedef cl_float DataType;
 
-cl_int runSimpleAddProgram(std::vector<cl::Device>& deviceList, std::vector<CLHelper::DeviceInfo>& deviceInfoList)
+static cl_int runSimpleAddOnSlices(CLHelper::Runtime& runtime, const SimpleAddOptions& options);
+static cl_int runSimpleAddStored(CLHelper::Runtime& runtime, const SimpleAddOptions& options);
+
+static CLHelper::ValidationReport validateOnHost(
+	CLHelper::ValidationMode mode,
+	const CLHelper::ValidationOptions& validation,
+	const DataType* h_dataA,
+	const DataType* h_dataB,
+	const DataType* result,
+	size_t count,
+	const CLHelper::Tolerance& tolerance);
+static size_t pickWorkGroupSize(const CLHelper::DeviceInfo& deviceInfo, size_t dataSize, size_t requested);
+static void prepareInput(const InputSource& source, DataType* data, size_t count, size_t rampPeriod = 0);
+static void fillInputRange(const InputSource* source, size_t rampPeriod, DataType* data, size_t first, size_t last);
+static void computeReference(const DataType* h_dataA, const DataType* h_dataB, DataType* reference, size_t first, size_t last);
+static void encodeStorageRange(CLHelper::StorageFormat format, const DataType* input, char* output, float scale, size_t first, size_t last);
+static void decodeStorageRange(CLHelper::StorageFormat format, const char* input, DataType* output, float scale, size_t first, size_t last);
+
+bool parseInputSource(const std::string& spec, InputSource* source)
+{
+	std::string kind = spec.substr(0, spec.find(':'));
+	std::string argument = (spec.find(':') != std::string::npos) ? spec.substr(spec.find(':') + 1) : "";
+
+	*source = InputSource();
+	if(kind == "ramp" && argument.empty())
+		source->kind = INPUT_RAMP;
+	else if(kind == "zero" && argument.empty())
+		source->kind = INPUT_ZERO;
+	else if(kind == "random") {
+		source->kind = INPUT_RANDOM;
+		source->seed = (boost::uint32_t) strtoul(argument.c_str(), NULL, 10);
+	}
+	else if(kind == "file" && !argument.empty()) {
+		source->kind = INPUT_FILE;
+		source->path = argument;
+	}
+	else
+		return false;
+
+	return true;
+}
+
+cl_int runSimpleAddProgram(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	const SimpleAddOptions& options)
+{
+// Create a context with one profiling command queue per device
+	CLHelper::Runtime runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE);
+
+	return runSimpleAdd(runtime, options);
+}
+
+cl_int runSimpleAdd(CLHelper::Runtime& runtime, const SimpleAddOptions& options)
 {
 	cl_int err;
 	boost::timer timer;
+	size_t dataSize = options.dataSize;
+	size_t repetitions = std::max(options.repetitions, (size_t) 1);
 
-// Create a Context from the list of devices
-	cl::Context context(deviceList, NULL, &contextCallbackFunction, NULL, &err);
-	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+// With several devices (e.g. the sub-devices of a partitioned CPU) every device computes its own slice.
+// Slices generate float inputs on their devices, so a storage format or transfer strategy cannot apply.
+	if(runtime.getDeviceCount() > 1) {
+		if(options.storageFormat != CLHelper::STORAGE_FLOAT || options.transferStrategy != CLHelper::TRANSFER_AUTO) {
+			std::cerr << "A storage format or transfer strategy cannot be combined with several devices" << std::endl;
+			return CL_INVALID_VALUE;
+		}
+		return runSimpleAddOnSlices(runtime, options);
+	}
 
-// Load the .cl file into a string
-	std::string source;
-	CLHelper::loadKernelFileToString("SimpleAddKernel.cl", &source);
+// Reduced precision storage has its own path, since the arrays are converted on the host
+	if(options.storageFormat != CLHelper::STORAGE_FLOAT) {
+		return runSimpleAddStored(runtime, options);
+	}
 
-// Add the source code to a Source object using make_pair
-	cl::Program::Sources sources;
-	sources.push_back(std::make_pair(source.c_str(), source.length()));
+// A single device: use its first command queue
+	cl::Context& context = runtime.getContext();
+	cl::Device& device = runtime.getDevice(0);
+	CLHelper::DeviceInfo& deviceInfo = runtime.getDeviceInfo(0);
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
 
-// Create a Program object from the Context and the Source
-	cl::Program program(context, sources, &err);
-	CHECK_OPENCL_ERROR(err, "cl::Program::Program() failed.");
+// Use the requested work-group size, or the largest one that divides dataSize
+	size_t workGroupSize = pickWorkGroupSize(deviceInfo, dataSize, options.workGroupSize);
 
-// Compile the program, optionally giving arguments to the compiler
-	CLHelper::compileProgram(program, deviceList, "");
+// Bake dataSize into the kernel, and since the global size equals dataSize the bounds check can go too
+	CLHelper::Specialization specialization;
+	if(options.specialize) {
+		specialization.define("FIXED_DATA_SIZE", dataSize);
+		specialization.define("NO_BOUNDS_CHECK");
+	}
+	specialization.allowFastMath(options.fastMath);
 
-// Pick out a specific kernel function from the compiled Program object
-	cl::Kernel simpleAddKernel(program, "simpleAddKernel", &err);
-	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+// Start building the program now, it compiles on the build service while the inputs are prepared
+	runtime.prepareProgram("SimpleAddKernel.cl", specialization);
+
+// Allocate input and output arrays, declared first so they outlive the buffers that may wrap them.
+// They are left uninitialized here, so their pages get placed by the pool threads that touch them first.
+	boost::scoped_array<DataType> h_dataA(new DataType[dataSize]);
+	boost::scoped_array<DataType> h_dataB(new DataType[dataSize]);
+	boost::scoped_array<DataType> h_dataC(new DataType[dataSize]);
+
+// Fill the arrays from their sources, generated ones in parallel with every pool thread filling the same range each time
+	prepareInput(options.inputA, h_dataA.get(), dataSize);
+	prepareInput(options.inputB, h_dataB.get(), dataSize);
+	prepareInput(InputSource(INPUT_ZERO), h_dataC.get(), dataSize);
+
+// Pick how to move the arrays to and from this device, unless a strategy was forced
+// (an unsupported one, such as SVM on an OpenCL 1.x runtime, falls back to buffers)
+	CLHelper::TransferStrategy transferStrategy = options.transferStrategy;
+	std::string transferReason = "requested";
+	if(transferStrategy != CLHelper::TRANSFER_AUTO
+			&& !CLHelper::isTransferStrategySupported(transferStrategy, device, deviceInfo)) {
+		std::cout << "Transfer strategy " << CLHelper::transferStrategyToString(transferStrategy)
+				  << " is not supported by the device, falling back to buffers" << std::endl;
+		transferStrategy = CLHelper::TRANSFER_AUTO;
+	}
+	if(transferStrategy == CLHelper::TRANSFER_AUTO) {
+		transferStrategy = CLHelper::selectTransferStrategy(
+			context, commQueue, device, deviceInfo, dataSize*sizeof(DataType), &transferReason);
+	}
+	std::cout << "Transfer strategy: " << CLHelper::transferStrategyToString(transferStrategy) << " (" << transferReason << ")" << std::endl;
+
+// Create input and output buffers for the host arrays
+	CLHelper::TransferBuffer d_dataA(context, commQueue, transferStrategy, CL_MEM_READ_ONLY, dataSize*sizeof(DataType), &h_dataA[0]);
+	CLHelper::TransferBuffer d_dataB(context, commQueue, transferStrategy, CL_MEM_READ_ONLY, dataSize*sizeof(DataType), &h_dataB[0]);
+	CLHelper::TransferBuffer d_dataC(context, commQueue, transferStrategy, CL_MEM_WRITE_ONLY, dataSize*sizeof(DataType), &h_dataC[0]);
+
+// Wait for the program built (or loaded prebuilt) with the specialization's compiler options, or reuse
+// the one the runtime built for an earlier job
+	cl::Program program = runtime.getProgram("SimpleAddKernel.cl", specialization);
+
+// Pick out a specific kernel function from the compiled Program object, the one that also
+// computes a checksum of the result when validating by checksum
+	bool checksumValidation = (options.validation.mode == CLHelper::VALIDATE_CHECKSUM);
+	const char* kernelName = checksumValidation ? "simpleAddChecksumKernel" : "simpleAddKernel";
+	CLHelper::KernelBinder simpleAddKernel(program, kernelName);
+
+// Set the kernel arguments
+	err  = d_dataA.setAsKernelArg(simpleAddKernel, 0);
+	err |= d_dataB.setAsKernelArg(simpleAddKernel, 1);
+	err |= d_dataC.setAsKernelArg(simpleAddKernel, 2);
+	err |= simpleAddKernel.set(3, (cl_uint) dataSize);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+	cl_uint checksum = 0;
+	cl::Buffer d_checksum;
+	if(checksumValidation) {
+		d_checksum = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &checksum, &err);
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+		err  = simpleAddKernel.set(4, d_checksum);
+		err |= simpleAddKernel.setLocal(5, workGroupSize * sizeof(cl_uint));
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+	}
+	
+// Move the inputs to the device
+	d_dataA.upload();
+	d_dataB.upload();
+
+	timer.restart();
+
+// Execute the kernel on the command queue, as often as asked to. The checksum restarts from zero every time.
+	double kernelSeconds = 0;
+	for(size_t repetition = 0; repetition < repetitions; repetition++)
+	{
+		if(checksumValidation) {
+			checksum = 0;
+			err = commQueue.enqueueWriteBuffer(d_checksum, CL_TRUE, 0, sizeof(cl_uint), &checksum);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+		}
+
+		cl::Event clEvent;
+		err = commQueue.enqueueNDRangeKernel(
+			simpleAddKernel.getKernel(),
+			cl::NullRange,
+			cl::NDRange(dataSize),
+			cl::NDRange(workGroupSize), NULL, &clEvent);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+		CLHelper::Trace::shared().addDeviceSpan(clEvent, kernelName, device);
+
+// Wait until the kernel returns
+		TRACE_SCOPE("waitForKernel");
+		err = clEvent.wait();
+		CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+
+		kernelSeconds += CLHelper::eventSeconds(clEvent) / repetitions;
+	}
+
+	std::cout << "Time to run kernel " << repetitions << " times: " << timer.elapsed() << " s" << std::endl;
+
+// Compare the achieved bandwidth with the device's measured ceiling, if it has been characterized
+	double achievedBandwidth = 3.0 * dataSize * sizeof(DataType) / kernelSeconds / 1e9;
+	std::cout << "Kernel device time: " << kernelSeconds << " s" << (repetitions > 1 ? " on average" : "") << ", " << achievedBandwidth << " GB/s";
+
+	CLHelper::RooflineProfile profile;
+	if(CLHelper::loadRooflineProfile(device, &profile) && profile.globalTriadBandwidth > 0)
+		std::cout << " (" << 100.0 * achievedBandwidth / profile.globalTriadBandwidth << "% of measured triad bandwidth)";
+	std::cout << std::endl;
+
+// Get the result back to the host, all of it for a host validation, or only the printed last element
+// when the kernel's checksum stands for the rest
+	DataType* result;
+	if(checksumValidation) {
+		DataType* last = (DataType*) d_dataC.download((dataSize-1) * sizeof(DataType), sizeof(DataType));
+		std::cout << "Result: " << *last << std::endl;
+		result = NULL;
+	}
+	else {
+		result = (DataType*) d_dataC.download();
+		std::cout << "Result: " << result[dataSize-1] << std::endl;
+	}
+
+// Validate the result, by the kernel's checksum or against a host reference
+	CLHelper::ValidationReport report;
+	if(checksumValidation) {
+		err = commQueue.enqueueReadBuffer(d_checksum, CL_TRUE, 0, sizeof(cl_uint), &checksum);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
 
-// Create command queues for all devices and put them into 'commQueueList'
+		report = CLHelper::validateChecksum(h_dataA.get(), h_dataB.get(), dataSize, checksum);
+		CLHelper::printValidationReport(options.validation.mode, report);
+	}
+	else if(options.validation.mode != CLHelper::VALIDATE_NONE) {
+		report = validateOnHost(options.validation.mode, options.validation, h_dataA.get(), h_dataB.get(), result, dataSize,
+			options.validation.toleranceFor(CLHelper::STORAGE_FLOAT));
+		CLHelper::printValidationReport(options.validation.mode, report);
+	}
+
+// Release the mapping, if any, when done
+	d_dataC.release();
+
+	return report.passed() ? CL_SUCCESS : VALIDATION_FAILED;
+}
+
+// Splits the problem into one slice per device. Every slice lives in its own
+// CL_MEM_ALLOC_HOST_PTR buffers that are filled by initKernel on the device that
+// computes the slice, so on a CPU partitioned by NUMA domain the pages are first
+// touched by threads of the same domain instead of by the host thread.
+static cl_int runSimpleAddOnSlices(CLHelper::Runtime& runtime, const SimpleAddOptions& options)
+{
+	cl_int err;
+	boost::timer timer;
+	size_t dataSize = options.dataSize;
+	size_t repetitions = std::max(options.repetitions, (size_t) 1);
+	cl::Context& context = runtime.getContext();
+
+	if(options.inputA.kind != INPUT_RAMP || options.inputB.kind != INPUT_RAMP)
+		std::cout << "Slices generate ramp inputs on their devices, the input sources are ignored" << std::endl;
+
+// Slices have different sizes, so use the generic program rather than one specialization per slice
+	CLHelper::Specialization specialization;
+	specialization.allowFastMath(options.fastMath);
+
+	cl::Program program = runtime.getProgram("SimpleAddKernel.cl", specialization);
+
+// The first command queue of every device computes its slice. The runtime's monitor sizes the slices
+// by the throughput the devices showed in earlier jobs, evenly at first, and devices left without
+// elements (drained ones, or more devices than elements) get no slice.
+	CLHelper::DeviceMonitor& monitor = runtime.getMonitor();
+	std::vector<size_t> parts = monitor.splitWork(dataSize);
 	std::vector<cl::CommandQueue> commQueueList;
-	std::vector<cl::Device>::iterator device;
-	for(device = deviceList.begin(); device != deviceList.end(); device++)
+	std::vector<size_t> sliceDevices, sliceOffsets, sliceSizes;
+	size_t sliceOffset = 0;
+	for(size_t deviceIndex = 0; deviceIndex < parts.size(); deviceIndex++)
+	{
+		if(parts[deviceIndex] > 0) {
+			commQueueList.push_back(runtime.getQueues(deviceIndex).front());
+			sliceDevices.push_back(deviceIndex);
+			sliceOffsets.push_back(sliceOffset);
+			sliceSizes.push_back(parts[deviceIndex]);
+		}
+		sliceOffset += parts[deviceIndex];
+	}
+	size_t sliceCount = sliceSizes.size();
+
+	std::vector<cl::Buffer> d_dataA, d_dataB, d_dataC;
+	std::vector<cl::Kernel> simpleAddKernels;
+	std::vector<cl::Event> initEvents;
+
+// Create and initialize the buffers of every slice on its own device
+	for(size_t slice = 0; slice < sliceCount; slice++)
+	{
+		sliceOffset = sliceOffsets[slice];
+		size_t currentSliceSize = sliceSizes[slice];
+
+		d_dataA.push_back(cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, currentSliceSize*sizeof(DataType), NULL, &err));
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		d_dataB.push_back(cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, currentSliceSize*sizeof(DataType), NULL, &err));
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+		d_dataC.push_back(cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, currentSliceSize*sizeof(DataType), NULL, &err));
+		CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+		cl::Kernel initKernel(program, "initKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+		err  = initKernel.setArg(0, d_dataA.back());
+		err |= initKernel.setArg(1, d_dataB.back());
+		err |= initKernel.setArg(2, d_dataC.back());
+		err |= initKernel.setArg(3, (cl_uint) sliceOffset);
+		err |= initKernel.setArg(4, (cl_uint) currentSliceSize);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		cl::Event initEvent;
+		err = commQueueList[slice].enqueueNDRangeKernel(initKernel, cl::NullRange, cl::NDRange(currentSliceSize), cl::NullRange, NULL, &initEvent);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+		initEvents.push_back(initEvent);
+
+		cl::Kernel simpleAddKernel(program, "simpleAddKernel", &err);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+		err  = simpleAddKernel.setArg(0, d_dataA.back());
+		err |= simpleAddKernel.setArg(1, d_dataB.back());
+		err |= simpleAddKernel.setArg(2, d_dataC.back());
+		err |= simpleAddKernel.setArg(3, (cl_uint) currentSliceSize);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		simpleAddKernels.push_back(simpleAddKernel);
+	}
+
+	err = cl::WaitForEvents(initEvents);
+	CHECK_OPENCL_ERROR(err, "cl::WaitForEvents() failed.");
+
+	timer.restart();
+
+// Execute the kernels on all command queues at once and wait for all of them, as often as asked to
+	for(size_t repetition = 0; repetition < repetitions; repetition++)
+	{
+		std::vector<cl::Event> clEvents(sliceCount);
+		for(size_t slice = 0; slice < sliceCount; slice++)
+		{
+			err = commQueueList[slice].enqueueNDRangeKernel(
+				simpleAddKernels[slice],
+				cl::NullRange,
+				cl::NDRange(sliceSizes[slice]),
+				cl::NullRange, NULL, &clEvents[slice]);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+			CLHelper::Trace::shared().addDeviceSpan(clEvents[slice], "simpleAddKernel", runtime.getDevice(sliceDevices[slice]));
+
+			err = commQueueList[slice].flush();
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::flush() failed.");
+		}
+
+		err = cl::WaitForEvents(clEvents);
+		CHECK_OPENCL_ERROR(err, "cl::WaitForEvents() failed.");
+
+		for(size_t slice = 0; slice < sliceCount; slice++)
+			monitor.recordCommand(sliceDevices[slice], clEvents[slice], 3.0 * sliceSizes[slice] * sizeof(DataType));
+	}
+
+	std::cout << "Time to run kernel " << repetitions << " times on " << sliceCount << " devices: " << timer.elapsed() << " s" << std::endl;
+
+// Map the last slice of the result to read the last element
+	cl::CommandQueue& lastQueue = commQueueList.back();
+	DataType* result =
+			(DataType*) lastQueue.enqueueMapBuffer(d_dataC.back(), true, CL_MAP_READ, 0, sliceSizes.back()*sizeof(DataType), NULL, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+
+	std::cout << "Result: " << result[sliceSizes.back()-1] << std::endl;
+
+	lastQueue.enqueueUnmapMemObject(d_dataC.back(), result);
+
+// Validate slice by slice against a host reference, the kernels here compute no checksum
+	CLHelper::ValidationMode validationMode = options.validation.mode;
+	if(validationMode == CLHelper::VALIDATE_CHECKSUM)
+		validationMode = CLHelper::VALIDATE_FULL;
+
+	if(validationMode != CLHelper::VALIDATE_NONE) {
+		CLHelper::ValidationReport report;
+		for(size_t slice = 0; slice < sliceCount; slice++)
+		{
+			size_t sliceBytes = sliceSizes[slice]*sizeof(DataType);
+			DataType* sliceA = (DataType*) commQueueList[slice].enqueueMapBuffer(d_dataA[slice], true, CL_MAP_READ, 0, sliceBytes, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+			DataType* sliceB = (DataType*) commQueueList[slice].enqueueMapBuffer(d_dataB[slice], true, CL_MAP_READ, 0, sliceBytes, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+			DataType* sliceC = (DataType*) commQueueList[slice].enqueueMapBuffer(d_dataC[slice], true, CL_MAP_READ, 0, sliceBytes, NULL, NULL, &err);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+
+			CLHelper::ValidationReport sliceReport = validateOnHost(validationMode, options.validation, sliceA, sliceB, sliceC, sliceSizes[slice],
+				options.validation.toleranceFor(CLHelper::STORAGE_FLOAT));
+			report.merge(sliceReport, sliceOffsets[slice]);
+
+			commQueueList[slice].enqueueUnmapMemObject(d_dataA[slice], sliceA);
+			commQueueList[slice].enqueueUnmapMemObject(d_dataB[slice], sliceB);
+			commQueueList[slice].enqueueUnmapMemObject(d_dataC[slice], sliceC);
+		}
+		CLHelper::printValidationReport(validationMode, report);
+		if(!report.passed())
+			return VALIDATION_FAILED;
+	}
+
+	return CL_SUCCESS;
+}
+
+// Stores the arrays in half, bfloat16 or int8 and computes in float. The kernel
+// moves half or a quarter of the bytes, at the price of the accuracy reported
+// against a float reference computed on the host.
+static cl_int runSimpleAddStored(CLHelper::Runtime& runtime, const SimpleAddOptions& options)
+{
+	cl_int err;
+	size_t dataSize = options.dataSize;
+	size_t repetitions = std::max(options.repetitions, (size_t) 1);
+	cl::Context& context = runtime.getContext();
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
+	CLHelper::StorageFormat format = options.storageFormat;
+	size_t storedBytes = dataSize * CLHelper::storageFormatSize(format);
+
+	CLHelper::ThreadPool& threadPool = CLHelper::ThreadPool::shared();
+	boost::scoped_array<DataType> h_dataA(new DataType[dataSize]);
+	boost::scoped_array<DataType> h_dataB(new DataType[dataSize]);
+	boost::scoped_array<DataType> h_dataC(new DataType[dataSize]);
+	boost::scoped_array<DataType> reference(new DataType[dataSize]);
+	// Ramps wrap like initStoredKernel's, so that they fit the reduced precision formats
+	prepareInput(options.inputA, h_dataA.get(), dataSize, RAMP_PERIOD);
+	prepareInput(options.inputB, h_dataB.get(), dataSize, RAMP_PERIOD);
+	prepareInput(InputSource(INPUT_ZERO), h_dataC.get(), dataSize);
+	threadPool.parallelForAffine(0, dataSize,
+		boost::bind(&computeReference, h_dataA.get(), h_dataB.get(), reference.get(), boost::placeholders::_1, boost::placeholders::_2));
+
+// int8 scales: the inputs' from their range, the result's from the largest possible sum
+	float scaleA = CLHelper::int8Scale(&h_dataA[0], dataSize);
+	float scaleB = CLHelper::int8Scale(&h_dataB[0], dataSize);
+	float scaleC = scaleA + scaleB;
+
+// Wall clock time, since the conversions run on several threads
+	pt::ptime start = pt::microsec_clock::universal_time();
+	std::vector<char> storedA(storedBytes), storedB(storedBytes), storedC(storedBytes);
+	threadPool.parallelFor(0, dataSize, boost::bind(&encodeStorageRange, format, h_dataA.get(), &storedA[0], scaleA, boost::placeholders::_1, boost::placeholders::_2));
+	threadPool.parallelFor(0, dataSize, boost::bind(&encodeStorageRange, format, h_dataB.get(), &storedB[0], scaleB, boost::placeholders::_1, boost::placeholders::_2));
+	std::cout << "Time to convert inputs to " << CLHelper::storageFormatToString(format) << ": "
+			  << (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6 << " s" << std::endl;
+
+	cl::Buffer d_dataA(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, storedBytes, &storedA[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_dataB(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, storedBytes, &storedB[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_dataC(context, CL_MEM_WRITE_ONLY, storedBytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	CLHelper::Specialization specialization;
+	specialization.define(CLHelper::storageFormatDefine(format));
+	if(options.specialize) {
+		specialization.define("FIXED_DATA_SIZE", dataSize);
+		specialization.define("NO_BOUNDS_CHECK");
+	}
+	specialization.allowFastMath(options.fastMath);
+
+	CLHelper::KernelBinder simpleAddKernel(runtime.getProgram("SimpleAddKernel.cl", specialization), "simpleAddStoredKernel");
+
+	err  = simpleAddKernel.set(0, d_dataA);
+	err |= simpleAddKernel.set(1, d_dataB);
+	err |= simpleAddKernel.set(2, d_dataC);
+	err |= simpleAddKernel.set(3, (cl_uint) dataSize);
+	err |= simpleAddKernel.set(4, scaleA);
+	err |= simpleAddKernel.set(5, scaleB);
+	err |= simpleAddKernel.set(6, scaleC);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+	double kernelSeconds = 0;
+	for(size_t repetition = 0; repetition < repetitions; repetition++)
 	{
-		commQueueList.push_back(cl::CommandQueue(context, *device, 0, &err));
-		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+		cl::Event clEvent;
+		err = commQueue.enqueueNDRangeKernel(simpleAddKernel.getKernel(), cl::NullRange, cl::NDRange(dataSize), cl::NullRange, NULL, &clEvent);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+		CLHelper::Trace::shared().addDeviceSpan(clEvent, "simpleAddStoredKernel", runtime.getDevice(0));
+		err = clEvent.wait();
+		CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+
+		kernelSeconds += CLHelper::eventSeconds(clEvent) / repetitions;
 	}
 
-// For the rest of the program, pick the first command queue from the list (and ignore the rest of the devices, if any)
-	cl::CommandQueue commQueue = commQueueList.front();
+	std::cout << "Kernel device time: " << kernelSeconds << " s" << (repetitions > 1 ? " on average" : "") << ", " << 3.0 * storedBytes / kernelSeconds / 1e9 << " GB/s, "
+			  << 3.0 * dataSize * sizeof(DataType) / kernelSeconds / 1e9 << " GB/s float equivalent" << std::endl;
+
+	err = commQueue.enqueueReadBuffer(d_dataC, CL_TRUE, 0, storedBytes, &storedC[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+	start = pt::microsec_clock::universal_time();
+	threadPool.parallelFor(0, dataSize, boost::bind(&decodeStorageRange, format, &storedC[0], h_dataC.get(), scaleC, boost::placeholders::_1, boost::placeholders::_2));
+	std::cout << "Time to convert the result to float: " << (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6 << " s" << std::endl;
 
-// Allocate input and output arrays
-	DataType* h_dataA = new DataType[DATA_SIZE];
-	DataType* h_dataB = new DataType[DATA_SIZE];
-	DataType* h_dataC = new DataType[DATA_SIZE];
+	std::cout << "Result: " << h_dataC[dataSize-1] << std::endl;
+	CLHelper::printStorageErrorReport(format, CLHelper::compareWithReference(&reference[0], &h_dataC[0], dataSize));
+
+// Validate against the format's tolerance. The stored result differs from a float checksum, so check every element instead.
+	CLHelper::ValidationMode validationMode = options.validation.mode;
+	if(validationMode == CLHelper::VALIDATE_CHECKSUM)
+		validationMode = CLHelper::VALIDATE_FULL;
+
+	if(validationMode != CLHelper::VALIDATE_NONE) {
+		CLHelper::ValidationReport report = validateOnHost(validationMode, options.validation, h_dataA.get(), h_dataB.get(), h_dataC.get(), dataSize,
+			options.validation.toleranceFor(format, scaleC));
+		CLHelper::printValidationReport(validationMode, report);
+		if(!report.passed())
+			return VALIDATION_FAILED;
+	}
+
+	return CL_SUCCESS;
+}
+
+// Runs the same add repeatedly on reused arrays with every transfer strategy the
+// device supports, so that the per-use cost of moving data (API calls, map/unmap
+// synchronization and copies) can be compared, e.g. SVM against buffers.
+cl_int runTransferBenchmark(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	size_t iterations)
+{
+	cl_int err;
 
-// Initialize the input arrays
+	cl::Context context(deviceList, NULL, &contextCallbackFunction, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+	cl::CommandQueue commQueue(context, deviceList.front(), 0, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	CLHelper::SpecializationCache programCache(context, deviceList, "SimpleAddKernel.cl");
+	cl::Program& program = programCache.getGeneric();
+
+	std::vector<DataType> h_dataA(DATA_SIZE);
+	std::vector<DataType> h_dataB(DATA_SIZE);
+	std::vector<DataType> h_dataC(DATA_SIZE);
 	for(size_t i = 0; i < DATA_SIZE; i++)
 	{
 		h_dataA[i] = (DataType) i;
 		h_dataB[i] = (DataType) i;
-		h_dataC[i] = (DataType) 0;
 	}
 
-// Create input and output Buffer objects using the host pointers
-	cl::Buffer d_dataA(context, CL_MEM_READ_ONLY  | CL_MEM_USE_HOST_PTR, DATA_SIZE*sizeof(DataType), h_dataA, &err);
+	const CLHelper::TransferStrategy strategies[] = {
+		CLHelper::TRANSFER_READ_WRITE,
+		CLHelper::TRANSFER_COPY_HOST_PTR,
+		CLHelper::TRANSFER_MAP,
+		CLHelper::TRANSFER_USE_HOST_PTR,
+		CLHelper::TRANSFER_SVM
+	};
+
+	std::cout << "Transfer benchmark, " << iterations << " iterations of " << DATA_SIZE << " elements:" << std::endl;
+
+	double bufferSeconds = 0;
+	for(size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); s++)
+	{
+		CLHelper::TransferStrategy strategy = strategies[s];
+		if(!CLHelper::isTransferStrategySupported(strategy, deviceList.front(), deviceInfoList.front())) {
+			std::cout << "  " << CLHelper::transferStrategyToString(strategy) << ": not supported" << std::endl;
+			continue;
+		}
+
+		CLHelper::TransferBuffer d_dataA(context, commQueue, strategy, CL_MEM_READ_ONLY, DATA_SIZE*sizeof(DataType), &h_dataA[0]);
+		CLHelper::TransferBuffer d_dataB(context, commQueue, strategy, CL_MEM_READ_ONLY, DATA_SIZE*sizeof(DataType), &h_dataB[0]);
+		CLHelper::TransferBuffer d_dataC(context, commQueue, strategy, CL_MEM_WRITE_ONLY, DATA_SIZE*sizeof(DataType), &h_dataC[0]);
+
+		CLHelper::KernelBinder simpleAddKernel(program, "simpleAddKernel");
+
+		boost::timer timer;
+		DataType checksum = 0;
+		for(size_t iteration = 0; iteration < iterations; iteration++)
+		{
+			// Arguments are set as if they could change, the binder skips the ones that did not
+			err  = d_dataA.setAsKernelArg(simpleAddKernel, 0);
+			err |= d_dataB.setAsKernelArg(simpleAddKernel, 1);
+			err |= d_dataC.setAsKernelArg(simpleAddKernel, 2);
+			err |= simpleAddKernel.set(3, (cl_uint) DATA_SIZE);
+			CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+			d_dataA.upload();
+			d_dataB.upload();
+
+			err = commQueue.enqueueNDRangeKernel(simpleAddKernel.getKernel(), cl::NullRange, cl::NDRange(DATA_SIZE), cl::NullRange);
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+
+			DataType* result = (DataType*) d_dataC.download();
+			checksum += result[DATA_SIZE-1];
+			d_dataC.release();
+		}
+		err = commQueue.finish();
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::finish() failed.");
+		double seconds = timer.elapsed();
+
+		// The first strategy is the plain buffer path everything is compared with
+		if(bufferSeconds == 0)
+			bufferSeconds = seconds;
+
+		std::cout << "  " << CLHelper::transferStrategyToString(strategy);
+		if(strategy == CLHelper::TRANSFER_SVM)
+			std::cout << (d_dataA.isFineGrained() ? " (fine-grained)" : " (coarse-grained)");
+		std::cout << ": " << 1000.0 * seconds / iterations << " ms per iteration, "
+				  << bufferSeconds / seconds << "x read-write"
+				  << ", result " << checksum / iterations << std::endl;
+	}
+
+	return CL_SUCCESS;
+}
+
+// Measures the latency of a stream of tiny adds, each submitted and waited for on
+// its own, once with a kernel launch per add and once through a persistent kernel
+cl_int runPersistentBenchmark(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	size_t iterations)
+{
+	cl_int err;
+	const size_t tinySize = 256;
+
+	cl::Device& device = deviceList.front();
+	CLHelper::DeviceInfo& deviceInfo = deviceInfoList.front();
+
+	cl::Context context(deviceList, NULL, &contextCallbackFunction, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Context::Context() failed.");
+	cl::CommandQueue commQueue(context, device, 0, &err);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::CommandQueue() failed.");
+
+	std::vector<DataType> h_dataA(tinySize);
+	std::vector<DataType> h_dataB(tinySize);
+	std::vector<DataType> h_dataC(tinySize);
+	for(size_t i = 0; i < tinySize; i++)
+	{
+		h_dataA[i] = (DataType) i;
+		h_dataB[i] = (DataType) i;
+	}
+
+	std::cout << "Persistent kernel benchmark, " << iterations << " adds of " << tinySize << " elements:" << std::endl;
+
+// Discrete launches: write, launch and read back for every add
+	CLHelper::SpecializationCache programCache(context, deviceList, "SimpleAddKernel.cl");
+	cl::Kernel simpleAddKernel(programCache.getGeneric(), "simpleAddKernel", &err);
+	CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+	cl::Buffer d_dataA(context, CL_MEM_READ_ONLY, tinySize*sizeof(DataType), NULL, &err);
 	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
-	cl::Buffer d_dataB(context, CL_MEM_READ_ONLY  | CL_MEM_USE_HOST_PTR, DATA_SIZE*sizeof(DataType), h_dataB, &err);
+	cl::Buffer d_dataB(context, CL_MEM_READ_ONLY, tinySize*sizeof(DataType), NULL, &err);
 	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
-	cl::Buffer d_dataC(context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, DATA_SIZE*sizeof(DataType), h_dataC, &err);
+	cl::Buffer d_dataC(context, CL_MEM_WRITE_ONLY, tinySize*sizeof(DataType), NULL, &err);
 	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
 
-// Set the kernel arguments
 	err  = simpleAddKernel.setArg(0, d_dataA);
 	err |= simpleAddKernel.setArg(1, d_dataB);
 	err |= simpleAddKernel.setArg(2, d_dataC);
-	err |= simpleAddKernel.setArg(3, DATA_SIZE);
+	err |= simpleAddKernel.setArg(3, (cl_uint) tinySize);
 	CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
 
-// Get device information from deviceInfoList
-	CLHelper::DeviceInfo deviceInfo = deviceInfoList.front();
-	size_t workGroupSize = deviceInfo.maxWorkGroupSize;
+	boost::timer timer;
+	for(size_t iteration = 0; iteration < iterations; iteration++)
+	{
+		commQueue.enqueueWriteBuffer(d_dataA, CL_FALSE, 0, tinySize*sizeof(DataType), &h_dataA[0]);
+		commQueue.enqueueWriteBuffer(d_dataB, CL_FALSE, 0, tinySize*sizeof(DataType), &h_dataB[0]);
+		err = commQueue.enqueueNDRangeKernel(simpleAddKernel, cl::NullRange, cl::NDRange(tinySize), cl::NullRange);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+		err = commQueue.enqueueReadBuffer(d_dataC, CL_TRUE, 0, tinySize*sizeof(DataType), &h_dataC[0]);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+	}
+	double discreteSeconds = timer.elapsed();
+	std::cout << "  discrete launches: " << 1e6 * discreteSeconds / iterations << " us per add, result " << h_dataC[tinySize-1] << std::endl;
 
-// Keep halving workGroupSize until it divides perfectly into DATA_SIZE
-	while((DATA_SIZE % workGroupSize) != 0) {
-		workGroupSize /= 2;
+// Persistent kernel: write the inputs and a descriptor, then poll for completion
+	if(!CLHelper::PersistentWorker::isSupported(device, deviceInfo)) {
+		std::cout << "  persistent kernel: not supported (needs fine-grained SVM with atomics)" << std::endl;
+		return CL_SUCCESS;
 	}
-	
+
+	CLHelper::PersistentWorker worker(context, device, deviceInfo, tinySize);
+	const DataType* result = NULL;
+
 	timer.restart();
+	for(size_t iteration = 0; iteration < iterations; iteration++)
+	{
+		boost::int32_t ticket = worker.submitAdd(&h_dataA[0], &h_dataB[0], tinySize);
+		result = worker.wait(ticket);
+	}
+	double persistentSeconds = timer.elapsed();
+	std::cout << "  persistent kernel: " << 1e6 * persistentSeconds / iterations << " us per add, "
+			  << discreteSeconds / persistentSeconds << "x discrete, result " << (result != NULL ? result[tinySize-1] : 0) << std::endl;
 
-// Execute the kernel on the command queue
-	cl::Event clEvent;
-	err = commQueue.enqueueNDRangeKernel(
-		simpleAddKernel,
-		cl::NullRange,
-		cl::NDRange(DATA_SIZE),
-		cl::NDRange(workGroupSize), NULL, &clEvent);
-	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueNDRangeKernel() failed.");
+	worker.stop();
 
-// Wait until the kernel returns
-	err = clEvent.wait();
-	CHECK_OPENCL_ERROR(err, "cl::Event::wait() failed.");
+	return CL_SUCCESS;
+}
 
-	std::cout << "Time to run kernel: " << timer.elapsed() << " s" << std::endl;
+// Full or sampled comparison with a host reference
+static CLHelper::ValidationReport validateOnHost(
+	CLHelper::ValidationMode mode,
+	const CLHelper::ValidationOptions& validation,
+	const DataType* h_dataA,
+	const DataType* h_dataB,
+	const DataType* result,
+	size_t count,
+	const CLHelper::Tolerance& tolerance)
+{
+	TRACE_SCOPE("validate");
+	double sampleFraction = (mode == CLHelper::VALIDATE_SAMPLED) ? validation.sampleFraction : 1.0;
+	return CLHelper::validateAdd(h_dataA, h_dataB, result, count, tolerance, sampleFraction);
+}
 
-// Map a host pointer to the Buffer
-	DataType* result =
-			(DataType*) commQueue.enqueueMapBuffer(d_dataC, true, CL_MAP_READ, 0, DATA_SIZE*sizeof(DataType), NULL, NULL, &err);
-	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+static size_t pickWorkGroupSize(const CLHelper::DeviceInfo& deviceInfo, size_t dataSize, size_t requested)
+{
+	if(requested > 0 && requested <= deviceInfo.maxWorkGroupSize && (dataSize % requested) == 0)
+		return requested;
+	if(requested > 0)
+		std::cout << "Work-group size " << requested << " does not divide " << dataSize << " or exceeds the device's maximum, picking one" << std::endl;
 
-	std::cout << "Result: " << result[DATA_SIZE-1] << std::endl;
+// Keep halving workGroupSize until it divides perfectly into dataSize
+	size_t workGroupSize = deviceInfo.maxWorkGroupSize;
+	while((dataSize % workGroupSize) != 0) {
+		workGroupSize /= 2;
+	}
+	return workGroupSize;
+}
 
-// Unmap the host pointer when done
-	commQueue.enqueueUnmapMemObject(d_dataC, result);
+// Files are read as they are, generated inputs are filled in parallel by the pool.
+// A non-zero rampPeriod makes ramps repeat with that period.
+static void prepareInput(const InputSource& source, DataType* data, size_t count, size_t rampPeriod)
+{
+	TRACE_SCOPE("prepareInput");
 
-// Free memory
-	delete[] h_dataA;
-	delete[] h_dataB;
-	delete[] h_dataC;
+	if(source.kind != INPUT_FILE) {
+		CLHelper::ThreadPool::shared().parallelForAffine(0, count,
+			boost::bind(&fillInputRange, &source, rampPeriod, data, boost::placeholders::_1, boost::placeholders::_2));
+		return;
+	}
 
-	return CL_SUCCESS;
+	std::ifstream file(source.path.c_str(), std::ios::in | std::ios::binary);
+	file.read((char*) data, count * sizeof(DataType));
+	if(!file.good()) {
+		std::cerr << "Unable to read " << count << " floats from " << source.path << std::endl;
+		exit(1);
+	}
+}
+
+static void fillInputRange(const InputSource* source, size_t rampPeriod, DataType* data, size_t first, size_t last)
+{
+	for(size_t i = first; i < last; i++)
+	{
+		switch(source->kind) {
+		case INPUT_RAMP:
+			data[i] = (DataType) (rampPeriod > 0 ? i % rampPeriod : i);
+			break;
+		case INPUT_ZERO:
+		case INPUT_FILE:
+			data[i] = (DataType) 0;
+			break;
+		case INPUT_RANDOM:
+		{
+			// Uniform in [0, 1), from a hash of the index so ranges fill independently
+			boost::uint32_t bits = ((boost::uint32_t) i ^ source->seed) * 0x9E3779B9u;
+			bits ^= bits >> 15;
+			bits *= 0x85EBCA6Bu;
+			bits ^= bits >> 13;
+			data[i] = (DataType) (bits >> 8) / 16777216.0f;
+			break;
+		}
+		}
+	}
+}
+
+static void computeReference(const DataType* h_dataA, const DataType* h_dataB, DataType* reference, size_t first, size_t last)
+{
+	for(size_t i = first; i < last; i++)
+		reference[i] = h_dataA[i] + h_dataB[i];
+}
+
+static void encodeStorageRange(CLHelper::StorageFormat format, const DataType* input, char* output, float scale, size_t first, size_t last)
+{
+	CLHelper::encodeStorage(format, input + first, last - first, output + first * CLHelper::storageFormatSize(format), scale);
+}
+
+static void decodeStorageRange(CLHelper::StorageFormat format, const char* input, DataType* output, float scale, size_t first, size_t last)
+{
+	CLHelper::decodeStorage(format, input + first * CLHelper::storageFormatSize(format), last - first, output + first, scale);
 }
 
 void CL_CALLBACK contextCallbackFunction(const char* errorinfo, const void* private_info_size, size_t cb, void* user_data)
@@ -1,8 +1,65 @@
 #ifndef _SIMPLEADDPROGRAM_H
 #define _SIMPLEADDPROGRAM_H
 
+#include <string>
+#include <boost/cstdint.hpp>
 #include "CLHelper.h"
+#include "Runtime.h"
+#include "StorageFormat.h"
+#include "TransferStrategy.h"
+#include "Validation.h"
 
-cl_int runSimpleAddProgram(std::vector<cl::Device>& deviceList, std::vector<CLHelper::DeviceInfo>& deviceInfoList);
+enum InputKind {
+	INPUT_RAMP,				/* element i is i, modulo RAMP_PERIOD with reduced precision storage */
+	INPUT_ZERO,
+	INPUT_RANDOM,			/* uniform in [0, 1), reproducible from the seed */
+	INPUT_FILE				/* raw native endian floats */
+};
+
+struct InputSource {
+	InputKind kind;
+	boost::uint32_t seed;
+	std::string path;
+
+	InputSource(InputKind kind = INPUT_RAMP) : kind(kind), seed(0) {}
+};
+
+/* Parses "ramp", "zero", "random[:<seed>]" or "file:<path>" */
+bool parseInputSource(const std::string& spec, InputSource* source);
+
+struct SimpleAddOptions {
+	size_t dataSize;		/* Elements per array */
+	size_t workGroupSize;	/* 0 picks the largest one dividing dataSize */
+	size_t repetitions;		/* Kernel runs on the same buffers, timings are averaged */
+	InputSource inputA;
+	InputSource inputB;
+	bool specialize;		/* Bake the problem size into the kernel */
+	bool fastMath;			/* Allow -cl-fast-relaxed-math */
+	CLHelper::TransferStrategy transferStrategy;	/* How to move the arrays, TRANSFER_AUTO picks per device */
+	CLHelper::StorageFormat storageFormat;			/* Reduced precision storage, if the caller tolerates it */
+	CLHelper::ValidationOptions validation;			/* How the result is checked */
+
+	SimpleAddOptions()
+		: dataSize(1048576), workGroupSize(0), repetitions(1), specialize(true), fastMath(false), transferStrategy(CLHelper::TRANSFER_AUTO), storageFormat(CLHelper::STORAGE_FLOAT) {}
+};
+
+/* Returns VALIDATION_FAILED when the result does not validate */
+cl_int runSimpleAddProgram(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	const SimpleAddOptions& options = SimpleAddOptions());
+
+/* Same, on a runtime that stays warm across calls. Programs are built once per specialization. */
+cl_int runSimpleAdd(CLHelper::Runtime& runtime, const SimpleAddOptions& options = SimpleAddOptions());
+
+cl_int runTransferBenchmark(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	size_t iterations);
+
+cl_int runPersistentBenchmark(
+	std::vector<cl::Device>& deviceList,
+	std::vector<CLHelper::DeviceInfo>& deviceInfoList,
+	size_t iterations);
 
 #endif
@@ -0,0 +1,241 @@
+#include "KernelHelpers.clh"
+
+// Radix sort, scan and segmented reductions of CLHelper::DeviceSorter. The
+// host defines KEY_TYPE (uint or ulong), RADIX_BITS and SORT_ITEMS from the
+// device's local memory, see CLHelper::chooseRadixShape(). No kernel uses
+// atomics: every work-item counts into its own column of a local histogram.
+#ifndef KEY_TYPE
+#define KEY_TYPE uint
+#endif
+#ifndef RADIX_BITS
+#define RADIX_BITS 4
+#endif
+#ifndef SORT_ITEMS
+#define SORT_ITEMS 8
+#endif
+
+#define RADIX (1 << RADIX_BITS)
+#define DIGIT(key, shift) ((uint) ((key) >> (shift)) & (RADIX - 1))
+
+// Work-group g works on block g of get_local_size(0) * SORT_ITEMS elements,
+// work-item i on the SORT_ITEMS consecutive elements at i * SORT_ITEMS in it
+size_t firstItem()
+{
+	return ((size_t) get_group_id(0) * get_local_size(0) + get_local_id(0)) * SORT_ITEMS;
+}
+
+// Counts the digits of the work-item's keys into its column of the
+// digit-major RADIX x localSize histogram
+void countDigits(__global const KEY_TYPE* keys, unsigned int count, unsigned int shift, __local uint* histogram)
+{
+	unsigned int localId = get_local_id(0);
+	unsigned int localSize = get_local_size(0);
+
+	for(unsigned int digit = 0; digit < RADIX; digit++)
+		histogram[digit * localSize + localId] = 0;
+
+	size_t first = firstItem();
+	for(unsigned int item = 0; item < SORT_ITEMS; item++)
+	{
+		if(first + item < count)
+			histogram[DIGIT(keys[first + item], shift) * localSize + localId]++;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// How many keys of every digit each block holds, digit-major, so that the
+// exclusive scan of groupCounts gives every block the position of its first
+// key of every digit
+__kernel
+void radixCountKernel(
+	__global const KEY_TYPE* keys,
+	unsigned int count,
+	unsigned int shift,
+	__global uint* groupCounts,
+	__local uint* histogram)
+{
+	unsigned int localSize = get_local_size(0);
+	unsigned int group = get_group_id(0);
+	unsigned int groupCount = get_num_groups(0);
+
+	countDigits(keys, count, shift, histogram);
+
+	for(unsigned int digit = get_local_id(0); digit < RADIX; digit += localSize)
+	{
+		uint sum = 0;
+		for(unsigned int i = 0; i < localSize; i++)
+			sum += histogram[digit * localSize + i];
+		groupCounts[digit * groupCount + group] = sum;
+	}
+}
+
+// Moves every key (and its value when withValues is set) to its position
+// after this pass. Work-items scatter their keys in order from positions
+// they own, which keeps the sort stable. Needs RADIX <= localSize.
+__kernel
+void radixScatterKernel(
+	__global const KEY_TYPE* keysIn,
+	__global const uint* valuesIn,
+	__global KEY_TYPE* keysOut,
+	__global uint* valuesOut,
+	unsigned int count,
+	unsigned int shift,
+	unsigned int withValues,
+	__global const uint* groupOffsets,
+	__local uint* offsets,
+	__local uint* scratch)
+{
+	unsigned int localId = get_local_id(0);
+	unsigned int localSize = get_local_size(0);
+	unsigned int group = get_group_id(0);
+	unsigned int groupCount = get_num_groups(0);
+
+	countDigits(keysIn, count, shift, offsets);
+
+	// Exclusive scan of the whole histogram, RADIX consecutive entries per work-item
+	uint total = 0;
+	for(unsigned int i = 0; i < RADIX; i++)
+		total += offsets[localId * RADIX + i];
+
+	uint prefix = workGroupExclusiveScan(total, scratch);
+	for(unsigned int i = 0; i < RADIX; i++)
+	{
+		uint entry = offsets[localId * RADIX + i];
+		offsets[localId * RADIX + i] = prefix;
+		prefix += entry;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Rebase every row from the block's first key of that digit to its global position
+	for(unsigned int digit = localId; digit < RADIX; digit += localSize)
+		scratch[digit] = groupOffsets[digit * groupCount + group] - offsets[digit * localSize];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(unsigned int digit = 0; digit < RADIX; digit++)
+		offsets[digit * localSize + localId] += scratch[digit];
+
+	size_t first = firstItem();
+	for(unsigned int item = 0; item < SORT_ITEMS; item++)
+	{
+		size_t index = first + item;
+		if(index >= count)
+			break;
+
+		KEY_TYPE key = keysIn[index];
+		uint position = offsets[DIGIT(key, shift) * localSize + localId]++;
+		keysOut[position] = key;
+		if(withValues)
+			valuesOut[position] = valuesIn[index];
+	}
+}
+
+// Exclusive scan of every block in place, with the block totals in blockSums
+__kernel
+void scanBlocksKernel(__global uint* data, unsigned int count, __global uint* blockSums, __local uint* scratch)
+{
+	size_t first = firstItem();
+
+	uint total = 0;
+	for(unsigned int item = 0; item < SORT_ITEMS; item++)
+	{
+		if(first + item < count)
+			total += data[first + item];
+	}
+
+	uint prefix = workGroupExclusiveScan(total, scratch);
+	if(get_local_id(0) == get_local_size(0) - 1)
+		blockSums[get_group_id(0)] = prefix + total;
+
+	for(unsigned int item = 0; item < SORT_ITEMS; item++)
+	{
+		if(first + item < count) {
+			uint value = data[first + item];
+			data[first + item] = prefix;
+			prefix += value;
+		}
+	}
+}
+
+// Adds the scanned block totals to the blocks of scanBlocksKernel
+__kernel
+void addBlockOffsetsKernel(__global uint* data, unsigned int count, __global const uint* blockOffsets)
+{
+	size_t first = firstItem();
+	uint offset = blockOffsets[get_group_id(0)];
+
+	for(unsigned int item = 0; item < SORT_ITEMS; item++)
+	{
+		if(first + item < count)
+			data[first + item] += offset;
+	}
+}
+
+// 1 where a run of equal keys starts; heads[count] is 0, so that the exclusive
+// scan of count + 1 heads ends with the number of runs
+__kernel
+void segmentHeadsKernel(__global const KEY_TYPE* keys, unsigned int count, __global uint* heads)
+{
+	size_t index = get_global_id(0);
+
+	if(index < count)
+		heads[index] = (index == 0 || keys[index] != keys[index - 1]) ? 1 : 0;
+	else if(index == count)
+		heads[index] = 0;
+}
+
+// The first index and the key of every run, from the scanned heads, and count
+// after the last run
+__kernel
+void segmentStartsKernel(
+	__global const KEY_TYPE* keys,
+	__global const uint* segmentIndices,
+	unsigned int count,
+	__global uint* segmentStarts,
+	__global KEY_TYPE* uniqueKeys)
+{
+	size_t index = get_global_id(0);
+
+	if(index >= count)
+		return;
+
+	if(index == 0 || keys[index] != keys[index - 1]) {
+		segmentStarts[segmentIndices[index]] = index;
+		uniqueKeys[segmentIndices[index]] = keys[index];
+	}
+	if(index == count - 1)
+		segmentStarts[segmentIndices[count]] = count;
+}
+
+// One work-item per segment [segmentStarts[s], segmentStarts[s + 1]), summed,
+// or reduced to its minimum or maximum with -D REDUCE_MIN or -D REDUCE_MAX
+__kernel
+void reduceSegmentsKernel(
+	__global const float* values,
+	__global const uint* segmentStarts,
+	unsigned int segmentCount,
+	__global float* results)
+{
+	size_t segment = get_global_id(0);
+
+	if(segment >= segmentCount)
+		return;
+
+	uint first = segmentStarts[segment];
+	uint end = segmentStarts[segment + 1];
+
+#if defined(REDUCE_MIN)
+	float result = INFINITY;
+	for(uint i = first; i < end; i++)
+		result = fmin(result, values[i]);
+#elif defined(REDUCE_MAX)
+	float result = -INFINITY;
+	for(uint i = first; i < end; i++)
+		result = fmax(result, values[i]);
+#else
+	float result = 0.0f;
+	for(uint i = first; i < end; i++)
+		result += values[i];
+#endif
+
+	results[segment] = result;
+}
@@ -0,0 +1,594 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include "RecordLayout.h"
+#include "StandInPlatform.h"
+#include "StorageFormat.h"
+#include "Validation.h"
+
+/*
+ * Native equivalents of the repository's kernels for the stand-in platform.
+ * Each one computes a whole work-group and must give the results of its
+ * OpenCL C original, see the .cl files for what they do. Kernels that need
+ * images, run persistently or are built from generated accessor macros have
+ * no native equivalent.
+ */
+
+static void simpleAddKernel(const CLHelper::StandInWorkGroup& group);
+static void simpleAddChecksumKernel(const CLHelper::StandInWorkGroup& group);
+static void initKernel(const CLHelper::StandInWorkGroup& group);
+static void simpleAddStoredKernel(const CLHelper::StandInWorkGroup& group);
+static void initStoredKernel(const CLHelper::StandInWorkGroup& group);
+static void readBandwidthKernel(const CLHelper::StandInWorkGroup& group);
+static void writeBandwidthKernel(const CLHelper::StandInWorkGroup& group);
+static void copyBandwidthKernel(const CLHelper::StandInWorkGroup& group);
+static void triadBandwidthKernel(const CLHelper::StandInWorkGroup& group);
+static void localBandwidthKernel(const CLHelper::StandInWorkGroup& group);
+static void peakFlopsKernel(const CLHelper::StandInWorkGroup& group);
+static void stencil2DKernel(const CLHelper::StandInWorkGroup& group);
+static void matmulKernel(const CLHelper::StandInWorkGroup& group);
+static void convertLayoutKernel(const CLHelper::StandInWorkGroup& group);
+static void decodeBlocksKernel(const CLHelper::StandInWorkGroup& group);
+static void radixCountKernel(const CLHelper::StandInWorkGroup& group);
+static void radixScatterKernel(const CLHelper::StandInWorkGroup& group);
+static void scanBlocksKernel(const CLHelper::StandInWorkGroup& group);
+static void addBlockOffsetsKernel(const CLHelper::StandInWorkGroup& group);
+static void segmentHeadsKernel(const CLHelper::StandInWorkGroup& group);
+static void segmentStartsKernel(const CLHelper::StandInWorkGroup& group);
+static void reduceSegmentsKernel(const CLHelper::StandInWorkGroup& group);
+static size_t simpleAddEnd(const CLHelper::StandInWorkGroup& group, cl_uint dataSizeIndex);
+static CLHelper::StorageFormat storedFormat(const CLHelper::StandInWorkGroup& group);
+template <typename T> static void peakFlops(const CLHelper::StandInWorkGroup& group);
+static size_t layoutIndex(cl_uint kind, cl_uint tileWidth, cl_uint record, cl_uint field, cl_uint fieldCount, cl_uint count);
+static bool wideKeys(const CLHelper::StandInWorkGroup& group);
+static size_t sortBlockBegin(const CLHelper::StandInWorkGroup& group);
+static size_t sortBlockEnd(const CLHelper::StandInWorkGroup& group, size_t count);
+template <typename Key> static void radixCount(const CLHelper::StandInWorkGroup& group);
+template <typename Key> static void radixScatter(const CLHelper::StandInWorkGroup& group);
+template <typename Key> static void segmentHeads(const CLHelper::StandInWorkGroup& group);
+template <typename Key> static void segmentStarts(const CLHelper::StandInWorkGroup& group);
+
+static boost::mutex atomicMutex;
+
+void CLHelper::registerStandInKernels()
+{
+	registerStandInKernel("simpleAddKernel", &simpleAddKernel);
+	registerStandInKernel("simpleAddChecksumKernel", &simpleAddChecksumKernel);
+	registerStandInKernel("initKernel", &initKernel);
+	registerStandInKernel("simpleAddStoredKernel", &simpleAddStoredKernel);
+	registerStandInKernel("initStoredKernel", &initStoredKernel);
+
+	registerStandInKernel("readBandwidthKernel", &readBandwidthKernel);
+	registerStandInKernel("writeBandwidthKernel", &writeBandwidthKernel);
+	registerStandInKernel("copyBandwidthKernel", &copyBandwidthKernel);
+	registerStandInKernel("triadBandwidthKernel", &triadBandwidthKernel);
+	registerStandInKernel("localBandwidthKernel", &localBandwidthKernel);
+	registerStandInKernel("peakFlopsKernel", &peakFlopsKernel);
+
+	// The tiled versions only differ in how they use local memory
+	registerStandInKernel("stencil2DKernel", &stencil2DKernel);
+	registerStandInKernel("stencil2DTiledKernel", &stencil2DKernel);
+	registerStandInKernel("matmulKernel", &matmulKernel);
+	registerStandInKernel("matmulTiledKernel", &matmulKernel);
+
+	registerStandInKernel("convertLayoutKernel", &convertLayoutKernel);
+	registerStandInKernel("decodeBlocksKernel", &decodeBlocksKernel);
+
+	registerStandInKernel("radixCountKernel", &radixCountKernel);
+	registerStandInKernel("radixScatterKernel", &radixScatterKernel);
+	registerStandInKernel("scanBlocksKernel", &scanBlocksKernel);
+	registerStandInKernel("addBlockOffsetsKernel", &addBlockOffsetsKernel);
+	registerStandInKernel("segmentHeadsKernel", &segmentHeadsKernel);
+	registerStandInKernel("segmentStartsKernel", &segmentStartsKernel);
+	registerStandInKernel("reduceSegmentsKernel", &reduceSegmentsKernel);
+}
+
+/* SimpleAddKernel.cl */
+
+static void simpleAddKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* dataA = group.global<float>(0);
+	const float* dataB = group.global<float>(1);
+	float* dataC = group.global<float>(2);
+
+	size_t end = simpleAddEnd(group, 3);
+	for(size_t threadId = group.begin(0); threadId < end; threadId++)
+		dataC[threadId] = dataA[threadId] + dataB[threadId];
+}
+
+static void simpleAddChecksumKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* dataA = group.global<float>(0);
+	const float* dataB = group.global<float>(1);
+	float* dataC = group.global<float>(2);
+	boost::uint32_t* checksum = group.global<boost::uint32_t>(4);
+
+	boost::uint32_t partialSum = 0;
+	size_t end = simpleAddEnd(group, 3);
+	for(size_t threadId = group.begin(0); threadId < end; threadId++)
+	{
+		float sum = dataA[threadId] + dataB[threadId];
+		dataC[threadId] = sum;
+		partialSum += CLHelper::checksumElement(threadId, sum);
+	}
+
+	boost::mutex::scoped_lock lock(atomicMutex);
+	*checksum += partialSum;
+}
+
+static void initKernel(const CLHelper::StandInWorkGroup& group)
+{
+	float* dataA = group.global<float>(0);
+	float* dataB = group.global<float>(1);
+	float* dataC = group.global<float>(2);
+	unsigned int offset = group.value<unsigned int>(3);
+	size_t end = std::min(group.end(0), (size_t) group.value<unsigned int>(4));
+
+	for(size_t threadId = group.begin(0); threadId < end; threadId++)
+	{
+		dataA[threadId] = (float) (offset + threadId);
+		dataB[threadId] = (float) (offset + threadId);
+		dataC[threadId] = 0.0f;
+	}
+}
+
+static void simpleAddStoredKernel(const CLHelper::StandInWorkGroup& group)
+{
+	CLHelper::StorageFormat format = storedFormat(group);
+	size_t elementSize = CLHelper::storageFormatSize(format);
+	size_t begin = group.begin(0);
+	size_t end = simpleAddEnd(group, 3);
+	if(begin >= end)
+		return;
+
+	std::vector<float> dataA(end - begin);
+	std::vector<float> dataB(end - begin);
+	CLHelper::decodeStorage(format, group.global<char>(0) + begin * elementSize, dataA.size(), &dataA[0], group.value<float>(4));
+	CLHelper::decodeStorage(format, group.global<char>(1) + begin * elementSize, dataB.size(), &dataB[0], group.value<float>(5));
+
+	for(size_t i = 0; i < dataA.size(); i++)
+		dataA[i] += dataB[i];
+	CLHelper::encodeStorage(format, &dataA[0], dataA.size(), group.global<char>(2) + begin * elementSize, group.value<float>(6));
+}
+
+static void initStoredKernel(const CLHelper::StandInWorkGroup& group)
+{
+	CLHelper::StorageFormat format = storedFormat(group);
+	size_t elementSize = CLHelper::storageFormatSize(format);
+	unsigned int offset = group.value<unsigned int>(2);
+	size_t begin = group.begin(0);
+	size_t end = std::min(group.end(0), (size_t) group.value<unsigned int>(3));
+	if(begin >= end)
+		return;
+
+	std::vector<float> values(end - begin);
+	for(size_t i = 0; i < values.size(); i++)
+		values[i] = (float) ((offset + begin + i) % RAMP_PERIOD);
+
+	CLHelper::encodeStorage(format, &values[0], values.size(), group.global<char>(0) + begin * elementSize, group.value<float>(4));
+	CLHelper::encodeStorage(format, &values[0], values.size(), group.global<char>(1) + begin * elementSize, group.value<float>(5));
+}
+
+/* MicroBenchmarkKernels.cl, where every work-item moves four floats */
+
+static void readBandwidthKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* input = group.global<float>(0);
+	float* output = group.global<float>(1);
+
+	for(size_t threadId = group.begin(0); threadId < group.end(0); threadId++)
+	{
+		const float* value = input + 4 * threadId;
+		if(value[0] + value[1] + value[2] + value[3] == -1.0f)
+			output[0] = value[0];
+	}
+}
+
+static void writeBandwidthKernel(const CLHelper::StandInWorkGroup& group)
+{
+	float* output = group.global<float>(0);
+	std::fill(output + 4 * group.begin(0), output + 4 * group.end(0), group.value<float>(1));
+}
+
+static void copyBandwidthKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* input = group.global<float>(0);
+	float* output = group.global<float>(1);
+	memcpy(output + 4 * group.begin(0), input + 4 * group.begin(0), 4 * group.getLocalSize(0) * sizeof(float));
+}
+
+static void triadBandwidthKernel(const CLHelper::StandInWorkGroup& group)
+{
+	float* dataA = group.global<float>(0);
+	const float* dataB = group.global<float>(1);
+	const float* dataC = group.global<float>(2);
+	float scalar = group.value<float>(3);
+
+	for(size_t i = 4 * group.begin(0); i < 4 * group.end(0); i++)
+		dataA[i] = dataB[i] + scalar * dataC[i];
+}
+
+static void localBandwidthKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const unsigned int localIterations = 64;
+
+	float* output = group.global<float>(0);
+	float* scratch = group.local<float>(1);
+	size_t localSize = group.getLocalSize(0);
+
+	for(size_t localId = 0; localId < localSize; localId++)
+		scratch[localId] = (float) localId;
+
+	for(size_t localId = 0; localId < localSize; localId++)
+	{
+		float sum = 0.0f;
+		for(unsigned int i = 0; i < localIterations; i++)
+			sum += scratch[(localId + i) & (localSize - 1)];
+		output[group.begin(0) + localId] = sum;
+	}
+}
+
+static void peakFlopsKernel(const CLHelper::StandInWorkGroup& group)
+{
+	if(group.getDefine("FLOAT_TYPE", "float") == "double")
+		peakFlops<double>(group);
+	else
+		peakFlops<float>(group);
+}
+
+/* TiledKernels.cl */
+
+static void stencil2DKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* input = group.global<float>(0);
+	float* output = group.global<float>(1);
+	size_t width = group.value<unsigned int>(2);
+	size_t height = group.value<unsigned int>(3);
+	float center = group.value<float>(4);
+	float neighbour = group.value<float>(5);
+
+	for(size_t y = group.begin(1); y < std::min(group.end(1), height); y++)
+	{
+		size_t up = (y > 0) ? y - 1 : 0;
+		size_t down = std::min(y + 1, height - 1);
+
+		for(size_t x = group.begin(0); x < std::min(group.end(0), width); x++)
+		{
+			size_t left = (x > 0) ? x - 1 : 0;
+			size_t right = std::min(x + 1, width - 1);
+
+			output[y * width + x] = center * input[y * width + x]
+				+ neighbour * (input[y * width + left] + input[y * width + right] + input[up * width + x] + input[down * width + x]);
+		}
+	}
+}
+
+static void matmulKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* dataA = group.global<float>(0);
+	const float* dataB = group.global<float>(1);
+	float* dataC = group.global<float>(2);
+	size_t rows = group.value<unsigned int>(3);
+	size_t columns = group.value<unsigned int>(4);
+	size_t inner = group.value<unsigned int>(5);
+
+	for(size_t row = group.begin(1); row < std::min(group.end(1), rows); row++)
+	{
+		for(size_t column = group.begin(0); column < std::min(group.end(0), columns); column++)
+		{
+			float sum = 0.0f;
+			for(size_t k = 0; k < inner; k++)
+				sum += dataA[row * inner + k] * dataB[k * columns + column];
+			dataC[row * columns + column] = sum;
+		}
+	}
+}
+
+/* LayoutKernels.cl */
+
+static void convertLayoutKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const boost::uint32_t* source = group.global<boost::uint32_t>(0);
+	boost::uint32_t* destination = group.global<boost::uint32_t>(1);
+	cl_uint count = group.value<cl_uint>(2);
+	cl_uint fieldCount = group.value<cl_uint>(3);
+	cl_uint sourceKind = group.value<cl_uint>(4);
+	cl_uint sourceTile = group.value<cl_uint>(5);
+	cl_uint destinationKind = group.value<cl_uint>(6);
+	cl_uint destinationTile = group.value<cl_uint>(7);
+
+	for(size_t field = group.begin(1); field < group.end(1); field++)
+	{
+		for(size_t record = group.begin(0); record < std::min(group.end(0), (size_t) count); record++)
+		{
+			destination[layoutIndex(destinationKind, destinationTile, (cl_uint) record, (cl_uint) field, fieldCount, count)] =
+				source[layoutIndex(sourceKind, sourceTile, (cl_uint) record, (cl_uint) field, fieldCount, count)];
+		}
+	}
+}
+
+/* CompressionKernels.cl */
+
+static void decodeBlocksKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const boost::uint32_t* words = group.global<boost::uint32_t>(0);
+	const boost::uint32_t* blockOffsets = group.global<boost::uint32_t>(1);
+	size_t blockCount = group.value<unsigned int>(2);
+	size_t blockElements = group.value<unsigned int>(3);
+	size_t elementCount = group.value<unsigned int>(4);
+	float* output = group.global<float>(5);
+
+	for(size_t block = group.begin(0); block < std::min(group.end(0), blockCount); block++)
+	{
+		const boost::uint32_t* blockWords = words + blockOffsets[block];
+		float* blockOutput = output + block * blockElements;
+		size_t count = std::min(blockElements, elementCount - block * blockElements);
+
+		boost::uint32_t value = blockWords[0];
+		boost::uint32_t width = blockWords[1];
+		const boost::uint32_t* packed = blockWords + 2;
+		boost::uint32_t mask = (width == 32) ? 0xFFFFFFFF : ((1u << width) - 1);
+
+		memcpy(&blockOutput[0], &value, sizeof(float));
+
+		size_t bitPosition = 0;
+		for(size_t i = 1; i < count; i++)
+		{
+			boost::uint32_t zigzag = 0;
+			if(width > 0) {
+				size_t word = bitPosition >> 5;
+				size_t shift = bitPosition & 31;
+				zigzag = packed[word] >> shift;
+				if(shift + width > 32)
+					zigzag |= packed[word + 1] << (32 - shift);
+				zigzag &= mask;
+				bitPosition += width;
+			}
+
+			value += (zigzag >> 1) ^ (0u - (zigzag & 1));
+			memcpy(&blockOutput[i], &value, sizeof(float));
+		}
+	}
+}
+
+/* SortKernels.cl */
+
+static void radixCountKernel(const CLHelper::StandInWorkGroup& group)
+{
+	if(wideKeys(group))
+		radixCount<cl_ulong>(group);
+	else
+		radixCount<cl_uint>(group);
+}
+
+static void radixScatterKernel(const CLHelper::StandInWorkGroup& group)
+{
+	if(wideKeys(group))
+		radixScatter<cl_ulong>(group);
+	else
+		radixScatter<cl_uint>(group);
+}
+
+static void scanBlocksKernel(const CLHelper::StandInWorkGroup& group)
+{
+	boost::uint32_t* data = group.global<boost::uint32_t>(0);
+	size_t count = group.value<cl_uint>(1);
+	boost::uint32_t* blockSums = group.global<boost::uint32_t>(2);
+
+	boost::uint32_t prefix = 0;
+	for(size_t i = sortBlockBegin(group); i < sortBlockEnd(group, count); i++)
+	{
+		boost::uint32_t value = data[i];
+		data[i] = prefix;
+		prefix += value;
+	}
+	blockSums[group.getGroupId(0)] = prefix;
+}
+
+static void addBlockOffsetsKernel(const CLHelper::StandInWorkGroup& group)
+{
+	boost::uint32_t* data = group.global<boost::uint32_t>(0);
+	size_t count = group.value<cl_uint>(1);
+	boost::uint32_t offset = group.global<boost::uint32_t>(2)[group.getGroupId(0)];
+
+	for(size_t i = sortBlockBegin(group); i < sortBlockEnd(group, count); i++)
+		data[i] += offset;
+}
+
+static void segmentHeadsKernel(const CLHelper::StandInWorkGroup& group)
+{
+	if(wideKeys(group))
+		segmentHeads<cl_ulong>(group);
+	else
+		segmentHeads<cl_uint>(group);
+}
+
+static void segmentStartsKernel(const CLHelper::StandInWorkGroup& group)
+{
+	if(wideKeys(group))
+		segmentStarts<cl_ulong>(group);
+	else
+		segmentStarts<cl_uint>(group);
+}
+
+static void reduceSegmentsKernel(const CLHelper::StandInWorkGroup& group)
+{
+	const float* values = group.global<float>(0);
+	const boost::uint32_t* segmentStarts = group.global<boost::uint32_t>(1);
+	size_t segmentCount = group.value<cl_uint>(2);
+	float* results = group.global<float>(3);
+
+	bool minimum = group.isDefined("REDUCE_MIN");
+	bool maximum = group.isDefined("REDUCE_MAX");
+	float identity = minimum ? std::numeric_limits<float>::infinity()
+		: maximum ? -std::numeric_limits<float>::infinity() : 0.0f;
+
+	for(size_t segment = group.begin(0); segment < std::min(group.end(0), segmentCount); segment++)
+	{
+		float result = identity;
+		for(size_t i = segmentStarts[segment]; i < segmentStarts[segment + 1]; i++)
+		{
+			if(minimum)
+				result = std::min(result, values[i]);
+			else if(maximum)
+				result = std::max(result, values[i]);
+			else
+				result += values[i];
+		}
+		results[segment] = result;
+	}
+}
+
+/* Helpers */
+
+/* End of the work-items that pass the bounds check selected by FIXED_DATA_SIZE and NO_BOUNDS_CHECK */
+static size_t simpleAddEnd(const CLHelper::StandInWorkGroup& group, cl_uint dataSizeIndex)
+{
+	if(group.isDefined("FIXED_DATA_SIZE") && group.isDefined("NO_BOUNDS_CHECK"))
+		return group.end(0);
+	if(group.isDefined("FIXED_DATA_SIZE"))
+		return std::min(group.end(0), (size_t) group.getDefineInt("FIXED_DATA_SIZE", 0));
+	return std::min(group.end(0), (size_t) group.value<unsigned int>(dataSizeIndex));
+}
+
+static CLHelper::StorageFormat storedFormat(const CLHelper::StandInWorkGroup& group)
+{
+	if(group.isDefined("STORAGE_HALF"))
+		return CLHelper::STORAGE_HALF;
+	if(group.isDefined("STORAGE_BF16"))
+		return CLHelper::STORAGE_BF16;
+	if(group.isDefined("STORAGE_INT8"))
+		return CLHelper::STORAGE_INT8;
+	return CLHelper::STORAGE_FLOAT;
+}
+
+/* Four independent chains of FLOPS_ITERATIONS x 8 multiply-adds */
+template <typename T>
+static void peakFlops(const CLHelper::StandInWorkGroup& group)
+{
+	const int flopsIterations = 128;
+
+	T* output = group.global<T>(0);
+	T factor = (T) 0.999f;
+	T offset = (T) group.value<float>(1);
+
+	for(size_t threadId = group.begin(0); threadId < group.end(0); threadId++)
+	{
+		T x[4];
+		for(int chain = 0; chain < 4; chain++)
+			x[chain] = (T) threadId + (T) chain;
+
+		for(int i = 0; i < flopsIterations * 8; i++)
+		{
+			for(int chain = 0; chain < 4; chain++)
+				x[chain] = x[chain] * factor + offset;
+		}
+
+		output[threadId] = x[0] + x[1] + x[2] + x[3];
+	}
+}
+
+/* Must match layoutIndex() in LayoutKernels.cl */
+static size_t layoutIndex(cl_uint kind, cl_uint tileWidth, cl_uint record, cl_uint field, cl_uint fieldCount, cl_uint count)
+{
+	CLHelper::RecordLayout layout((CLHelper::LayoutKind) kind, tileWidth);
+	return CLHelper::layoutIndex(layout, fieldCount, count, record, field);
+}
+
+static bool wideKeys(const CLHelper::StandInWorkGroup& group)
+{
+	return group.getDefine("KEY_TYPE", "uint") == "ulong";
+}
+
+/* The work-group's block of local size x SORT_ITEMS elements, see firstItem() in SortKernels.cl */
+static size_t sortBlockBegin(const CLHelper::StandInWorkGroup& group)
+{
+	return group.begin(0) * group.getDefineInt("SORT_ITEMS", 8);
+}
+
+static size_t sortBlockEnd(const CLHelper::StandInWorkGroup& group, size_t count)
+{
+	return std::min(group.end(0) * group.getDefineInt("SORT_ITEMS", 8), count);
+}
+
+template <typename Key>
+static void radixCount(const CLHelper::StandInWorkGroup& group)
+{
+	const Key* keys = group.global<Key>(0);
+	size_t count = group.value<cl_uint>(1);
+	cl_uint shift = group.value<cl_uint>(2);
+	boost::uint32_t* groupCounts = group.global<boost::uint32_t>(3);
+
+	size_t radix = (size_t) 1 << group.getDefineInt("RADIX_BITS", 4);
+	size_t groupCount = group.getGlobalSize(0) / group.getLocalSize(0);
+
+	std::vector<boost::uint32_t> histogram(radix, 0);
+	for(size_t i = sortBlockBegin(group); i < sortBlockEnd(group, count); i++)
+		histogram[(size_t) (keys[i] >> shift) & (radix - 1)]++;
+
+	for(size_t digit = 0; digit < radix; digit++)
+		groupCounts[digit * groupCount + group.getGroupId(0)] = histogram[digit];
+}
+
+/* The block's keys in order, each after the ones of its digit before it, which is what the work-items do */
+template <typename Key>
+static void radixScatter(const CLHelper::StandInWorkGroup& group)
+{
+	const Key* keysIn = group.global<Key>(0);
+	const boost::uint32_t* valuesIn = group.global<boost::uint32_t>(1);
+	Key* keysOut = group.global<Key>(2);
+	boost::uint32_t* valuesOut = group.global<boost::uint32_t>(3);
+	size_t count = group.value<cl_uint>(4);
+	cl_uint shift = group.value<cl_uint>(5);
+	bool withValues = group.value<cl_uint>(6) != 0;
+	const boost::uint32_t* groupOffsets = group.global<boost::uint32_t>(7);
+
+	size_t radix = (size_t) 1 << group.getDefineInt("RADIX_BITS", 4);
+	size_t groupCount = group.getGlobalSize(0) / group.getLocalSize(0);
+
+	std::vector<boost::uint32_t> positions(radix);
+	for(size_t digit = 0; digit < radix; digit++)
+		positions[digit] = groupOffsets[digit * groupCount + group.getGroupId(0)];
+
+	for(size_t i = sortBlockBegin(group); i < sortBlockEnd(group, count); i++)
+	{
+		boost::uint32_t position = positions[(size_t) (keysIn[i] >> shift) & (radix - 1)]++;
+		keysOut[position] = keysIn[i];
+		if(withValues)
+			valuesOut[position] = valuesIn[i];
+	}
+}
+
+template <typename Key>
+static void segmentHeads(const CLHelper::StandInWorkGroup& group)
+{
+	const Key* keys = group.global<Key>(0);
+	size_t count = group.value<cl_uint>(1);
+	boost::uint32_t* heads = group.global<boost::uint32_t>(2);
+
+	for(size_t index = group.begin(0); index < std::min(group.end(0), count + 1); index++)
+		heads[index] = (index < count && (index == 0 || keys[index] != keys[index - 1])) ? 1 : 0;
+}
+
+template <typename Key>
+static void segmentStarts(const CLHelper::StandInWorkGroup& group)
+{
+	const Key* keys = group.global<Key>(0);
+	const boost::uint32_t* segmentIndices = group.global<boost::uint32_t>(1);
+	size_t count = group.value<cl_uint>(2);
+	boost::uint32_t* segmentStarts = group.global<boost::uint32_t>(3);
+	Key* uniqueKeys = group.global<Key>(4);
+
+	for(size_t index = group.begin(0); index < std::min(group.end(0), count); index++)
+	{
+		if(index == 0 || keys[index] != keys[index - 1]) {
+			segmentStarts[segmentIndices[index]] = (boost::uint32_t) index;
+			uniqueKeys[segmentIndices[index]] = keys[index];
+		}
+		if(index == count - 1)
+			segmentStarts[segmentIndices[count]] = (boost::uint32_t) count;
+	}
+}
@@ -0,0 +1,2864 @@
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "StandInPlatform.h"
+#include "ThreadPool.h"
+
+namespace pt = boost::posix_time;
+
+#define STANDIN_MAX_WORK_GROUP_SIZE 1024
+#define STANDIN_DEFAULT_LOCAL_SIZE 64
+#define STANDIN_MEMORY_ALIGNMENT 4096
+#define STANDIN_CLOCK_ORIGIN 1000000000ull
+
+/* Parsed from CLHELPER_STANDIN, see StandInPlatform.h */
+struct StandInConfig {
+	cl_uint devices;
+	cl_device_type type;
+	cl_uint computeUnits;
+	cl_ulong memoryBytes;
+	cl_uint numaNodes;
+	bool simulate;
+	bool sleep;
+	double launchMicroseconds;
+	double transferGBs;
+	double bandwidthGBs;
+};
+
+/* A __kernel function found in a program's source */
+struct StandInPrototype {
+	std::string name;
+	std::vector<CLHelper::StandInArgument> arguments;
+};
+
+struct EventCallback {
+	cl_int status;
+	void (CL_CALLBACK* function)(cl_event, cl_int, void*);
+	void* userData;
+};
+
+struct _cl_platform_id {
+	std::vector<cl_device_id> devices;
+};
+
+struct _cl_device_id {
+	cl_platform_id platform;
+	cl_device_id parent;					/* NULL for root devices, which are not reference counted */
+	cl_uint index;
+	cl_uint computeUnits;
+#ifdef CL_VERSION_1_2
+	std::vector<cl_device_partition_property> partitionType;
+#endif
+	boost::atomic<cl_uint> references;
+
+	boost::mutex clockMutex;
+	cl_ulong clock;							/* end of the last command on the simulated timeline, ns */
+
+	_cl_device_id(cl_platform_id platform, cl_device_id parent, cl_uint index, cl_uint computeUnits)
+		: platform(platform), parent(parent), index(index), computeUnits(computeUnits), references(1), clock(STANDIN_CLOCK_ORIGIN) {}
+	~_cl_device_id();
+};
+
+struct _cl_context {
+	boost::atomic<cl_uint> references;
+	std::vector<cl_device_id> devices;
+	std::vector<cl_context_properties> properties;
+
+	_cl_context(const std::vector<cl_device_id>& devices, const cl_context_properties* properties);
+	~_cl_context();
+};
+
+struct _cl_command_queue {
+	boost::atomic<cl_uint> references;
+	cl_context context;
+	cl_device_id device;
+	cl_command_queue_properties properties;
+	boost::mutex mutex;						/* commands run one at a time, in order */
+
+	_cl_command_queue(cl_context context, cl_device_id device, cl_command_queue_properties properties);
+	~_cl_command_queue();
+};
+
+struct _cl_mem {
+	boost::atomic<cl_uint> references;
+	cl_context context;
+	cl_mem_flags flags;
+	size_t size;
+	char* data;
+	bool ownsData;
+	void* hostPtr;
+	cl_mem parent;							/* the buffer of a sub-buffer */
+	size_t origin;
+	boost::atomic<cl_uint> mapCount;
+	std::vector<std::pair<void (CL_CALLBACK*)(cl_mem, void*), void*> > destructorCallbacks;
+
+	_cl_mem(cl_context context, cl_mem_flags flags, size_t size)
+		: references(1), context(context), flags(flags), size(size), data(NULL), ownsData(false), hostPtr(NULL), parent(NULL), origin(0), mapCount(0) {}
+	~_cl_mem();
+};
+
+struct _cl_sampler {
+	boost::atomic<cl_uint> references;
+};
+
+struct _cl_program {
+	boost::atomic<cl_uint> references;
+	cl_context context;
+	std::vector<cl_device_id> devices;
+	std::string source;
+	std::string options;
+	std::string log;
+	cl_build_status status;
+	std::map<std::string, std::string> defines;
+	std::vector<StandInPrototype> kernels;
+
+	_cl_program(cl_context context, const std::vector<cl_device_id>& devices, const std::string& source);
+	~_cl_program();
+};
+
+struct _cl_kernel {
+	boost::atomic<cl_uint> references;
+	cl_program program;
+	std::string name;
+	CLHelper::StandInKernel function;
+	std::vector<CLHelper::StandInArgument> arguments;
+
+	_cl_kernel(cl_program program, const StandInPrototype& prototype, CLHelper::StandInKernel function);
+	~_cl_kernel();
+};
+
+struct _cl_event {
+	boost::atomic<cl_uint> references;
+	cl_context context;
+	cl_command_queue queue;					/* NULL for user events */
+	cl_command_type type;
+	cl_ulong queued;
+	cl_ulong start;
+	cl_ulong end;
+
+	boost::mutex mutex;
+	boost::condition_variable statusChanged;
+	cl_int status;
+	std::vector<EventCallback> callbacks;	/* of user events that have not reached their status yet */
+
+	_cl_event(cl_context context, cl_command_queue queue, cl_command_type type, cl_int status);
+	~_cl_event();
+};
+
+/* A kernel launch, copied so that later clSetKernelArg() calls cannot change it */
+struct StandInLaunch {
+	CLHelper::StandInKernel function;
+	cl_uint dims;
+	size_t globalOffset[3];
+	size_t globalSize[3];
+	size_t localSize[3];
+	std::vector<CLHelper::StandInArgument> arguments;
+	const std::map<std::string, std::string>* defines;
+};
+
+static StandInConfig config;
+static _cl_platform_id platform;
+static pt::ptime clockOrigin;
+static boost::once_flag initialized = BOOST_ONCE_INIT;
+
+static boost::mutex kernelRegistryMutex;
+static std::map<std::string, CLHelper::StandInKernel> kernelRegistry;
+
+static void initialize();
+static void parseConfig(const char* configString);
+static cl_device_id getRootDevice(cl_device_id device);
+static bool matchesType(cl_device_id device, cl_device_type type);
+static void setError(cl_int* errcodeRet, cl_int err);
+static cl_int returnInfo(const void* value, size_t valueSize, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet);
+static cl_int returnString(const std::string& value, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet);
+template <typename T> static cl_int returnValue(const T& value, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet);
+static cl_ulong wallNanoseconds();
+static double launchNanoseconds();
+static double transferNanoseconds(size_t bytes);
+static double deviceNanoseconds(cl_device_id device, size_t bytes);
+static bool isZeroCopy(cl_mem memory);
+static cl_int checkWaitList(cl_command_queue queue, cl_uint numEvents, const cl_event* waitList);
+static cl_int waitForEvents(cl_uint numEvents, const cl_event* waitList, cl_ulong* latestEnd);
+static cl_int enqueueCommand(
+	cl_command_queue queue,
+	cl_command_type type,
+	double modeledNanoseconds,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event,
+	const boost::function<void ()>& work);
+static void copyBytes(void* destination, const void* source, size_t bytes);
+static void fillPattern(char* destination, const void* pattern, size_t patternSize, size_t size);
+static void copyRect(
+	char* destination,
+	const size_t* destinationOrigin,
+	size_t destinationRowPitch,
+	size_t destinationSlicePitch,
+	const char* source,
+	const size_t* sourceOrigin,
+	size_t sourceRowPitch,
+	size_t sourceSlicePitch,
+	const size_t* region);
+static bool parseBuildOptions(const std::string& options, std::map<std::string, std::string>* defines, std::string* log);
+static void findKernels(const std::string& source, std::vector<StandInPrototype>* kernels);
+static bool parseArgument(const std::vector<std::string>& tokens, CLHelper::StandInArgument* argument);
+static CLHelper::StandInKernel findNativeKernel(const std::string& name);
+static cl_int createSubDevices(cl_device_id device, const std::vector<cl_uint>& counts, const cl_device_partition_property* properties, cl_uint numDevices, cl_device_id* outDevices, cl_uint* numDevicesRet);
+static cl_command_queue createQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties, cl_int* errcodeRet);
+static void runKernel(const StandInLaunch& launch);
+static void runGroups(const StandInLaunch& launch, size_t firstGroup, size_t lastGroup);
+static void completeEvent(cl_event event, cl_int status);
+
+/* Native kernels */
+
+void CLHelper::registerStandInKernel(const std::string& name, StandInKernel kernel)
+{
+	boost::mutex::scoped_lock lock(kernelRegistryMutex);
+	kernelRegistry[name] = kernel;
+}
+
+CLHelper::StandInWorkGroup::StandInWorkGroup(
+	cl_uint dims,
+	const size_t* globalOffset,
+	const size_t* globalSize,
+	const size_t* localSize,
+	const std::vector<StandInArgument>& arguments,
+	const std::map<std::string, std::string>& defines)
+	: dims(dims), arguments(arguments), defines(defines), localMemory(arguments.size())
+{
+	for(cl_uint dim = 0; dim < 3; dim++)
+	{
+		this->globalOffset[dim] = (dim < dims) ? globalOffset[dim] : 0;
+		this->globalSize[dim] = (dim < dims) ? globalSize[dim] : 1;
+		this->localSize[dim] = (dim < dims) ? localSize[dim] : 1;
+		groups[dim] = this->globalSize[dim] / this->localSize[dim];
+		group[dim] = 0;
+	}
+
+	for(size_t i = 0; i < arguments.size(); i++)
+	{
+		if(arguments[i].kind == STANDIN_LOCAL)
+			localMemory[i].resize(arguments[i].localBytes);
+	}
+}
+
+void CLHelper::StandInWorkGroup::setGroup(size_t linearGroup)
+{
+	group[0] = linearGroup % groups[0];
+	group[1] = (linearGroup / groups[0]) % groups[1];
+	group[2] = linearGroup / (groups[0] * groups[1]);
+}
+
+bool CLHelper::StandInWorkGroup::isDefined(const std::string& name) const
+{
+	return defines.count(name) > 0;
+}
+
+std::string CLHelper::StandInWorkGroup::getDefine(const std::string& name, const std::string& defaultValue) const
+{
+	std::map<std::string, std::string>::const_iterator define = defines.find(name);
+	return (define != defines.end()) ? define->second : defaultValue;
+}
+
+long CLHelper::StandInWorkGroup::getDefineInt(const std::string& name, long defaultValue) const
+{
+	std::map<std::string, std::string>::const_iterator define = defines.find(name);
+	if(define == defines.end() || define->second.empty())
+		return defaultValue;
+	return strtol(define->second.c_str(), NULL, 0);
+}
+
+/* Objects */
+
+_cl_device_id::~_cl_device_id()
+{
+	if(parent != NULL)
+		clReleaseDevice(parent);
+}
+
+_cl_context::_cl_context(const std::vector<cl_device_id>& devices, const cl_context_properties* properties)
+	: references(1), devices(devices)
+{
+	for(size_t i = 0; i < devices.size(); i++)
+		clRetainDevice(devices[i]);
+
+	if(properties != NULL) {
+		for(; *properties != 0; properties += 2)
+		{
+			this->properties.push_back(properties[0]);
+			this->properties.push_back(properties[1]);
+		}
+		this->properties.push_back(0);
+	}
+}
+
+_cl_context::~_cl_context()
+{
+	for(size_t i = 0; i < devices.size(); i++)
+		clReleaseDevice(devices[i]);
+}
+
+_cl_command_queue::_cl_command_queue(cl_context context, cl_device_id device, cl_command_queue_properties properties)
+	: references(1), context(context), device(device), properties(properties)
+{
+	clRetainContext(context);
+	clRetainDevice(device);
+}
+
+_cl_command_queue::~_cl_command_queue()
+{
+	clReleaseDevice(device);
+	clReleaseContext(context);
+}
+
+_cl_mem::~_cl_mem()
+{
+	for(size_t i = destructorCallbacks.size(); i > 0; i--)
+		destructorCallbacks[i - 1].first(this, destructorCallbacks[i - 1].second);
+
+	if(ownsData)
+		free(data);
+	if(parent != NULL)
+		clReleaseMemObject(parent);
+	clReleaseContext(context);
+}
+
+_cl_program::_cl_program(cl_context context, const std::vector<cl_device_id>& devices, const std::string& source)
+	: references(1), context(context), devices(devices), source(source), status(CL_BUILD_NONE)
+{
+	clRetainContext(context);
+	findKernels(source, &kernels);
+}
+
+_cl_program::~_cl_program()
+{
+	clReleaseContext(context);
+}
+
+_cl_kernel::_cl_kernel(cl_program program, const StandInPrototype& prototype, CLHelper::StandInKernel function)
+	: references(1), program(program), name(prototype.name), function(function), arguments(prototype.arguments)
+{
+	clRetainProgram(program);
+}
+
+_cl_kernel::~_cl_kernel()
+{
+	clReleaseProgram(program);
+}
+
+_cl_event::_cl_event(cl_context context, cl_command_queue queue, cl_command_type type, cl_int status)
+	: references(1), context(context), queue(queue), type(type), queued(0), start(0), end(0), status(status)
+{
+	clRetainContext(context);
+	if(queue != NULL)
+		clRetainCommandQueue(queue);
+}
+
+_cl_event::~_cl_event()
+{
+	if(queue != NULL)
+		clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+}
+
+/* Platform and devices */
+
+CL_API_ENTRY cl_int CL_API_CALL clGetPlatformIDs(cl_uint numEntries, cl_platform_id* platforms, cl_uint* numPlatforms)
+{
+	if((numEntries == 0 && platforms != NULL) || (platforms == NULL && numPlatforms == NULL))
+		return CL_INVALID_VALUE;
+
+	boost::call_once(&initialize, initialized);
+
+	if(platforms != NULL)
+		platforms[0] = &platform;
+	if(numPlatforms != NULL)
+		*numPlatforms = 1;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetPlatformInfo(
+	cl_platform_id platformId,
+	cl_platform_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(platformId != NULL && platformId != &platform)
+		return CL_INVALID_PLATFORM;
+
+	switch(paramName)
+	{
+	case CL_PLATFORM_PROFILE:
+		return returnString("FULL_PROFILE", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PLATFORM_VERSION:
+		return returnString("OpenCL 1.2 CLHelper stand-in", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PLATFORM_NAME:
+		return returnString("CLHelper Stand-in Platform", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PLATFORM_VENDOR:
+		return returnString("CLHelper", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PLATFORM_EXTENSIONS:
+		return returnString("", paramValueSize, paramValue, paramValueSizeRet);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetDeviceIDs(
+	cl_platform_id platformId,
+	cl_device_type deviceType,
+	cl_uint numEntries,
+	cl_device_id* devices,
+	cl_uint* numDevices)
+{
+	boost::call_once(&initialize, initialized);
+
+	if(platformId != NULL && platformId != &platform)
+		return CL_INVALID_PLATFORM;
+	if((numEntries == 0 && devices != NULL) || (devices == NULL && numDevices == NULL))
+		return CL_INVALID_VALUE;
+
+	std::vector<cl_device_id> matching;
+	for(size_t i = 0; i < platform.devices.size(); i++)
+	{
+		if(deviceType == CL_DEVICE_TYPE_DEFAULT ? i == 0 : matchesType(platform.devices[i], deviceType))
+			matching.push_back(platform.devices[i]);
+	}
+
+	if(matching.empty())
+		return CL_DEVICE_NOT_FOUND;
+
+	for(cl_uint i = 0; devices != NULL && i < std::min(numEntries, (cl_uint) matching.size()); i++)
+		devices[i] = matching[i];
+	if(numDevices != NULL)
+		*numDevices = (cl_uint) matching.size();
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetDeviceInfo(
+	cl_device_id device,
+	cl_device_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(device == NULL)
+		return CL_INVALID_DEVICE;
+
+	bool gpu = (config.type & CL_DEVICE_TYPE_GPU) != 0;
+	cl_ulong maxAlloc = std::max(config.memoryBytes / 4, (cl_ulong) 128 * 1024 * 1024);
+	cl_device_fp_config fpConfig = CL_FP_DENORM | CL_FP_INF_NAN | CL_FP_ROUND_TO_NEAREST | CL_FP_ROUND_TO_ZERO | CL_FP_ROUND_TO_INF | CL_FP_FMA;
+	size_t maxWorkItemSizes[3] = { STANDIN_MAX_WORK_GROUP_SIZE, STANDIN_MAX_WORK_GROUP_SIZE, STANDIN_MAX_WORK_GROUP_SIZE };
+
+	switch(paramName)
+	{
+	case CL_DEVICE_TYPE:
+		return returnValue(config.type, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_VENDOR_ID:
+		return returnValue((cl_uint) 0, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_COMPUTE_UNITS:
+		return returnValue(device->computeUnits, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS:
+		return returnValue((cl_uint) 3, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_WORK_ITEM_SIZES:
+		return returnInfo(maxWorkItemSizes, sizeof(maxWorkItemSizes), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_WORK_GROUP_SIZE:
+		return returnValue((size_t) STANDIN_MAX_WORK_GROUP_SIZE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR:
+		return returnValue((cl_uint) 16, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT:
+		return returnValue((cl_uint) 8, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT:
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT:
+		return returnValue((cl_uint) 4, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG:
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE:
+		return returnValue((cl_uint) 2, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_CLOCK_FREQUENCY:
+		return returnValue((cl_uint) 1000, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_ADDRESS_BITS:
+		return returnValue((cl_uint) (sizeof(void*) * 8), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_READ_IMAGE_ARGS:
+	case CL_DEVICE_MAX_WRITE_IMAGE_ARGS:
+	case CL_DEVICE_MAX_SAMPLERS:
+		return returnValue((cl_uint) 0, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_MEM_ALLOC_SIZE:
+		return returnValue(maxAlloc, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_IMAGE2D_MAX_WIDTH:
+	case CL_DEVICE_IMAGE2D_MAX_HEIGHT:
+	case CL_DEVICE_IMAGE3D_MAX_WIDTH:
+	case CL_DEVICE_IMAGE3D_MAX_HEIGHT:
+	case CL_DEVICE_IMAGE3D_MAX_DEPTH:
+		return returnValue((size_t) 0, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_IMAGE_SUPPORT:
+	case CL_DEVICE_ERROR_CORRECTION_SUPPORT:
+		return returnValue((cl_bool) CL_FALSE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_PARAMETER_SIZE:
+		return returnValue((size_t) 1024, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MEM_BASE_ADDR_ALIGN:
+		return returnValue((cl_uint) (STANDIN_MEMORY_ALIGNMENT * 8), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MIN_DATA_TYPE_ALIGN_SIZE:
+		return returnValue((cl_uint) 128, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_SINGLE_FP_CONFIG:
+	case CL_DEVICE_DOUBLE_FP_CONFIG:
+		return returnValue(fpConfig, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_GLOBAL_MEM_CACHE_TYPE:
+		return returnValue((cl_device_mem_cache_type) CL_READ_WRITE_CACHE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE:
+		return returnValue((cl_uint) 64, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_GLOBAL_MEM_CACHE_SIZE:
+		return returnValue((cl_ulong) 1024 * 1024, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_GLOBAL_MEM_SIZE:
+		return returnValue(config.memoryBytes, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE:
+		return returnValue((cl_ulong) 64 * 1024, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_MAX_CONSTANT_ARGS:
+		return returnValue((cl_uint) 8, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_LOCAL_MEM_TYPE:
+		return returnValue((cl_device_local_mem_type) (gpu ? CL_LOCAL : CL_GLOBAL), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_LOCAL_MEM_SIZE:
+		return returnValue((cl_ulong) 32 * 1024, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PROFILING_TIMER_RESOLUTION:
+		return returnValue((size_t) (config.simulate ? 1 : 1000), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_ENDIAN_LITTLE:
+	case CL_DEVICE_AVAILABLE:
+	case CL_DEVICE_COMPILER_AVAILABLE:
+		return returnValue((cl_bool) CL_TRUE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_EXECUTION_CAPABILITIES:
+		return returnValue((cl_device_exec_capabilities) CL_EXEC_KERNEL, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_QUEUE_PROPERTIES:
+		return returnValue((cl_command_queue_properties) (CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE),
+			paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PLATFORM:
+		return returnValue(device->platform, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_NAME:
+		return returnString(gpu ? "Stand-in GPU" : "Stand-in Device", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_VENDOR:
+		return returnString("CLHelper", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DRIVER_VERSION:
+		return returnString("1.0", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PROFILE:
+		return returnString("FULL_PROFILE", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_VERSION:
+		return returnString("OpenCL 1.2 CLHelper stand-in", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_EXTENSIONS:
+		return returnString("cl_khr_fp64 cl_khr_global_int32_base_atomics cl_khr_global_int32_extended_atomics cl_khr_byte_addressable_store",
+			paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_1
+	case CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF:
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_SHORT:
+		return returnValue((cl_uint) 8, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_CHAR:
+		return returnValue((cl_uint) 16, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_INT:
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT:
+		return returnValue((cl_uint) 4, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_LONG:
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE:
+		return returnValue((cl_uint) 2, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_NATIVE_VECTOR_WIDTH_HALF:
+		return returnValue((cl_uint) 0, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_HOST_UNIFIED_MEMORY:
+		return returnValue((cl_bool) (gpu ? CL_FALSE : CL_TRUE), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_OPENCL_C_VERSION:
+		return returnString("OpenCL C 1.2", paramValueSize, paramValue, paramValueSizeRet);
+#endif
+#ifdef CL_VERSION_1_2
+	case CL_DEVICE_LINKER_AVAILABLE:
+	case CL_DEVICE_PREFERRED_INTEROP_USER_SYNC:
+		return returnValue((cl_bool) CL_TRUE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_BUILT_IN_KERNELS:
+		return returnString("", paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_IMAGE_MAX_BUFFER_SIZE:
+	case CL_DEVICE_IMAGE_MAX_ARRAY_SIZE:
+		return returnValue((size_t) 0, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PRINTF_BUFFER_SIZE:
+		return returnValue((size_t) 1024 * 1024, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PARENT_DEVICE:
+		return returnValue(device->parent, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PARTITION_MAX_SUB_DEVICES:
+		return returnValue(device->computeUnits, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PARTITION_PROPERTIES: {
+		cl_device_partition_property properties[] = {
+			CL_DEVICE_PARTITION_EQUALLY, CL_DEVICE_PARTITION_BY_COUNTS, CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN };
+		return returnInfo(properties, sizeof(properties), paramValueSize, paramValue, paramValueSizeRet);
+	}
+	case CL_DEVICE_PARTITION_AFFINITY_DOMAIN:
+		return returnValue((cl_device_affinity_domain) (CL_DEVICE_AFFINITY_DOMAIN_NUMA | CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE),
+			paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_PARTITION_TYPE:
+		if(device->partitionType.empty())
+			return returnValue((cl_device_partition_property) 0, paramValueSize, paramValue, paramValueSizeRet);
+		return returnInfo(&device->partitionType[0], device->partitionType.size() * sizeof(cl_device_partition_property),
+			paramValueSize, paramValue, paramValueSizeRet);
+	case CL_DEVICE_REFERENCE_COUNT:
+		return returnValue((cl_uint) device->references, paramValueSize, paramValue, paramValueSizeRet);
+#endif
+#ifdef CL_VERSION_2_0
+	case CL_DEVICE_SVM_CAPABILITIES:
+		return returnValue((cl_device_svm_capabilities) 0, paramValueSize, paramValue, paramValueSizeRet);
+#endif
+#ifdef CL_VERSION_2_1
+	case CL_DEVICE_IL_VERSION:
+		return returnString("", paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clCreateSubDevices(
+	cl_device_id device,
+	const cl_device_partition_property* properties,
+	cl_uint numDevices,
+	cl_device_id* outDevices,
+	cl_uint* numDevicesRet)
+{
+	if(device == NULL)
+		return CL_INVALID_DEVICE;
+	if(properties == NULL)
+		return CL_INVALID_VALUE;
+
+	std::vector<cl_uint> counts;
+	switch(properties[0])
+	{
+	case CL_DEVICE_PARTITION_EQUALLY:
+		if(properties[1] <= 0)
+			return CL_INVALID_VALUE;
+		counts.resize(device->computeUnits / (cl_uint) properties[1], (cl_uint) properties[1]);
+		break;
+	case CL_DEVICE_PARTITION_BY_COUNTS: {
+		cl_uint total = 0;
+		for(const cl_device_partition_property* count = properties + 1; *count != CL_DEVICE_PARTITION_BY_COUNTS_LIST_END; count++)
+		{
+			if(*count <= 0)
+				return CL_INVALID_DEVICE_PARTITION_COUNT;
+			counts.push_back((cl_uint) *count);
+			total += (cl_uint) *count;
+		}
+		if(total > device->computeUnits)
+			return CL_INVALID_DEVICE_PARTITION_COUNT;
+		break;
+	}
+	case CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN: {
+		cl_uint nodes = std::max(std::min(config.numaNodes, device->computeUnits), 1u);
+		for(cl_uint node = 0; node < nodes; node++)
+			counts.push_back(device->computeUnits / nodes + (node < device->computeUnits % nodes ? 1 : 0));
+		break;
+	}
+	default:
+		return CL_INVALID_VALUE;
+	}
+
+	return createSubDevices(device, counts, properties, numDevices, outDevices, numDevicesRet);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainDevice(cl_device_id device)
+{
+	if(device == NULL)
+		return CL_INVALID_DEVICE;
+	if(device->parent != NULL)
+		device->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseDevice(cl_device_id device)
+{
+	if(device == NULL)
+		return CL_INVALID_DEVICE;
+	if(device->parent != NULL && --device->references == 0)
+		delete device;
+	return CL_SUCCESS;
+}
+#endif
+
+/* Contexts and queues */
+
+CL_API_ENTRY cl_context CL_API_CALL clCreateContext(
+	const cl_context_properties* properties,
+	cl_uint numDevices,
+	const cl_device_id* devices,
+	void (CL_CALLBACK* notify)(const char*, const void*, size_t, void*),
+	void* userData,
+	cl_int* errcodeRet)
+{
+	boost::call_once(&initialize, initialized);
+
+	if(numDevices == 0 || devices == NULL || (notify == NULL && userData != NULL)) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+	for(cl_uint i = 0; i < numDevices; i++)
+	{
+		if(devices[i] == NULL) {
+			setError(errcodeRet, CL_INVALID_DEVICE);
+			return NULL;
+		}
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return new _cl_context(std::vector<cl_device_id>(devices, devices + numDevices), properties);
+}
+
+CL_API_ENTRY cl_context CL_API_CALL clCreateContextFromType(
+	const cl_context_properties* properties,
+	cl_device_type deviceType,
+	void (CL_CALLBACK* notify)(const char*, const void*, size_t, void*),
+	void* userData,
+	cl_int* errcodeRet)
+{
+	cl_uint numDevices = 0;
+	cl_int err = clGetDeviceIDs(NULL, deviceType, 0, NULL, &numDevices);
+	if(err != CL_SUCCESS) {
+		setError(errcodeRet, err);
+		return NULL;
+	}
+
+	std::vector<cl_device_id> devices(numDevices);
+	clGetDeviceIDs(NULL, deviceType, numDevices, &devices[0], NULL);
+	return clCreateContext(properties, numDevices, &devices[0], notify, userData, errcodeRet);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainContext(cl_context context)
+{
+	if(context == NULL)
+		return CL_INVALID_CONTEXT;
+	context->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseContext(cl_context context)
+{
+	if(context == NULL)
+		return CL_INVALID_CONTEXT;
+	if(--context->references == 0)
+		delete context;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetContextInfo(
+	cl_context context,
+	cl_context_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(context == NULL)
+		return CL_INVALID_CONTEXT;
+
+	switch(paramName)
+	{
+	case CL_CONTEXT_REFERENCE_COUNT:
+		return returnValue((cl_uint) context->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_CONTEXT_DEVICES:
+		return returnInfo(&context->devices[0], context->devices.size() * sizeof(cl_device_id), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_CONTEXT_PROPERTIES:
+		return returnInfo(context->properties.empty() ? NULL : &context->properties[0], context->properties.size() * sizeof(cl_context_properties),
+			paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_1
+	case CL_CONTEXT_NUM_DEVICES:
+		return returnValue((cl_uint) context->devices.size(), paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+CL_API_ENTRY cl_command_queue CL_API_CALL clCreateCommandQueue(
+	cl_context context,
+	cl_device_id device,
+	cl_command_queue_properties properties,
+	cl_int* errcodeRet)
+{
+	return createQueue(context, device, properties, errcodeRet);
+}
+
+#ifdef CL_VERSION_2_0
+CL_API_ENTRY cl_command_queue CL_API_CALL clCreateCommandQueueWithProperties(
+	cl_context context,
+	cl_device_id device,
+	const cl_queue_properties* properties,
+	cl_int* errcodeRet)
+{
+	cl_command_queue_properties queueProperties = 0;
+	for(; properties != NULL && *properties != 0; properties += 2)
+	{
+		if(properties[0] == CL_QUEUE_PROPERTIES)
+			queueProperties = (cl_command_queue_properties) properties[1];
+	}
+
+	return createQueue(context, device, queueProperties, errcodeRet);
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainCommandQueue(cl_command_queue queue)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	queue->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseCommandQueue(cl_command_queue queue)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(--queue->references == 0)
+		delete queue;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetCommandQueueInfo(
+	cl_command_queue queue,
+	cl_command_queue_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+
+	switch(paramName)
+	{
+	case CL_QUEUE_CONTEXT:
+		return returnValue(queue->context, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_QUEUE_DEVICE:
+		return returnValue(queue->device, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_QUEUE_REFERENCE_COUNT:
+		return returnValue((cl_uint) queue->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_QUEUE_PROPERTIES:
+		return returnValue(queue->properties, paramValueSize, paramValue, paramValueSizeRet);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+/* Every command runs to completion when it is enqueued */
+CL_API_ENTRY cl_int CL_API_CALL clFlush(cl_command_queue queue)
+{
+	return (queue == NULL) ? CL_INVALID_COMMAND_QUEUE : CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clFinish(cl_command_queue queue)
+{
+	return (queue == NULL) ? CL_INVALID_COMMAND_QUEUE : CL_SUCCESS;
+}
+
+/* Memory objects */
+
+CL_API_ENTRY cl_mem CL_API_CALL clCreateBuffer(
+	cl_context context,
+	cl_mem_flags flags,
+	size_t size,
+	void* hostPtr,
+	cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+
+	cl_ulong maxAlloc = 0;
+	clGetDeviceInfo(context->devices[0], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, NULL);
+	if(size == 0 || size > maxAlloc) {
+		setError(errcodeRet, CL_INVALID_BUFFER_SIZE);
+		return NULL;
+	}
+
+	bool needsHostPtr = (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0;
+	if(needsHostPtr != (hostPtr != NULL) || ((flags & CL_MEM_USE_HOST_PTR) && (flags & (CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR)))) {
+		setError(errcodeRet, (hostPtr == NULL && needsHostPtr) || !needsHostPtr ? CL_INVALID_HOST_PTR : CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	cl_mem memory = new _cl_mem(context, flags, size);
+	clRetainContext(context);
+
+	if(flags & CL_MEM_USE_HOST_PTR) {
+		memory->data = (char*) hostPtr;
+		memory->hostPtr = hostPtr;
+	}
+	else {
+		void* data = NULL;
+		if(posix_memalign(&data, STANDIN_MEMORY_ALIGNMENT, size) != 0) {
+			delete memory;
+			setError(errcodeRet, CL_MEM_OBJECT_ALLOCATION_FAILURE);
+			return NULL;
+		}
+		memory->data = (char*) data;
+		memory->ownsData = true;
+
+		if(flags & CL_MEM_COPY_HOST_PTR)
+			copyBytes(memory->data, hostPtr, size);
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return memory;
+}
+
+#ifdef CL_VERSION_1_1
+CL_API_ENTRY cl_mem CL_API_CALL clCreateSubBuffer(
+	cl_mem buffer,
+	cl_mem_flags flags,
+	cl_buffer_create_type createType,
+	const void* createInfo,
+	cl_int* errcodeRet)
+{
+	if(buffer == NULL || buffer->parent != NULL) {
+		setError(errcodeRet, CL_INVALID_MEM_OBJECT);
+		return NULL;
+	}
+	if(createType != CL_BUFFER_CREATE_TYPE_REGION || createInfo == NULL) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	const cl_buffer_region* region = (const cl_buffer_region*) createInfo;
+	if(region->size == 0) {
+		setError(errcodeRet, CL_INVALID_BUFFER_SIZE);
+		return NULL;
+	}
+	if(region->origin + region->size > buffer->size) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+	if(region->origin % STANDIN_MEMORY_ALIGNMENT != 0) {
+		setError(errcodeRet, CL_MISALIGNED_SUB_BUFFER_OFFSET);
+		return NULL;
+	}
+
+	// Access flags are the only ones a sub-buffer may set, the rest is inherited
+	cl_mem_flags accessFlags = CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY;
+	cl_mem memory = new _cl_mem(buffer->context, (flags & accessFlags) ? (buffer->flags & ~accessFlags) | flags : buffer->flags, region->size);
+	clRetainContext(buffer->context);
+	clRetainMemObject(buffer);
+	memory->parent = buffer;
+	memory->origin = region->origin;
+	memory->data = buffer->data + region->origin;
+	memory->hostPtr = buffer->hostPtr ? (char*) buffer->hostPtr + region->origin : NULL;
+
+	setError(errcodeRet, CL_SUCCESS);
+	return memory;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clSetMemObjectDestructorCallback(
+	cl_mem memory,
+	void (CL_CALLBACK* notify)(cl_mem, void*),
+	void* userData)
+{
+	if(memory == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(notify == NULL)
+		return CL_INVALID_VALUE;
+
+	memory->destructorCallbacks.push_back(std::make_pair(notify, userData));
+	return CL_SUCCESS;
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainMemObject(cl_mem memory)
+{
+	if(memory == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	memory->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseMemObject(cl_mem memory)
+{
+	if(memory == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(--memory->references == 0)
+		delete memory;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetMemObjectInfo(
+	cl_mem memory,
+	cl_mem_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(memory == NULL)
+		return CL_INVALID_MEM_OBJECT;
+
+	switch(paramName)
+	{
+	case CL_MEM_TYPE:
+		return returnValue((cl_mem_object_type) CL_MEM_OBJECT_BUFFER, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_FLAGS:
+		return returnValue(memory->flags, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_SIZE:
+		return returnValue(memory->size, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_HOST_PTR:
+		return returnValue(memory->hostPtr, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_MAP_COUNT:
+		return returnValue((cl_uint) memory->mapCount, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_REFERENCE_COUNT:
+		return returnValue((cl_uint) memory->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_CONTEXT:
+		return returnValue(memory->context, paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_1
+	case CL_MEM_ASSOCIATED_MEMOBJECT:
+		return returnValue(memory->parent, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_MEM_OFFSET:
+		return returnValue(memory->origin, paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+/* Images are not supported by the stand-in devices, DeviceImage falls back to buffers */
+CL_API_ENTRY cl_int CL_API_CALL clGetSupportedImageFormats(
+	cl_context context,
+	cl_mem_flags flags,
+	cl_mem_object_type imageType,
+	cl_uint numEntries,
+	cl_image_format* imageFormats,
+	cl_uint* numImageFormats)
+{
+	if(context == NULL)
+		return CL_INVALID_CONTEXT;
+	if(numImageFormats != NULL)
+		*numImageFormats = 0;
+	return CL_SUCCESS;
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_mem CL_API_CALL clCreateImage(
+	cl_context context,
+	cl_mem_flags flags,
+	const cl_image_format* imageFormat,
+	const cl_image_desc* imageDesc,
+	void* hostPtr,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_OPERATION);
+	return NULL;
+}
+#endif
+
+CL_API_ENTRY cl_mem CL_API_CALL clCreateImage2D(
+	cl_context context,
+	cl_mem_flags flags,
+	const cl_image_format* imageFormat,
+	size_t imageWidth,
+	size_t imageHeight,
+	size_t imageRowPitch,
+	void* hostPtr,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_OPERATION);
+	return NULL;
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL clCreateImage3D(
+	cl_context context,
+	cl_mem_flags flags,
+	const cl_image_format* imageFormat,
+	size_t imageWidth,
+	size_t imageHeight,
+	size_t imageDepth,
+	size_t imageRowPitch,
+	size_t imageSlicePitch,
+	void* hostPtr,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_OPERATION);
+	return NULL;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetImageInfo(
+	cl_mem image,
+	cl_image_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+CL_API_ENTRY cl_sampler CL_API_CALL clCreateSampler(
+	cl_context context,
+	cl_bool normalizedCoords,
+	cl_addressing_mode addressingMode,
+	cl_filter_mode filterMode,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_OPERATION);
+	return NULL;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainSampler(cl_sampler sampler)
+{
+	return CL_INVALID_SAMPLER;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseSampler(cl_sampler sampler)
+{
+	return CL_INVALID_SAMPLER;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetSamplerInfo(
+	cl_sampler sampler,
+	cl_sampler_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	return CL_INVALID_SAMPLER;
+}
+
+/* Programs and kernels */
+
+CL_API_ENTRY cl_program CL_API_CALL clCreateProgramWithSource(
+	cl_context context,
+	cl_uint count,
+	const char** strings,
+	const size_t* lengths,
+	cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+	if(count == 0 || strings == NULL) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	std::string source;
+	for(cl_uint i = 0; i < count; i++)
+	{
+		if(strings[i] == NULL) {
+			setError(errcodeRet, CL_INVALID_VALUE);
+			return NULL;
+		}
+		source.append(strings[i], (lengths != NULL && lengths[i] > 0) ? lengths[i] : strlen(strings[i]));
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return new _cl_program(context, context->devices, source);
+}
+
+/* The stand-in's binaries are the program source */
+CL_API_ENTRY cl_program CL_API_CALL clCreateProgramWithBinary(
+	cl_context context,
+	cl_uint numDevices,
+	const cl_device_id* devices,
+	const size_t* lengths,
+	const unsigned char** binaries,
+	cl_int* binaryStatus,
+	cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+	if(numDevices == 0 || devices == NULL || lengths == NULL || binaries == NULL) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	for(cl_uint i = 0; i < numDevices; i++)
+	{
+		if(lengths[i] == 0 || binaries[i] == NULL) {
+			if(binaryStatus != NULL)
+				binaryStatus[i] = CL_INVALID_VALUE;
+			setError(errcodeRet, CL_INVALID_VALUE);
+			return NULL;
+		}
+		if(binaryStatus != NULL)
+			binaryStatus[i] = CL_SUCCESS;
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return new _cl_program(context, std::vector<cl_device_id>(devices, devices + numDevices), std::string((const char*) binaries[0], lengths[0]));
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_program CL_API_CALL clCreateProgramWithBuiltInKernels(
+	cl_context context,
+	cl_uint numDevices,
+	const cl_device_id* devices,
+	const char* kernelNames,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_VALUE);
+	return NULL;
+}
+#endif
+
+#ifdef CL_VERSION_2_1
+CL_API_ENTRY cl_program CL_API_CALL clCreateProgramWithIL(
+	cl_context context,
+	const void* il,
+	size_t length,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_OPERATION);
+	return NULL;
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainProgram(cl_program program)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+	program->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseProgram(cl_program program)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+	if(--program->references == 0)
+		delete program;
+	return CL_SUCCESS;
+}
+
+/*
+ * Nothing is compiled: building records the -D options for the native
+ * kernels and lists the program's kernels without a native equivalent
+ */
+CL_API_ENTRY cl_int CL_API_CALL clBuildProgram(
+	cl_program program,
+	cl_uint numDevices,
+	const cl_device_id* deviceList,
+	const char* options,
+	void (CL_CALLBACK* notify)(cl_program, void*),
+	void* userData)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+	if((numDevices == 0) != (deviceList == NULL) || (notify == NULL && userData != NULL))
+		return CL_INVALID_VALUE;
+
+	program->options = (options != NULL) ? options : "";
+	program->defines.clear();
+	program->log.clear();
+
+	bool built = parseBuildOptions(program->options, &program->defines, &program->log);
+	if(built) {
+		std::ostringstream log;
+		for(size_t i = 0; i < program->kernels.size(); i++)
+		{
+			if(findNativeKernel(program->kernels[i].name) == NULL)
+				log << "warning: kernel '" << program->kernels[i].name << "' has no native equivalent on the stand-in platform" << std::endl;
+		}
+		program->log += log.str();
+	}
+	program->status = built ? CL_BUILD_SUCCESS : CL_BUILD_ERROR;
+
+	if(notify != NULL)
+		notify(program, userData);
+	return built ? CL_SUCCESS : CL_BUILD_PROGRAM_FAILURE;
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clCompileProgram(
+	cl_program program,
+	cl_uint numDevices,
+	const cl_device_id* deviceList,
+	const char* options,
+	cl_uint numInputHeaders,
+	const cl_program* inputHeaders,
+	const char** headerIncludeNames,
+	void (CL_CALLBACK* notify)(cl_program, void*),
+	void* userData)
+{
+	cl_int err = clBuildProgram(program, numDevices, deviceList, options, notify, userData);
+	return (err == CL_BUILD_PROGRAM_FAILURE) ? CL_COMPILE_PROGRAM_FAILURE : err;
+}
+
+/* Links by concatenating the sources of the compiled programs */
+CL_API_ENTRY cl_program CL_API_CALL clLinkProgram(
+	cl_context context,
+	cl_uint numDevices,
+	const cl_device_id* deviceList,
+	const char* options,
+	cl_uint numInputPrograms,
+	const cl_program* inputPrograms,
+	void (CL_CALLBACK* notify)(cl_program, void*),
+	void* userData,
+	cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+	if(numInputPrograms == 0 || inputPrograms == NULL) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	std::string source;
+	std::string compileOptions;
+	for(cl_uint i = 0; i < numInputPrograms; i++)
+	{
+		source += inputPrograms[i]->source + "\n";
+		compileOptions += " " + inputPrograms[i]->options;
+	}
+
+	cl_program program = new _cl_program(context, context->devices, source);
+	cl_int err = clBuildProgram(program, 0, NULL, (compileOptions + " " + (options != NULL ? options : "")).c_str(), notify, userData);
+	setError(errcodeRet, (err == CL_BUILD_PROGRAM_FAILURE) ? CL_LINK_PROGRAM_FAILURE : err);
+	return program;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clUnloadPlatformCompiler(cl_platform_id platformId)
+{
+	return CL_SUCCESS;
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clUnloadCompiler(void)
+{
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetProgramInfo(
+	cl_program program,
+	cl_program_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+
+	switch(paramName)
+	{
+	case CL_PROGRAM_REFERENCE_COUNT:
+		return returnValue((cl_uint) program->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_CONTEXT:
+		return returnValue(program->context, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_NUM_DEVICES:
+		return returnValue((cl_uint) program->devices.size(), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_DEVICES:
+		return returnInfo(&program->devices[0], program->devices.size() * sizeof(cl_device_id), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_SOURCE:
+		return returnString(program->source, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_BINARY_SIZES: {
+		std::vector<size_t> sizes(program->devices.size(), (program->status == CL_BUILD_SUCCESS) ? program->source.size() : 0);
+		return returnInfo(&sizes[0], sizes.size() * sizeof(size_t), paramValueSize, paramValue, paramValueSizeRet);
+	}
+	case CL_PROGRAM_BINARIES: {
+		if(paramValue != NULL) {
+			if(paramValueSize < program->devices.size() * sizeof(unsigned char*))
+				return CL_INVALID_VALUE;
+			unsigned char** binaries = (unsigned char**) paramValue;
+			for(size_t i = 0; i < program->devices.size(); i++)
+			{
+				if(binaries[i] != NULL && program->status == CL_BUILD_SUCCESS)
+					copyBytes(binaries[i], program->source.data(), program->source.size());
+			}
+		}
+		if(paramValueSizeRet != NULL)
+			*paramValueSizeRet = program->devices.size() * sizeof(unsigned char*);
+		return CL_SUCCESS;
+	}
+#ifdef CL_VERSION_1_2
+	case CL_PROGRAM_NUM_KERNELS:
+	case CL_PROGRAM_KERNEL_NAMES: {
+		if(program->status != CL_BUILD_SUCCESS)
+			return CL_INVALID_PROGRAM_EXECUTABLE;
+		if(paramName == CL_PROGRAM_NUM_KERNELS)
+			return returnValue(program->kernels.size(), paramValueSize, paramValue, paramValueSizeRet);
+
+		std::string names;
+		for(size_t i = 0; i < program->kernels.size(); i++)
+			names += (i > 0 ? ";" : "") + program->kernels[i].name;
+		return returnString(names, paramValueSize, paramValue, paramValueSizeRet);
+	}
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetProgramBuildInfo(
+	cl_program program,
+	cl_device_id device,
+	cl_program_build_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+	if(device == NULL)
+		return CL_INVALID_DEVICE;
+
+	switch(paramName)
+	{
+	case CL_PROGRAM_BUILD_STATUS:
+		return returnValue(program->status, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_BUILD_OPTIONS:
+		return returnString(program->options, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROGRAM_BUILD_LOG:
+		return returnString(program->log, paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_2
+	case CL_PROGRAM_BINARY_TYPE:
+		return returnValue((cl_program_binary_type) (program->status == CL_BUILD_SUCCESS ? CL_PROGRAM_BINARY_TYPE_EXECUTABLE : CL_PROGRAM_BINARY_TYPE_NONE),
+			paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+CL_API_ENTRY cl_kernel CL_API_CALL clCreateKernel(cl_program program, const char* kernelName, cl_int* errcodeRet)
+{
+	if(program == NULL) {
+		setError(errcodeRet, CL_INVALID_PROGRAM);
+		return NULL;
+	}
+	if(program->status != CL_BUILD_SUCCESS) {
+		setError(errcodeRet, CL_INVALID_PROGRAM_EXECUTABLE);
+		return NULL;
+	}
+	if(kernelName == NULL) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	for(size_t i = 0; i < program->kernels.size(); i++)
+	{
+		if(program->kernels[i].name != kernelName)
+			continue;
+
+		CLHelper::StandInKernel function = findNativeKernel(kernelName);
+		if(function == NULL)
+			break;
+
+		setError(errcodeRet, CL_SUCCESS);
+		return new _cl_kernel(program, program->kernels[i], function);
+	}
+
+	setError(errcodeRet, CL_INVALID_KERNEL_NAME);
+	return NULL;
+}
+
+/* Creates the kernels that have a native equivalent */
+CL_API_ENTRY cl_int CL_API_CALL clCreateKernelsInProgram(cl_program program, cl_uint numKernels, cl_kernel* kernels, cl_uint* numKernelsRet)
+{
+	if(program == NULL)
+		return CL_INVALID_PROGRAM;
+	if(program->status != CL_BUILD_SUCCESS)
+		return CL_INVALID_PROGRAM_EXECUTABLE;
+
+	std::vector<size_t> runnable;
+	for(size_t i = 0; i < program->kernels.size(); i++)
+	{
+		if(findNativeKernel(program->kernels[i].name) != NULL)
+			runnable.push_back(i);
+	}
+
+	if(kernels != NULL) {
+		if(numKernels < runnable.size())
+			return CL_INVALID_VALUE;
+		for(size_t i = 0; i < runnable.size(); i++)
+		{
+			const StandInPrototype& prototype = program->kernels[runnable[i]];
+			kernels[i] = new _cl_kernel(program, prototype, findNativeKernel(prototype.name));
+		}
+	}
+	if(numKernelsRet != NULL)
+		*numKernelsRet = (cl_uint) runnable.size();
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainKernel(cl_kernel kernel)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+	kernel->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseKernel(cl_kernel kernel)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+	if(--kernel->references == 0)
+		delete kernel;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clSetKernelArg(cl_kernel kernel, cl_uint argIndex, size_t argSize, const void* argValue)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+	if(argIndex >= kernel->arguments.size())
+		return CL_INVALID_ARG_INDEX;
+
+	CLHelper::StandInArgument& argument = kernel->arguments[argIndex];
+	switch(argument.kind)
+	{
+	case CLHelper::STANDIN_LOCAL:
+		if(argValue != NULL)
+			return CL_INVALID_ARG_VALUE;
+		if(argSize == 0)
+			return CL_INVALID_ARG_SIZE;
+		argument.localBytes = argSize;
+		break;
+	case CLHelper::STANDIN_GLOBAL:
+		if(argSize != sizeof(cl_mem))
+			return CL_INVALID_ARG_SIZE;
+		argument.memory = (argValue != NULL) ? *(const cl_mem*) argValue : NULL;
+		argument.data = NULL;
+		break;
+	default:
+		if(argValue == NULL)
+			return CL_INVALID_ARG_VALUE;
+		if(argSize == 0)
+			return CL_INVALID_ARG_SIZE;
+		argument.value.assign((const char*) argValue, (const char*) argValue + argSize);
+		break;
+	}
+
+	argument.set = true;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetKernelInfo(
+	cl_kernel kernel,
+	cl_kernel_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+
+	switch(paramName)
+	{
+	case CL_KERNEL_FUNCTION_NAME:
+		return returnString(kernel->name, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_NUM_ARGS:
+		return returnValue((cl_uint) kernel->arguments.size(), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_REFERENCE_COUNT:
+		return returnValue((cl_uint) kernel->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_CONTEXT:
+		return returnValue(kernel->program->context, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_PROGRAM:
+		return returnValue(kernel->program, paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_2
+	case CL_KERNEL_ATTRIBUTES:
+		return returnString("", paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+#ifdef CL_VERSION_1_2
+/* Always available, read from the kernel's prototype */
+CL_API_ENTRY cl_int CL_API_CALL clGetKernelArgInfo(
+	cl_kernel kernel,
+	cl_uint argIndex,
+	cl_kernel_arg_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+	if(argIndex >= kernel->arguments.size())
+		return CL_INVALID_ARG_INDEX;
+
+	const CLHelper::StandInArgument& argument = kernel->arguments[argIndex];
+	cl_kernel_arg_address_qualifier addressQualifier = CL_KERNEL_ARG_ADDRESS_PRIVATE;
+	if(argument.kind == CLHelper::STANDIN_GLOBAL)
+		addressQualifier = CL_KERNEL_ARG_ADDRESS_GLOBAL;
+	else if(argument.kind == CLHelper::STANDIN_LOCAL)
+		addressQualifier = CL_KERNEL_ARG_ADDRESS_LOCAL;
+
+	switch(paramName)
+	{
+	case CL_KERNEL_ARG_ADDRESS_QUALIFIER:
+		return returnValue(addressQualifier, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_ARG_ACCESS_QUALIFIER:
+		return returnValue((cl_kernel_arg_access_qualifier) CL_KERNEL_ARG_ACCESS_NONE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_ARG_TYPE_NAME:
+		return returnString(argument.typeName, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_ARG_TYPE_QUALIFIER:
+		return returnValue((cl_kernel_arg_type_qualifier) CL_KERNEL_ARG_TYPE_NONE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_ARG_NAME:
+		return returnString(argument.name, paramValueSize, paramValue, paramValueSizeRet);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clGetKernelWorkGroupInfo(
+	cl_kernel kernel,
+	cl_device_id device,
+	cl_kernel_work_group_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+
+	size_t compileWorkGroupSize[3] = { 0, 0, 0 };
+	cl_ulong localBytes = 0;
+	for(size_t i = 0; i < kernel->arguments.size(); i++)
+		localBytes += kernel->arguments[i].localBytes;
+
+	switch(paramName)
+	{
+	case CL_KERNEL_WORK_GROUP_SIZE:
+		return returnValue((size_t) STANDIN_MAX_WORK_GROUP_SIZE, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_COMPILE_WORK_GROUP_SIZE:
+		return returnInfo(compileWorkGroupSize, sizeof(compileWorkGroupSize), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_LOCAL_MEM_SIZE:
+		return returnValue(localBytes, paramValueSize, paramValue, paramValueSizeRet);
+#ifdef CL_VERSION_1_1
+	case CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE:
+		return returnValue((size_t) ((config.type & CL_DEVICE_TYPE_GPU) ? 32 : 1), paramValueSize, paramValue, paramValueSizeRet);
+	case CL_KERNEL_PRIVATE_MEM_SIZE:
+		return returnValue((cl_ulong) 0, paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+/* Events */
+
+CL_API_ENTRY cl_int CL_API_CALL clWaitForEvents(cl_uint numEvents, const cl_event* eventList)
+{
+	if(numEvents == 0 || eventList == NULL)
+		return CL_INVALID_VALUE;
+	return waitForEvents(numEvents, eventList, NULL);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetEventInfo(
+	cl_event event,
+	cl_event_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(event == NULL)
+		return CL_INVALID_EVENT;
+
+	switch(paramName)
+	{
+	case CL_EVENT_COMMAND_QUEUE:
+		return returnValue(event->queue, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_EVENT_COMMAND_TYPE:
+		return returnValue(event->type, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_EVENT_REFERENCE_COUNT:
+		return returnValue((cl_uint) event->references, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_EVENT_COMMAND_EXECUTION_STATUS: {
+		boost::mutex::scoped_lock lock(event->mutex);
+		return returnValue(event->status, paramValueSize, paramValue, paramValueSizeRet);
+	}
+#ifdef CL_VERSION_1_1
+	case CL_EVENT_CONTEXT:
+		return returnValue(event->context, paramValueSize, paramValue, paramValueSizeRet);
+#endif
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+#ifdef CL_VERSION_1_1
+CL_API_ENTRY cl_event CL_API_CALL clCreateUserEvent(cl_context context, cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return new _cl_event(context, NULL, CL_COMMAND_USER, CL_SUBMITTED);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clSetUserEventStatus(cl_event event, cl_int executionStatus)
+{
+	if(event == NULL || event->queue != NULL)
+		return CL_INVALID_EVENT;
+	if(executionStatus > CL_COMPLETE)
+		return CL_INVALID_VALUE;
+
+	{
+		boost::mutex::scoped_lock lock(event->mutex);
+		if(event->status <= CL_COMPLETE)
+			return CL_INVALID_OPERATION;
+	}
+
+	event->end = config.simulate ? 0 : wallNanoseconds();
+	completeEvent(event, executionStatus);
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clSetEventCallback(
+	cl_event event,
+	cl_int commandExecCallbackType,
+	void (CL_CALLBACK* notify)(cl_event, cl_int, void*),
+	void* userData)
+{
+	if(event == NULL)
+		return CL_INVALID_EVENT;
+	if(notify == NULL || commandExecCallbackType < CL_COMPLETE || commandExecCallbackType > CL_SUBMITTED)
+		return CL_INVALID_VALUE;
+
+	cl_int status;
+	{
+		boost::mutex::scoped_lock lock(event->mutex);
+		status = event->status;
+		if(status > commandExecCallbackType) {
+			EventCallback callback = { commandExecCallbackType, notify, userData };
+			event->callbacks.push_back(callback);
+			return CL_SUCCESS;
+		}
+	}
+
+	notify(event, (status < 0) ? status : commandExecCallbackType, userData);
+	return CL_SUCCESS;
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clRetainEvent(cl_event event)
+{
+	if(event == NULL)
+		return CL_INVALID_EVENT;
+	event->references++;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clReleaseEvent(cl_event event)
+{
+	if(event == NULL)
+		return CL_INVALID_EVENT;
+	if(--event->references == 0)
+		delete event;
+	return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clGetEventProfilingInfo(
+	cl_event event,
+	cl_profiling_info paramName,
+	size_t paramValueSize,
+	void* paramValue,
+	size_t* paramValueSizeRet)
+{
+	if(event == NULL)
+		return CL_INVALID_EVENT;
+	if(event->queue == NULL || !(event->queue->properties & CL_QUEUE_PROFILING_ENABLE))
+		return CL_PROFILING_INFO_NOT_AVAILABLE;
+
+	switch(paramName)
+	{
+	case CL_PROFILING_COMMAND_QUEUED:
+	case CL_PROFILING_COMMAND_SUBMIT:
+		return returnValue(event->queued, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROFILING_COMMAND_START:
+		return returnValue(event->start, paramValueSize, paramValue, paramValueSizeRet);
+	case CL_PROFILING_COMMAND_END:
+#ifdef CL_VERSION_2_0
+	case CL_PROFILING_COMMAND_COMPLETE:
+#endif
+		return returnValue(event->end, paramValueSize, paramValue, paramValueSizeRet);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+/* Enqueued commands */
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueReadBuffer(
+	cl_command_queue queue,
+	cl_mem buffer,
+	cl_bool blockingRead,
+	size_t offset,
+	size_t size,
+	void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(buffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(ptr == NULL || offset + size > buffer->size)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_READ_BUFFER, transferNanoseconds(size), numEvents, waitList, event,
+		boost::bind(&copyBytes, ptr, buffer->data + offset, size));
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueWriteBuffer(
+	cl_command_queue queue,
+	cl_mem buffer,
+	cl_bool blockingWrite,
+	size_t offset,
+	size_t size,
+	const void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(buffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(ptr == NULL || offset + size > buffer->size)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_WRITE_BUFFER, transferNanoseconds(size), numEvents, waitList, event,
+		boost::bind(&copyBytes, buffer->data + offset, ptr, size));
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueCopyBuffer(
+	cl_command_queue queue,
+	cl_mem sourceBuffer,
+	cl_mem destinationBuffer,
+	size_t sourceOffset,
+	size_t destinationOffset,
+	size_t size,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(sourceBuffer == NULL || destinationBuffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(size == 0 || sourceOffset + size > sourceBuffer->size || destinationOffset + size > destinationBuffer->size)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_COPY_BUFFER, deviceNanoseconds(queue->device, 2 * size), numEvents, waitList, event,
+		boost::bind(&copyBytes, destinationBuffer->data + destinationOffset, sourceBuffer->data + sourceOffset, size));
+}
+
+#ifdef CL_VERSION_1_1
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueReadBufferRect(
+	cl_command_queue queue,
+	cl_mem buffer,
+	cl_bool blockingRead,
+	const size_t* bufferOrigin,
+	const size_t* hostOrigin,
+	const size_t* region,
+	size_t bufferRowPitch,
+	size_t bufferSlicePitch,
+	size_t hostRowPitch,
+	size_t hostSlicePitch,
+	void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(buffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(ptr == NULL || bufferOrigin == NULL || hostOrigin == NULL || region == NULL)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_READ_BUFFER_RECT, transferNanoseconds(region[0] * region[1] * region[2]), numEvents, waitList, event,
+		boost::bind(&copyRect, (char*) ptr, hostOrigin, hostRowPitch, hostSlicePitch, buffer->data, bufferOrigin, bufferRowPitch, bufferSlicePitch, region));
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueWriteBufferRect(
+	cl_command_queue queue,
+	cl_mem buffer,
+	cl_bool blockingWrite,
+	const size_t* bufferOrigin,
+	const size_t* hostOrigin,
+	const size_t* region,
+	size_t bufferRowPitch,
+	size_t bufferSlicePitch,
+	size_t hostRowPitch,
+	size_t hostSlicePitch,
+	const void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(buffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(ptr == NULL || bufferOrigin == NULL || hostOrigin == NULL || region == NULL)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_WRITE_BUFFER_RECT, transferNanoseconds(region[0] * region[1] * region[2]), numEvents, waitList, event,
+		boost::bind(&copyRect, buffer->data, bufferOrigin, bufferRowPitch, bufferSlicePitch, (const char*) ptr, hostOrigin, hostRowPitch, hostSlicePitch, region));
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueCopyBufferRect(
+	cl_command_queue queue,
+	cl_mem sourceBuffer,
+	cl_mem destinationBuffer,
+	const size_t* sourceOrigin,
+	const size_t* destinationOrigin,
+	const size_t* region,
+	size_t sourceRowPitch,
+	size_t sourceSlicePitch,
+	size_t destinationRowPitch,
+	size_t destinationSlicePitch,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(sourceBuffer == NULL || destinationBuffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(sourceOrigin == NULL || destinationOrigin == NULL || region == NULL)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_COPY_BUFFER_RECT, deviceNanoseconds(queue->device, 2 * region[0] * region[1] * region[2]), numEvents, waitList, event,
+		boost::bind(&copyRect, destinationBuffer->data, destinationOrigin, destinationRowPitch, destinationSlicePitch,
+			(const char*) sourceBuffer->data, sourceOrigin, sourceRowPitch, sourceSlicePitch, region));
+}
+#endif
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueFillBuffer(
+	cl_command_queue queue,
+	cl_mem buffer,
+	const void* pattern,
+	size_t patternSize,
+	size_t offset,
+	size_t size,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(buffer == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(pattern == NULL || patternSize == 0 || offset % patternSize != 0 || size % patternSize != 0 || offset + size > buffer->size)
+		return CL_INVALID_VALUE;
+
+	return enqueueCommand(queue, CL_COMMAND_FILL_BUFFER, deviceNanoseconds(queue->device, size), numEvents, waitList, event,
+		boost::bind(&fillPattern, buffer->data + offset, pattern, patternSize, size));
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueReadImage(
+	cl_command_queue queue,
+	cl_mem image,
+	cl_bool blockingRead,
+	const size_t* origin,
+	const size_t* region,
+	size_t rowPitch,
+	size_t slicePitch,
+	void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueWriteImage(
+	cl_command_queue queue,
+	cl_mem image,
+	cl_bool blockingWrite,
+	const size_t* origin,
+	const size_t* region,
+	size_t inputRowPitch,
+	size_t inputSlicePitch,
+	const void* ptr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueCopyImage(
+	cl_command_queue queue,
+	cl_mem sourceImage,
+	cl_mem destinationImage,
+	const size_t* sourceOrigin,
+	const size_t* destinationOrigin,
+	const size_t* region,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueCopyImageToBuffer(
+	cl_command_queue queue,
+	cl_mem sourceImage,
+	cl_mem destinationBuffer,
+	const size_t* sourceOrigin,
+	const size_t* region,
+	size_t destinationOffset,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueCopyBufferToImage(
+	cl_command_queue queue,
+	cl_mem sourceBuffer,
+	cl_mem destinationImage,
+	size_t sourceOffset,
+	const size_t* destinationOrigin,
+	const size_t* region,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueFillImage(
+	cl_command_queue queue,
+	cl_mem image,
+	const void* fillColor,
+	const size_t* origin,
+	const size_t* region,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_MEM_OBJECT;
+}
+#endif
+
+/* Buffers live in host memory, so mapping never copies */
+CL_API_ENTRY void* CL_API_CALL clEnqueueMapBuffer(
+	cl_command_queue queue,
+	cl_mem buffer,
+	cl_bool blockingMap,
+	cl_map_flags mapFlags,
+	size_t offset,
+	size_t size,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event,
+	cl_int* errcodeRet)
+{
+	if(queue == NULL) {
+		setError(errcodeRet, CL_INVALID_COMMAND_QUEUE);
+		return NULL;
+	}
+	if(buffer == NULL) {
+		setError(errcodeRet, CL_INVALID_MEM_OBJECT);
+		return NULL;
+	}
+	if(size == 0 || offset + size > buffer->size) {
+		setError(errcodeRet, CL_INVALID_VALUE);
+		return NULL;
+	}
+
+	cl_int err = enqueueCommand(queue, CL_COMMAND_MAP_BUFFER, isZeroCopy(buffer) ? launchNanoseconds() : transferNanoseconds(size),
+		numEvents, waitList, event, boost::function<void ()>());
+	setError(errcodeRet, err);
+	if(err != CL_SUCCESS)
+		return NULL;
+
+	buffer->mapCount++;
+	return buffer->data + offset;
+}
+
+CL_API_ENTRY void* CL_API_CALL clEnqueueMapImage(
+	cl_command_queue queue,
+	cl_mem image,
+	cl_bool blockingMap,
+	cl_map_flags mapFlags,
+	const size_t* origin,
+	const size_t* region,
+	size_t* imageRowPitch,
+	size_t* imageSlicePitch,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event,
+	cl_int* errcodeRet)
+{
+	setError(errcodeRet, CL_INVALID_MEM_OBJECT);
+	return NULL;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueUnmapMemObject(
+	cl_command_queue queue,
+	cl_mem memory,
+	void* mappedPtr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(memory == NULL)
+		return CL_INVALID_MEM_OBJECT;
+	if(memory->mapCount == 0 || (char*) mappedPtr < memory->data || (char*) mappedPtr >= memory->data + memory->size)
+		return CL_INVALID_VALUE;
+
+	memory->mapCount--;
+	return enqueueCommand(queue, CL_COMMAND_UNMAP_MEM_OBJECT, isZeroCopy(memory) ? launchNanoseconds() : transferNanoseconds(memory->size),
+		numEvents, waitList, event, boost::function<void ()>());
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueMigrateMemObjects(
+	cl_command_queue queue,
+	cl_uint numMemObjects,
+	const cl_mem* memObjects,
+	cl_mem_migration_flags flags,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(numMemObjects == 0 || memObjects == NULL)
+		return CL_INVALID_VALUE;
+
+	size_t bytes = 0;
+	for(cl_uint i = 0; i < numMemObjects; i++)
+	{
+		if(memObjects[i] == NULL)
+			return CL_INVALID_MEM_OBJECT;
+		if(!(flags & CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED) && !isZeroCopy(memObjects[i]))
+			bytes += memObjects[i]->size;
+	}
+
+	return enqueueCommand(queue, CL_COMMAND_MIGRATE_MEM_OBJECTS, transferNanoseconds(bytes), numEvents, waitList, event, boost::function<void ()>());
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueNDRangeKernel(
+	cl_command_queue queue,
+	cl_kernel kernel,
+	cl_uint workDim,
+	const size_t* globalWorkOffset,
+	const size_t* globalWorkSize,
+	const size_t* localWorkSize,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(kernel == NULL)
+		return CL_INVALID_KERNEL;
+	if(workDim < 1 || workDim > 3)
+		return CL_INVALID_WORK_DIMENSION;
+	if(globalWorkSize == NULL)
+		return CL_INVALID_GLOBAL_WORK_SIZE;
+
+	StandInLaunch launch;
+	launch.function = kernel->function;
+	launch.dims = workDim;
+	launch.defines = &kernel->program->defines;
+
+	size_t workGroupSize = 1;
+	for(cl_uint dim = 0; dim < workDim; dim++)
+	{
+		if(globalWorkSize[dim] == 0)
+			return CL_INVALID_GLOBAL_WORK_SIZE;
+		launch.globalOffset[dim] = (globalWorkOffset != NULL) ? globalWorkOffset[dim] : 0;
+		launch.globalSize[dim] = globalWorkSize[dim];
+
+		if(localWorkSize != NULL) {
+			if(localWorkSize[dim] == 0 || localWorkSize[dim] > STANDIN_MAX_WORK_GROUP_SIZE)
+				return CL_INVALID_WORK_ITEM_SIZE;
+			if(globalWorkSize[dim] % localWorkSize[dim] != 0)
+				return CL_INVALID_WORK_GROUP_SIZE;
+			launch.localSize[dim] = localWorkSize[dim];
+		}
+		else {
+			// The largest divisor of the global size up to the default, along the first dimension only
+			size_t localSize = (dim == 0) ? std::min(globalWorkSize[0], (size_t) STANDIN_DEFAULT_LOCAL_SIZE) : 1;
+			while(globalWorkSize[dim] % localSize != 0)
+				localSize--;
+			launch.localSize[dim] = localSize;
+		}
+		workGroupSize *= launch.localSize[dim];
+	}
+	if(workGroupSize > STANDIN_MAX_WORK_GROUP_SIZE)
+		return CL_INVALID_WORK_GROUP_SIZE;
+
+	// The cost model charges every byte of the buffer arguments once
+	size_t bytes = 0;
+	launch.arguments = kernel->arguments;
+	for(size_t i = 0; i < launch.arguments.size(); i++)
+	{
+		CLHelper::StandInArgument& argument = launch.arguments[i];
+		if(!argument.set)
+			return CL_INVALID_KERNEL_ARGS;
+
+		if(argument.kind == CLHelper::STANDIN_GLOBAL && argument.memory != NULL) {
+			argument.data = argument.memory->data;
+			bytes += argument.memory->size;
+		}
+	}
+
+	return enqueueCommand(queue, CL_COMMAND_NDRANGE_KERNEL, deviceNanoseconds(queue->device, bytes), numEvents, waitList, event,
+		boost::bind(&runKernel, boost::cref(launch)));
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueTask(
+	cl_command_queue queue,
+	cl_kernel kernel,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	size_t one = 1;
+	return clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &one, &one, numEvents, waitList, event);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueNativeKernel(
+	cl_command_queue queue,
+	void (CL_CALLBACK* userFunction)(void*),
+	void* args,
+	size_t argsSize,
+	cl_uint numMemObjects,
+	const cl_mem* memList,
+	const void** argsMemLoc,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_OPERATION;
+}
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueMarkerWithWaitList(cl_command_queue queue, cl_uint numEvents, const cl_event* waitList, cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	return enqueueCommand(queue, CL_COMMAND_MARKER, 0.0, numEvents, waitList, event, boost::function<void ()>());
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueBarrierWithWaitList(cl_command_queue queue, cl_uint numEvents, const cl_event* waitList, cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	return enqueueCommand(queue, CL_COMMAND_BARRIER, 0.0, numEvents, waitList, event, boost::function<void ()>());
+}
+#endif
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueMarker(cl_command_queue queue, cl_event* event)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(event == NULL)
+		return CL_INVALID_VALUE;
+	return enqueueCommand(queue, CL_COMMAND_MARKER, 0.0, 0, NULL, event, boost::function<void ()>());
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueWaitForEvents(cl_command_queue queue, cl_uint numEvents, const cl_event* eventList)
+{
+	if(queue == NULL)
+		return CL_INVALID_COMMAND_QUEUE;
+	if(numEvents == 0 || eventList == NULL)
+		return CL_INVALID_VALUE;
+	return enqueueCommand(queue, CL_COMMAND_BARRIER, 0.0, numEvents, eventList, NULL, boost::function<void ()>());
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueBarrier(cl_command_queue queue)
+{
+	return (queue == NULL) ? CL_INVALID_COMMAND_QUEUE : CL_SUCCESS;
+}
+
+#ifdef CL_VERSION_2_0
+/* The stand-in devices report no SVM capabilities */
+CL_API_ENTRY void* CL_API_CALL clSVMAlloc(cl_context context, cl_svm_mem_flags flags, size_t size, cl_uint alignment)
+{
+	return NULL;
+}
+
+CL_API_ENTRY void CL_API_CALL clSVMFree(cl_context context, void* svmPointer)
+{
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clSetKernelArgSVMPointer(cl_kernel kernel, cl_uint argIndex, const void* argValue)
+{
+	return CL_INVALID_OPERATION;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueSVMMap(
+	cl_command_queue queue,
+	cl_bool blockingMap,
+	cl_map_flags flags,
+	void* svmPtr,
+	size_t size,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_OPERATION;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL clEnqueueSVMUnmap(
+	cl_command_queue queue,
+	void* svmPtr,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event)
+{
+	return CL_INVALID_OPERATION;
+}
+#endif
+
+#ifdef CL_VERSION_1_2
+CL_API_ENTRY void* CL_API_CALL clGetExtensionFunctionAddressForPlatform(cl_platform_id platformId, const char* functionName)
+{
+	return NULL;
+}
+#endif
+
+CL_API_ENTRY void* CL_API_CALL clGetExtensionFunctionAddress(const char* functionName)
+{
+	return NULL;
+}
+
+/* Helpers */
+
+static void initialize()
+{
+	clockOrigin = pt::microsec_clock::universal_time();
+
+	config.devices = 1;
+	config.type = CL_DEVICE_TYPE_GPU;
+	config.computeUnits = (cl_uint) CLHelper::ThreadPool::shared().getThreadCount();
+	config.memoryBytes = (cl_ulong) 1024 * 1024 * 1024;
+	config.numaNodes = 1;
+	config.simulate = false;
+	config.sleep = false;
+	config.launchMicroseconds = 10.0;
+	config.transferGBs = 8.0;
+	config.bandwidthGBs = 100.0;
+
+	const char* configString = getenv("CLHELPER_STANDIN");
+	if(configString != NULL)
+		parseConfig(configString);
+
+	for(cl_uint i = 0; i < config.devices; i++)
+		platform.devices.push_back(new _cl_device_id(&platform, NULL, i, config.computeUnits));
+
+	CLHelper::registerStandInKernels();
+}
+
+static void parseConfig(const char* configString)
+{
+	std::vector<std::string> entries;
+	boost::split(entries, configString, boost::is_any_of(","), boost::token_compress_on);
+
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		std::string entry = boost::trim_copy(entries[i]);
+		std::string value;
+		size_t equals = entry.find('=');
+		if(equals != std::string::npos) {
+			value = entry.substr(equals + 1);
+			entry = entry.substr(0, equals);
+		}
+
+		try {
+			if(entry.empty())
+				continue;
+			else if(entry == "simulate")
+				config.simulate = true;
+			else if(entry == "sleep")
+				config.simulate = config.sleep = true;
+			else if(entry == "devices")
+				config.devices = std::max(boost::lexical_cast<cl_uint>(value), 1u);
+			else if(entry == "compute-units")
+				config.computeUnits = std::max(boost::lexical_cast<cl_uint>(value), 1u);
+			else if(entry == "memory")
+				config.memoryBytes = boost::lexical_cast<cl_ulong>(value) * 1024 * 1024;
+			else if(entry == "numa-nodes")
+				config.numaNodes = std::max(boost::lexical_cast<cl_uint>(value), 1u);
+			else if(entry == "launch-us")
+				config.launchMicroseconds = boost::lexical_cast<double>(value);
+			else if(entry == "transfer-gbs")
+				config.transferGBs = boost::lexical_cast<double>(value);
+			else if(entry == "bandwidth-gbs")
+				config.bandwidthGBs = boost::lexical_cast<double>(value);
+			else if(entry == "type" && (value == "gpu" || value == "GPU"))
+				config.type = CL_DEVICE_TYPE_GPU;
+			else if(entry == "type" && (value == "cpu" || value == "CPU"))
+				config.type = CL_DEVICE_TYPE_CPU;
+			else if(entry == "type" && (value == "accelerator" || value == "ACCELERATOR"))
+				config.type = CL_DEVICE_TYPE_ACCELERATOR;
+			else
+				std::cerr << "CLHELPER_STANDIN: ignoring unknown setting '" << entries[i] << "'" << std::endl;
+		}
+		catch(const boost::bad_lexical_cast&) {
+			std::cerr << "CLHELPER_STANDIN: ignoring malformed setting '" << entries[i] << "'" << std::endl;
+		}
+	}
+
+	if(config.transferGBs <= 0.0 || config.bandwidthGBs <= 0.0) {
+		std::cerr << "CLHELPER_STANDIN: bandwidths must be positive, using the defaults" << std::endl;
+		config.transferGBs = 8.0;
+		config.bandwidthGBs = 100.0;
+	}
+}
+
+static cl_device_id getRootDevice(cl_device_id device)
+{
+	while(device->parent != NULL)
+		device = device->parent;
+	return device;
+}
+
+static bool matchesType(cl_device_id device, cl_device_type type)
+{
+	return type == CL_DEVICE_TYPE_ALL || (config.type & type) != 0;
+}
+
+static void setError(cl_int* errcodeRet, cl_int err)
+{
+	if(errcodeRet != NULL)
+		*errcodeRet = err;
+}
+
+static cl_int returnInfo(const void* value, size_t valueSize, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet)
+{
+	if(paramValue != NULL) {
+		if(paramValueSize < valueSize)
+			return CL_INVALID_VALUE;
+		copyBytes(paramValue, value, valueSize);
+	}
+	if(paramValueSizeRet != NULL)
+		*paramValueSizeRet = valueSize;
+	return CL_SUCCESS;
+}
+
+static cl_int returnString(const std::string& value, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet)
+{
+	return returnInfo(value.c_str(), value.size() + 1, paramValueSize, paramValue, paramValueSizeRet);
+}
+
+template <typename T>
+static cl_int returnValue(const T& value, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet)
+{
+	return returnInfo(&value, sizeof(T), paramValueSize, paramValue, paramValueSizeRet);
+}
+
+static cl_ulong wallNanoseconds()
+{
+	return STANDIN_CLOCK_ORIGIN + (cl_ulong) (pt::microsec_clock::universal_time() - clockOrigin).total_microseconds() * 1000;
+}
+
+static double launchNanoseconds()
+{
+	return config.launchMicroseconds * 1e3;
+}
+
+/* 1 GB/s moves one byte per nanosecond */
+static double transferNanoseconds(size_t bytes)
+{
+	return launchNanoseconds() + bytes / config.transferGBs;
+}
+
+/* Sub-devices get the share of the bandwidth of their compute units */
+static double deviceNanoseconds(cl_device_id device, size_t bytes)
+{
+	double share = (double) device->computeUnits / getRootDevice(device)->computeUnits;
+	return launchNanoseconds() + bytes / (config.bandwidthGBs * share);
+}
+
+static bool isZeroCopy(cl_mem memory)
+{
+	return !(config.type & CL_DEVICE_TYPE_GPU) || (memory->flags & (CL_MEM_ALLOC_HOST_PTR | CL_MEM_USE_HOST_PTR));
+}
+
+static cl_int checkWaitList(cl_command_queue queue, cl_uint numEvents, const cl_event* waitList)
+{
+	if((numEvents == 0) != (waitList == NULL))
+		return CL_INVALID_EVENT_WAIT_LIST;
+
+	for(cl_uint i = 0; i < numEvents; i++)
+	{
+		if(waitList[i] == NULL)
+			return CL_INVALID_EVENT_WAIT_LIST;
+		if(waitList[i]->context != queue->context)
+			return CL_INVALID_CONTEXT;
+	}
+	return CL_SUCCESS;
+}
+
+/* Only user events can be incomplete, every other command completed when it was enqueued */
+static cl_int waitForEvents(cl_uint numEvents, const cl_event* waitList, cl_ulong* latestEnd)
+{
+	cl_int err = CL_SUCCESS;
+	for(cl_uint i = 0; i < numEvents; i++)
+	{
+		if(waitList[i] == NULL)
+			return CL_INVALID_EVENT;
+
+		boost::mutex::scoped_lock lock(waitList[i]->mutex);
+		while(waitList[i]->status > CL_COMPLETE)
+			waitList[i]->statusChanged.wait(lock);
+
+		if(waitList[i]->status < 0)
+			err = CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+		if(latestEnd != NULL)
+			*latestEnd = std::max(*latestEnd, waitList[i]->end);
+	}
+	return err;
+}
+
+/*
+ * Runs a command to completion on the calling thread. Its profiling times
+ * are measured, or with 'simulate' placed on the device's virtual clock:
+ * the command starts when the device is done with the previous one and its
+ * wait list is complete, and takes modeledNanoseconds.
+ */
+static cl_int enqueueCommand(
+	cl_command_queue queue,
+	cl_command_type type,
+	double modeledNanoseconds,
+	cl_uint numEvents,
+	const cl_event* waitList,
+	cl_event* event,
+	const boost::function<void ()>& work)
+{
+	cl_int err = checkWaitList(queue, numEvents, waitList);
+	if(err != CL_SUCCESS)
+		return err;
+
+	cl_ulong ready = 0;
+	err = waitForEvents(numEvents, waitList, &ready);
+	if(err != CL_SUCCESS)
+		return err;
+
+	boost::mutex::scoped_lock lock(queue->mutex);
+
+	cl_ulong queued = wallNanoseconds();
+	if(!work.empty())
+		work();
+	cl_ulong finished = wallNanoseconds();
+
+	cl_ulong start = queued;
+	cl_ulong end = finished;
+	if(config.simulate) {
+		{
+			boost::mutex::scoped_lock clockLock(queue->device->clockMutex);
+			start = std::max(queue->device->clock, ready);
+			end = start + (cl_ulong) modeledNanoseconds;
+			queue->device->clock = end;
+		}
+		queued = start;
+
+		if(config.sleep && end - start > finished - queued)
+			boost::this_thread::sleep(pt::microseconds((end - start - (finished - queued)) / 1000));
+	}
+
+	if(event != NULL) {
+		*event = new _cl_event(queue->context, queue, type, CL_COMPLETE);
+		(*event)->queued = queued;
+		(*event)->start = start;
+		(*event)->end = end;
+	}
+	return CL_SUCCESS;
+}
+
+static void copyBytes(void* destination, const void* source, size_t bytes)
+{
+	if(destination != source)
+		memmove(destination, source, bytes);
+}
+
+static void fillPattern(char* destination, const void* pattern, size_t patternSize, size_t size)
+{
+	for(size_t offset = 0; offset < size; offset += patternSize)
+		memcpy(destination + offset, pattern, patternSize);
+}
+
+/* Origins and the region are in bytes along x, zero pitches mean packed rows and slices */
+static void copyRect(
+	char* destination,
+	const size_t* destinationOrigin,
+	size_t destinationRowPitch,
+	size_t destinationSlicePitch,
+	const char* source,
+	const size_t* sourceOrigin,
+	size_t sourceRowPitch,
+	size_t sourceSlicePitch,
+	const size_t* region)
+{
+	if(destinationRowPitch == 0) destinationRowPitch = region[0];
+	if(destinationSlicePitch == 0) destinationSlicePitch = region[1] * destinationRowPitch;
+	if(sourceRowPitch == 0) sourceRowPitch = region[0];
+	if(sourceSlicePitch == 0) sourceSlicePitch = region[1] * sourceRowPitch;
+
+	for(size_t z = 0; z < region[2]; z++)
+	{
+		for(size_t y = 0; y < region[1]; y++)
+		{
+			memmove(
+				destination + (destinationOrigin[2] + z) * destinationSlicePitch + (destinationOrigin[1] + y) * destinationRowPitch + destinationOrigin[0],
+				source + (sourceOrigin[2] + z) * sourceSlicePitch + (sourceOrigin[1] + y) * sourceRowPitch + sourceOrigin[0],
+				region[0]);
+		}
+	}
+}
+
+/* Collects -D defines; fails, like a real compiler would, for OpenCL C versions past 1.2 */
+static bool parseBuildOptions(const std::string& options, std::map<std::string, std::string>* defines, std::string* log)
+{
+	std::istringstream stream(options);
+	std::string option;
+	while(stream >> option)
+	{
+		if(option == "-D" || option == "-I") {
+			std::string argument;
+			if(!(stream >> argument)) {
+				*log += "error: missing argument to '" + option + "'\n";
+				return false;
+			}
+			option += argument;
+		}
+
+		if(option.compare(0, 2, "-D") == 0) {
+			std::string define = option.substr(2);
+			size_t equals = define.find('=');
+			if(equals == std::string::npos)
+				(*defines)[define] = "1";
+			else
+				(*defines)[define.substr(0, equals)] = define.substr(equals + 1);
+		}
+		else if(option.compare(0, 8, "-cl-std=") == 0 && option != "-cl-std=CL1.0" && option != "-cl-std=CL1.1" && option != "-cl-std=CL1.2") {
+			*log += "error: the stand-in devices support OpenCL C 1.2, not '" + option + "'\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Finds every __kernel function's name and parameters. The source is only
+ * tokenized, not preprocessed: comments and preprocessor lines are skipped,
+ * so kernels inside #if blocks are always listed.
+ */
+static void findKernels(const std::string& source, std::vector<StandInPrototype>* kernels)
+{
+	std::vector<std::string> tokens;
+	bool lineStart = true;
+	for(size_t i = 0; i < source.size();)
+	{
+		char c = source[i];
+		if(c == '\n') {
+			lineStart = true;
+			i++;
+		}
+		else if(isspace((unsigned char) c)) {
+			i++;
+		}
+		else if(source.compare(i, 2, "//") == 0) {
+			i = source.find('\n', i);
+			if(i == std::string::npos) break;
+		}
+		else if(source.compare(i, 2, "/*") == 0) {
+			i = source.find("*/", i + 2);
+			if(i == std::string::npos) break;
+			i += 2;
+		}
+		else if(c == '#' && lineStart) {
+			// Up to the end of the line, including continued lines
+			while(i < source.size() && !(source[i] == '\n' && source[i - 1] != '\\'))
+				i++;
+		}
+		else if(isalnum((unsigned char) c) || c == '_') {
+			size_t start = i;
+			while(i < source.size() && (isalnum((unsigned char) source[i]) || source[i] == '_'))
+				i++;
+			tokens.push_back(source.substr(start, i - start));
+			lineStart = false;
+		}
+		else {
+			tokens.push_back(std::string(1, c));
+			lineStart = false;
+			i++;
+		}
+	}
+
+	for(size_t i = 0; i < tokens.size(); i++)
+	{
+		if(tokens[i] != "__kernel" && tokens[i] != "kernel")
+			continue;
+
+		// __kernel [__attribute__((...))] void name(parameters)
+		size_t next = i + 1;
+		while(next < tokens.size() && tokens[next] == "__attribute__")
+		{
+			next++;
+			int depth = 0;
+			do {
+				if(tokens[next] == "(") depth++;
+				else if(tokens[next] == ")") depth--;
+				next++;
+			} while(next < tokens.size() && depth > 0);
+		}
+		if(next + 2 >= tokens.size() || tokens[next] != "void" || tokens[next + 2] != "(")
+			continue;
+
+		StandInPrototype prototype;
+		prototype.name = tokens[next + 1];
+
+		std::vector<std::string> parameter;
+		int depth = 0;
+		for(next += 3; next < tokens.size(); next++)
+		{
+			if(depth == 0 && (tokens[next] == "," || tokens[next] == ")")) {
+				CLHelper::StandInArgument argument;
+				if(parseArgument(parameter, &argument))
+					prototype.arguments.push_back(argument);
+				parameter.clear();
+				if(tokens[next] == ")")
+					break;
+				continue;
+			}
+
+			if(tokens[next] == "(") depth++;
+			else if(tokens[next] == ")") depth--;
+			parameter.push_back(tokens[next]);
+		}
+
+		kernels->push_back(prototype);
+		i = next;
+	}
+}
+
+static bool parseArgument(const std::vector<std::string>& tokens, CLHelper::StandInArgument* argument)
+{
+	if(tokens.empty() || (tokens.size() == 1 && tokens[0] == "void"))
+		return false;
+
+	bool pointer = false;
+	std::vector<std::string> typeTokens;
+	for(size_t i = 0; i + 1 < tokens.size(); i++)
+	{
+		const std::string& token = tokens[i];
+		if(token == "__global" || token == "global" || token == "__constant" || token == "constant")
+			argument->kind = CLHelper::STANDIN_GLOBAL;
+		else if(token == "__local" || token == "local")
+			argument->kind = CLHelper::STANDIN_LOCAL;
+		else if(token == "*")
+			pointer = true;
+		else if(token != "const" && token != "volatile" && token != "restrict" && token != "__restrict"
+			&& token != "__private" && token != "private")
+			typeTokens.push_back(token);
+	}
+
+	argument->name = tokens.back();
+	argument->typeName = boost::join(typeTokens, " ") + (pointer ? "*" : "");
+	return true;
+}
+
+static CLHelper::StandInKernel findNativeKernel(const std::string& name)
+{
+	boost::mutex::scoped_lock lock(kernelRegistryMutex);
+	std::map<std::string, CLHelper::StandInKernel>::const_iterator kernel = kernelRegistry.find(name);
+	return (kernel != kernelRegistry.end()) ? kernel->second : NULL;
+}
+
+#ifdef CL_VERSION_1_2
+static cl_int createSubDevices(
+	cl_device_id device,
+	const std::vector<cl_uint>& counts,
+	const cl_device_partition_property* properties,
+	cl_uint numDevices,
+	cl_device_id* outDevices,
+	cl_uint* numDevicesRet)
+{
+	if(counts.empty())
+		return CL_DEVICE_PARTITION_FAILED;
+	if(outDevices != NULL && numDevices < counts.size())
+		return CL_INVALID_VALUE;
+
+	std::vector<cl_device_partition_property> partitionType;
+	for(const cl_device_partition_property* property = properties; *property != 0; property++)
+		partitionType.push_back(*property);
+	partitionType.push_back(0);
+
+	for(size_t i = 0; outDevices != NULL && i < counts.size(); i++)
+	{
+		outDevices[i] = new _cl_device_id(device->platform, device, (cl_uint) i, counts[i]);
+		outDevices[i]->partitionType = partitionType;
+		clRetainDevice(device);
+	}
+	if(numDevicesRet != NULL)
+		*numDevicesRet = (cl_uint) counts.size();
+	return CL_SUCCESS;
+}
+#endif
+
+static cl_command_queue createQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties, cl_int* errcodeRet)
+{
+	if(context == NULL) {
+		setError(errcodeRet, CL_INVALID_CONTEXT);
+		return NULL;
+	}
+	if(device == NULL || std::find(context->devices.begin(), context->devices.end(), device) == context->devices.end()) {
+		setError(errcodeRet, CL_INVALID_DEVICE);
+		return NULL;
+	}
+	if(properties & ~(cl_command_queue_properties) (CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE)) {
+		setError(errcodeRet, CL_INVALID_QUEUE_PROPERTIES);
+		return NULL;
+	}
+
+	setError(errcodeRet, CL_SUCCESS);
+	return new _cl_command_queue(context, device, properties);
+}
+
+static void runKernel(const StandInLaunch& launch)
+{
+	size_t groups = 1;
+	for(cl_uint dim = 0; dim < launch.dims; dim++)
+		groups *= launch.globalSize[dim] / launch.localSize[dim];
+
+	CLHelper::ThreadPool::shared().parallelFor(0, groups, boost::bind(&runGroups, boost::cref(launch), boost::placeholders::_1, boost::placeholders::_2));
+}
+
+static void runGroups(const StandInLaunch& launch, size_t firstGroup, size_t lastGroup)
+{
+	CLHelper::StandInWorkGroup group(launch.dims, launch.globalOffset, launch.globalSize, launch.localSize, launch.arguments, *launch.defines);
+	for(size_t linearGroup = firstGroup; linearGroup < lastGroup; linearGroup++)
+	{
+		group.setGroup(linearGroup);
+		launch.function(group);
+	}
+}
+
+static void completeEvent(cl_event event, cl_int status)
+{
+	std::vector<EventCallback> callbacks;
+	{
+		boost::mutex::scoped_lock lock(event->mutex);
+		event->status = status;
+		callbacks.swap(event->callbacks);
+		event->statusChanged.notify_all();
+	}
+
+	for(size_t i = 0; i < callbacks.size(); i++)
+		callbacks[i].function(event, status, callbacks[i].userData);
+}
@@ -0,0 +1,121 @@
+#ifndef _STANDINPLATFORM_H
+#define _STANDINPLATFORM_H
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "CLHelper.h"
+
+/*
+ * An in-process OpenCL platform for machines without an ICD, linked instead of
+ * the OpenCL library when configured with -DOPENCL_STAND_IN=ON. It implements
+ * the C API behind cl.hpp on host memory and runs every kernel through a
+ * native C++ equivalent registered under the kernel's name; argument kinds and
+ * names are read from the kernel's prototype in the program source.
+ *
+ * The environment variable CLHELPER_STANDIN configures it as a comma separated
+ * list of:
+ *   devices=<n>            root devices on the platform (1)
+ *   type=gpu|cpu|accelerator
+ *                          the reported device type (gpu)
+ *   compute-units=<n>      compute units per device (the host thread count)
+ *   memory=<MiB>           global memory per device (1024)
+ *   numa-nodes=<n>         sub-devices of an affinity domain partition (1)
+ *   simulate               profiling times from the cost model below instead
+ *                          of measured, on one virtual clock per device, so
+ *                          results do not depend on the host's load
+ *   sleep                  also hold every command until its modeled time has
+ *                          passed, for host side wall clock timing
+ *   launch-us=<us>         modeled latency of every command (10)
+ *   transfer-gbs=<GB/s>    modeled host to device bandwidth (8)
+ *   bandwidth-gbs=<GB/s>   modeled device memory bandwidth, scaled down for
+ *                          sub-devices (100)
+ */
+namespace CLHelper
+{
+	/* Argument kinds, from the address space qualifiers of the kernel prototype */
+	enum StandInArgumentKind {
+		STANDIN_VALUE,
+		STANDIN_GLOBAL,			/* __global and __constant pointers */
+		STANDIN_LOCAL
+	};
+
+	struct StandInArgument {
+		StandInArgumentKind kind;
+		std::string name;
+		std::string typeName;		/* without qualifiers, e.g. "float*" */
+		bool set;
+
+		std::vector<char> value;	/* STANDIN_VALUE */
+		cl_mem memory;				/* STANDIN_GLOBAL, NULL for SVM pointers */
+		char* data;					/* STANDIN_GLOBAL, resolved when enqueued */
+		size_t localBytes;			/* STANDIN_LOCAL */
+
+		StandInArgument() : kind(STANDIN_VALUE), set(false), memory(NULL), data(NULL), localBytes(0) {}
+	};
+
+	/*
+	 * One work-group of an NDRange on the stand-in platform. Native kernels
+	 * loop over the work-items of their group themselves, so a barrier
+	 * becomes the end of one such loop. Groups run in parallel on the host
+	 * thread pool.
+	 */
+	class StandInWorkGroup {
+
+	public:
+		StandInWorkGroup(
+			cl_uint dims,
+			const size_t* globalOffset,
+			const size_t* globalSize,
+			const size_t* localSize,
+			const std::vector<StandInArgument>& arguments,
+			const std::map<std::string, std::string>& defines);
+
+		void setGroup(size_t linearGroup);
+
+		cl_uint getDims() const { return dims; }
+		size_t begin(cl_uint dim) const { return dim < dims ? globalOffset[dim] + group[dim] * localSize[dim] : 0; }		/* first global id of the group */
+		size_t end(cl_uint dim) const { return dim < dims ? begin(dim) + localSize[dim] : 1; }
+		size_t getGroupId(cl_uint dim) const { return dim < dims ? group[dim] : 0; }
+		size_t getLocalSize(cl_uint dim) const { return dim < dims ? localSize[dim] : 1; }
+		size_t getGlobalSize(cl_uint dim) const { return dim < dims ? globalSize[dim] : 1; }
+
+		template <typename T> T* global(cl_uint index) const { return (T*) arguments[index].data; }
+		template <typename T> T* local(cl_uint index) const { return (T*) &localMemory[index][0]; }
+		template <typename T> T value(cl_uint index) const
+		{
+			T result = T();
+			memcpy(&result, &arguments[index].value[0], std::min(sizeof(T), arguments[index].value.size()));
+			return result;
+		}
+
+		/* The program's -D build options */
+		bool isDefined(const std::string& name) const;
+		std::string getDefine(const std::string& name, const std::string& defaultValue = "") const;
+		long getDefineInt(const std::string& name, long defaultValue) const;
+
+	private:
+		cl_uint dims;
+		size_t globalOffset[3];
+		size_t globalSize[3];
+		size_t localSize[3];
+		size_t groups[3];
+		size_t group[3];
+
+		const std::vector<StandInArgument>& arguments;
+		const std::map<std::string, std::string>& defines;
+		std::vector<std::vector<char> > localMemory;		/* per argument, reused by the groups of one host thread */
+	};
+
+	typedef void (*StandInKernel)(const StandInWorkGroup& group);
+
+	/* Makes the kernel of that name runnable on the stand-in platform, replacing any earlier one */
+	void registerStandInKernel(const std::string& name, StandInKernel kernel);
+
+	/* Registers the native equivalents of the repository's kernels, see StandInKernels.cpp */
+	void registerStandInKernels();
+};
+
+#endif
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "StorageFormat.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+static boost::uint16_t floatToHalf(float value);
+static float halfToFloat(boost::uint16_t value);
+static boost::uint16_t floatToBfloat16(float value);
+static float bfloat16ToFloat(boost::uint16_t value);
+static boost::int8_t floatToInt8(float value, float inverseScale);
+
+CLHelper::StorageErrorReport::StorageErrorReport()
+	: count(0), maxAbsoluteError(0), maxRelativeError(0), rmsError(0), worstIndex(0)
+{
+}
+
+std::string CLHelper::storageFormatToString(StorageFormat format)
+{
+	switch(format) {
+	case STORAGE_FLOAT:
+		return "float";
+	case STORAGE_HALF:
+		return "half";
+	case STORAGE_BF16:
+		return "bf16";
+	case STORAGE_INT8:
+		return "int8";
+	}
+
+	return "unknown";
+}
+
+bool CLHelper::storageFormatFromString(const std::string& formatString, StorageFormat* format)
+{
+	if(formatString == "float")
+		*format = STORAGE_FLOAT;
+	else if(formatString == "half")
+		*format = STORAGE_HALF;
+	else if(formatString == "bf16")
+		*format = STORAGE_BF16;
+	else if(formatString == "int8")
+		*format = STORAGE_INT8;
+	else
+		return false;
+
+	return true;
+}
+
+size_t CLHelper::storageFormatSize(StorageFormat format)
+{
+	switch(format) {
+	case STORAGE_HALF:
+	case STORAGE_BF16:
+		return 2;
+	case STORAGE_INT8:
+		return 1;
+	default:
+		return 4;
+	}
+}
+
+std::string CLHelper::storageFormatDefine(StorageFormat format)
+{
+	switch(format) {
+	case STORAGE_HALF:
+		return "STORAGE_HALF";
+	case STORAGE_BF16:
+		return "STORAGE_BF16";
+	case STORAGE_INT8:
+		return "STORAGE_INT8";
+	default:
+		return "";
+	}
+}
+
+float CLHelper::int8Scale(const float* data, size_t count)
+{
+	float maxMagnitude = 0;
+	for(size_t i = 0; i < count; i++)
+		maxMagnitude = std::max(maxMagnitude, (float) fabs(data[i]));
+
+	return maxMagnitude > 0 ? maxMagnitude / 127.0f : 1.0f;
+}
+
+void CLHelper::encodeStorage(StorageFormat format, const float* input, size_t count, void* output, float scale)
+{
+	size_t i = 0;
+
+	switch(format) {
+	case STORAGE_FLOAT:
+		memcpy(output, input, count * sizeof(float));
+		break;
+
+	case STORAGE_HALF:
+	{
+		boost::uint16_t* halfOutput = (boost::uint16_t*) output;
+#ifdef __F16C__
+		for(; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i*) (halfOutput + i), _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+		for(; i < count; i++)
+			halfOutput[i] = floatToHalf(input[i]);
+		break;
+	}
+
+	case STORAGE_BF16:
+	{
+		boost::uint16_t* bfloat16Output = (boost::uint16_t*) output;
+#ifdef __SSE2__
+		// Round to nearest even: add 0x7FFF plus the lowest kept bit, then keep the upper half.
+		// NaNs are blended back in quieted, like floatToBfloat16(), since the rounding could carry them into infinity.
+		const __m128i roundingBias = _mm_set1_epi32(0x7FFF);
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i absMask = _mm_set1_epi32(0x7FFFFFFF);
+		const __m128i infinity = _mm_set1_epi32(0x7F800000);
+		const __m128i quietBit = _mm_set1_epi32(0x00400000);
+		for(; i + 8 <= count; i += 8)
+		{
+			__m128i low = _mm_castps_si128(_mm_loadu_ps(input + i));
+			__m128i high = _mm_castps_si128(_mm_loadu_ps(input + i + 4));
+			__m128i lowNaN = _mm_cmpgt_epi32(_mm_and_si128(low, absMask), infinity);
+			__m128i highNaN = _mm_cmpgt_epi32(_mm_and_si128(high, absMask), infinity);
+			__m128i lowQuiet = _mm_or_si128(low, quietBit);
+			__m128i highQuiet = _mm_or_si128(high, quietBit);
+			low = _mm_add_epi32(low, _mm_add_epi32(roundingBias, _mm_and_si128(_mm_srli_epi32(low, 16), one)));
+			high = _mm_add_epi32(high, _mm_add_epi32(roundingBias, _mm_and_si128(_mm_srli_epi32(high, 16), one)));
+			low = _mm_or_si128(_mm_and_si128(lowNaN, lowQuiet), _mm_andnot_si128(lowNaN, low));
+			high = _mm_or_si128(_mm_and_si128(highNaN, highQuiet), _mm_andnot_si128(highNaN, high));
+			// Shift arithmetically so _mm_packs_epi32 passes the 16-bit patterns through unsaturated
+			low = _mm_srai_epi32(_mm_slli_epi32(_mm_srli_epi32(low, 16), 16), 16);
+			high = _mm_srai_epi32(_mm_slli_epi32(_mm_srli_epi32(high, 16), 16), 16);
+			_mm_storeu_si128((__m128i*) (bfloat16Output + i), _mm_packs_epi32(low, high));
+		}
+#endif
+		for(; i < count; i++)
+			bfloat16Output[i] = floatToBfloat16(input[i]);
+		break;
+	}
+
+	case STORAGE_INT8:
+	{
+		boost::int8_t* int8Output = (boost::int8_t*) output;
+		float inverseScale = 1.0f / scale;
+#ifdef __SSE2__
+		const __m128 inverseScales = _mm_set1_ps(inverseScale);
+		for(; i + 16 <= count; i += 16)
+		{
+			// _mm_cvtps_epi32 rounds to nearest even, the packs saturate to [-128, 127]
+			__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(input + i), inverseScales));
+			__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(input + i + 4), inverseScales));
+			__m128i c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(input + i + 8), inverseScales));
+			__m128i d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(input + i + 12), inverseScales));
+			_mm_storeu_si128((__m128i*) (int8Output + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+		}
+#endif
+		for(; i < count; i++)
+			int8Output[i] = floatToInt8(input[i], inverseScale);
+		break;
+	}
+	}
+}
+
+void CLHelper::decodeStorage(StorageFormat format, const void* input, size_t count, float* output, float scale)
+{
+	size_t i = 0;
+
+	switch(format) {
+	case STORAGE_FLOAT:
+		memcpy(output, input, count * sizeof(float));
+		break;
+
+	case STORAGE_HALF:
+	{
+		const boost::uint16_t* halfInput = (const boost::uint16_t*) input;
+#ifdef __F16C__
+		for(; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(output + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (halfInput + i))));
+#endif
+		for(; i < count; i++)
+			output[i] = halfToFloat(halfInput[i]);
+		break;
+	}
+
+	case STORAGE_BF16:
+	{
+		const boost::uint16_t* bfloat16Input = (const boost::uint16_t*) input;
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128();
+		for(; i + 8 <= count; i += 8)
+		{
+			__m128i values = _mm_loadu_si128((const __m128i*) (bfloat16Input + i));
+			_mm_storeu_ps(output + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, values)));
+			_mm_storeu_ps(output + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, values)));
+		}
+#endif
+		for(; i < count; i++)
+			output[i] = bfloat16ToFloat(bfloat16Input[i]);
+		break;
+	}
+
+	case STORAGE_INT8:
+	{
+		const boost::int8_t* int8Input = (const boost::int8_t*) input;
+#ifdef __SSE2__
+		const __m128 scales = _mm_set1_ps(scale);
+		for(; i + 16 <= count; i += 16)
+		{
+			// Sign extend by placing the bytes in the upper bits and shifting back arithmetically
+			__m128i bytes = _mm_loadu_si128((const __m128i*) (int8Input + i));
+			__m128i low = _mm_unpacklo_epi8(bytes, bytes);
+			__m128i high = _mm_unpackhi_epi8(bytes, bytes);
+			_mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(low, low), 24)), scales));
+			_mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(low, low), 24)), scales));
+			_mm_storeu_ps(output + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(high, high), 24)), scales));
+			_mm_storeu_ps(output + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(high, high), 24)), scales));
+		}
+#endif
+		for(; i < count; i++)
+			output[i] = int8Input[i] * scale;
+		break;
+	}
+	}
+}
+
+CLHelper::StorageErrorReport CLHelper::compareWithReference(const float* reference, const float* values, size_t count)
+{
+	StorageErrorReport report;
+	report.count = count;
+
+	double squaredErrorSum = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		double absoluteError = fabs((double) values[i] - reference[i]);
+		squaredErrorSum += absoluteError * absoluteError;
+
+		if(absoluteError > report.maxAbsoluteError) {
+			report.maxAbsoluteError = absoluteError;
+			report.worstIndex = i;
+		}
+		if(reference[i] != 0)
+			report.maxRelativeError = std::max(report.maxRelativeError, absoluteError / fabs(reference[i]));
+	}
+
+	if(count > 0)
+		report.rmsError = sqrt(squaredErrorSum / count);
+
+	return report;
+}
+
+void CLHelper::printStorageErrorReport(StorageFormat format, const StorageErrorReport& report)
+{
+	std::cout << "Accuracy of " << storageFormatToString(format) << " storage over " << report.count << " elements:" << std::endl;
+	std::cout << "  max absolute error: " << report.maxAbsoluteError << " (element " << report.worstIndex << ")" << std::endl;
+	std::cout << "  max relative error: " << report.maxRelativeError << std::endl;
+	std::cout << "  RMS error: " << report.rmsError << std::endl;
+}
+
+// Scalar conversions, used for the elements the SIMD loops leave over
+
+static boost::uint16_t floatToHalf(float value)
+{
+	boost::uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	boost::uint16_t sign = (boost::uint16_t) ((bits >> 16) & 0x8000);
+	boost::int32_t exponent = (boost::int32_t) ((bits >> 23) & 0xFF) - 127 + 15;
+	boost::uint32_t mantissa = bits & 0x7FFFFF;
+
+	// NaN and infinity
+	if(((bits >> 23) & 0xFF) == 0xFF)
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+
+	// Too large for half: infinity
+	if(exponent >= 31)
+		return sign | 0x7C00;
+
+	// Subnormal half or zero
+	if(exponent <= 0) {
+		if(exponent < -10)
+			return sign;
+
+		mantissa |= 0x800000;
+		boost::uint32_t shift = (boost::uint32_t) (14 - exponent);
+		boost::uint32_t halfMantissa = mantissa >> shift;
+		boost::uint32_t remainder = mantissa & ((1u << shift) - 1);
+		boost::uint32_t halfway = 1u << (shift - 1);
+		if(remainder > halfway || (remainder == halfway && (halfMantissa & 1)))
+			halfMantissa++;
+		return sign | (boost::uint16_t) halfMantissa;
+	}
+
+	// Normal half, rounded to nearest even (a carry into the exponent is correct)
+	boost::uint32_t half = ((boost::uint32_t) exponent << 10) | (mantissa >> 13);
+	boost::uint32_t remainder = mantissa & 0x1FFF;
+	if(remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		half++;
+	return sign | (boost::uint16_t) half;
+}
+
+static float halfToFloat(boost::uint16_t value)
+{
+	boost::uint32_t sign = (boost::uint32_t) (value & 0x8000) << 16;
+	boost::uint32_t exponent = (value >> 10) & 0x1F;
+	boost::uint32_t mantissa = value & 0x3FF;
+	boost::uint32_t bits;
+
+	if(exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if(exponent != 0) {
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	else if(mantissa == 0) {
+		bits = sign;
+	}
+	else {
+		// Normalize the subnormal half
+		exponent = 127 - 15 + 1;
+		while((mantissa & 0x400) == 0) {
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+static boost::uint16_t floatToBfloat16(float value)
+{
+	boost::uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	// Keep NaNs quiet instead of letting the rounding turn them into infinity
+	if((bits & 0x7FFFFFFF) > 0x7F800000)
+		return (boost::uint16_t) ((bits >> 16) | 0x40);
+
+	bits += 0x7FFF + ((bits >> 16) & 1);
+	return (boost::uint16_t) (bits >> 16);
+}
+
+static float bfloat16ToFloat(boost::uint16_t value)
+{
+	boost::uint32_t bits = (boost::uint32_t) value << 16;
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+static boost::int8_t floatToInt8(float value, float inverseScale)
+{
+	float scaled = value * inverseScale;
+	if(scaled >= 127.0f)
+		return 127;
+	if(scaled <= -128.0f)
+		return -128;
+
+	// Nearest, ties to even, like _mm_cvtps_epi32 and the kernel's convert_char_sat_rte
+	float rounded = floor(scaled + 0.5f);
+	if(rounded - scaled == 0.5f && fmod(rounded, 2.0f) != 0)
+		rounded -= 1.0f;
+	return (boost::int8_t) rounded;
+}
@@ -0,0 +1,47 @@
+#ifndef _STORAGEFORMAT_H
+#define _STORAGEFORMAT_H
+
+#include <string>
+#include <boost/cstdint.hpp>
+
+/* Ramp inputs stored in reduced precision repeat every RAMP_PERIOD elements: the values are exact in half
+   and the sum of two stays far below its 65504 maximum. Float ramps do not wrap. */
+#define RAMP_PERIOD 2048
+
+namespace CLHelper
+{
+	/* How float data is stored in device memory. Kernels always compute in float. */
+	enum StorageFormat {
+		STORAGE_FLOAT,		/* 32-bit IEEE float */
+		STORAGE_HALF,		/* 16-bit IEEE half, through vload_half/vstore_half */
+		STORAGE_BF16,		/* upper 16 bits of a float, same range with 8 bits of mantissa */
+		STORAGE_INT8		/* signed 8-bit, scaled by a per-array factor */
+	};
+
+	std::string storageFormatToString(StorageFormat format);
+	bool storageFormatFromString(const std::string& formatString, StorageFormat* format);
+	size_t storageFormatSize(StorageFormat format);
+	std::string storageFormatDefine(StorageFormat format);		/* the kernel's -D name, empty for STORAGE_FLOAT */
+
+	/* Scale that maps the largest magnitude in data to 127, for STORAGE_INT8 */
+	float int8Scale(const float* data, size_t count);
+
+	/* Conversions between float and a storage format, vectorized where the host CPU allows it */
+	void encodeStorage(StorageFormat format, const float* input, size_t count, void* output, float scale = 1.0f);
+	void decodeStorage(StorageFormat format, const void* input, size_t count, float* output, float scale = 1.0f);
+
+	struct StorageErrorReport {
+		size_t count;
+		double maxAbsoluteError;
+		double maxRelativeError;		/* over elements whose reference is not zero */
+		double rmsError;
+		size_t worstIndex;
+
+		StorageErrorReport();
+	};
+
+	StorageErrorReport compareWithReference(const float* reference, const float* values, size_t count);
+	void printStorageErrorReport(StorageFormat format, const StorageErrorReport& report);
+};
+
+#endif
@@ -0,0 +1,298 @@
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <boost/bind/bind.hpp>
+#include "ThreadPool.h"
+
+#define IDLE_WAIT_MICROSECONDS 1000
+
+/* Passed through clSetEventCallback() */
+struct CompletionTask {
+	CLHelper::TaskGroup* group;
+	boost::function<void ()> task;
+};
+
+static void runRange(const boost::function<void (size_t, size_t)>& body, size_t first, size_t last);
+
+CLHelper::ThreadPool::ThreadPool(size_t threadCount, bool pinThreads)
+	: queuedTasks(0), nextQueue(0), stopping(false)
+{
+	if(threadCount == 0)
+		threadCount = std::max(boost::thread::hardware_concurrency(), 1u);
+
+	for(size_t i = 0; i < threadCount; i++)
+		queues.push_back(boost::shared_ptr<WorkerQueue>(new WorkerQueue()));
+
+	for(size_t i = 0; i < threadCount; i++)
+		threads.create_thread(boost::bind(&ThreadPool::workerLoop, this, i, pinThreads));
+}
+
+CLHelper::ThreadPool::~ThreadPool()
+{
+	{
+		boost::mutex::scoped_lock lock(idleMutex);
+		stopping = true;
+		idleCondition.notify_all();
+	}
+
+	threads.join_all();
+}
+
+CLHelper::ThreadPool& CLHelper::ThreadPool::shared()
+{
+	// Never destroyed: an exit() from a worker must not wait for that worker to join
+	static ThreadPool* pool = new ThreadPool();
+	return *pool;
+}
+
+size_t CLHelper::ThreadPool::getThreadCount() const
+{
+	return queues.size();
+}
+
+void CLHelper::ThreadPool::submit(const boost::function<void ()>& task)
+{
+	// Workers keep what they spawn local, other threads spread tasks round-robin
+	size_t* worker = currentWorker.get();
+	push(task, worker != NULL ? *worker : nextQueue++ % queues.size(), false);
+}
+
+void CLHelper::ThreadPool::parallelFor(size_t begin, size_t end, const boost::function<void (size_t, size_t)>& body, size_t grain)
+{
+	if(end <= begin)
+		return;
+
+	// A few ranges per worker leave room for stealing when ranges take unequal time
+	size_t count = end - begin;
+	if(grain == 0)
+		grain = std::max(count / (queues.size() * 4), (size_t) 1);
+
+	if(count <= grain) {
+		body(begin, end);
+		return;
+	}
+
+	TaskGroup group(*this);
+	for(size_t first = begin; first < end; first += grain)
+		group.run(boost::bind(&runRange, boost::cref(body), first, std::min(first + grain, end)));
+	group.wait();
+}
+
+void CLHelper::ThreadPool::parallelForAffine(size_t begin, size_t end, const boost::function<void (size_t, size_t)>& body)
+{
+	if(end <= begin)
+		return;
+
+	size_t count = end - begin;
+	size_t rangeSize = (count + queues.size() - 1) / queues.size();
+
+	TaskGroup group(*this);
+	for(size_t worker = 0; worker < queues.size() && begin + worker * rangeSize < end; worker++)
+	{
+		size_t first = begin + worker * rangeSize;
+		group.runAffine(boost::bind(&runRange, boost::cref(body), first, std::min(first + rangeSize, end)), worker);
+	}
+	group.wait();
+}
+
+bool CLHelper::ThreadPool::runPendingTask()
+{
+	size_t* worker = currentWorker.get();
+
+	Task task;
+	if(!take(worker != NULL ? *worker : queues.size(), &task))
+		return false;
+
+	task.function();
+	return true;
+}
+
+void CLHelper::ThreadPool::push(const boost::function<void ()>& function, size_t queueIndex, bool affine)
+{
+	Task task;
+	task.function = function;
+	task.affine = affine;
+
+	{
+		boost::mutex::scoped_lock lock(queues[queueIndex]->mutex);
+		queues[queueIndex]->tasks.push_back(task);
+	}
+
+	// Only the owner may run an affine task, and any worker might be the one woken
+	boost::mutex::scoped_lock lock(idleMutex);
+	queuedTasks++;
+	if(affine)
+		idleCondition.notify_all();
+	else
+		idleCondition.notify_one();
+}
+
+// Takes the newest task of the given worker, or steals the oldest task of another.
+// A queueIndex past the last worker (a thread outside the pool) only steals.
+bool CLHelper::ThreadPool::take(size_t queueIndex, Task* task)
+{
+	if(queueIndex < queues.size()) {
+		WorkerQueue& own = *queues[queueIndex];
+		boost::mutex::scoped_lock lock(own.mutex);
+		if(!own.tasks.empty()) {
+			*task = own.tasks.back();
+			own.tasks.pop_back();
+			queuedTasks--;
+			return true;
+		}
+	}
+
+	for(size_t offset = 1; offset <= queues.size(); offset++)
+	{
+		size_t victimIndex = (queueIndex + offset) % queues.size();
+		if(victimIndex == queueIndex)
+			continue;
+
+		WorkerQueue& victim = *queues[victimIndex];
+		boost::mutex::scoped_lock lock(victim.mutex);
+		if(!victim.tasks.empty() && !victim.tasks.front().affine) {
+			*task = victim.tasks.front();
+			victim.tasks.pop_front();
+			queuedTasks--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CLHelper::ThreadPool::workerLoop(size_t workerIndex, bool pinThread)
+{
+	currentWorker.reset(new size_t(workerIndex));
+
+#ifdef __linux__
+	// Pin worker i to the i-th CPU the process may use, so affine ranges stay on one NUMA node
+	cpu_set_t allowed;
+	if(pinThread && sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0) {
+		int target = (int) (workerIndex % CPU_COUNT(&allowed));
+		for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if(!CPU_ISSET(cpu, &allowed) || target-- > 0)
+				continue;
+
+			cpu_set_t single;
+			CPU_ZERO(&single);
+			CPU_SET(cpu, &single);
+			pthread_setaffinity_np(pthread_self(), sizeof(single), &single);
+			break;
+		}
+	}
+#endif
+
+	for(;;) {
+		Task task;
+		if(take(workerIndex, &task)) {
+			task.function();
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(idleMutex);
+		if(stopping && queuedTasks == 0)
+			break;
+
+		// Queued tasks may all be affine to other workers, so wake up now and then instead of sleeping for good
+		if(queuedTasks == 0 && !stopping)
+			idleCondition.wait(lock);
+		else
+			idleCondition.timed_wait(lock, boost::posix_time::microseconds(IDLE_WAIT_MICROSECONDS));
+	}
+}
+
+CLHelper::TaskGroup::TaskGroup(ThreadPool& pool)
+	: pool(pool), pending(0)
+{
+}
+
+CLHelper::TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+void CLHelper::TaskGroup::run(const boost::function<void ()>& task)
+{
+	pending++;
+	pool.submit(boost::bind(&TaskGroup::execute, this, task));
+}
+
+void CLHelper::TaskGroup::runAffine(const boost::function<void ()>& task, size_t workerIndex)
+{
+	pending++;
+	pool.push(boost::bind(&TaskGroup::execute, this, task), workerIndex, true);
+}
+
+#ifdef CL_VERSION_1_1
+void CLHelper::TaskGroup::runOnCompletion(cl::Event& event, const boost::function<void ()>& task)
+{
+	CompletionTask* completion = new CompletionTask();
+	completion->group = this;
+	completion->task = task;
+
+	pending++;
+	cl_int err = event.setCallback(CL_COMPLETE, &TaskGroup::eventCompleted, completion);
+	CHECK_OPENCL_ERROR(err, "cl::Event::setCallback() failed.");
+}
+#else
+void CLHelper::TaskGroup::runOnCompletion(cl::Event& event, const boost::function<void ()>& task)
+{
+	// No event callbacks before OpenCL 1.1
+	event.wait();
+	run(task);
+}
+#endif
+
+void CLHelper::TaskGroup::wait()
+{
+	while(pending > 0) {
+		if(pool.runPendingTask())
+			continue;
+
+		boost::mutex::scoped_lock lock(mutex);
+		if(pending > 0)
+			finished.timed_wait(lock, boost::posix_time::microseconds(IDLE_WAIT_MICROSECONDS));
+	}
+
+	// The last finishOne() may still hold the mutex
+	boost::mutex::scoped_lock lock(mutex);
+}
+
+void CLHelper::TaskGroup::execute(const boost::function<void ()>& task)
+{
+	task();
+	finishOne();
+}
+
+void CLHelper::TaskGroup::finishOne()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if(--pending == 0)
+		finished.notify_all();
+}
+
+#ifdef CL_VERSION_1_1
+// Called on a driver thread, so the task only gets queued here. A failed
+// command still releases the group, but its task is dropped.
+void CL_CALLBACK CLHelper::TaskGroup::eventCompleted(cl_event event, cl_int status, void* userData)
+{
+	CompletionTask* completion = (CompletionTask*) userData;
+	TaskGroup* group = completion->group;
+
+	if(status == CL_COMPLETE)
+		group->pool.submit(boost::bind(&TaskGroup::execute, group, completion->task));
+	else
+		group->finishOne();
+
+	delete completion;
+}
+#endif
+
+static void runRange(const boost::function<void (size_t, size_t)>& body, size_t first, size_t last)
+{
+	body(first, last);
+}
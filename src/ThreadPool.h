@@ -0,0 +1,115 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <deque>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	class TaskGroup;
+
+	/*
+	 * Host worker threads with one task deque each. A worker runs its own
+	 * newest task first and, when it runs dry, steals the oldest task of
+	 * another worker. Threads that wait for tasks (TaskGroup::wait(),
+	 * parallelFor()) run queued tasks meanwhile, so waiting inside a task
+	 * cannot deadlock the pool.
+	 */
+	class ThreadPool {
+
+	public:
+		explicit ThreadPool(size_t threadCount = 0, bool pinThreads = true);	/* 0 uses every core */
+		~ThreadPool();
+
+		/* The process-wide pool used by the host-side stages */
+		static ThreadPool& shared();
+
+		size_t getThreadCount() const;
+
+		void submit(const boost::function<void ()>& task);
+
+		/* Calls body(first, last) on subranges of [begin, end) of about grain elements (0 picks one) and waits */
+		void parallelFor(size_t begin, size_t end, const boost::function<void (size_t, size_t)>& body, size_t grain = 0);
+
+		/*
+		 * Splits [begin, end) into one contiguous range per worker and always gives
+		 * range i to worker i. Filling memory with this and processing it the same
+		 * way later keeps every page on the NUMA node of the thread that touched it
+		 * first, as long as the workers are pinned.
+		 */
+		void parallelForAffine(size_t begin, size_t end, const boost::function<void (size_t, size_t)>& body);
+
+		/* Runs one queued task on the calling thread, if there is one that may run here */
+		bool runPendingTask();
+
+	private:
+		friend class TaskGroup;
+
+		struct Task {
+			boost::function<void ()> function;
+			bool affine;			/* must run on the worker whose deque holds it */
+		};
+
+		struct WorkerQueue {
+			boost::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+		void push(const boost::function<void ()>& function, size_t queueIndex, bool affine);
+		bool take(size_t queueIndex, Task* task);
+		void workerLoop(size_t workerIndex, bool pinThread);
+
+		std::vector<boost::shared_ptr<WorkerQueue> > queues;
+		boost::thread_group threads;
+		boost::thread_specific_ptr<size_t> currentWorker;
+
+		boost::mutex idleMutex;
+		boost::condition_variable idleCondition;
+		boost::atomic<size_t> queuedTasks;
+		boost::atomic<size_t> nextQueue;
+		boost::atomic<bool> stopping;
+	};
+
+	/* Tasks that are waited for together */
+	class TaskGroup {
+
+	public:
+		explicit TaskGroup(ThreadPool& pool = ThreadPool::shared());
+		~TaskGroup();
+
+		void run(const boost::function<void ()>& task);
+
+		/* Runs the task on the pool once the event completes, instead of blocking a thread on it */
+		void runOnCompletion(cl::Event& event, const boost::function<void ()>& task);
+
+		void wait();
+
+	private:
+		friend class ThreadPool;
+
+		TaskGroup(const TaskGroup&);
+		TaskGroup& operator=(const TaskGroup&);
+
+		void runAffine(const boost::function<void ()>& task, size_t workerIndex);
+		void execute(const boost::function<void ()>& task);
+		void finishOne();
+
+#ifdef CL_VERSION_1_1
+		static void CL_CALLBACK eventCompleted(cl_event event, cl_int status, void* userData);
+#endif
+
+		ThreadPool& pool;
+		boost::atomic<size_t> pending;
+		boost::mutex mutex;
+		boost::condition_variable finished;
+	};
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include "DeviceCharacterization.h"
+#include "TiledEngine.h"
+#include "Validation.h"
+
+static bool tileFits(const CLHelper::DeviceInfo& deviceInfo, const CLHelper::TileShape& shape, size_t elementBytes, size_t localArrays, size_t workGroupLimit);
+static CLHelper::TileShape buildTiledKernels(CLHelper::Runtime& runtime, const size_t* extent, size_t halo, size_t localArrays, bool square, const char** kernelNames, cl::Kernel* kernels);
+static size_t nextPowerOfTwo(size_t value);
+
+CLHelper::TileShape::TileShape()
+	: dims(1), halo(0)
+{
+	for(int d = 0; d < 3; d++)
+	{
+		extent[d] = 1;
+		tile[d] = 1;
+		padded[d] = 1;
+	}
+}
+
+cl::NDRange CLHelper::TileShape::global() const
+{
+	if(dims == 3)
+		return cl::NDRange(padded[0], padded[1], padded[2]);
+	if(dims == 2)
+		return cl::NDRange(padded[0], padded[1]);
+	return cl::NDRange(padded[0]);
+}
+
+cl::NDRange CLHelper::TileShape::local() const
+{
+	if(dims == 3)
+		return cl::NDRange(tile[0], tile[1], tile[2]);
+	if(dims == 2)
+		return cl::NDRange(tile[0], tile[1]);
+	return cl::NDRange(tile[0]);
+}
+
+size_t CLHelper::TileShape::workGroupSize() const
+{
+	return tile[0] * tile[1] * tile[2];
+}
+
+size_t CLHelper::TileShape::stagedElements() const
+{
+	size_t elements = 1;
+	for(cl_uint d = 0; d < dims; d++)
+		elements *= tile[d] + 2 * halo;
+
+	return elements;
+}
+
+CLHelper::TileShape CLHelper::chooseTileShape(
+	const DeviceInfo& deviceInfo,
+	cl_uint dims,
+	const size_t* extent,
+	size_t halo,
+	size_t elementBytes,
+	size_t localArrays,
+	bool square,
+	size_t workGroupLimit)
+{
+	if(workGroupLimit == 0)
+		workGroupLimit = deviceInfo.maxWorkGroupSize;
+
+	TileShape shape;
+	shape.dims = std::max(std::min(dims, (cl_uint) 3), (cl_uint) 1);
+	shape.halo = halo;
+	for(cl_uint d = 0; d < shape.dims; d++)
+		shape.extent[d] = std::max(extent[d], (size_t) 1);
+
+	for(;;)
+	{
+		TileShape grown = shape;
+		if(square) {
+			bool capped = false;
+			for(cl_uint d = 0; d < shape.dims; d++)
+			{
+				capped = capped || shape.tile[d] >= nextPowerOfTwo(shape.extent[d]);
+				grown.tile[d] *= 2;
+			}
+			if(capped || !tileFits(deviceInfo, grown, elementBytes, localArrays, workGroupLimit))
+				break;
+			shape = grown;
+			continue;
+		}
+
+		// Try the dimensions from the smallest edge up, so tiles stay close to square
+		bool grew = false;
+		for(size_t edge = 1; !grew && edge <= shape.workGroupSize(); edge *= 2)
+		{
+			for(cl_uint d = 0; !grew && d < shape.dims; d++)
+			{
+				if(shape.tile[d] != edge || shape.tile[d] >= nextPowerOfTwo(shape.extent[d]))
+					continue;
+
+				grown = shape;
+				grown.tile[d] *= 2;
+				if(tileFits(deviceInfo, grown, elementBytes, localArrays, workGroupLimit)) {
+					shape = grown;
+					grew = true;
+				}
+			}
+		}
+		if(!grew)
+			break;
+	}
+
+	// Pad the range, the kernels skip the items past the extent
+	for(cl_uint d = 0; d < 3; d++)
+		shape.padded[d] = (shape.extent[d] + shape.tile[d] - 1) / shape.tile[d] * shape.tile[d];
+
+	return shape;
+}
+
+void CLHelper::defineTileShape(const TileShape& shape, Specialization* specialization)
+{
+	const char* names[] = { "TILE_X", "TILE_Y", "TILE_Z" };
+	for(cl_uint d = 0; d < shape.dims; d++)
+		specialization->define(names[d], shape.tile[d]);
+}
+
+void CLHelper::runTiledBenchmark(Runtime& runtime, size_t edge, size_t repetitions)
+{
+	cl_int err;
+
+	cl::Context& context = runtime.getContext();
+	cl::CommandQueue& commQueue = runtime.getQueues(0).front();
+	repetitions = std::max(repetitions, (size_t) 1);
+
+	size_t extent[2] = { edge, edge };
+	size_t elementCount = edge * edge;
+	size_t bytes = elementCount * sizeof(cl_float);
+
+	std::vector<float> dataA(elementCount), dataB(elementCount);
+	for(size_t i = 0; i < elementCount; i++)
+	{
+		dataA[i] = (float) ((i * 7919) % 1000) / 1000.0f;
+		dataB[i] = (float) ((i * 104729) % 1000) / 1000.0f;
+	}
+
+	cl::Buffer d_dataA(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &dataA[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_dataB(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &dataB[0], &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_naive(context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+	cl::Buffer d_tiled(context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+	CHECK_OPENCL_ERROR(err, "cl::Buffer::Buffer() failed.");
+
+	std::vector<float> naive(elementCount), tiled(elementCount);
+
+	std::cout << "Tiled kernel benchmark, " << edge << " x " << edge << ", average of " << repetitions << " runs:" << std::endl;
+
+	// 5-point stencil: one float staged per work-item plus a halo of one
+	cl::Kernel stencilKernels[2];
+	const char* stencilNames[] = { "stencil2DKernel", "stencil2DTiledKernel" };
+	TileShape stencilShape = buildTiledKernels(runtime, extent, 1, 1, false, stencilNames, stencilKernels);
+
+	cl::Buffer* outputs[] = { &d_naive, &d_tiled };
+	double stencilSeconds[2];
+	for(int variant = 0; variant < 2; variant++)
+	{
+		err  = stencilKernels[variant].setArg(0, d_dataA);
+		err |= stencilKernels[variant].setArg(1, *outputs[variant]);
+		err |= stencilKernels[variant].setArg(2, (cl_uint) edge);
+		err |= stencilKernels[variant].setArg(3, (cl_uint) edge);
+		err |= stencilKernels[variant].setArg(4, 0.6f);
+		err |= stencilKernels[variant].setArg(5, 0.1f);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		stencilSeconds[variant] = averageKernelSeconds(commQueue, stencilKernels[variant], stencilShape.global(), stencilShape.local(), repetitions);
+	}
+
+	err  = commQueue.enqueueReadBuffer(d_naive, CL_TRUE, 0, bytes, &naive[0]);
+	err |= commQueue.enqueueReadBuffer(d_tiled, CL_TRUE, 0, bytes, &tiled[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+	std::cout << "  stencil, tile " << stencilShape.tile[0] << " x " << stencilShape.tile[1]
+	          << ", padded to " << stencilShape.padded[0] << " x " << stencilShape.padded[1] << std::endl;
+	std::cout << "    naive: " << 1e3 * stencilSeconds[0] << " ms, " << elementCount / stencilSeconds[0] / 1e6 << " Mcells/s" << std::endl;
+	std::cout << "    tiled: " << 1e3 * stencilSeconds[1] << " ms, " << elementCount / stencilSeconds[1] / 1e6 << " Mcells/s"
+	          << ", speedup " << stencilSeconds[0] / stencilSeconds[1] << ", max difference " << maxDifference(&naive[0], &tiled[0], elementCount) << std::endl;
+
+	// Matmul: square tiles of A and B staged side by side
+	cl::Kernel matmulKernels[2];
+	const char* matmulNames[] = { "matmulKernel", "matmulTiledKernel" };
+	TileShape matmulShape = buildTiledKernels(runtime, extent, 0, 2, true, matmulNames, matmulKernels);
+
+	double matmulSeconds[2];
+	for(int variant = 0; variant < 2; variant++)
+	{
+		err  = matmulKernels[variant].setArg(0, d_dataA);
+		err |= matmulKernels[variant].setArg(1, d_dataB);
+		err |= matmulKernels[variant].setArg(2, *outputs[variant]);
+		err |= matmulKernels[variant].setArg(3, (cl_uint) edge);
+		err |= matmulKernels[variant].setArg(4, (cl_uint) edge);
+		err |= matmulKernels[variant].setArg(5, (cl_uint) edge);
+		CHECK_OPENCL_ERROR(err, "cl::Kernel::setArg() failed.");
+
+		matmulSeconds[variant] = averageKernelSeconds(commQueue, matmulKernels[variant], matmulShape.global(), matmulShape.local(), repetitions);
+	}
+
+	err  = commQueue.enqueueReadBuffer(d_naive, CL_TRUE, 0, bytes, &naive[0]);
+	err |= commQueue.enqueueReadBuffer(d_tiled, CL_TRUE, 0, bytes, &tiled[0]);
+	CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+
+	double flops = 2.0 * edge * edge * edge;
+	std::cout << "  matmul, tile " << matmulShape.tile[0] << " x " << matmulShape.tile[1]
+	          << ", padded to " << matmulShape.padded[0] << " x " << matmulShape.padded[1] << std::endl;
+	std::cout << "    naive: " << 1e3 * matmulSeconds[0] << " ms, " << flops / matmulSeconds[0] / 1e9 << " GFLOPS" << std::endl;
+	std::cout << "    tiled: " << 1e3 * matmulSeconds[1] << " ms, " << flops / matmulSeconds[1] / 1e9 << " GFLOPS"
+	          << ", speedup " << matmulSeconds[0] / matmulSeconds[1] << ", max relative difference " << maxDifference(&naive[0], &tiled[0], elementCount, true) << std::endl;
+}
+
+static bool tileFits(const CLHelper::DeviceInfo& deviceInfo, const CLHelper::TileShape& shape, size_t elementBytes, size_t localArrays, size_t workGroupLimit)
+{
+	if(shape.workGroupSize() > std::min((size_t) deviceInfo.maxWorkGroupSize, workGroupLimit))
+		return false;
+
+	for(cl_uint d = 0; d < shape.dims; d++)
+	{
+		if(deviceInfo.maxWorkItemSizes != NULL && d < deviceInfo.maxWorkItemDims && shape.tile[d] > deviceInfo.maxWorkItemSizes[d])
+			return false;
+	}
+
+	return localArrays * shape.stagedElements() * elementBytes <= deviceInfo.localMemSize;
+}
+
+// Builds the naive and tiled variant for the largest tile, halving the work-group until both built kernels
+// accept it: register use can lower CL_KERNEL_WORK_GROUP_SIZE below the device's limit, and the compiler's own
+// local memory comes on top of the staged tiles
+static CLHelper::TileShape buildTiledKernels(CLHelper::Runtime& runtime, const size_t* extent, size_t halo, size_t localArrays, bool square, const char** kernelNames, cl::Kernel* kernels)
+{
+	cl_int err;
+
+	CLHelper::DeviceInfo& deviceInfo = runtime.getDeviceInfo(0);
+	size_t workGroupLimit = deviceInfo.maxWorkGroupSize;
+	for(;;)
+	{
+		CLHelper::TileShape shape = CLHelper::chooseTileShape(deviceInfo, 2, extent, halo, sizeof(cl_float), localArrays, square, workGroupLimit);
+		CLHelper::Specialization specialization;
+		CLHelper::defineTileShape(shape, &specialization);
+		cl::Program program = runtime.getProgram("TiledKernels.cl", specialization);
+
+		size_t kernelWorkGroupSize = shape.workGroupSize();
+		cl_ulong kernelLocalMemSize = 0;
+		for(int variant = 0; variant < 2; variant++)
+		{
+			kernels[variant] = cl::Kernel(program, kernelNames[variant], &err);
+			CHECK_OPENCL_ERROR(err, "cl::Kernel::Kernel() failed.");
+
+			size_t workGroupSize;
+			cl_ulong localMemSize;
+			err  = kernels[variant].getWorkGroupInfo(runtime.getDevice(0), CL_KERNEL_WORK_GROUP_SIZE, &workGroupSize);
+			err |= kernels[variant].getWorkGroupInfo(runtime.getDevice(0), CL_KERNEL_LOCAL_MEM_SIZE, &localMemSize);
+			CHECK_OPENCL_ERROR(err, "cl::Kernel::getWorkGroupInfo() failed.");
+			kernelWorkGroupSize = std::min(kernelWorkGroupSize, workGroupSize);
+			kernelLocalMemSize = std::max(kernelLocalMemSize, localMemSize);
+		}
+
+		bool fits = kernelWorkGroupSize >= shape.workGroupSize() && kernelLocalMemSize <= deviceInfo.localMemSize;
+		if(fits || shape.workGroupSize() == 1)
+			return shape;
+		workGroupLimit = std::max(std::min(kernelWorkGroupSize, shape.workGroupSize() / 2), (size_t) 1);
+	}
+}
+
+static size_t nextPowerOfTwo(size_t value)
+{
+	size_t power = 1;
+	while(power < value)
+		power *= 2;
+
+	return power;
+}
@@ -0,0 +1,52 @@
+#ifndef _TILEDENGINE_H
+#define _TILEDENGINE_H
+
+#include "CLHelper.h"
+#include "KernelSpecializer.h"
+#include "Runtime.h"
+
+namespace CLHelper
+{
+	/* A 1D, 2D or 3D range cut into work-group sized tiles */
+	struct TileShape {
+		cl_uint dims;
+		size_t extent[3];		/* problem size, 1 in unused dimensions */
+		size_t tile[3];			/* work-items per work-group */
+		size_t padded[3];		/* extent rounded up to a multiple of tile */
+		size_t halo;			/* neighbours read on each side of a tile */
+
+		TileShape();
+
+		cl::NDRange global() const;
+		cl::NDRange local() const;
+		size_t workGroupSize() const;
+		size_t stagedElements() const;		/* of one local array holding a tile and its halo */
+	};
+
+	/*
+	 * Picks the largest tile the device allows: the work-group must fit
+	 * maxWorkGroupSize and maxWorkItemSizes, and localArrays arrays of the
+	 * tile with its halo must fit localMemSize. Tiles grow by doubling the
+	 * smallest edge, x first, and never beyond the next power of two of the
+	 * extent. Square tiles are kept equal in every dimension. A non-zero
+	 * workGroupLimit, such as a built kernel's CL_KERNEL_WORK_GROUP_SIZE,
+	 * caps the work-group further.
+	 */
+	TileShape chooseTileShape(
+		const DeviceInfo& deviceInfo,
+		cl_uint dims,
+		const size_t* extent,
+		size_t halo = 0,
+		size_t elementBytes = sizeof(cl_float),
+		size_t localArrays = 1,
+		bool square = false,
+		size_t workGroupLimit = 0);
+
+	/* Defines TILE_X, TILE_Y and TILE_Z for kernels sizing their local arrays by the tile */
+	void defineTileShape(const TileShape& shape, Specialization* specialization);
+
+	/* Compares the naive and tiled 2D stencil and matmul of TiledKernels.cl on the runtime's first device */
+	void runTiledBenchmark(Runtime& runtime, size_t edge, size_t repetitions);
+};
+
+#endif
@@ -0,0 +1,121 @@
+// 2D kernels for the tiled engine, each in a naive global memory version and a
+// tiled version staging its inputs through local memory. The host defines
+// TILE_X and TILE_Y as the work-group size (see CLHelper::defineTileShape());
+// the global range is padded up to a multiple of it, so every kernel checks
+// its bounds, but only after the last barrier.
+
+#ifndef TILE_X
+#define TILE_X 16
+#endif
+#ifndef TILE_Y
+#define TILE_Y 16
+#endif
+
+// Radius of the 5-point stencil
+#define HALO 1
+
+// Jacobi step out = center * in + neighbour * (sum of the 4 neighbours),
+// with the grid clamped at its edges
+__kernel
+void stencil2DKernel(__global const float* input, __global float* output, unsigned int width, unsigned int height, float center, float neighbour)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	if(x >= (int) width || y >= (int) height)
+		return;
+
+	int left = max(x - 1, 0);
+	int right = min(x + 1, (int) width - 1);
+	int up = max(y - 1, 0);
+	int down = min(y + 1, (int) height - 1);
+
+	output[y * width + x] = center * input[y * width + x]
+		+ neighbour * (input[y * width + left] + input[y * width + right] + input[up * width + x] + input[down * width + x]);
+}
+
+// stencil2DKernel reading every input once per work-group: the work-group
+// loads its tile plus a HALO wide border into local memory, then computes
+// from there
+__kernel
+void stencil2DTiledKernel(__global const float* input, __global float* output, unsigned int width, unsigned int height, float center, float neighbour)
+{
+	__local float tile[TILE_Y + 2 * HALO][TILE_X + 2 * HALO];
+
+	int localX = get_local_id(0);
+	int localY = get_local_id(1);
+	int originX = get_group_id(0) * TILE_X - HALO;
+	int originY = get_group_id(1) * TILE_Y - HALO;
+
+	// The tile with its halo has more elements than the work-group has items, so they take turns
+	for(int index = localY * TILE_X + localX; index < (TILE_X + 2 * HALO) * (TILE_Y + 2 * HALO); index += TILE_X * TILE_Y)
+	{
+		int tileX = index % (TILE_X + 2 * HALO);
+		int tileY = index / (TILE_X + 2 * HALO);
+		int x = clamp(originX + tileX, 0, (int) width - 1);
+		int y = clamp(originY + tileY, 0, (int) height - 1);
+		tile[tileY][tileX] = input[y * width + x];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if(x >= (int) width || y >= (int) height)
+		return;
+
+	int tileX = localX + HALO;
+	int tileY = localY + HALO;
+	output[y * width + x] = center * tile[tileY][tileX]
+		+ neighbour * (tile[tileY][tileX - 1] + tile[tileY][tileX + 1] + tile[tileY - 1][tileX] + tile[tileY + 1][tileX]);
+}
+
+// C = A * B for row major A (rows x inner) and B (inner x columns)
+__kernel
+void matmulKernel(__global const float* dataA, __global const float* dataB, __global float* dataC, unsigned int rows, unsigned int columns, unsigned int inner)
+{
+	unsigned int column = get_global_id(0);
+	unsigned int row = get_global_id(1);
+
+	if(column >= columns || row >= rows)
+		return;
+
+	float sum = 0.0f;
+	for(unsigned int k = 0; k < inner; k++)
+		sum += dataA[row * inner + k] * dataB[k * columns + column];
+
+	dataC[row * columns + column] = sum;
+}
+
+// matmulKernel over square tiles: for every step along the inner dimension the
+// work-group loads one tile of A and one of B, zero padded past the edges, so
+// each element loaded from global memory is used TILE_X times. Needs square tiles.
+#if TILE_X == TILE_Y
+__kernel
+void matmulTiledKernel(__global const float* dataA, __global const float* dataB, __global float* dataC, unsigned int rows, unsigned int columns, unsigned int inner)
+{
+	__local float tileA[TILE_Y][TILE_X];
+	__local float tileB[TILE_Y][TILE_X];
+
+	unsigned int localX = get_local_id(0);
+	unsigned int localY = get_local_id(1);
+	unsigned int column = get_global_id(0);
+	unsigned int row = get_global_id(1);
+
+	float sum = 0.0f;
+	for(unsigned int step = 0; step < inner; step += TILE_X)
+	{
+		unsigned int k = step + localX;
+		tileA[localY][localX] = (row < rows && k < inner) ? dataA[row * inner + k] : 0.0f;
+		k = step + localY;
+		tileB[localY][localX] = (k < inner && column < columns) ? dataB[k * columns + column] : 0.0f;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for(unsigned int i = 0; i < TILE_X; i++)
+			sum += tileA[localY][i] * tileB[i][localX];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(column < columns && row < rows)
+		dataC[row * columns + column] = sum;
+}
+#endif
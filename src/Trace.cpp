@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "Trace.h"
+
+/* How long write() waits for device spans whose events have not completed yet */
+#define PENDING_WAIT_MILLISECONDS 1000
+
+namespace pt = boost::posix_time;
+
+static void writeTraceAtExit();
+static std::string escapeJson(const std::string& text);
+
+bool CLHelper::Trace::enabled = false;
+
+CLHelper::Trace& CLHelper::Trace::shared()
+{
+	static Trace trace;
+	return trace;
+}
+
+void CLHelper::Trace::start(const std::string& path)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	this->path = path;
+	origin = pt::microsec_clock::universal_time();
+	hostTracks = 0;
+
+	if(!enabled)
+		atexit(&writeTraceAtExit);
+	enabled = true;
+}
+
+double CLHelper::Trace::now() const
+{
+	return (pt::microsec_clock::universal_time() - origin).total_microseconds();
+}
+
+void CLHelper::Trace::addHostSpan(const char* name, const char* category, double begin, double end)
+{
+	if(!enabled)
+		return;
+
+	Span span;
+	span.name = name;
+	span.category = category;
+	span.device = NULL;
+	span.begin = begin;
+	span.end = end;
+
+	boost::mutex::scoped_lock lock(mutex);
+	span.track = getHostTrack();
+	spans.push_back(span);
+}
+
+#ifdef CL_VERSION_1_1
+void CLHelper::Trace::addDeviceSpan(cl::Event& event, const std::string& name, const cl::Device& device)
+{
+	if(!enabled)
+		return;
+
+	PendingSpan* pendingSpan = new PendingSpan();
+	pendingSpan->trace = this;
+	pendingSpan->name = name;
+	pendingSpan->device = device();
+
+	addDeviceTrack(device);
+
+	pending++;
+	if(event.setCallback(CL_COMPLETE, &Trace::eventCompleted, pendingSpan) != CL_SUCCESS) {
+		pending--;
+		delete pendingSpan;
+	}
+}
+#else
+void CLHelper::Trace::addDeviceSpan(cl::Event& event, const std::string& name, const cl::Device& device)
+{
+	if(!enabled)
+		return;
+
+	// No event callbacks before OpenCL 1.1
+	addDeviceTrack(device);
+
+	event.wait();
+	deviceSpanCompleted(event(), name, device());
+}
+#endif
+
+void CL_CALLBACK CLHelper::Trace::eventCompleted(cl_event event, cl_int status, void* data)
+{
+	PendingSpan* pendingSpan = (PendingSpan*) data;
+	Trace* trace = pendingSpan->trace;
+
+	if(status == CL_COMPLETE)
+		trace->deviceSpanCompleted(event, pendingSpan->name, pendingSpan->device);
+	delete pendingSpan;
+
+	boost::mutex::scoped_lock lock(trace->mutex);
+	trace->pending--;
+	trace->pendingDone.notify_all();
+}
+
+/*
+ * The device clock is mapped to the host clock by the smallest difference
+ * seen between a command's end and the moment the host learned it had ended,
+ * which bounds the callback latency from below
+ */
+void CLHelper::Trace::deviceSpanCompleted(cl_event event, const std::string& name, cl_device_id device)
+{
+	double observed = now();
+
+	cl_ulong start, end;
+	if(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS
+			|| clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) != CL_SUCCESS)
+		return;
+
+	Span span;
+	span.name = name;
+	span.category = "device";
+	span.device = device;
+	span.begin = start / 1000.0;
+	span.end = end / 1000.0;
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::map<cl_device_id, double>::iterator offset = clockOffsets.find(device);
+	if(offset == clockOffsets.end())
+		clockOffsets[device] = observed - span.end;
+	else
+		offset->second = std::min(offset->second, observed - span.end);
+
+	span.track = deviceTracks[device];
+	spans.push_back(span);
+}
+
+void CLHelper::Trace::write()
+{
+	if(!enabled)
+		return;
+
+	boost::mutex::scoped_lock lock(mutex);
+	pt::ptime deadline = pt::microsec_clock::universal_time() + pt::milliseconds(PENDING_WAIT_MILLISECONDS);
+	while(pending > 0 && pendingDone.timed_wait(lock, deadline)) {}
+
+	std::ofstream file(path.c_str());
+	if(!file.good()) {
+		std::cerr << "Unable to write the trace to \"" << path << "\"." << std::endl;
+		return;
+	}
+
+	// Host threads are process 0, devices process 1 with one thread each
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"host\"}}," << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"devices\"}}";
+
+	for(size_t track = 0; track < hostTracks; track++)
+	{
+		file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << track
+			 << ",\"args\":{\"name\":\"thread " << track << "\"}}";
+	}
+	for(size_t track = 0; track < deviceNames.size(); track++)
+	{
+		file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track
+			 << ",\"args\":{\"name\":\"" << escapeJson(deviceNames[track]) << " #" << track << "\"}}";
+	}
+
+	char timing[64];
+	for(size_t i = 0; i < spans.size(); i++)
+	{
+		const Span& span = spans[i];
+		double offset = (span.device != NULL) ? clockOffsets[span.device] : 0.0;
+
+		sprintf(timing, "%.3f,\"dur\":%.3f", span.begin + offset, span.end - span.begin);
+		file << "," << std::endl << "{\"name\":\"" << escapeJson(span.name) << "\",\"cat\":\"" << span.category
+			 << "\",\"ph\":\"X\",\"ts\":" << timing << ",\"pid\":" << (span.device != NULL ? 1 : 0) << ",\"tid\":" << span.track << "}";
+	}
+
+	file << std::endl << "]}" << std::endl;
+
+	std::cout << "Trace of " << spans.size() << " spans written to \"" << path << "\"" << std::endl;
+}
+
+size_t CLHelper::Trace::getHostTrack()
+{
+	if(hostTrack.get() == NULL)
+		hostTrack.reset(new size_t(hostTracks++));
+	return *hostTrack;
+}
+
+void CLHelper::Trace::addDeviceTrack(const cl::Device& device)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if(deviceTracks.count(device()) > 0)
+		return;
+
+	deviceTracks[device()] = deviceNames.size();
+	deviceNames.push_back(device.getInfo<CL_DEVICE_NAME>());
+}
+
+static void writeTraceAtExit()
+{
+	CLHelper::Trace::shared().write();
+}
+
+static std::string escapeJson(const std::string& text)
+{
+	std::string escaped;
+	for(size_t i = 0; i < text.size(); i++)
+	{
+		unsigned char c = text[i];
+		if(c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if(c < 0x20) {
+			char code[8];
+			sprintf(code, "\\u%04x", c);
+			escaped += code;
+		}
+		else
+			escaped += c;
+	}
+	return escaped;
+}
@@ -0,0 +1,113 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include "CLHelper.h"
+
+namespace CLHelper
+{
+	/*
+	 * Timeline of one run in the Chrome trace event format, for chrome://tracing
+	 * or ui.perfetto.dev. Host spans come from TRACE_SCOPE on the thread that
+	 * ran them, device spans from the profiling timestamps of completed
+	 * commands, one track per device. Until start() is called every entry
+	 * point returns after testing a single flag.
+	 */
+	class Trace {
+
+	public:
+		static Trace& shared();
+		static bool isEnabled() { return enabled; }
+
+		/* Starts recording, the file is written when the process exits */
+		void start(const std::string& path);
+		void write();
+
+		/* Microseconds since start() on the host clock */
+		double now() const;
+
+		void addHostSpan(const char* name, const char* category, double begin, double end);
+
+		/*
+		 * Records the command behind event once it completes, on the track of
+		 * the device. Needs a queue with CL_QUEUE_PROFILING_ENABLE; events of
+		 * other queues are skipped.
+		 */
+		void addDeviceSpan(cl::Event& event, const std::string& name, const cl::Device& device);
+
+	private:
+		struct Span {
+			std::string name;
+			const char* category;
+			cl_device_id device;		/* NULL for host spans */
+			size_t track;				/* host thread or device */
+			double begin;				/* microseconds, device spans on the device clock */
+			double end;
+		};
+
+		struct PendingSpan {
+			Trace* trace;
+			std::string name;
+			cl_device_id device;
+		};
+
+		Trace() : hostTracks(0), pending(0) {}
+		Trace(const Trace&);
+		Trace& operator=(const Trace&);
+
+		size_t getHostTrack();
+		void addDeviceTrack(const cl::Device& device);
+		void deviceSpanCompleted(cl_event event, const std::string& name, cl_device_id device);
+		static void CL_CALLBACK eventCompleted(cl_event event, cl_int status, void* data);
+
+		static bool enabled;
+
+		std::string path;
+		boost::posix_time::ptime origin;
+
+		boost::mutex mutex;
+		std::vector<Span> spans;
+		std::map<cl_device_id, double> clockOffsets;	/* host minus device clock, microseconds */
+		std::map<cl_device_id, size_t> deviceTracks;
+		std::vector<std::string> deviceNames;		/* by track */
+		size_t hostTracks;
+		boost::thread_specific_ptr<size_t> hostTrack;
+
+		boost::atomic<size_t> pending;		/* device spans whose events have not completed */
+		boost::condition_variable pendingDone;
+	};
+
+	/* Records the enclosing scope as a host span */
+	class TraceScope {
+
+	public:
+		TraceScope(const char* name, const char* category = "host") : name(name), category(category)
+		{
+			begin = Trace::isEnabled() ? Trace::shared().now() : 0;
+		}
+
+		~TraceScope()
+		{
+			if(Trace::isEnabled())
+				Trace::shared().addHostSpan(name, category, begin, Trace::shared().now());
+		}
+
+	private:
+		const char* name;
+		const char* category;
+		double begin;
+	};
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+#define TRACE_SCOPE(name) CLHelper::TraceScope TRACE_CONCATENATE(traceScope, __LINE__)(name)
+
+#endif
@@ -0,0 +1,396 @@
+#include <cstring>
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "TransferStrategy.h"
+#include "DeviceCharacterization.h"
+#include "Trace.h"
+
+#define CALIBRATION_BYTES (4 * 1024 * 1024)
+#define CALIBRATION_REPETITIONS 3
+
+namespace pt = boost::posix_time;
+
+/* Calibrated choices per device, since calibrating costs a few round trips */
+static std::map<cl_device_id, std::pair<CLHelper::TransferStrategy, std::string> > calibratedStrategies;
+static boost::mutex calibrationMutex;
+
+static const CLHelper::TransferStrategy candidateStrategies[] = {
+	CLHelper::TRANSFER_USE_HOST_PTR,
+	CLHelper::TRANSFER_MAP,
+	CLHelper::TRANSFER_COPY_HOST_PTR,
+	CLHelper::TRANSFER_READ_WRITE,
+	CLHelper::TRANSFER_SVM
+};
+
+std::string CLHelper::transferStrategyToString(TransferStrategy strategy)
+{
+	switch(strategy) {
+	case TRANSFER_AUTO:
+		return "auto";
+	case TRANSFER_USE_HOST_PTR:
+		return "use-host-ptr";
+	case TRANSFER_MAP:
+		return "map";
+	case TRANSFER_COPY_HOST_PTR:
+		return "copy-host-ptr";
+	case TRANSFER_READ_WRITE:
+		return "read-write";
+	case TRANSFER_SVM:
+		return "svm";
+	}
+
+	return "unknown";
+}
+
+bool CLHelper::parseTransferStrategy(const std::string& strategyString, TransferStrategy* strategy)
+{
+	if(strategyString == "auto")
+		*strategy = TRANSFER_AUTO;
+	else if(strategyString == "use-host-ptr")
+		*strategy = TRANSFER_USE_HOST_PTR;
+	else if(strategyString == "map")
+		*strategy = TRANSFER_MAP;
+	else if(strategyString == "copy-host-ptr")
+		*strategy = TRANSFER_COPY_HOST_PTR;
+	else if(strategyString == "read-write")
+		*strategy = TRANSFER_READ_WRITE;
+	else if(strategyString == "svm")
+		*strategy = TRANSFER_SVM;
+	else
+		return false;
+
+	return true;
+}
+
+bool CLHelper::isTransferStrategySupported(TransferStrategy strategy, cl::Device& device, DeviceInfo& deviceInfo)
+{
+	if(strategy == TRANSFER_AUTO)
+		return false;
+
+	if(strategy == TRANSFER_SVM) {
+#ifdef CL_VERSION_2_0
+		if(parseOpenCLVersion(deviceInfo.deviceVersion) < 200)
+			return false;
+
+		cl_device_svm_capabilities svmCapabilities = 0;
+		if(device.getInfo(CL_DEVICE_SVM_CAPABILITIES, &svmCapabilities) != CL_SUCCESS)
+			return false;
+
+		return (svmCapabilities & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER) != 0;
+#else
+		return false;
+#endif
+	}
+
+	return true;
+}
+
+// Chooses how to move data for one device. A roofline profile's measured transfer
+// rates are used when there is one, otherwise every supported strategy is timed on
+// a round trip of a small array. Devices sharing host memory win ties with USE_HOST_PTR.
+CLHelper::TransferStrategy CLHelper::selectTransferStrategy(
+	cl::Context& context,
+	cl::CommandQueue& commQueue,
+	cl::Device& device,
+	DeviceInfo& deviceInfo,
+	size_t size,
+	std::string* reason)
+{
+	TRACE_SCOPE("selectTransferStrategy");
+	boost::mutex::scoped_lock lock(calibrationMutex);
+
+	std::map<cl_device_id, std::pair<TransferStrategy, std::string> >::iterator calibrated = calibratedStrategies.find(device());
+	if(calibrated != calibratedStrategies.end()) {
+		if(reason != NULL)
+			*reason = calibrated->second.second;
+		return calibrated->second.first;
+	}
+
+	TransferStrategy bestStrategy = deviceInfo.hostUnifiedMem ? TRANSFER_USE_HOST_PTR : TRANSFER_READ_WRITE;
+	std::string bestReason = deviceInfo.hostUnifiedMem ? "device shares host memory" : "discrete device";
+
+	RooflineProfile profile;
+	if(loadRooflineProfile(device, &profile) && profile.readWriteHostToDevice > 0) {
+		// Seconds per byte for a round trip with each strategy
+		double readWriteCost = 1.0 / profile.readWriteHostToDevice + 1.0 / profile.readWriteDeviceToHost;
+		double mapCost = 1.0 / profile.mapHostToDevice + 1.0 / profile.mapDeviceToHost;
+		double hostPtrCost = 1.0 / profile.hostPtrHostToDevice + 1.0 / profile.hostPtrDeviceToHost;
+
+		double bestCost = readWriteCost;
+		bestStrategy = TRANSFER_READ_WRITE;
+		if(mapCost < bestCost) {
+			bestCost = mapCost;
+			bestStrategy = TRANSFER_MAP;
+		}
+		// Ties go to USE_HOST_PTR, which leaves no second copy of the arrays
+		if(hostPtrCost <= bestCost) {
+			bestStrategy = TRANSFER_USE_HOST_PTR;
+		}
+		bestReason = "fastest in roofline profile";
+	}
+	else {
+		size_t calibrationSize = std::min(size, (size_t) CALIBRATION_BYTES);
+		std::vector<char> hostData(calibrationSize, 1);
+
+		// Fastest round trip of every supported strategy, negative for the unsupported ones
+		std::map<TransferStrategy, double> strategySeconds;
+		for(size_t candidate = 0; candidate < sizeof(candidateStrategies) / sizeof(candidateStrategies[0]); candidate++)
+		{
+			TransferStrategy strategy = candidateStrategies[candidate];
+			strategySeconds[strategy] = -1;
+			if(!isTransferStrategySupported(strategy, device, deviceInfo))
+				continue;
+
+			TransferBuffer transferBuffer(context, commQueue, strategy, CL_MEM_READ_WRITE, calibrationSize, &hostData[0]);
+			for(int rep = 0; rep < CALIBRATION_REPETITIONS; rep++)
+			{
+				pt::ptime start = pt::microsec_clock::universal_time();
+				transferBuffer.upload();
+				transferBuffer.download();
+				transferBuffer.release();
+				commQueue.finish();
+				double seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+				if(strategySeconds[strategy] < 0 || seconds < strategySeconds[strategy])
+					strategySeconds[strategy] = seconds;
+			}
+		}
+
+		// Start from the hostUnifiedMem-based default, a strict comparison keeps it on ties
+		double bestSeconds = strategySeconds[bestStrategy];
+		for(size_t candidate = 0; candidate < sizeof(candidateStrategies) / sizeof(candidateStrategies[0]); candidate++)
+		{
+			TransferStrategy strategy = candidateStrategies[candidate];
+			double seconds = strategySeconds[strategy];
+			if(seconds >= 0 && (bestSeconds < 0 || seconds < bestSeconds)) {
+				bestSeconds = seconds;
+				bestStrategy = strategy;
+			}
+		}
+
+		std::ostringstream calibrationReason;
+		calibrationReason << "fastest round trip of " << calibrationSize / 1024 << " KB";
+		bestReason = calibrationReason.str();
+	}
+
+	calibratedStrategies[device()] = std::make_pair(bestStrategy, bestReason);
+
+	if(reason != NULL)
+		*reason = bestReason;
+	return bestStrategy;
+}
+
+CLHelper::TransferBuffer::TransferBuffer(
+	cl::Context& context,
+	cl::CommandQueue& commQueue,
+	TransferStrategy strategy,
+	cl_mem_flags access,
+	size_t size,
+	void* hostData)
+	: context(context),
+	  commQueue(commQueue),
+	  strategy(strategy),
+	  size(size),
+	  hostData(hostData),
+	  svmPointer(NULL),
+	  fineGrained(false),
+	  mappedPointer(NULL),
+	  uploaded(false)
+{
+	TRACE_SCOPE("createBuffer");
+	cl_int err = CL_SUCCESS;
+
+	switch(strategy) {
+	case TRANSFER_USE_HOST_PTR:
+		buffer = cl::Buffer(context, access | CL_MEM_USE_HOST_PTR, size, hostData, &err);
+		break;
+	case TRANSFER_MAP:
+		buffer = cl::Buffer(context, access | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+		break;
+	case TRANSFER_COPY_HOST_PTR:
+		buffer = cl::Buffer(context, access | CL_MEM_COPY_HOST_PTR, size, hostData, &err);
+		break;
+	case TRANSFER_READ_WRITE:
+		buffer = cl::Buffer(context, access, size, NULL, &err);
+		break;
+	case TRANSFER_SVM:
+#ifdef CL_VERSION_2_0
+	{
+		// Prefer fine-grained buffers, which the host can access without mapping
+		cl::Device device;
+		commQueue.getInfo(CL_QUEUE_DEVICE, &device);
+		cl_device_svm_capabilities svmCapabilities = 0;
+		device.getInfo(CL_DEVICE_SVM_CAPABILITIES, &svmCapabilities);
+		fineGrained = (svmCapabilities & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0;
+
+		svmPointer = clSVMAlloc(context(), access | (fineGrained ? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0), size, 0);
+		if(svmPointer == NULL)
+			err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+		break;
+	}
+#endif
+	default:
+		std::cerr << "Unsupported transfer strategy: " << transferStrategyToString(strategy) << std::endl;
+		exit(1);
+	}
+	CHECK_OPENCL_ERROR(err, "TransferBuffer::TransferBuffer() failed.");
+}
+
+CLHelper::TransferBuffer::~TransferBuffer()
+{
+	release();
+
+#ifdef CL_VERSION_2_0
+	if(svmPointer != NULL) {
+		commQueue.finish();
+		clSVMFree(context(), svmPointer);
+	}
+#endif
+}
+
+// Makes the host array's contents visible to the device. Transfers are
+// enqueued without blocking, so the host array must stay untouched until
+// the next blocking call on the queue.
+void CLHelper::TransferBuffer::upload()
+{
+	TRACE_SCOPE("upload");
+	cl_int err = CL_SUCCESS;
+
+#ifdef CL_VERSION_1_2
+	cl_map_flags writeMapFlags = CL_MAP_WRITE_INVALIDATE_REGION;
+#else
+	cl_map_flags writeMapFlags = CL_MAP_WRITE;
+#endif
+
+	release();
+
+	switch(strategy) {
+	case TRANSFER_USE_HOST_PTR:
+		// Synchronizes the device's view of the host array, free on zero-copy devices
+		mappedPointer = commQueue.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_WRITE, 0, size, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		break;
+	case TRANSFER_MAP:
+		mappedPointer = commQueue.enqueueMapBuffer(buffer, CL_TRUE, writeMapFlags, 0, size, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		memcpy(mappedPointer, hostData, size);
+		break;
+	case TRANSFER_COPY_HOST_PTR:
+		// The buffer was created with a copy of the host array, so the first upload has nothing to do
+		if(!uploaded)
+			break;
+		/* fall through */
+	case TRANSFER_READ_WRITE:
+		err = commQueue.enqueueWriteBuffer(buffer, CL_FALSE, 0, size, hostData);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueWriteBuffer() failed.");
+		break;
+	case TRANSFER_SVM:
+#ifdef CL_VERSION_2_0
+		// Fine-grained memory is coherent at kernel launch, so writing it is enough
+		if(fineGrained) {
+			memcpy(svmPointer, hostData, size);
+			break;
+		}
+
+		err = clEnqueueSVMMap(commQueue(), CL_TRUE, writeMapFlags, svmPointer, size, 0, NULL, NULL);
+		CHECK_OPENCL_ERROR(err, "clEnqueueSVMMap() failed.");
+		memcpy(svmPointer, hostData, size);
+		mappedPointer = svmPointer;
+#endif
+		break;
+	default:
+		break;
+	}
+
+	uploaded = true;
+	release();
+}
+
+// Makes the device's results readable on the host and returns where to read
+// them, which is the host array or mapped memory depending on the strategy
+void* CLHelper::TransferBuffer::download()
+{
+	return download(0, size);
+}
+
+void* CLHelper::TransferBuffer::download(size_t offset, size_t bytes)
+{
+	TRACE_SCOPE("download");
+	cl_int err;
+
+	release();
+
+	switch(strategy) {
+	case TRANSFER_USE_HOST_PTR:
+	case TRANSFER_MAP:
+		mappedPointer = commQueue.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_READ, offset, bytes, NULL, NULL, &err);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueMapBuffer() failed.");
+		return mappedPointer;
+	case TRANSFER_COPY_HOST_PTR:
+	case TRANSFER_READ_WRITE:
+		err = commQueue.enqueueReadBuffer(buffer, CL_TRUE, offset, bytes, (char*) hostData + offset);
+		CHECK_OPENCL_ERROR(err, "cl::CommandQueue::enqueueReadBuffer() failed.");
+		return (char*) hostData + offset;
+	case TRANSFER_SVM:
+#ifdef CL_VERSION_2_0
+		if(fineGrained) {
+			err = commQueue.finish();
+			CHECK_OPENCL_ERROR(err, "cl::CommandQueue::finish() failed.");
+			return (char*) svmPointer + offset;
+		}
+
+		mappedPointer = (char*) svmPointer + offset;
+		err = clEnqueueSVMMap(commQueue(), CL_TRUE, CL_MAP_READ, mappedPointer, bytes, 0, NULL, NULL);
+		CHECK_OPENCL_ERROR(err, "clEnqueueSVMMap() failed.");
+		return mappedPointer;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+void CLHelper::TransferBuffer::release()
+{
+	if(mappedPointer == NULL)
+		return;
+
+	cl_int err;
+#ifdef CL_VERSION_2_0
+	if(strategy == TRANSFER_SVM)
+		err = clEnqueueSVMUnmap(commQueue(), mappedPointer, 0, NULL, NULL);
+	else
+#endif
+		err = commQueue.enqueueUnmapMemObject(buffer, mappedPointer);
+	CHECK_OPENCL_ERROR(err, "Unmapping a TransferBuffer failed.");
+
+	mappedPointer = NULL;
+}
+
+cl_int CLHelper::TransferBuffer::setAsKernelArg(cl::Kernel& kernel, cl_uint index)
+{
+#ifdef CL_VERSION_2_0
+	if(strategy == TRANSFER_SVM)
+		return clSetKernelArgSVMPointer(kernel(), index, svmPointer);
+#endif
+
+	return kernel.setArg(index, buffer);
+}
+
+cl_int CLHelper::TransferBuffer::setAsKernelArg(KernelBinder& binder, cl_uint index)
+{
+	if(strategy == TRANSFER_SVM)
+		return binder.setSVMPointer(index, svmPointer);
+
+	return binder.set(index, buffer);
+}
+
+CLHelper::TransferStrategy CLHelper::TransferBuffer::getStrategy() const
+{
+	return strategy;
+}
+
+bool CLHelper::TransferBuffer::isFineGrained() const
+{
+	return fineGrained;
+}
@@ -0,0 +1,76 @@
+#ifndef _TRANSFERSTRATEGY_H
+#define _TRANSFERSTRATEGY_H
+
+#include "CLHelper.h"
+#include "KernelBinder.h"
+
+namespace CLHelper
+{
+	enum TransferStrategy {
+		TRANSFER_AUTO,				/* choose per device with selectTransferStrategy() */
+		TRANSFER_USE_HOST_PTR,		/* wrap the host array, zero-copy on devices sharing host memory */
+		TRANSFER_MAP,				/* CL_MEM_ALLOC_HOST_PTR buffer filled and read through map/unmap */
+		TRANSFER_COPY_HOST_PTR,		/* copy at creation, enqueueReadBuffer for results */
+		TRANSFER_READ_WRITE,		/* enqueueWriteBuffer / enqueueReadBuffer */
+		TRANSFER_SVM				/* shared virtual memory, OpenCL 2.0, fine-grained where supported */
+	};
+
+	std::string transferStrategyToString(TransferStrategy strategy);
+	bool parseTransferStrategy(const std::string& strategyString, TransferStrategy* strategy);
+
+	bool isTransferStrategySupported(TransferStrategy strategy, cl::Device& device, DeviceInfo& deviceInfo);
+
+	TransferStrategy selectTransferStrategy(
+		cl::Context& context,
+		cl::CommandQueue& commQueue,
+		cl::Device& device,
+		DeviceInfo& deviceInfo,
+		size_t size,
+		std::string* reason = NULL);
+
+	/*
+	 * Device storage for one host array, moved with a fixed strategy:
+	 * upload() before the kernel, download() after it, and release() once the
+	 * pointer returned by download() is no longer needed.
+	 */
+	class TransferBuffer {
+
+	public:
+		TransferBuffer(
+			cl::Context& context,
+			cl::CommandQueue& commQueue,
+			TransferStrategy strategy,
+			cl_mem_flags access,
+			size_t size,
+			void* hostData);
+		~TransferBuffer();
+
+		void upload();
+		void* download();
+		void* download(size_t offset, size_t bytes);	/* only the given range, the returned pointer is at offset */
+		void release();
+
+		cl_int setAsKernelArg(cl::Kernel& kernel, cl_uint index);
+		cl_int setAsKernelArg(KernelBinder& binder, cl_uint index);
+		TransferStrategy getStrategy() const;
+		bool isFineGrained() const;
+
+	private:
+		TransferBuffer(const TransferBuffer&);
+		TransferBuffer& operator=(const TransferBuffer&);
+
+		cl::Context context;
+		cl::CommandQueue commQueue;
+		TransferStrategy strategy;
+		size_t size;
+		void* hostData;
+
+		cl::Buffer buffer;
+		void* svmPointer;
+		bool fineGrained;			/* fine-grained SVM, shared with the host without map/unmap */
+		void* mappedPointer;
+		bool uploaded;				/* upload() ran before, so COPY_HOST_PTR buffers need the write */
+	};
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "Validation.h"
+#include "ThreadPool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace pt = boost::posix_time;
+
+/* Shared by the pool tasks of one validateAdd() call */
+struct AddValidation {
+	const float* a;
+	const float* b;
+	const float* output;
+	size_t count;
+	CLHelper::Tolerance tolerance;
+	size_t firstBlock, blockStride;
+
+	boost::mutex mutex;
+	CLHelper::ValidationReport report;
+};
+
+static void validateBlocks(AddValidation* validation, size_t firstSample, size_t lastSample);
+static void compareRange(const float* a, const float* b, const float* output, size_t first, size_t last, const CLHelper::Tolerance& tolerance, CLHelper::ValidationReport* report);
+static void checkElement(const float* a, const float* b, const float* output, size_t index, const CLHelper::Tolerance& tolerance, CLHelper::ValidationReport* report);
+static void checksumRange(const float* a, const float* b, boost::atomic<boost::uint32_t>* checksum, size_t first, size_t last);
+
+std::string CLHelper::validationModeToString(ValidationMode mode)
+{
+	switch(mode) {
+	case VALIDATE_NONE:
+		return "none";
+	case VALIDATE_FULL:
+		return "full";
+	case VALIDATE_SAMPLED:
+		return "sampled";
+	case VALIDATE_CHECKSUM:
+		return "checksum";
+	}
+
+	return "unknown";
+}
+
+bool CLHelper::validationModeFromString(const std::string& modeString, ValidationMode* mode)
+{
+	if(modeString == "none")
+		*mode = VALIDATE_NONE;
+	else if(modeString == "full")
+		*mode = VALIDATE_FULL;
+	else if(modeString == "sampled")
+		*mode = VALIDATE_SAMPLED;
+	else if(modeString == "checksum")
+		*mode = VALIDATE_CHECKSUM;
+	else
+		return false;
+
+	return true;
+}
+
+// An add rounds once in float. Reduced formats also round both inputs and the
+// result to their mantissa (half 11 bits, bfloat16 8 bits), int8 to half a
+// step of each of the three scales, which sum to the result's scale.
+CLHelper::Tolerance CLHelper::defaultTolerance(StorageFormat format, float scale)
+{
+	switch(format) {
+	case STORAGE_FLOAT:
+		return Tolerance(0, ldexp(1.0, -23));
+	case STORAGE_HALF:
+		return Tolerance(ldexp(1.0, -24), ldexp(1.0, -9));
+	case STORAGE_BF16:
+		return Tolerance(0, ldexp(1.0, -6));
+	case STORAGE_INT8:
+		return Tolerance(scale, 0);
+	}
+
+	return Tolerance();
+}
+
+CLHelper::Tolerance CLHelper::ValidationOptions::toleranceFor(StorageFormat format, float scale) const
+{
+	std::map<StorageFormat, Tolerance>::const_iterator tolerance = tolerances.find(format);
+	if(tolerance != tolerances.end())
+		return tolerance->second;
+
+	return defaultTolerance(format, scale);
+}
+
+bool CLHelper::parseTolerances(const std::string& spec, ValidationOptions* options)
+{
+	std::stringstream entries(spec);
+	std::string entry;
+	while(std::getline(entries, entry, ',')) {
+		size_t equals = entry.find('=');
+		if(equals == std::string::npos)
+			return false;
+
+		StorageFormat format;
+		if(!storageFormatFromString(entry.substr(0, equals), &format))
+			return false;
+
+		std::string values = entry.substr(equals + 1);
+		size_t colon = values.find(':');
+
+		char* end;
+		Tolerance tolerance;
+		tolerance.absolute = strtod(values.substr(0, colon).c_str(), &end);
+		if(*end != '\0')
+			return false;
+		if(colon != std::string::npos) {
+			tolerance.relative = strtod(values.substr(colon + 1).c_str(), &end);
+			if(*end != '\0')
+				return false;
+		}
+
+		options->tolerances[format] = tolerance;
+	}
+
+	return true;
+}
+
+CLHelper::ValidationReport::ValidationReport()
+	: checked(0), mismatches(0), firstMismatch(0), maxAbsoluteError(0), seconds(0)
+{
+}
+
+bool CLHelper::ValidationReport::passed() const
+{
+	return mismatches == 0;
+}
+
+void CLHelper::ValidationReport::merge(const ValidationReport& other, size_t indexOffset)
+{
+	if(other.mismatches > 0 && (mismatches == 0 || other.firstMismatch + indexOffset < firstMismatch))
+		firstMismatch = other.firstMismatch + indexOffset;
+
+	checked += other.checked;
+	mismatches += other.mismatches;
+	maxAbsoluteError = std::max(maxAbsoluteError, other.maxAbsoluteError);
+	seconds += other.seconds;
+}
+
+CLHelper::ValidationReport CLHelper::validateAdd(
+	const float* a,
+	const float* b,
+	const float* output,
+	size_t count,
+	const Tolerance& tolerance,
+	double sampleFraction)
+{
+	pt::ptime start = pt::microsec_clock::universal_time();
+
+	AddValidation validation;
+	validation.a = a;
+	validation.b = b;
+	validation.output = output;
+	validation.count = count;
+	validation.tolerance = tolerance;
+	validation.firstBlock = 0;
+	validation.blockStride = 1;
+
+// Sample every n-th block from a random first one, so successive runs cover different blocks
+	size_t blockCount = (count + VALIDATION_BLOCK_ELEMENTS - 1) / VALIDATION_BLOCK_ELEMENTS;
+	if(sampleFraction < 1.0) {
+		validation.blockStride = (size_t) std::max(1.0, floor(1.0 / std::max(sampleFraction, 1e-9) + 0.5));
+		validation.firstBlock = (size_t) (start.time_of_day().total_microseconds() % validation.blockStride);
+	}
+
+	size_t sampleCount = 0;
+	if(validation.firstBlock < blockCount)
+		sampleCount = (blockCount - validation.firstBlock + validation.blockStride - 1) / validation.blockStride;
+
+	ThreadPool::shared().parallelFor(0, sampleCount, boost::bind(&validateBlocks, &validation, boost::placeholders::_1, boost::placeholders::_2));
+
+	validation.report.seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+	return validation.report;
+}
+
+boost::uint32_t CLHelper::checksumElement(size_t index, float value)
+{
+	boost::uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	boost::uint32_t mixed = bits ^ ((boost::uint32_t) index * 0x9E3779B9u);
+	mixed *= 0x85EBCA6Bu;
+	return mixed ^ (mixed >> 13);
+}
+
+boost::uint32_t CLHelper::addChecksum(const float* a, const float* b, size_t count)
+{
+	boost::atomic<boost::uint32_t> checksum(0);
+	ThreadPool::shared().parallelFor(0, count, boost::bind(&checksumRange, a, b, &checksum, boost::placeholders::_1, boost::placeholders::_2));
+	return checksum;
+}
+
+CLHelper::ValidationReport CLHelper::validateChecksum(const float* a, const float* b, size_t count, boost::uint32_t deviceChecksum)
+{
+	pt::ptime start = pt::microsec_clock::universal_time();
+
+	ValidationReport report;
+	report.checked = count;
+	if(addChecksum(a, b, count) != deviceChecksum)
+		report.mismatches = 1;	/* a checksum cannot tell how many or which */
+
+	report.seconds = (pt::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+	return report;
+}
+
+void CLHelper::printValidationReport(ValidationMode mode, const ValidationReport& report)
+{
+	std::cout << "Validation (" << validationModeToString(mode) << "): " << report.checked << " elements checked in " << report.seconds << " s, ";
+
+	if(report.passed())
+		std::cout << "passed";
+	else if(mode == VALIDATE_CHECKSUM)
+		std::cout << "FAILED, the device checksum differs from the host's";
+	else
+		std::cout << "FAILED, " << report.mismatches << " mismatches, the first at element " << report.firstMismatch;
+
+	if(mode != VALIDATE_CHECKSUM)
+		std::cout << " (max absolute error " << report.maxAbsoluteError << ")";
+	std::cout << std::endl;
+}
+
+float CLHelper::maxDifference(const float* a, const float* b, size_t count, bool relative)
+{
+	float difference = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		float error = std::fabs(a[i] - b[i]);
+		if(relative)
+			error /= std::max(std::fabs(a[i]), 1e-6f);
+		difference = std::max(difference, error);
+	}
+
+	return difference;
+}
+
+static void validateBlocks(AddValidation* validation, size_t firstSample, size_t lastSample)
+{
+	CLHelper::ValidationReport report;
+	for(size_t sample = firstSample; sample < lastSample; sample++)
+	{
+		size_t first = (validation->firstBlock + sample * validation->blockStride) * VALIDATION_BLOCK_ELEMENTS;
+		size_t last = std::min(first + VALIDATION_BLOCK_ELEMENTS, validation->count);
+		compareRange(validation->a, validation->b, validation->output, first, last, validation->tolerance, &report);
+	}
+
+	boost::mutex::scoped_lock lock(validation->mutex);
+	validation->report.merge(report, 0);
+}
+
+// Four elements at a time; any group with a failing element is rechecked one by one
+static void compareRange(const float* a, const float* b, const float* output, size_t first, size_t last, const CLHelper::Tolerance& tolerance, CLHelper::ValidationReport* report)
+{
+	size_t i = first;
+	float maxAbsoluteError = 0;
+
+#ifdef __SSE2__
+	const __m128 absoluteMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 absolute = _mm_set1_ps((float) tolerance.absolute);
+	const __m128 relative = _mm_set1_ps((float) tolerance.relative);
+	__m128 maxErrors = _mm_setzero_ps();
+	for(; i + 4 <= last; i += 4)
+	{
+		__m128 reference = _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		__m128 errors = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(output + i), reference), absoluteMask);
+		__m128 allowed = _mm_add_ps(absolute, _mm_mul_ps(relative, _mm_and_ps(reference, absoluteMask)));
+
+		// NaN errors fail the comparison and are left out of the maximum
+		maxErrors = _mm_max_ps(errors, maxErrors);
+		if(_mm_movemask_ps(_mm_cmple_ps(errors, allowed)) != 0xF) {
+			for(size_t j = i; j < i + 4; j++)
+				checkElement(a, b, output, j, tolerance, report);
+		}
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, maxErrors);
+	maxAbsoluteError = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+	report->maxAbsoluteError = std::max(report->maxAbsoluteError, (double) maxAbsoluteError);
+
+	for(; i < last; i++)
+		checkElement(a, b, output, i, tolerance, report);
+
+	report->checked += last - first;
+}
+
+static void checkElement(const float* a, const float* b, const float* output, size_t index, const CLHelper::Tolerance& tolerance, CLHelper::ValidationReport* report)
+{
+	float reference = a[index] + b[index];
+	double error = fabs((double) output[index] - reference);
+
+	bool bothNaN = (reference != reference) && (output[index] != output[index]);
+	if(!bothNaN && error == error)
+		report->maxAbsoluteError = std::max(report->maxAbsoluteError, error);
+
+	if(bothNaN || error <= tolerance.absolute + tolerance.relative * fabs(reference))
+		return;
+
+	if(report->mismatches == 0 || index < report->firstMismatch)
+		report->firstMismatch = index;
+	report->mismatches++;
+}
+
+static void checksumRange(const float* a, const float* b, boost::atomic<boost::uint32_t>* checksum, size_t first, size_t last)
+{
+	boost::uint32_t sum = 0;
+	for(size_t i = first; i < last; i++)
+		sum += CLHelper::checksumElement(i, a[i] + b[i]);
+
+	checksum->fetch_add(sum);
+}
@@ -0,0 +1,92 @@
+#ifndef _VALIDATION_H
+#define _VALIDATION_H
+
+#include <map>
+#include <string>
+#include <boost/cstdint.hpp>
+#include "StorageFormat.h"
+
+#define VALIDATION_BLOCK_ELEMENTS 4096
+
+/* Returned by the programs when the result does not validate, outside the range of the OpenCL error codes */
+#define VALIDATION_FAILED -9999
+
+namespace CLHelper
+{
+	enum ValidationMode {
+		VALIDATE_NONE,
+		VALIDATE_FULL,			/* every element against a host reference */
+		VALIDATE_SAMPLED,		/* a share of the blocks against a host reference, starting at a random block */
+		VALIDATE_CHECKSUM		/* a checksum computed by the kernel itself, the output is not read back for it */
+	};
+
+	std::string validationModeToString(ValidationMode mode);
+	bool validationModeFromString(const std::string& modeString, ValidationMode* mode);
+
+	/* An element passes if |value - reference| <= absolute + relative * |reference| */
+	struct Tolerance {
+		double absolute;
+		double relative;
+
+		Tolerance(double absolute = 0, double relative = 0) : absolute(absolute), relative(relative) {}
+	};
+
+	/* What an add of values stored in the format may be off by. scale is the result's STORAGE_INT8 scale. */
+	Tolerance defaultTolerance(StorageFormat format, float scale = 1.0f);
+
+	struct ValidationOptions {
+		ValidationMode mode;
+		double sampleFraction;							/* VALIDATE_SAMPLED: share of blocks checked */
+		std::map<StorageFormat, Tolerance> tolerances;	/* replace defaultTolerance() for these formats */
+
+		ValidationOptions() : mode(VALIDATE_SAMPLED), sampleFraction(0.02) {}
+
+		Tolerance toleranceFor(StorageFormat format, float scale = 1.0f) const;
+	};
+
+	/* Parses "<format>=<absolute>[:<relative>],..." such as "half=0:0.002,int8=0.5" into options->tolerances */
+	bool parseTolerances(const std::string& spec, ValidationOptions* options);
+
+	struct ValidationReport {
+		size_t checked;
+		size_t mismatches;
+		size_t firstMismatch;		/* index of the first failing element, if any */
+		double maxAbsoluteError;
+		double seconds;
+
+		ValidationReport();
+
+		bool passed() const;
+		void merge(const ValidationReport& other, size_t indexOffset);	/* other's indices start at indexOffset */
+	};
+
+	/*
+	 * Checks output against a + b computed on the host, vectorized and spread over
+	 * the shared thread pool. With a sampleFraction below 1 only every n-th block of
+	 * VALIDATION_BLOCK_ELEMENTS is checked, so the cost shrinks with the fraction.
+	 */
+	ValidationReport validateAdd(
+		const float* a,
+		const float* b,
+		const float* output,
+		size_t count,
+		const Tolerance& tolerance,
+		double sampleFraction = 1.0);
+
+	/*
+	 * Order independent checksum of a float array: the sum of every element's
+	 * mixed bit pattern and index. checksumElement() must match checksumMix()
+	 * in KernelHelpers.clh. Only exact results compare equal.
+	 */
+	boost::uint32_t checksumElement(size_t index, float value);
+	boost::uint32_t addChecksum(const float* a, const float* b, size_t count);	/* the checksum a + b should have */
+
+	ValidationReport validateChecksum(const float* a, const float* b, size_t count, boost::uint32_t deviceChecksum);
+
+	void printValidationReport(ValidationMode mode, const ValidationReport& report);
+
+	/* Largest |a[i] - b[i]|, divided by |a[i]| when relative, for comparing two device results */
+	float maxDifference(const float* a, const float* b, size_t count, bool relative = false);
+};
+
+#endif
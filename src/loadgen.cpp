@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <boost/bind/bind.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <unistd.h>
+
+#include "JobClient.h"
+#include "SharedArena.h"
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+
+struct ClientReport {
+	std::vector<double> latencies;
+	size_t rejected;
+	size_t failed;
+
+	ClientReport() : rejected(0), failed(0) {}
+};
+
+void runClient(std::string socketPath, std::string tenant, size_t jobs, size_t dataSize, CLHelper::StorageFormat format, ClientReport* report)
+{
+	CLHelper::JobClient client;
+	if(!client.connect(socketPath)) {
+		report->failed = jobs;
+		return;
+	}
+
+	for(size_t i = 0; i < jobs; i++)
+	{
+		CLHelper::JobResult result;
+		if(!client.submitAdd(tenant, dataSize, &result, format))
+			report->failed++;
+		else if(!result.accepted)
+			report->rejected++;
+		else
+			report->latencies.push_back(result.totalMs);
+	}
+}
+
+// Submits jobs through a shared arena, keeping up to 'depth' of them in flight
+void runSharedClient(std::string socketPath, std::string tenant, size_t jobs, size_t dataSize, size_t depth, size_t clientId, ClientReport* report)
+{
+	depth = std::max((size_t) 1, std::min(depth, (size_t) SHARED_RING_CAPACITY));
+
+	std::ostringstream arenaName;
+	arenaName << "/opencltemplate-" << getpid() << "-" << clientId;
+
+	CLHelper::SharedArena arena;
+	size_t dataBytes = dataSize * sizeof(float);
+	if(!arena.create(arenaName.str(), depth * 3 * (dataBytes + SHARED_ARENA_ALIGNMENT))) {
+		report->failed = jobs;
+		return;
+	}
+
+// Every in-flight slot has its own inputs and output, written in place once
+	std::vector<CLHelper::SharedJobDescriptor> slots(depth);
+	for(size_t slot = 0; slot < depth; slot++)
+	{
+		arena.allocate(dataBytes, &slots[slot].offsetA);
+		arena.allocate(dataBytes, &slots[slot].offsetB);
+		arena.allocate(dataBytes, &slots[slot].offsetC);
+		slots[slot].dataSize = dataSize;
+
+		float* dataA = (float*) arena.getData(slots[slot].offsetA);
+		float* dataB = (float*) arena.getData(slots[slot].offsetB);
+		for(size_t i = 0; i < dataSize; i++) {
+			dataA[i] = (float) i;
+			dataB[i] = (float) i;
+		}
+	}
+
+	CLHelper::JobClient client;
+	if(!client.connect(socketPath) || !client.attachArena(arenaName.str(), tenant)) {
+		report->failed = jobs;
+		return;
+	}
+
+// Completions can arrive out of order, so track free slots and carry the slot in the job id
+	std::vector<size_t> freeSlots;
+	for(size_t slot = depth; slot > 0; slot--)
+		freeSlots.push_back(slot - 1);
+
+	std::vector<pt::ptime> submitTimes(depth);
+	size_t submitted = 0, completed = 0;
+	while(completed < jobs)
+	{
+		while(submitted < jobs && !freeSlots.empty())
+		{
+			size_t slot = freeSlots.back();
+			slots[slot].jobId = ((boost::uint64_t) submitted << 16) | slot;
+			submitTimes[slot] = pt::microsec_clock::universal_time();
+			if(!arena.getRequests().push(slots[slot]))
+				break;
+
+			freeSlots.pop_back();
+			submitted++;
+		}
+
+		CLHelper::SharedJobCompletion completion;
+		if(!arena.getCompletions().pop(&completion)) {
+			boost::this_thread::yield();
+			continue;
+		}
+
+		size_t slot = (size_t) (completion.jobId & 0xffff);
+		freeSlots.push_back(slot);
+		completed++;
+
+		if(!completion.accepted)
+			report->rejected++;
+		else
+			report->latencies.push_back((pt::microsec_clock::universal_time() - submitTimes[slot]).total_microseconds() / 1000.0);
+	}
+
+	client.detachArena(arenaName.str());
+}
+
+int main(int argc, char **argv) {
+
+	std::string socketPath, storage;
+	size_t clients, jobs, dataSize, tenants, depth;
+
+// Specify options
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("socket,s",
+			po::value<std::string>(&socketPath)->default_value("/tmp/opencltemplate.sock"),
+			"The job server's Unix socket.")
+		("clients,c",
+			po::value<size_t>(&clients)->default_value(4),
+			"Number of concurrent client connections.")
+		("jobs,j",
+			po::value<size_t>(&jobs)->default_value(100),
+			"Jobs submitted by every client.")
+		("size,n",
+			po::value<size_t>(&dataSize)->default_value(1048576),
+			"Number of elements per job.")
+		("tenants,t",
+			po::value<size_t>(&tenants)->default_value(1),
+			"Number of tenants the clients are spread over.")
+		("storage",
+			po::value<std::string>(&storage)->default_value("float"),
+			"Storage format of the generated jobs' data on the device. ('float', 'half', 'bf16' or 'int8')")
+		("shared",
+			"Pass job data through a shared memory arena instead of generating it on the server.")
+		("depth",
+			po::value<size_t>(&depth)->default_value(8),
+			"Jobs every client keeps in flight with --shared.")
+		("shutdown", "Ask the server to shut down afterwards.")
+		("help", "Print this.");
+
+// Parse the command line
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+// Display help if requested
+	if(vm.count("help")) {
+		std::cout << desc << std::endl;
+		exit(1);
+	}
+
+	CLHelper::StorageFormat format;
+	if(!CLHelper::storageFormatFromString(storage, &format)) {
+		std::cerr << "Invalid storage format provided: " << storage << std::endl;
+		exit(1);
+	}
+	if(format != CLHelper::STORAGE_FLOAT && vm.count("shared")) {
+		std::cerr << "Shared arena jobs are always stored as float." << std::endl;
+		exit(1);
+	}
+
+// Run all clients concurrently
+	std::vector<ClientReport> reports(clients);
+	boost::thread_group clientThreads;
+
+	pt::ptime startTime = pt::microsec_clock::universal_time();
+	for(size_t client = 0; client < clients; client++)
+	{
+		std::ostringstream tenant;
+		tenant << "tenant" << (client % std::max(tenants, (size_t) 1));
+		if(vm.count("shared"))
+			clientThreads.create_thread(boost::bind(&runSharedClient, socketPath, tenant.str(), jobs, dataSize, depth, client, &reports[client]));
+		else
+			clientThreads.create_thread(boost::bind(&runClient, socketPath, tenant.str(), jobs, dataSize, format, &reports[client]));
+	}
+	clientThreads.join_all();
+	double elapsedSeconds = (pt::microsec_clock::universal_time() - startTime).total_microseconds() / 1e6;
+
+// Summarize
+	std::vector<double> latencies;
+	size_t rejected = 0, failed = 0;
+	for(size_t client = 0; client < clients; client++)
+	{
+		latencies.insert(latencies.end(), reports[client].latencies.begin(), reports[client].latencies.end());
+		rejected += reports[client].rejected;
+		failed += reports[client].failed;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << "Completed jobs: " << latencies.size() << " (rejected " << rejected << ", failed " << failed << ")" << std::endl;
+	std::cout << "Elapsed: " << elapsedSeconds << " s" << std::endl;
+	if(!latencies.empty()) {
+		double bytesPerJob = 3.0 * dataSize * CLHelper::storageFormatSize(format);
+		std::cout << "Throughput: " << latencies.size() / elapsedSeconds << " jobs/s, "
+		          << latencies.size() * bytesPerJob / elapsedSeconds / 1e9 << " GB/s" << std::endl;
+		std::cout << "Latency p50: " << latencies[latencies.size() / 2] << " ms, "
+		          << "p95: " << latencies[(latencies.size() * 95) / 100] << " ms, "
+		          << "p99: " << latencies[(latencies.size() * 99) / 100] << " ms, "
+		          << "max: " << latencies.back() << " ms" << std::endl;
+	}
+
+	CLHelper::JobClient statsClient;
+	if(statsClient.connect(socketPath)) {
+		std::string stats;
+		if(statsClient.getStats(&stats))
+			std::cout << "Server: " << stats << std::endl;
+		if(vm.count("shutdown"))
+			statsClient.shutdownServer();
+	}
+
+	return 0;
+}
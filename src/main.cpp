@@ -1,14 +1,30 @@
 #include <CL/cl.hpp>
 #include <boost/program_options.hpp>
 
+#include "BuildService.h"
 #include "CLHelper.h"
+#include "CompressedStreaming.h"
+#include "DeviceCharacterization.h"
+#include "DeviceImage.h"
+#include "DeviceSelector.h"
+#include "DeviceSort.h"
+#include "JobFile.h"
+#include "JobServer.h"
+#include "RecordLayout.h"
 #include "SimpleAddProgram.h"
+#include "TiledEngine.h"
+#include "Trace.h"
 
 namespace po = boost::program_options;
 
+static void printBuildLogs();
+
 int main(int argc, char **argv) {
 
-	std::string defaultVendor, defaultDeviceTypeString;
+	std::string defaultVendor, defaultDeviceTypeString, selectPredicates, partitionScheme, socketPath, transferStrategy, storageFormat, validationMode, tolerances, inputA, inputB, jobFile, tracePath;
+	double sampleFraction;
+	size_t queuesPerDevice;
+	SimpleAddOptions options;
 	cl_device_type defaultDeviceType;
 	cl_int defaultDeviceId;
 
@@ -20,10 +36,100 @@ int main(int argc, char **argv) {
 			"The device ID to use as default.")
 		("device-type,t",
 			po::value<std::string>(&defaultDeviceTypeString)->default_value("DEFAULT"),
-			"The device type to use as default. ('GPU', 'CPU' or 'ALL')")
+			"The device type to use as default. ('GPU', 'CPU', 'ACCELERATOR', 'ALL' or several such as 'GPU,CPU')")
 		("vendor,v",
 			po::value<std::string>(&defaultVendor)->default_value(""),
 			"The vendor to use as default. (Examples: 'AMD', 'Intel')")
+		("select,s",
+			po::value<std::string>(&selectPredicates),
+			"Use every device of the given vendor and type that meets the predicates, best first, instead of the one with the default ID. "
+			"('fp64', 'min-memory=<MiB>', 'min-alloc=<MiB>', 'min-version=<x.y>', 'count=<n>', 'rank=bandwidth' or 'rank=compute', comma separated. "
+			"'all-platforms' keeps devices that cannot share a context, for --characterize.)")
+		("partition,p",
+			po::value<std::string>(&partitionScheme)->default_value(""),
+			"Partition the device into sub-devices that each get a slice of the work. ('NUMA', 'L1'-'L4', 'EQUALLY:<units>' or counts such as '4,4')")
+		("precompile",
+			po::value<std::vector<std::string> >()->multitoken(),
+			"Compile the given kernel files ahead of time for every matching device, store the binaries in 'prebuilt/' and exit. They are built without options, so only generic programs load them.")
+		("size",
+			po::value<size_t>(&options.dataSize)->default_value(options.dataSize),
+			"Number of elements to add.")
+		("work-group-size",
+			po::value<size_t>(&options.workGroupSize)->default_value(0),
+			"Work-group size of the add, 0 picks the largest one dividing the size.")
+		("repetitions",
+			po::value<size_t>(&options.repetitions)->default_value(1),
+			"Run the add kernel this many times and report the average time.")
+		("input-a",
+			po::value<std::string>(&inputA)->default_value("ramp"),
+			"Where the first input comes from. ('ramp', 'zero', 'random[:<seed>]' or 'file:<raw floats>')")
+		("input-b",
+			po::value<std::string>(&inputB)->default_value("ramp"),
+			"Where the second input comes from, as --input-a.")
+		("jobs",
+			po::value<std::string>(&jobFile),
+			"Run the jobs of the given JSON file as a batch on warm contexts, and exit. Other options give the defaults of every job.")
+		("generic",
+			"Use the generic kernel instead of one specialized for the problem size. Without --fast-math it is the one --precompile stores.")
+		("fast-math",
+			"Allow the kernel to be compiled with -cl-fast-relaxed-math.")
+		("transfer",
+			po::value<std::string>(&transferStrategy)->default_value("auto"),
+			"How to move data between host and device. ('auto', 'use-host-ptr', 'map', 'copy-host-ptr', 'read-write' or 'svm')")
+		("storage",
+			po::value<std::string>(&storageFormat)->default_value("float"),
+			"Store the arrays in reduced precision and compute in float, reporting the error. ('float', 'half', 'bf16' or 'int8')")
+		("validate",
+			po::value<std::string>(&validationMode)->default_value("sampled"),
+			"How to check the result. ('none', 'full', 'sampled' or 'checksum', computed by the kernel)")
+		("sample-fraction",
+			po::value<double>(&sampleFraction)->default_value(0.02),
+			"Share of the result checked by sampled validation.")
+		("tolerance",
+			po::value<std::string>(&tolerances)->default_value(""),
+			"Validation tolerances per storage format, replacing the defaults: <format>=<absolute>[:<relative>],... (Example: 'half=0:0.002,int8=0.5')")
+		("compress-floats",
+			po::value<std::vector<std::string> >()->multitoken(),
+			"Compress a file of raw floats into a block compressed stream file: <raw> <stream>. Exits afterwards.")
+		("stream-compressed",
+			po::value<std::vector<std::string> >()->multitoken(),
+			"Add two block compressed stream files chunk by chunk, optionally compressing the result: <a> <b> [<result>]")
+		("device-decode",
+			"Decode compressed streams with an OpenCL kernel instead of host threads.")
+		("benchmark-compression",
+			po::value<size_t>(),
+			"Compare raw and compressed streaming of inputs with the given number of elements at increasing entropy, and exit.")
+		("benchmark-transfers",
+			po::value<size_t>(),
+			"Time the given number of add iterations with every supported transfer strategy, SVM included, and exit.")
+		("benchmark-persistent",
+			po::value<size_t>(),
+			"Time the given number of tiny adds with one launch per add and with a persistent kernel, and exit.")
+		("benchmark-tiled",
+			po::value<size_t>(),
+			"Compare naive and local memory tiled 2D stencil and matmul kernels on a square of the given edge, averaging --repetitions runs, and exit.")
+		("benchmark-images",
+			po::value<size_t>(),
+			"Compare image and buffer backed bilinear resampling and swirl kernels on a square source of the given edge, averaging --repetitions runs, and exit.")
+		("benchmark-layouts",
+			po::value<size_t>(),
+			"Compare AoS, SoA and AoSoA layouts of the given number of particle records, converting on host and device and running field kernels through generated accessors, and exit.")
+		("benchmark-sort",
+			po::value<size_t>(),
+			"Compare device radix sorts of 32 and 64-bit keys with host sorts at growing sizes up to the given number of keys, plus sort and reduce by key, taking the best of --repetitions runs, and exit.")
+		("characterize",
+			"Measure memory bandwidths, peak flops and transfer rates of the selected devices, store their roofline profiles in 'profiles/' and exit.")
+		("serve",
+			po::value<std::string>(&socketPath),
+			"Keep running and execute jobs submitted over the given Unix socket instead of running once.")
+		("queues-per-device",
+			po::value<size_t>(&queuesPerDevice)->default_value(1),
+			"Number of command queues (and server workers) per device when serving jobs.")
+		("trace",
+			po::value<std::string>(&tracePath),
+			"Record host and device activity and write it to the given file in the Chrome trace format (chrome://tracing, ui.perfetto.dev) on exit.")
+		("build-log",
+			"Print the compiler output of every finished build that produced some when the process exits.")
 		("help", "Print this.");
 
 
@@ -38,6 +144,59 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+// Start recording the timeline, it is written when the process exits
+	if(vm.count("trace")) {
+		CLHelper::Trace::shared().start(tracePath);
+	}
+
+// Build logs are kept instead of printed, show them at the end if asked to
+	if(vm.count("build-log")) {
+		atexit(&printBuildLogs);
+	}
+
+// Compressing a file needs no device
+	if(vm.count("compress-floats")) {
+		std::vector<std::string> paths = vm["compress-floats"].as<std::vector<std::string> >();
+		if(paths.size() != 2 || !CLHelper::compressFloatFile(paths[0], paths[1])) {
+			std::cerr << "Usage: --compress-floats <raw> <stream>, with a readable raw file" << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+// Gather the options of the add, which are also the defaults of a job file
+	options.specialize = (vm.count("generic") == 0);
+	options.fastMath = (vm.count("fast-math") > 0);
+	if(!CLHelper::parseTransferStrategy(transferStrategy, &options.transferStrategy)) {
+		std::cerr << "Invalid transfer strategy provided: " << transferStrategy << std::endl;
+		return 1;
+	}
+	if(!CLHelper::storageFormatFromString(storageFormat, &options.storageFormat)) {
+		std::cerr << "Invalid storage format provided: " << storageFormat << std::endl;
+		return 1;
+	}
+	if(!CLHelper::validationModeFromString(validationMode, &options.validation.mode)) {
+		std::cerr << "Invalid validation mode provided: " << validationMode << std::endl;
+		return 1;
+	}
+	if(!CLHelper::parseTolerances(tolerances, &options.validation)) {
+		std::cerr << "Invalid tolerances provided: " << tolerances << std::endl;
+		return 1;
+	}
+	options.validation.sampleFraction = sampleFraction;
+	if(!parseInputSource(inputA, &options.inputA) || !parseInputSource(inputB, &options.inputB)) {
+		std::cerr << "Invalid input provided: " << inputA << ", " << inputB << std::endl;
+		return 1;
+	}
+	if(options.dataSize == 0) {
+		std::cerr << "The size must be positive" << std::endl;
+		return 1;
+	}
+	if(queuesPerDevice == 0) {
+		std::cerr << "The queues per device must be positive" << std::endl;
+		return 1;
+	}
+
 // Modify "AMD" string to correct one
 	if(defaultVendor.compare("AMD") == 0) {
 		defaultVendor = "Advanced Micro Devices, Inc.";
@@ -49,18 +208,161 @@ int main(int argc, char **argv) {
 // Print all platforms and devices
 	CLHelper::printAllPlatformsAndDevices();
 
+// Precompile kernels for all devices of the given vendor and type instead of running a program
+	if(vm.count("precompile")) {
+		std::vector<std::string> kernelFiles = vm["precompile"].as<std::vector<std::string> >();
+		CLHelper::precompileKernels(defaultVendor, defaultDeviceType, kernelFiles);
+		return 0;
+	}
+
+// Run a batch of jobs, each selecting its own devices
+	if(vm.count("jobs")) {
+		JobSpec defaults;
+		defaults.device.vendor = defaultVendor;
+		defaults.device.type = defaultDeviceTypeString;
+		defaults.device.id = defaultDeviceId;
+		defaults.device.select = selectPredicates;
+		defaults.device.partition = partitionScheme;
+		defaults.add = options;
+
+		std::vector<JobSpec> jobs;
+		if(!loadJobFile(jobFile, defaults, &jobs))
+			return 1;
+		return runJobs(jobs) == 0 ? 0 : 1;
+	}
+
 // Find specified devices and store them in 'deviceList' and related device info in 'deviceInfoList'
 	std::vector<cl::Device> deviceList;
 	std::vector<CLHelper::DeviceInfo> deviceInfoList;
-	CLHelper::findSpecifiedDevices(defaultVendor, defaultDeviceType, defaultDeviceId, &deviceList, &deviceInfoList);
+	if(vm.count("select")) {
+		CLHelper::DeviceRequirements requirements;
+		requirements.vendor = defaultVendor;
+		requirements.type = (defaultDeviceType == CL_DEVICE_TYPE_DEFAULT) ? CL_DEVICE_TYPE_ALL : defaultDeviceType;
+		if(!CLHelper::parseDeviceRequirements(selectPredicates, &requirements)) {
+			std::cerr << "Invalid device predicates provided: " << selectPredicates << std::endl;
+			return 1;
+		}
+		CLHelper::selectDevices(requirements, &deviceList, &deviceInfoList);
+	}
+	else
+		CLHelper::findSpecifiedDevices(defaultVendor, defaultDeviceType, defaultDeviceId, &deviceList, &deviceInfoList);
+
+// Replace the device with its sub-devices, if requested
+	if(partitionScheme.length() > 0) {
+		CLHelper::partitionDevices(partitionScheme, &deviceList, &deviceInfoList);
+	}
 
 // Print selected devices
 	std::cout << std::endl;
 	std::cout << "Selected devices:" << std::endl;
 	CLHelper::printDeviceInfoList(deviceInfoList);
 
+// Characterize the selected devices instead of running a program
+	if(vm.count("characterize")) {
+		for(size_t i = 0; i < deviceList.size(); i++) {
+			CLHelper::RooflineProfile profile;
+			CLHelper::characterizeDevice(deviceList[i], deviceInfoList[i], &profile);
+			CLHelper::printRooflineProfile(profile);
+			CLHelper::saveRooflineProfile(deviceList[i], profile);
+		}
+		return 0;
+	}
+
+// Compare the transfer strategies, SVM against buffers, on the first selected device
+	if(vm.count("benchmark-transfers")) {
+		size_t iterations = vm["benchmark-transfers"].as<size_t>();
+		if(iterations == 0) {
+			std::cerr << "The iterations of the transfer benchmark must be positive" << std::endl;
+			return 1;
+		}
+
+		runTransferBenchmark(deviceList, deviceInfoList, iterations);
+		return 0;
+	}
+
+// Stream compressed inputs through the device
+	if(vm.count("stream-compressed")) {
+		std::vector<std::string> paths = vm["stream-compressed"].as<std::vector<std::string> >();
+		if(paths.size() < 2 || paths.size() > 3) {
+			std::cerr << "Usage: --stream-compressed <a> <b> [<result>]" << std::endl;
+			return 1;
+		}
+		CLHelper::runCompressedFileAdd(deviceList, paths[0], paths[1], paths.size() == 3 ? paths[2] : "", vm.count("device-decode") > 0);
+		return 0;
+	}
+
+	if(vm.count("benchmark-compression")) {
+		CLHelper::runCompressionBenchmark(deviceList, vm["benchmark-compression"].as<size_t>());
+		return 0;
+	}
+
+// Compare per-add launches with a persistent kernel polling a work queue
+	if(vm.count("benchmark-persistent")) {
+		size_t adds = vm["benchmark-persistent"].as<size_t>();
+		if(adds == 0) {
+			std::cerr << "The adds of the persistent benchmark must be positive" << std::endl;
+			return 1;
+		}
+
+		runPersistentBenchmark(deviceList, deviceInfoList, adds);
+		return 0;
+	}
+
+// Compare global memory kernels with tiled ones staging their inputs in local memory
+	if(vm.count("benchmark-tiled")) {
+		size_t edge = vm["benchmark-tiled"].as<size_t>();
+		if(edge == 0) {
+			std::cerr << "The edge of the tiled benchmark must be positive" << std::endl;
+			return 1;
+		}
+
+		CLHelper::Runtime runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE);
+		CLHelper::runTiledBenchmark(runtime, edge, options.repetitions);
+		return 0;
+	}
+
+// Compare gathers through the texture path with gathers from plain buffers
+	if(vm.count("benchmark-images")) {
+		CLHelper::Runtime runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE);
+		CLHelper::runImageBenchmark(runtime, vm["benchmark-images"].as<size_t>(), options.repetitions);
+		return 0;
+	}
+
+// Compare record layouts for the same kernels
+	if(vm.count("benchmark-layouts")) {
+		CLHelper::Runtime runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE);
+		CLHelper::runLayoutBenchmark(runtime, vm["benchmark-layouts"].as<size_t>(), options.repetitions);
+		return 0;
+	}
+
+// Find where sorting on the device starts to beat sorting on the host
+	if(vm.count("benchmark-sort")) {
+		CLHelper::Runtime runtime(deviceList, deviceInfoList, 1, CL_QUEUE_PROFILING_ENABLE);
+		CLHelper::runSortBenchmark(runtime, vm["benchmark-sort"].as<size_t>(), options.repetitions);
+		return 0;
+	}
+
+// Serve jobs on a warm runtime until asked to shut down
+	if(vm.count("serve")) {
+		// Profiling gives the device monitor its kernel timings
+		CLHelper::Runtime runtime(deviceList, deviceInfoList, queuesPerDevice, CL_QUEUE_PROFILING_ENABLE);
+		CLHelper::JobServer server(runtime, socketPath);
+		server.run();
+		return 0;
+	}
+
 // Call specific OpenCL program with 'deviceList' and optionally 'deviceInfoList' as parameter
-	runSimpleAddProgram(deviceList, deviceInfoList);
+	if(runSimpleAddProgram(deviceList, deviceInfoList, options) != CL_SUCCESS)
+		return 1;
 
 	return 0;
 }
+
+// Runs at exit, possibly called by exit() on a build worker, so it must not wait for
+// the builds still running: only the finished ones are shown
+static void printBuildLogs()
+{
+	std::string logs = CLHelper::BuildService::shared().formatLogs();
+	if(!logs.empty())
+		std::cout << "Build logs:" << std::endl << logs;
+}